@@ -0,0 +1,172 @@
+#include "corpus.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+
+#include <png_core/chunk_data.h>
+#include <png_core/pixel_format.h>
+
+namespace corpus {
+namespace {
+/// IDAT data is split like common encoders do
+constexpr size_t kIDATChunkSize = 32 * 1024;
+
+void AppendUInt32(std::vector<uint8_t>& stream, uint32_t value) {
+  for (int shift = 24; shift >= 0; shift -= 8)
+    stream.push_back((uint8_t)(value >> shift));
+}
+
+void AppendChunk(std::vector<uint8_t>& stream, ChunkType type, const uint8_t* data, size_t size) {
+  AppendUInt32(stream, (uint32_t)size);
+  stream.insert(stream.end(), std::begin(type.byte_array), std::end(type.byte_array));
+  stream.insert(stream.end(), data, data + size);
+  AppendUInt32(stream, PNGComputeChunkCRC(type, data, (uint32_t)size));
+}
+
+uint8_t PaethPredictor(int a, int b, int c) {
+  const int p = a + b - c;
+  const int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+  if (pa <= pb && pa <= pc)
+    return (uint8_t)a;
+  return (uint8_t)(pb <= pc ? b : c);
+}
+
+int PixelSizeBytes(const ImageSpec& spec) {
+  return (PNGGetChannelCount((PNGImageType)spec.color_type) * spec.bit_depth + 7) / 8;
+}
+}  // namespace
+
+std::string ToString(FilterMix filter_mix) {
+  switch (filter_mix) {
+    case FilterMix::kNone: return "none";
+    case FilterMix::kSub: return "sub";
+    case FilterMix::kUp: return "up";
+    case FilterMix::kAverage: return "average";
+    case FilterMix::kPaeth: return "paeth";
+    case FilterMix::kMixed: return "mixed";
+  }
+  return "unknown";
+}
+
+std::string ImageSpec::Name() const {
+  std::string type;
+  switch (color_type) {
+    case 0: type = "g"; break;
+    case 2: type = "rgb"; break;
+    case 3: type = "indexed"; break;
+    case 4: type = "ga"; break;
+    case 6: type = "rgba"; break;
+    default: type = "unknown"; break;
+  }
+  return type + std::to_string(bit_depth) + "_" + std::to_string(width) + "x" + std::to_string(height) + "_" +
+         ToString(filter_mix);
+}
+
+int ScanlineSizeBytes(const ImageSpec& spec) {
+  return (spec.width * PNGGetChannelCount((PNGImageType)spec.color_type) * spec.bit_depth + 7) / 8;
+}
+
+std::vector<uint8_t> FilterScanlines(const std::vector<uint8_t>& plain, int scanline_size_bytes,
+                                     int pixel_size_bytes, FilterMix filter_mix) {
+  const size_t height = plain.size() / scanline_size_bytes;
+  std::vector<uint8_t> filtered;
+  filtered.reserve(plain.size() + height);
+  for (size_t y = 0; y < height; ++y) {
+    const uint8_t* line = plain.data() + y * scanline_size_bytes;
+    const uint8_t* previous = y > 0 ? line - scanline_size_bytes : nullptr;
+    const int filter_type = filter_mix == FilterMix::kMixed ? (int)(y % 5) : (int)filter_mix;
+    filtered.push_back((uint8_t)filter_type);
+    for (int i = 0; i < scanline_size_bytes; ++i) {
+      const int a = i >= pixel_size_bytes ? line[i - pixel_size_bytes] : 0;
+      const int b = previous ? previous[i] : 0;
+      const int c = previous && i >= pixel_size_bytes ? previous[i - pixel_size_bytes] : 0;
+      int predictor = 0;
+      switch (filter_type) {
+        case 1: predictor = a; break;
+        case 2: predictor = b; break;
+        case 3: predictor = (a + b) / 2; break;
+        case 4: predictor = PaethPredictor(a, b, c); break;
+        default: break;
+      }
+      filtered.push_back((uint8_t)(line[i] - predictor));
+    }
+  }
+  return filtered;
+}
+
+GeneratedImage Generate(const ImageSpec& spec) {
+  GeneratedImage image;
+  image.spec = spec;
+
+  /* Gradients with low-amplitude noise. Sub-byte images get noise only, their samples are too coarse */
+  std::mt19937 generator(spec.seed);
+  const int scanline_size = ScanlineSizeBytes(spec);
+  image.plain.resize((size_t)scanline_size * spec.height);
+  for (int y = 0; y < spec.height; ++y)
+    for (int i = 0; i < scanline_size; ++i) {
+      const uint8_t gradient = (uint8_t)((i * 3 + y * 2) & 0xFF);
+      const uint8_t noise = (uint8_t)(generator() & 0x0F);
+      image.plain[(size_t)y * scanline_size + i] = spec.bit_depth < 8 ? (uint8_t)generator() : gradient ^ noise;
+    }
+
+  image.filtered = FilterScanlines(image.plain, scanline_size, PixelSizeBytes(spec), spec.filter_mix);
+
+  uLongf compressed_size = compressBound((uLong)image.filtered.size());
+  image.compressed.resize(compressed_size);
+  if (compress2(image.compressed.data(), &compressed_size, image.filtered.data(), (uLong)image.filtered.size(),
+                Z_DEFAULT_COMPRESSION) != Z_OK)
+    throw std::runtime_error("zlib compression failed");
+  image.compressed.resize(compressed_size);
+
+  static const uint8_t signature[] = {137, 80, 78, 71, 13, 10, 26, 10};
+  image.png.assign(std::begin(signature), std::end(signature));
+  std::vector<uint8_t> header;
+  AppendUInt32(header, (uint32_t)spec.width);
+  AppendUInt32(header, (uint32_t)spec.height);
+  header.insert(header.end(), {(uint8_t)spec.bit_depth, (uint8_t)spec.color_type, 0, 0, 0});
+  AppendChunk(image.png, CHUNK_IHDR, header.data(), header.size());
+  if (spec.color_type == PNG_IMAGE_TYPE_INDEXED) {
+    std::vector<uint8_t> palette(3 << spec.bit_depth);
+    for (auto& byte : palette)
+      byte = (uint8_t)generator();
+    AppendChunk(image.png, CHUNK_PLTE, palette.data(), palette.size());
+  }
+  for (size_t offset = 0; offset < image.compressed.size(); offset += kIDATChunkSize)
+    AppendChunk(image.png, CHUNK_IDAT, image.compressed.data() + offset,
+                std::min(kIDATChunkSize, image.compressed.size() - offset));
+  AppendChunk(image.png, CHUNK_IEND, nullptr, 0);
+  return image;
+}
+
+std::vector<ImageSpec> StandardCorpus(const std::vector<std::pair<int, int>>& sizes) {
+  std::vector<ImageSpec> specs;
+  for (int color_type : {0, 2, 3, 4, 6}) {
+    uint8_t depths[5];
+    const int depths_count = PNGGetAllowedBitDepths((PNGImageType)color_type, depths);
+    for (int d = 0; d < depths_count; ++d)
+      for (const auto& [width, height] : sizes) {
+        ImageSpec spec;
+        spec.width = width;
+        spec.height = height;
+        spec.bit_depth = depths[d];
+        spec.color_type = color_type;
+        specs.push_back(spec);
+      }
+  }
+  return specs;
+}
+
+void WriteCorpus(const std::vector<ImageSpec>& specs, const std::filesystem::path& dir) {
+  std::filesystem::create_directories(dir);
+  for (const auto& spec : specs) {
+    const auto image = Generate(spec);
+    std::ofstream file(dir / (spec.Name() + ".png"), std::ios_base::binary);
+    file.write((const char*)image.png.data(), (std::streamsize)image.png.size());
+  }
+}
+}  // namespace corpus
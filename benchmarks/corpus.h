@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace corpus {
+/// Filter types used for scanlines of generated image
+enum class FilterMix {
+  kNone = 0,
+  kSub = 1,
+  kUp = 2,
+  kAverage = 3,
+  kPaeth = 4,
+  /// Filter type cycles through all five from scanline to scanline
+  kMixed = 5,
+};
+
+std::string ToString(FilterMix filter_mix);
+
+struct ImageSpec {
+  int width = 256;
+  int height = 256;
+  int bit_depth = 8;
+  int color_type = 6;
+  FilterMix filter_mix = FilterMix::kMixed;
+  /// Same spec and seed always give the same bytes
+  uint32_t seed = 1;
+
+  /// Short name like `rgba8_256x256_mixed`
+  std::string Name() const;
+};
+
+struct GeneratedImage {
+  ImageSpec spec;
+  /// Scanlines without filter type bytes
+  std::vector<uint8_t> plain;
+  /// Scanlines with filter type bytes
+  std::vector<uint8_t> filtered;
+  /// zlib stream of filtered scanlines
+  std::vector<uint8_t> compressed;
+  /// Complete PNG datastream with signature
+  std::vector<uint8_t> png;
+};
+
+/// Size of scanline without filter type byte
+int ScanlineSizeBytes(const ImageSpec& spec);
+
+/// Generate image of smooth gradients with noise, so compression ratio is close to photos
+GeneratedImage Generate(const ImageSpec& spec);
+
+/// Filter plain scanlines with filter method 0
+std::vector<uint8_t> FilterScanlines(const std::vector<uint8_t>& plain, int scanline_size_bytes,
+                                     int pixel_size_bytes, FilterMix filter_mix);
+
+/// Every valid color type and bit depth at every listed size, with mixed filters
+std::vector<ImageSpec> StandardCorpus(const std::vector<std::pair<int, int>>& sizes);
+
+/// Write PNG files of specs into dir, named after specs
+void WriteCorpus(const std::vector<ImageSpec>& specs, const std::filesystem::path& dir);
+}  // namespace corpus
@@ -0,0 +1,305 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <png_core/chunk_data.h>
+#include <png_core/compression.h>
+#include <png_core/decoder.h>
+#include <png_core/encoder.h>
+#include <png_core/filtering.h>
+
+#include "corpus.h"
+
+namespace {
+/// Generated images are shared between benchmarks of the same spec
+const corpus::GeneratedImage& GetImage(const corpus::ImageSpec& spec) {
+  static std::map<std::string, corpus::GeneratedImage> cache;
+  const std::string key = spec.Name() + "_" + std::to_string(spec.seed);
+  auto it = cache.find(key);
+  if (it == cache.end())
+    it = cache.emplace(key, corpus::Generate(spec)).first;
+  return it->second;
+}
+
+const std::vector<std::pair<int, int>> kSizes = {{64, 64}, {512, 512}, {2048, 1024}};
+
+void BM_LoadRawChunkList(benchmark::State& state, corpus::ImageSpec spec) {
+  const auto& image = GetImage(spec);
+  for (auto _ : state) {
+    PNGRawChunk* chunks = PNGLoadRawChunkList(image.png.data(), (int)image.png.size(), true);
+    if (!chunks) {
+      state.SkipWithError("PNGLoadRawChunkList failed");
+      break;
+    }
+    benchmark::DoNotOptimize(chunks);
+    PNGFreeRawChunk(chunks);
+  }
+  state.SetBytesProcessed((int64_t)state.iterations() * (int64_t)image.png.size());
+}
+
+void BM_DataDecompress0(benchmark::State& state, corpus::ImageSpec spec, PNGInflateEngine engine) {
+  const auto& image = GetImage(spec);
+  const PNGDataDecompressionFunction decompress =
+      PNGGetDataDecompressionFunctionWithEngine(PNG_COMPRESSION_METHOD_0, engine);
+  for (auto _ : state) {
+    uint8_t* decompressed =
+        decompress(image.compressed.data(), (int)image.compressed.size(), (int)image.filtered.size());
+    if (!decompressed) {
+      state.SkipWithError("Decompression failed");
+      break;
+    }
+    benchmark::DoNotOptimize(decompressed);
+    PNGFreeCompressionData(decompressed);
+  }
+  state.SetBytesProcessed((int64_t)state.iterations() * (int64_t)image.filtered.size());
+}
+
+/// Filtered data of 8-bit greyscale image whose scanlines hold pixels of `pixel_size_bytes`
+void BM_DefilterScanlines0(benchmark::State& state, corpus::FilterMix filter_mix, int pixel_size_bytes) {
+  const int width_px = 1024;
+  const int height = 256;
+  corpus::ImageSpec spec;
+  spec.width = width_px * pixel_size_bytes;
+  spec.height = height;
+  spec.color_type = 0;
+  spec.bit_depth = 8;
+  const auto plain = corpus::Generate(spec).plain;
+  const auto filtered = corpus::FilterScanlines(plain, spec.width, pixel_size_bytes, filter_mix);
+
+  std::vector<uint8_t> defiltered(plain.size());
+  for (auto _ : state) {
+    if (!PNGDefilterScanlines0(filtered.data(), (int)filtered.size(), width_px, pixel_size_bytes,
+                               defiltered.data())) {
+      state.SkipWithError("PNGDefilterScanlines0 failed");
+      break;
+    }
+    benchmark::DoNotOptimize(defiltered.data());
+    benchmark::ClobberMemory();
+  }
+  if (defiltered != plain)
+    state.SkipWithError("Defiltered data does not match generated image");
+  state.SetBytesProcessed((int64_t)state.iterations() * (int64_t)plain.size());
+}
+
+/// Memory of one decode, measured by a separate call so timed iterations are not instrumented
+void SetMemoryCounters(benchmark::State& state, const PNGDecodeStats& stats) {
+  state.counters["allocations"] = stats.allocations_count;
+  state.counters["peak_bytes"] = (double)stats.peak_bytes;
+  state.counters["peak_scratch_bytes"] = (double)stats.peak_scratch_bytes;
+}
+
+void BM_GetRawImage(benchmark::State& state, corpus::ImageSpec spec) {
+  const auto& image = GetImage(spec);
+  PNGRawChunk* chunks = PNGLoadRawChunkList(image.png.data(), (int)image.png.size(), true);
+  if (!chunks) {
+    state.SkipWithError("PNGLoadRawChunkList failed");
+    return;
+  }
+  for (auto _ : state) {
+    PNGRawImage raw;
+    if (!PNGGetRawImage(chunks, &raw)) {
+      state.SkipWithError("PNGGetRawImage failed");
+      break;
+    }
+    benchmark::DoNotOptimize(raw.data);
+    free(raw.data);
+  }
+
+  PNGDecodeStats stats;
+  PNGInitDecodeStats(&stats);
+  PNGRawImage raw;
+  if (PNGGetRawImageWithStats(chunks, &raw, &stats))
+    free(raw.data);
+  PNGFreeRawChunk(chunks);
+  state.SetBytesProcessed((int64_t)state.iterations() * (int64_t)image.plain.size());
+  state.counters["pixels_per_second"] = benchmark::Counter(
+      (double)state.iterations() * spec.width * spec.height, benchmark::Counter::kIsRate);
+  SetMemoryCounters(state, stats);
+}
+
+void BM_DecodeImage(benchmark::State& state, corpus::ImageSpec spec, PNGPixelFormat format, PNGInflateEngine engine) {
+  const auto& image = GetImage(spec);
+  PNGRawChunk* chunks = PNGLoadRawChunkList(image.png.data(), (int)image.png.size(), true);
+  if (!chunks) {
+    state.SkipWithError("PNGLoadRawChunkList failed");
+    return;
+  }
+  PNGDecodeOptions options;
+  PNGInitDecodeOptions(&options);
+  options.format = format;
+  options.inflate_engine = engine;
+  for (auto _ : state) {
+    PNGImage decoded;
+    if (!PNGDecodeImage(chunks, &options, &decoded)) {
+      state.SkipWithError("PNGDecodeImage failed");
+      break;
+    }
+    benchmark::DoNotOptimize(decoded.data);
+    PNGFreeImage(&decoded);
+  }
+
+  PNGDecodeStats stats;
+  PNGInitDecodeStats(&stats);
+  options.stats = &stats;
+  PNGImage decoded;
+  if (PNGDecodeImage(chunks, &options, &decoded))
+    PNGFreeImage(&decoded);
+  PNGFreeRawChunk(chunks);
+  state.counters["pixels_per_second"] = benchmark::Counter(
+      (double)state.iterations() * spec.width * spec.height, benchmark::Counter::kIsRate);
+  SetMemoryCounters(state, stats);
+}
+
+void BM_EncodeRawImage(benchmark::State& state, corpus::ImageSpec spec, PNGFilterSelection selection) {
+  const auto& image = GetImage(spec);
+  PNGRawImage raw;
+  PNGInitRawImage(&raw);
+  raw.type = (PNGImageType)spec.color_type;
+  raw.data = (void*)image.plain.data();
+  raw.data_size = (int)image.plain.size();
+  raw.scanline_pixel_count = spec.width;
+  raw.channel_bit_depth = spec.bit_depth;
+  PNGEncodeOptions options;
+  PNGInitEncodeOptions(&options);
+  options.filter_selection = selection;
+  int encoded_size = 0;
+  for (auto _ : state) {
+    uint8_t* encoded = PNGEncodeRawImage(&raw, &options, &encoded_size);
+    if (!encoded) {
+      state.SkipWithError("PNGEncodeRawImage failed");
+      break;
+    }
+    benchmark::DoNotOptimize(encoded);
+    PNGFreeEncodedData(encoded);
+  }
+  state.SetBytesProcessed((int64_t)state.iterations() * (int64_t)image.plain.size());
+  state.counters["compression_ratio"] = (double)image.plain.size() / encoded_size;
+}
+
+void BM_OptimizeRawImage(benchmark::State& state, corpus::ImageSpec spec, int effort) {
+  const auto& image = GetImage(spec);
+  PNGRawImage raw;
+  PNGInitRawImage(&raw);
+  raw.type = (PNGImageType)spec.color_type;
+  raw.data = (void*)image.plain.data();
+  raw.data_size = (int)image.plain.size();
+  raw.scanline_pixel_count = spec.width;
+  raw.channel_bit_depth = spec.bit_depth;
+  PNGOptimizeOptions options;
+  PNGInitOptimizeOptions(&options);
+  options.effort = effort;
+  int optimized_size = 0;
+  PNGOptimizeResult result;
+  for (auto _ : state) {
+    uint8_t* optimized = PNGOptimizeRawImage(&raw, &options, &optimized_size, &result);
+    if (!optimized) {
+      state.SkipWithError("PNGOptimizeRawImage failed");
+      break;
+    }
+    benchmark::DoNotOptimize(optimized);
+    PNGFreeEncodedData(optimized);
+  }
+  state.SetBytesProcessed((int64_t)state.iterations() * (int64_t)image.plain.size());
+  state.counters["compression_ratio"] = (double)image.plain.size() / optimized_size;
+  state.counters["stopped_trials"] = result.stopped_trials_count;
+}
+
+void BM_ReduceRawImage(benchmark::State& state, corpus::ImageSpec spec) {
+  const auto& image = GetImage(spec);
+  PNGRawImage raw;
+  PNGInitRawImage(&raw);
+  raw.type = (PNGImageType)spec.color_type;
+  raw.data = (void*)image.plain.data();
+  raw.data_size = (int)image.plain.size();
+  raw.scanline_pixel_count = spec.width;
+  raw.channel_bit_depth = spec.bit_depth;
+  int reduced_size = 0;
+  for (auto _ : state) {
+    PNGReducedImage reduced;
+    if (!PNGReduceRawImage(&raw, &reduced)) {
+      state.SkipWithError("PNGReduceRawImage failed");
+      break;
+    }
+    reduced_size = reduced.image.data_size;
+    benchmark::DoNotOptimize(reduced.image.data);
+    PNGFreeReducedImage(&reduced);
+  }
+  state.SetBytesProcessed((int64_t)state.iterations() * (int64_t)image.plain.size());
+  state.counters["reduction_ratio"] = (double)image.plain.size() / reduced_size;
+}
+
+void RegisterBenchmarks() {
+  for (const auto& [width, height] : kSizes) {
+    corpus::ImageSpec spec;
+    spec.width = width;
+    spec.height = height;
+    benchmark::RegisterBenchmark(("LoadRawChunkList/" + spec.Name()).c_str(), BM_LoadRawChunkList, spec);
+    benchmark::RegisterBenchmark(("DataDecompress0/" + spec.Name() + "/zlib").c_str(), BM_DataDecompress0, spec,
+                                 PNG_INFLATE_ENGINE_ZLIB);
+    benchmark::RegisterBenchmark(("DataDecompress0/" + spec.Name() + "/builtin").c_str(), BM_DataDecompress0, spec,
+                                 PNG_INFLATE_ENGINE_BUILTIN);
+    benchmark::RegisterBenchmark(("EncodeRawImage/" + spec.Name() + "/none").c_str(), BM_EncodeRawImage, spec,
+                                 PNG_FILTER_SELECTION_NONE);
+    benchmark::RegisterBenchmark(("EncodeRawImage/" + spec.Name() + "/adaptive").c_str(), BM_EncodeRawImage, spec,
+                                 PNG_FILTER_SELECTION_ADAPTIVE);
+    benchmark::RegisterBenchmark(("OptimizeRawImage/" + spec.Name() + "/effort1").c_str(), BM_OptimizeRawImage,
+                                 spec, 1);
+  }
+
+  for (int filter_type = 0; filter_type <= 5; ++filter_type)
+    for (int pixel_size_bytes : {1, 2, 3, 4, 6, 8}) {
+      const auto filter_mix = (corpus::FilterMix)filter_type;
+      const std::string name =
+          "DefilterScanlines0/" + corpus::ToString(filter_mix) + "/bpp" + std::to_string(pixel_size_bytes);
+      benchmark::RegisterBenchmark(name.c_str(), BM_DefilterScanlines0, filter_mix, pixel_size_bytes);
+    }
+
+  for (const auto& spec : corpus::StandardCorpus({{512, 512}})) {
+    benchmark::RegisterBenchmark(("GetRawImage/" + spec.Name()).c_str(), BM_GetRawImage, spec);
+    benchmark::RegisterBenchmark(("ReduceRawImage/" + spec.Name()).c_str(), BM_ReduceRawImage, spec);
+    benchmark::RegisterBenchmark(("DecodeImage/" + spec.Name() + "/rgba8").c_str(), BM_DecodeImage, spec,
+                                 PNG_PIXEL_FORMAT_RGBA8, PNG_INFLATE_ENGINE_BUILTIN);
+    benchmark::RegisterBenchmark(("DecodeImage/" + spec.Name() + "/rgba8/zlib").c_str(), BM_DecodeImage, spec,
+                                 PNG_PIXEL_FORMAT_RGBA8, PNG_INFLATE_ENGINE_ZLIB);
+  }
+}
+}  // namespace
+
+/*
+ * Usage: png_core_bench [--corpus_dir=DIR] [Google Benchmark flags]
+ *   --corpus_dir=DIR  Write generated images into DIR and exit
+ * Results are also written to png_core_bench.json unless --benchmark_out is given
+ */
+int main(int argc, char** argv) {
+  std::vector<char*> args(argv, argv + argc);
+  bool has_out = false;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    if (arg.starts_with("--corpus_dir=")) {
+      corpus::WriteCorpus(corpus::StandardCorpus(kSizes), std::string(arg.substr(std::strlen("--corpus_dir="))));
+      return 0;
+    }
+    has_out = has_out || arg.starts_with("--benchmark_out=");
+  }
+
+  std::string out_arg = "--benchmark_out=png_core_bench.json";
+  std::string format_arg = "--benchmark_out_format=json";
+  if (!has_out) {
+    args.push_back(out_arg.data());
+    args.push_back(format_arg.data());
+  }
+  int args_count = (int)args.size();
+
+  benchmark::Initialize(&args_count, args.data());
+  if (benchmark::ReportUnrecognizedArguments(args_count, args.data()))
+    return 1;
+  RegisterBenchmarks();
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
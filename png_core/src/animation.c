@@ -0,0 +1,548 @@
+#include "png_core/animation.h"
+#include "png_core/decoder.h"
+#include "png_core/filtering.h"
+
+#include <limits.h>
+#include <memory.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "conversion.h"
+#include "decoding.h"
+#include "inflate.h"
+#include "thread_pool.h"
+#include "tools.h"
+
+/*
+ * Frame of datastream. Its data chunks, IDAT or fdAT, are consecutive
+ */
+struct FrameSource {
+  struct PNGChunkData_fcTL control;
+  const struct PNGRawChunk* first_data_chunk;
+  int data_chunks_count;
+  /* Total compressed data size */
+  int data_size;
+  /* Filtered scanlines size */
+  int filtered_size;
+};
+
+/*
+ * Buffers of a frame decoded ahead of composition. Used by one worker at a time
+ */
+struct FrameSlot {
+  /* Concatenated data of frames stored in several chunks */
+  uint8_t* compressed;
+  /* Filtered scanlines, defiltered in place */
+  uint8_t* scanlines;
+  /* Frame pixels in canvas format without padding between rows */
+  uint8_t* pixels;
+  bool ok;
+};
+
+struct PNGAnimationDecoder {
+  const struct PNGChunkData_IHDR* header;
+  const struct PNGChunkData_tRNS* transparency;
+  /* Palette entries for conversion */
+  struct PNGImage palette;
+  enum PNGImageType conversion_type;
+  enum PNGPixelFormat format;
+  int pixel_size;
+  enum PNGInflateEngine inflate_engine;
+  uint32_t max_inflate_ratio;
+
+  struct FrameSource* frames;
+  int frames_count;
+  uint32_t plays_count;
+  bool default_image_is_frame;
+
+  uint8_t* canvas;
+  size_t canvas_size;
+  int row_stride;
+  /* Canvas under the last frame with PNG_DISPOSE_OP_PREVIOUS before it was rendered */
+  uint8_t* saved_region;
+
+  struct FrameSlot* slots;
+  int slots_count;
+  /* Frames from batch_start decoded into slots in order */
+  int batch_start;
+  int batch_count;
+  /* Frame composed by the next call. Disposal of the frame before it is pending */
+  int next_frame;
+  bool failed;
+};
+
+void PNGInitAnimationOptions(struct PNGAnimationOptions* obj) {
+  obj->format = PNG_PIXEL_FORMAT_RGBA8;
+  obj->threads_count = 0;
+  obj->inflate_engine = PNG_INFLATE_ENGINE_BUILTIN;
+  PNGInitDecodeLimits(&obj->limits);
+}
+
+static void InitFullCanvasControl(const struct PNGChunkData_IHDR* header, struct PNGChunkData_fcTL* control) {
+  PNGInitData_fcTL(control);
+  control->width = (uint32_t)header->width;
+  control->height = (uint32_t)header->height;
+}
+
+static bool IsValidFrameControl(const struct PNGChunkData_IHDR* header, const struct PNGChunkData_fcTL* control) {
+  if (control->width == 0 || control->height == 0)
+    return false;
+  if ((uint64_t)control->x_offset + control->width > (uint64_t)header->width ||
+      (uint64_t)control->y_offset + control->height > (uint64_t)header->height)
+    return false;
+  return control->dispose_op <= PNG_DISPOSE_OP_PREVIOUS && control->blend_op <= PNG_BLEND_OP_OVER;
+}
+
+/*
+ * @brief Collect frames in datastream order, checking sequence numbers and frame regions.
+ * A frame is started by fcTL and owns IDAT or fdAT chunks following it
+ * @param[out] frames Array of `frames_count` frames, allocated by caller
+ * @return Amount of frames found or -1 if datastream is not a valid APNG
+ */
+static int CollectFrames(const struct PNGRawChunk* chunk_list, const struct PNGChunkData_IHDR* header,
+                         struct FrameSource* frames, int frames_count, bool* default_image_is_frame) {
+  uint32_t sequence_number = 0;
+  int count = 0;
+  bool idat_seen = false;
+  struct ChunkType previous_type = CHUNK_INVALID;
+  *default_image_is_frame = false;
+  for (const struct PNGRawChunk* chunk = chunk_list; chunk; chunk = chunk->next) {
+    struct FrameSource* frame = count > 0 ? &frames[count - 1] : NULL;
+    if (chunk->type.bytes == CHUNK_fcTL.bytes) {
+      const struct PNGChunkData_fcTL* control = chunk->parsed_data;
+      if (!control || control->sequence_number != sequence_number++ || count == frames_count)
+        return -1;
+      if (frame && !frame->first_data_chunk)
+        return -1;
+      if (!IsValidFrameControl(header, control))
+        return -1;
+      frame = &frames[count++];
+      memset(frame, 0, sizeof(struct FrameSource));
+      frame->control = *control;
+      if (!idat_seen) {
+        /* Default image is the first frame and covers whole canvas */
+        if (count != 1 || control->width != (uint32_t)header->width || control->height != (uint32_t)header->height ||
+            control->x_offset != 0 || control->y_offset != 0)
+          return -1;
+        *default_image_is_frame = true;
+      }
+    } else if (chunk->type.bytes == CHUNK_IDAT.bytes || chunk->type.bytes == CHUNK_fdAT.bytes) {
+      const bool idat = chunk->type.bytes == CHUNK_IDAT.bytes;
+      if (!chunk->parsed_data)
+        return -1;
+      int data_size = 0;
+      if (idat) {
+        idat_seen = true;
+        /* IDAT not preceded by fcTL is not part of animation */
+        if (!*default_image_is_frame)
+          continue;
+        data_size = ((const struct PNGChunkData_IDAT*)chunk->parsed_data)->data_size;
+      } else {
+        const struct PNGChunkData_fdAT* data = chunk->parsed_data;
+        if (data->sequence_number != sequence_number++ || !frame || (count == 1 && *default_image_is_frame))
+          return -1;
+        data_size = data->data_size;
+      }
+      if (!frame->first_data_chunk)
+        frame->first_data_chunk = chunk;
+      else if (previous_type.bytes != chunk->type.bytes)
+        return -1;
+      if (data_size > INT_MAX - frame->data_size)
+        return -1;
+      frame->data_size += data_size;
+      ++frame->data_chunks_count;
+    }
+    previous_type = chunk->type;
+  }
+  if (count > 0 && !frames[count - 1].first_data_chunk)
+    return -1;
+  return count;
+}
+
+/*
+ * @brief Check frame against limits, as CheckImageLimits does for still images
+ */
+static bool PrepareFrameLimits(const struct PNGChunkData_IHDR* header, const struct PNGDecodeLimits* limits,
+                               struct FrameSource* frame) {
+  struct PNGChunkData_IHDR frame_header = *header;
+  frame_header.width = (int32_t)frame->control.width;
+  frame_header.height = (int32_t)frame->control.height;
+  const int64_t filtered_size = PNGGetFilteredImageSizeBytes(&frame_header);
+  if (filtered_size < 0 || filtered_size > INT_MAX)
+    return false;
+  if (limits->max_output_bytes && (uint64_t)filtered_size > limits->max_output_bytes)
+    return false;
+  if (limits->max_inflate_ratio && (uint64_t)filtered_size > (uint64_t)frame->data_size * limits->max_inflate_ratio)
+    return false;
+  frame->filtered_size = (int)filtered_size;
+  return true;
+}
+
+static bool AllocateSlots(struct PNGAnimationDecoder* obj, int workers_count) {
+  int max_data_size = 0;
+  int max_filtered_size = 0;
+  size_t max_pixels_size = 0;
+  for (int i = 0; i < obj->frames_count; ++i) {
+    const struct FrameSource* frame = &obj->frames[i];
+    if (frame->data_chunks_count > 1 && frame->data_size > max_data_size)
+      max_data_size = frame->data_size;
+    if (frame->filtered_size > max_filtered_size)
+      max_filtered_size = frame->filtered_size;
+    const size_t pixels_size = (size_t)frame->control.width * frame->control.height * obj->pixel_size;
+    if (pixels_size > max_pixels_size)
+      max_pixels_size = pixels_size;
+  }
+
+  obj->slots_count = workers_count < obj->frames_count ? workers_count : obj->frames_count;
+  obj->slots = calloc(obj->slots_count, sizeof(struct FrameSlot));
+  if (!obj->slots)
+    return false;
+  for (int i = 0; i < obj->slots_count; ++i) {
+    struct FrameSlot* slot = &obj->slots[i];
+    slot->compressed = max_data_size ? malloc(max_data_size) : NULL;
+    slot->scanlines = malloc(max_filtered_size);
+    slot->pixels = malloc(max_pixels_size);
+    if ((max_data_size && !slot->compressed) || !slot->scanlines || !slot->pixels)
+      return false;
+  }
+  return true;
+}
+
+struct PNGAnimationDecoder* PNGCreateAnimationDecoder(const struct PNGRawChunk* chunk_list,
+                                                      const struct PNGAnimationOptions* options) {
+  struct PNGAnimationOptions default_options;
+  if (!options) {
+    PNGInitAnimationOptions(&default_options);
+    options = &default_options;
+  }
+  if (options->format != PNG_PIXEL_FORMAT_RGBA8 && options->format != PNG_PIXEL_FORMAT_RGBA16)
+    return NULL;
+
+  const struct PNGChunkData_IHDR* header = GetDecodableHeader(chunk_list);
+  if (!header)
+    return NULL;
+  const int pixel_size = PNGGetPixelFormatSizeBytes(options->format);
+  const int64_t row_stride = MultiplySizes(header->width, pixel_size);
+  const int64_t canvas_size = MultiplySizes(row_stride, header->height);
+  if (row_stride > INT_MAX || canvas_size < 0 || (uint64_t)canvas_size > SIZE_MAX)
+    return NULL;
+  if (options->limits.max_pixels && (uint64_t)header->width * (uint64_t)header->height > options->limits.max_pixels)
+    return NULL;
+  if (options->limits.max_output_bytes && (uint64_t)canvas_size > options->limits.max_output_bytes)
+    return NULL;
+
+  const struct PNGRawChunk* animation_chunk = FindChunk(chunk_list, CHUNK_acTL);
+  const struct PNGChunkData_acTL* animation = animation_chunk ? animation_chunk->parsed_data : NULL;
+  if (animation_chunk && (!animation || animation->frames_count == 0))
+    return NULL;
+  /* Every frame has its own chunks, so valid frames count is bounded by chunks count */
+  int chunks_count = 0;
+  for (const struct PNGRawChunk* chunk = chunk_list; chunk; chunk = chunk->next)
+    ++chunks_count;
+  const int frames_count = animation ? (int)(animation->frames_count < (uint32_t)chunks_count
+                                                 ? animation->frames_count
+                                                 : (uint32_t)chunks_count)
+                                     : 1;
+
+  struct PNGAnimationDecoder* obj = calloc(1, sizeof(struct PNGAnimationDecoder));
+  if (!obj)
+    return NULL;
+  obj->header = header;
+  const struct PNGRawChunk* transparency_chunk = FindChunk(chunk_list, CHUNK_tRNS);
+  obj->transparency = transparency_chunk ? transparency_chunk->parsed_data : NULL;
+  obj->conversion_type = GetConversionImageType(header, obj->transparency);
+  obj->format = options->format;
+  obj->pixel_size = pixel_size;
+  obj->inflate_engine = options->inflate_engine;
+  obj->max_inflate_ratio = options->limits.max_inflate_ratio;
+  obj->plays_count = animation ? animation->plays_count : 0;
+  obj->row_stride = (int)row_stride;
+  obj->canvas_size = (size_t)canvas_size;
+  PNGInitImage(&obj->palette);
+
+  obj->frames = malloc(sizeof(struct FrameSource) * frames_count);
+  bool ok = obj->frames && FillPalette(chunk_list, header, obj->transparency, &obj->palette);
+  if (ok && animation) {
+    obj->frames_count = CollectFrames(chunk_list, header, obj->frames, frames_count, &obj->default_image_is_frame);
+    ok = obj->frames_count == (int64_t)animation->frames_count;
+  } else if (ok) {
+    struct FrameSource* frame = &obj->frames[0];
+    memset(frame, 0, sizeof(struct FrameSource));
+    InitFullCanvasControl(header, &frame->control);
+    obj->frames_count = 1;
+    obj->default_image_is_frame = true;
+    struct ChunkType previous_type = CHUNK_INVALID;
+    for (const struct PNGRawChunk* chunk = chunk_list; chunk; previous_type = chunk->type, chunk = chunk->next) {
+      if (chunk->type.bytes != CHUNK_IDAT.bytes)
+        continue;
+      /* Frame data is read as consecutive chunks, as CollectFrames requires */
+      if (!chunk->parsed_data || (frame->first_data_chunk && previous_type.bytes != CHUNK_IDAT.bytes)) {
+        ok = false;
+        break;
+      }
+      const int data_size = ((const struct PNGChunkData_IDAT*)chunk->parsed_data)->data_size;
+      if (data_size > INT_MAX - frame->data_size)
+        ok = false;
+      if (!frame->first_data_chunk)
+        frame->first_data_chunk = chunk;
+      frame->data_size += data_size;
+      ++frame->data_chunks_count;
+    }
+    ok = ok && frame->first_data_chunk;
+  }
+  for (int i = 0; ok && i < obj->frames_count; ++i)
+    ok = PrepareFrameLimits(header, &options->limits, &obj->frames[i]);
+
+  if (ok) {
+    obj->canvas = calloc(1, obj->canvas_size);
+    obj->saved_region = malloc(obj->canvas_size);
+    const int workers_count = options->threads_count > 0 ? options->threads_count : GetOnlineCPUCount();
+    ok = obj->canvas && obj->saved_region && AllocateSlots(obj, workers_count);
+  }
+  if (!ok) {
+    PNGFreeAnimationDecoder(obj);
+    return NULL;
+  }
+  return obj;
+}
+
+void PNGGetAnimationInfo(const struct PNGAnimationDecoder* obj, struct PNGAnimationInfo* out) {
+  out->width = obj->header->width;
+  out->height = obj->header->height;
+  out->frames_count = obj->frames_count;
+  out->plays_count = obj->plays_count;
+  out->default_image_is_frame = obj->default_image_is_frame;
+}
+
+/*
+ * @brief Inflate, defilter and convert frame data into slot pixels
+ * @return false if data is corrupted, exceeds inflate ratio or allocation failed
+ */
+static bool DecodeFrameData(const struct PNGAnimationDecoder* obj, const struct FrameSource* frame,
+                            struct FrameSlot* slot) {
+  const uint8_t* compressed = NULL;
+  const struct PNGRawChunk* chunk = frame->first_data_chunk;
+  const bool idat = chunk->type.bytes == CHUNK_IDAT.bytes;
+  if (frame->data_chunks_count == 1) {
+    compressed = idat ? ((const struct PNGChunkData_IDAT*)chunk->parsed_data)->data
+                      : ((const struct PNGChunkData_fdAT*)chunk->parsed_data)->data;
+  } else {
+    uint8_t* ptr = slot->compressed;
+    for (int i = 0; i < frame->data_chunks_count; ++i, chunk = chunk->next) {
+      if (idat) {
+        const struct PNGChunkData_IDAT* data = chunk->parsed_data;
+        memcpy(ptr, data->data, data->data_size);
+        ptr += data->data_size;
+      } else {
+        const struct PNGChunkData_fdAT* data = chunk->parsed_data;
+        memcpy(ptr, data->data, data->data_size);
+        ptr += data->data_size;
+      }
+    }
+    compressed = slot->compressed;
+  }
+  if (!InflateZlibStream(compressed, frame->data_size, slot->scanlines, frame->filtered_size, obj->max_inflate_ratio,
+                         obj->inflate_engine))
+    return false;
+
+  struct PNGChunkData_IHDR frame_header = *obj->header;
+  frame_header.width = (int32_t)frame->control.width;
+  frame_header.height = (int32_t)frame->control.height;
+  struct RowConverter converter;
+  if (!InitRowConverter(&converter, obj->conversion_type, frame_header.bit_depth, frame_header.width, obj->format,
+                        &obj->palette.palette[0][0], obj->palette.palette_size)) {
+    FreeRowConverter(&converter);
+    return false;
+  }
+  if (obj->transparency)
+    SetColorKey(&frame_header, obj->transparency, &converter);
+
+  /* Scanlines are defiltered in place, so the previous defiltered scanline is right before the current one */
+  const int scanline_size_bytes = (int)PNGGetScanlineSizeBytes(&frame_header);
+  const int pixel_size_bytes = GetFilterPixelSizeBytes(&frame_header);
+  const size_t row_size = (size_t)frame_header.width * obj->pixel_size;
+  const uint8_t* previous = NULL;
+  bool ok = true;
+  for (int y = 0; ok && y < frame_header.height; ++y) {
+    uint8_t* scanline = slot->scanlines + (size_t)y * (scanline_size_bytes + 1);
+    ok = PNGDefilterScanline0(scanline[0], scanline + 1, previous, scanline + 1, scanline_size_bytes,
+                              pixel_size_bytes);
+    if (ok)
+      ConvertRow(&converter, scanline + 1, slot->pixels + (size_t)y * row_size);
+    previous = scanline + 1;
+  }
+  FreeRowConverter(&converter);
+  return ok;
+}
+
+struct FrameBatch {
+  struct PNGAnimationDecoder* decoder;
+  atomic_int next_slot;
+};
+
+static void DecodeBatchFrames(void* context, int worker_index) {
+  (void)worker_index;
+  struct FrameBatch* batch = context;
+  struct PNGAnimationDecoder* obj = batch->decoder;
+  for (int i = atomic_fetch_add(&batch->next_slot, 1); i < obj->batch_count;
+       i = atomic_fetch_add(&batch->next_slot, 1))
+    obj->slots[i].ok = DecodeFrameData(obj, &obj->frames[obj->batch_start + i], &obj->slots[i]);
+}
+
+/*
+ * @brief Decode frames starting from `first_frame` into slots, one slot per worker
+ */
+static void DecodeBatch(struct PNGAnimationDecoder* obj, int first_frame) {
+  const int frames_left = obj->frames_count - first_frame;
+  obj->batch_start = first_frame;
+  obj->batch_count = obj->slots_count < frames_left ? obj->slots_count : frames_left;
+  struct FrameBatch batch;
+  batch.decoder = obj;
+  atomic_init(&batch.next_slot, 0);
+  RunParallel(DecodeBatchFrames, &batch, obj->batch_count);
+}
+
+/*
+ * Non-premultiplied `src` over `dst` for RGBA8 pixels
+ */
+static void BlendOverRow8(const uint8_t* src, uint8_t* dst, int count) {
+  for (int i = 0; i < count; ++i, src += 4, dst += 4) {
+    const uint32_t src_alpha = src[3];
+    if (src_alpha == 0)
+      continue;
+    if (src_alpha == 0xFF || dst[3] == 0) {
+      memcpy(dst, src, 4);
+      continue;
+    }
+    /* Weights are scaled by 255 */
+    const uint32_t dst_weight = dst[3] * (0xFF - src_alpha);
+    const uint32_t alpha = src_alpha * 0xFF + dst_weight;
+    for (int c = 0; c < 3; ++c)
+      dst[c] = (uint8_t)((src[c] * src_alpha * 0xFF + dst[c] * dst_weight + alpha / 2) / alpha);
+    dst[3] = (uint8_t)((alpha + 0x7F) / 0xFF);
+  }
+}
+
+/*
+ * The same as BlendOverRow8 for RGBA16 pixels in native byte order
+ */
+static void BlendOverRow16(const uint8_t* src_bytes, uint8_t* dst_bytes, int count) {
+  const uint16_t* src = (const uint16_t*)src_bytes;
+  uint16_t* dst = (uint16_t*)dst_bytes;
+  for (int i = 0; i < count; ++i, src += 4, dst += 4) {
+    const uint64_t src_alpha = src[3];
+    if (src_alpha == 0)
+      continue;
+    if (src_alpha == 0xFFFF || dst[3] == 0) {
+      memcpy(dst, src, 8);
+      continue;
+    }
+    const uint64_t dst_weight = dst[3] * (0xFFFF - src_alpha);
+    const uint64_t alpha = src_alpha * 0xFFFF + dst_weight;
+    for (int c = 0; c < 3; ++c)
+      dst[c] = (uint16_t)((src[c] * src_alpha * 0xFFFF + dst[c] * dst_weight + alpha / 2) / alpha);
+    dst[3] = (uint16_t)((alpha + 0x7FFF) / 0xFFFF);
+  }
+}
+
+static uint8_t* GetRegionRow(const struct PNGAnimationDecoder* obj, const struct PNGChunkData_fcTL* control, int y) {
+  return obj->canvas + (size_t)(control->y_offset + y) * obj->row_stride + (size_t)control->x_offset * obj->pixel_size;
+}
+
+/*
+ * @brief Copy region of canvas to or from saved region
+ */
+static void CopyRegion(struct PNGAnimationDecoder* obj, const struct PNGChunkData_fcTL* control, bool save) {
+  const size_t row_size = (size_t)control->width * obj->pixel_size;
+  for (uint32_t y = 0; y < control->height; ++y) {
+    uint8_t* row = GetRegionRow(obj, control, y);
+    uint8_t* saved = obj->saved_region + y * row_size;
+    if (save)
+      memcpy(saved, row, row_size);
+    else
+      memcpy(row, saved, row_size);
+  }
+}
+
+static void DisposeFrame(struct PNGAnimationDecoder* obj, int index) {
+  const struct PNGChunkData_fcTL* control = &obj->frames[index].control;
+  /* The first frame has no previous contents, they are the cleared canvas */
+  const bool background = control->dispose_op == PNG_DISPOSE_OP_BACKGROUND ||
+                          (control->dispose_op == PNG_DISPOSE_OP_PREVIOUS && index == 0);
+  if (background) {
+    const size_t row_size = (size_t)control->width * obj->pixel_size;
+    for (uint32_t y = 0; y < control->height; ++y)
+      memset(GetRegionRow(obj, control, y), 0, row_size);
+  } else if (control->dispose_op == PNG_DISPOSE_OP_PREVIOUS) {
+    CopyRegion(obj, control, false);
+  }
+}
+
+static void RenderFrame(struct PNGAnimationDecoder* obj, int index, const uint8_t* pixels) {
+  const struct PNGChunkData_fcTL* control = &obj->frames[index].control;
+  if (control->dispose_op == PNG_DISPOSE_OP_PREVIOUS && index > 0)
+    CopyRegion(obj, control, true);
+
+  const size_t row_size = (size_t)control->width * obj->pixel_size;
+  for (uint32_t y = 0; y < control->height; ++y) {
+    const uint8_t* src = pixels + y * row_size;
+    uint8_t* dst = GetRegionRow(obj, control, y);
+    if (control->blend_op == PNG_BLEND_OP_SOURCE)
+      memcpy(dst, src, row_size);
+    else if (obj->format == PNG_PIXEL_FORMAT_RGBA16)
+      BlendOverRow16(src, dst, (int)control->width);
+    else
+      BlendOverRow8(src, dst, (int)control->width);
+  }
+}
+
+int PNGDecodeNextFrame(struct PNGAnimationDecoder* obj, struct PNGAnimationFrame* out) {
+  if (obj->failed)
+    return -1;
+  if (obj->next_frame >= obj->frames_count)
+    return 0;
+
+  const int index = obj->next_frame;
+  if (index > 0)
+    DisposeFrame(obj, index - 1);
+  if (index < obj->batch_start || index >= obj->batch_start + obj->batch_count)
+    DecodeBatch(obj, index);
+  const struct FrameSlot* slot = &obj->slots[index - obj->batch_start];
+  if (!slot->ok) {
+    obj->failed = true;
+    return -1;
+  }
+  RenderFrame(obj, index, slot->pixels);
+  ++obj->next_frame;
+
+  const struct PNGChunkData_fcTL* control = &obj->frames[index].control;
+  out->index = index;
+  out->control = *control;
+  out->delay_seconds = (double)control->delay_num / (control->delay_den ? control->delay_den : 100);
+  out->canvas = obj->canvas;
+  out->canvas_size = obj->canvas_size;
+  out->row_stride = obj->row_stride;
+  return 1;
+}
+
+void PNGRewindAnimation(struct PNGAnimationDecoder* obj) {
+  /* Slots are kept, so short animations are decoded once for all plays */
+  memset(obj->canvas, 0, obj->canvas_size);
+  obj->next_frame = 0;
+  obj->failed = false;
+}
+
+void PNGFreeAnimationDecoder(struct PNGAnimationDecoder* obj) {
+  if (!obj)
+    return;
+  for (int i = 0; obj->slots && i < obj->slots_count; ++i) {
+    free(obj->slots[i].compressed);
+    free(obj->slots[i].scanlines);
+    free(obj->slots[i].pixels);
+  }
+  free(obj->slots);
+  free(obj->frames);
+  free(obj->canvas);
+  free(obj->saved_region);
+  free(obj);
+}
@@ -0,0 +1,306 @@
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "png_core/batch.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#include "file_io.h"
+#include "file_read_queue.h"
+#include "thread_pool.h"
+
+/* Submission ring of io_uring holds two entries per file and at most 32768 entries */
+static const int s_max_queue_depth = 4096;
+
+void PNGInitBatchOptions(struct PNGBatchOptions* obj) {
+  obj->io_engine = PNG_BATCH_IO_ENGINE_AUTO;
+  obj->queue_depth = 64;
+  obj->threads_count = 0;
+  PNGInitDecodeOptions(&obj->decode);
+  obj->collect_stats = false;
+  obj->max_file_size = 256 << 20;
+}
+
+struct Batch {
+  const char* const* paths;
+  int paths_count;
+  const struct PNGBatchOptions* options;
+  struct PNGChunkLoadOptions load_options;
+  struct PNGDecodeOptions decode_options;
+  PNGBatchCallback callback;
+  void* user_data;
+  /* Next path read by pread workers */
+  atomic_int next_path;
+  atomic_int read_files_count;
+  atomic_int decoded_files_count;
+};
+
+/*
+ * @brief Load chunks of file, decode it and pass it to callback, then free file data
+ * @param data Malloc'ed file contents, NULL if `error` is set
+ */
+static void ProcessFile(struct Batch* batch, int index, int error, uint8_t* data, int64_t data_size) {
+  struct PNGBatchItem item;
+  item.index = index;
+  item.path = batch->paths[index];
+  item.error = error;
+  item.data = data;
+  item.data_size = (int)data_size;
+  item.chunk_list = NULL;
+  item.decoded = false;
+  PNGInitImage(&item.image);
+  item.stats = NULL;
+
+  /* Every file has its own statistics, options are shared between threads */
+  struct PNGDecodeStats stats;
+  struct PNGChunkLoadOptions load_options = batch->load_options;
+  struct PNGDecodeOptions decode_options = batch->decode_options;
+  if (batch->options->collect_stats && !error) {
+    PNGInitDecodeStats(&stats);
+    load_options.stats = &stats;
+    decode_options.stats = &stats;
+    item.stats = &stats;
+  }
+
+  struct PNGRawChunk* chunk_list = NULL;
+  if (!error) {
+    atomic_fetch_add(&batch->read_files_count, 1);
+    chunk_list = PNGLoadRawChunkListWithOptions(data, (int)data_size, true, &load_options);
+    item.chunk_list = chunk_list;
+    item.decoded = chunk_list && PNGDecodeImage(chunk_list, &decode_options, &item.image);
+    if (item.decoded)
+      atomic_fetch_add(&batch->decoded_files_count, 1);
+  }
+  batch->callback(batch->user_data, &item);
+  PNGFreeImage(&item.image);
+  PNGFreeRawChunk(chunk_list);
+  free(data);
+}
+
+static void RunPreadWorker(void* context, int worker_index) {
+  (void)worker_index;
+  struct Batch* batch = context;
+  for (int i = atomic_fetch_add(&batch->next_path, 1); i < batch->paths_count;
+       i = atomic_fetch_add(&batch->next_path, 1)) {
+    uint8_t* data = NULL;
+    int64_t data_size = 0;
+    const int error = ReadWholeFile(batch->paths[i], batch->options->max_file_size, &data, &data_size);
+    ProcessFile(batch, i, error, data, data_size);
+  }
+}
+
+#ifdef _WIN32
+
+static bool RunRingBatch(struct Batch* batch, struct FileReadQueue* queue, int workers_count) {
+  (void)batch;
+  (void)queue;
+  (void)workers_count;
+  return false;
+}
+
+#else
+
+/*
+ * Batch read through io_uring. Worker 0 keeps the queue full and passes read files to decoding workers.
+ * It decodes files too when every other worker is busy, so batch also completes if no other worker has started
+ */
+struct RingBatch {
+  struct Batch* batch;
+  struct FileReadQueue* queue;
+  pthread_mutex_t mutex;
+  /* Signaled when a file is read or reading is finished */
+  pthread_cond_t read_cond;
+  /* Signaled when a file is decoded */
+  pthread_cond_t decoded_cond;
+  /* Read files waiting for decoding, circular buffer of queue_depth */
+  struct FileReadResult* read_files;
+  int first_read_file;
+  int read_files_count;
+  /* Files queued for reading and not decoded yet, at most queue_depth */
+  int outstanding_count;
+  int idle_decoders_count;
+  bool reading_finished;
+  /* io_uring failed, files still in queue are not passed to callback */
+  bool failed;
+};
+
+static void PushReadFile(struct RingBatch* obj, const struct FileReadResult* file) {
+  pthread_mutex_lock(&obj->mutex);
+  const int depth = obj->batch->options->queue_depth;
+  obj->read_files[(obj->first_read_file + obj->read_files_count) % depth] = *file;
+  ++obj->read_files_count;
+  pthread_cond_signal(&obj->read_cond);
+  pthread_mutex_unlock(&obj->mutex);
+}
+
+/*
+ * @brief Decode the first read file. Called with mutex locked, which is released while file is decoded
+ */
+static void DecodeReadFileLocked(struct RingBatch* obj) {
+  const struct FileReadResult file = obj->read_files[obj->first_read_file];
+  obj->first_read_file = (obj->first_read_file + 1) % obj->batch->options->queue_depth;
+  --obj->read_files_count;
+  pthread_mutex_unlock(&obj->mutex);
+  ProcessFile(obj->batch, file.tag, file.error, file.data, file.data_size);
+  pthread_mutex_lock(&obj->mutex);
+  --obj->outstanding_count;
+  pthread_cond_signal(&obj->decoded_cond);
+}
+
+static void DriveFileReads(struct RingBatch* obj) {
+  const struct Batch* batch = obj->batch;
+  const int depth = batch->options->queue_depth;
+  int next_path = 0;
+  while (true) {
+    pthread_mutex_lock(&obj->mutex);
+    const int free_count = depth - obj->outstanding_count;
+    const int queue_count = free_count < batch->paths_count - next_path ? free_count : batch->paths_count - next_path;
+    obj->outstanding_count += queue_count;
+    /* Decoding is helped when every decoder is busy */
+    const bool help = obj->read_files_count > 0 && obj->idle_decoders_count == 0;
+    pthread_mutex_unlock(&obj->mutex);
+
+    for (int i = 0; i < queue_count; ++i, ++next_path)
+      QueueFileRead(obj->queue, batch->paths[next_path], batch->options->max_file_size, next_path);
+    const int pending_count = GetPendingFileReadCount(obj->queue);
+    if (pending_count == 0 && next_path == batch->paths_count)
+      break;
+
+    struct FileReadResult file;
+    if (pending_count > 0) {
+      if (WaitFileRead(obj->queue, !help, &file)) {
+        PushReadFile(obj, &file);
+        continue;
+      }
+      if (!help) {
+        obj->failed = true;
+        break;
+      }
+    }
+    /* No read has completed yet or queue is full of read files */
+    pthread_mutex_lock(&obj->mutex);
+    if (obj->read_files_count > 0)
+      DecodeReadFileLocked(obj);
+    else if (pending_count == 0)
+      while (obj->read_files_count == 0 && obj->outstanding_count >= depth)
+        pthread_cond_wait(&obj->decoded_cond, &obj->mutex);
+    pthread_mutex_unlock(&obj->mutex);
+  }
+
+  pthread_mutex_lock(&obj->mutex);
+  obj->reading_finished = true;
+  pthread_cond_broadcast(&obj->read_cond);
+  pthread_mutex_unlock(&obj->mutex);
+}
+
+static void DecodeReadFiles(struct RingBatch* obj) {
+  pthread_mutex_lock(&obj->mutex);
+  while (true) {
+    while (obj->read_files_count == 0 && !obj->reading_finished) {
+      ++obj->idle_decoders_count;
+      pthread_cond_wait(&obj->read_cond, &obj->mutex);
+      --obj->idle_decoders_count;
+    }
+    if (obj->read_files_count == 0)
+      break;
+    DecodeReadFileLocked(obj);
+  }
+  pthread_mutex_unlock(&obj->mutex);
+}
+
+static void RunRingWorker(void* context, int worker_index) {
+  struct RingBatch* obj = context;
+  if (worker_index == 0)
+    DriveFileReads(obj);
+  DecodeReadFiles(obj);
+}
+
+/*
+ * @return false if allocation or io_uring failed
+ */
+static bool RunRingBatch(struct Batch* batch, struct FileReadQueue* queue, int workers_count) {
+  struct RingBatch ring;
+  ring.batch = batch;
+  ring.queue = queue;
+  ring.read_files = malloc(sizeof(struct FileReadResult) * batch->options->queue_depth);
+  ring.first_read_file = 0;
+  ring.read_files_count = 0;
+  ring.outstanding_count = 0;
+  ring.idle_decoders_count = 0;
+  ring.reading_finished = false;
+  ring.failed = false;
+  if (!ring.read_files)
+    return false;
+  pthread_mutex_init(&ring.mutex, NULL);
+  pthread_cond_init(&ring.read_cond, NULL);
+  pthread_cond_init(&ring.decoded_cond, NULL);
+
+  RunParallel(RunRingWorker, &ring, workers_count);
+
+  pthread_cond_destroy(&ring.decoded_cond);
+  pthread_cond_destroy(&ring.read_cond);
+  pthread_mutex_destroy(&ring.mutex);
+  free(ring.read_files);
+  return !ring.failed;
+}
+
+#endif  // _WIN32
+
+bool PNGDecodeBatch(const char* const* paths, int paths_count, const struct PNGBatchOptions* options,
+                    PNGBatchCallback callback, void* user_data, struct PNGBatchResult* result) {
+  struct PNGBatchOptions default_options;
+  if (!options) {
+    PNGInitBatchOptions(&default_options);
+    options = &default_options;
+  }
+  if ((!paths && paths_count > 0) || paths_count < 0 || !callback || options->threads_count < 0 ||
+      options->queue_depth < 1 || options->queue_depth > s_max_queue_depth || options->max_file_size < 0 ||
+      options->io_engine < PNG_BATCH_IO_ENGINE_AUTO || options->io_engine > PNG_BATCH_IO_ENGINE_PREAD)
+    return false;
+
+  struct FileReadQueue* queue = NULL;
+  if (options->io_engine != PNG_BATCH_IO_ENGINE_PREAD) {
+    queue = CreateFileReadQueue(options->queue_depth);
+    if (!queue && options->io_engine == PNG_BATCH_IO_ENGINE_IO_URING)
+      return false;
+  }
+  const enum PNGBatchIOEngine io_engine = queue ? PNG_BATCH_IO_ENGINE_IO_URING : PNG_BATCH_IO_ENGINE_PREAD;
+
+  struct Batch batch;
+  batch.paths = paths;
+  batch.paths_count = paths_count;
+  batch.options = options;
+  PNGInitChunkLoadOptions(&batch.load_options);
+  batch.load_options.limits = options->decode.limits;
+  batch.decode_options = options->decode;
+  /* Statistics are not shared between threads, ProcessFile sets them per file */
+  batch.decode_options.stats = NULL;
+  batch.callback = callback;
+  batch.user_data = user_data;
+  atomic_init(&batch.next_path, 0);
+  atomic_init(&batch.read_files_count, 0);
+  atomic_init(&batch.decoded_files_count, 0);
+
+  int workers_count = options->threads_count ? options->threads_count : GetOnlineCPUCount();
+  if (workers_count > paths_count)
+    workers_count = paths_count > 0 ? paths_count : 1;
+  bool ok = true;
+  if (queue)
+    ok = RunRingBatch(&batch, queue, workers_count);
+  else if (paths_count > 0)
+    RunParallel(RunPreadWorker, &batch, workers_count);
+  FreeFileReadQueue(queue);
+
+  if (result) {
+    result->io_engine = io_engine;
+    result->read_files_count = atomic_load(&batch.read_files_count);
+    result->decoded_files_count = atomic_load(&batch.decoded_files_count);
+  }
+  return ok;
+}
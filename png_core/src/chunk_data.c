@@ -3,7 +3,9 @@
 #include <assert.h>
 #include <memory.h>
 #include <stdlib.h>
+#include <zlib.h>
 
+#include "stats_recorder.h"
 #include "tools.h"
 
 const uint8_t s_png_signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
@@ -16,6 +18,7 @@ void PNGInitChunkDataStructFunctions(struct PNGChunkDataStructFunctions *obj) {
   obj->init_func = NULL;
   obj->load_func = NULL;
   obj->write_func = NULL;
+  obj->size_func = NULL;
   obj->free_func = NULL;
 }
 
@@ -31,6 +34,7 @@ struct PNGChunkDataStructFunctions PNGGetChunkDataStructFunctions(struct ChunkTy
     functions.init_func = (PNGChunkDataStructInitFunc)PNGInitData_##chunk_name;          \
     functions.load_func = (PNGChunkDataStructLoadFunc)PNGLoadData_##chunk_name;          \
     functions.write_func = (PNGChunkDataStructWriteFunc)PNGWriteData_##chunk_name;       \
+    functions.size_func = (PNGChunkDataStructSizeFunc)PNGGetDataSize_##chunk_name;       \
     functions.free_func = (PNGChunkDataStructFreeFunc)PNGFreeData_##chunk_name;          \
     return functions;                                                                    \
   }
@@ -44,6 +48,10 @@ struct PNGChunkDataStructFunctions PNGGetChunkDataStructFunctions(struct ChunkTy
   PNG_RETURN_FUNCTION_SET(gAMA)
   PNG_RETURN_FUNCTION_SET(IDAT)
   PNG_RETURN_FUNCTION_SET(sBIT)
+  PNG_RETURN_FUNCTION_SET(tRNS)
+  PNG_RETURN_FUNCTION_SET(acTL)
+  PNG_RETURN_FUNCTION_SET(fcTL)
+  PNG_RETURN_FUNCTION_SET(fdAT)
 #undef PNG_RETURN_FUNCTION_SET
 
   struct PNGChunkDataStructFunctions functions;
@@ -52,6 +60,7 @@ struct PNGChunkDataStructFunctions PNGGetChunkDataStructFunctions(struct ChunkTy
   functions.init_func = (PNGChunkDataStructInitFunc)PNGInitData_UnknownData;
   functions.load_func = (PNGChunkDataStructLoadFunc)PNGLoadData_UnknownData;
   functions.write_func = (PNGChunkDataStructWriteFunc)PNGWriteData_UnknownData;
+  functions.size_func = (PNGChunkDataStructSizeFunc)PNGGetDataSize_UnknownData;
   functions.free_func = (PNGChunkDataStructFreeFunc)PNGFreeData_UnknownData;
   return functions;
 }
@@ -77,6 +86,10 @@ PNG_IMPLEMENT_CHUNK_DATA_ALLOCATE(IEND)
 PNG_IMPLEMENT_CHUNK_DATA_ALLOCATE(gAMA)
 PNG_IMPLEMENT_CHUNK_DATA_ALLOCATE(IDAT)
 PNG_IMPLEMENT_CHUNK_DATA_ALLOCATE(sBIT)
+PNG_IMPLEMENT_CHUNK_DATA_ALLOCATE(tRNS)
+PNG_IMPLEMENT_CHUNK_DATA_ALLOCATE(acTL)
+PNG_IMPLEMENT_CHUNK_DATA_ALLOCATE(fcTL)
+PNG_IMPLEMENT_CHUNK_DATA_ALLOCATE(fdAT)
 PNG_IMPLEMENT_CHUNK_DATA_ALLOCATE(UnknownData)
 
 #undef PNG_IMPLEMENT_CHUNK_DATA_ALLOCATE
@@ -115,6 +128,11 @@ struct PNGChunkData_IHDR *PNGLoadData_IHDR(const uint8_t *data, int data_size) {
   return out;
 }
 
+int PNGGetDataSize_IHDR(const struct PNGChunkData_IHDR *obj) {
+  assert(obj);
+  return 13;
+}
+
 int PNGWriteData_IHDR(const struct PNGChunkData_IHDR *data, uint8_t *out) {
   assert(data);
 
@@ -204,6 +222,11 @@ struct PNGChunkData_tEXt *PNGLoadData_tEXt(const uint8_t *data, int data_size) {
   return out;
 }
 
+int PNGGetDataSize_tEXt(const struct PNGChunkData_tEXt *obj) {
+  assert(obj);
+  return (int)strlen(obj->keyword) + 1 + (int)strlen(obj->text);
+}
+
 int PNGWriteData_tEXt(const struct PNGChunkData_tEXt *data, uint8_t *out) {
   assert(data);
 
@@ -285,6 +308,11 @@ struct PNGChunkData_PLTE *PNGLoadData_PLTE(const uint8_t *data, int data_size) {
   return out;
 }
 
+int PNGGetDataSize_PLTE(const struct PNGChunkData_PLTE *obj) {
+  assert(obj);
+  return 3 * obj->entries_count;
+}
+
 int PNGWriteData_PLTE(const struct PNGChunkData_PLTE *data, uint8_t *out) {
   assert(data);
 
@@ -322,26 +350,46 @@ void PNGInitData_bKGD(struct PNGChunkData_bKGD *obj) {
   assert(obj);
 
   obj->index_in_palette = 0;
+  memset(obj->samples, 0, sizeof(obj->samples));
+  obj->samples_count = 0;
 }
 
+/* Chunk size tells image type: 1 byte for indexed, 2 for greyscale, 6 for truecolor images */
 struct PNGChunkData_bKGD *PNGLoadData_bKGD(const uint8_t *data, int data_size) {
-  if (data_size != 1)
+  if (data_size != 1 && data_size != 2 && data_size != 6)
     return NULL;
 
-  struct PNGChunkData_bKGD *out = malloc(sizeof(struct PNGChunkData_bKGD));
+  struct PNGChunkData_bKGD *out = PNGAllocateData_bKGD();
   if (!out)
     return NULL;
 
-  out->index_in_palette = *data;
+  if (data_size == 1) {
+    out->index_in_palette = *data;
+    return out;
+  }
+  out->samples_count = data_size / 2;
+  for (int i = 0; i < out->samples_count; ++i)
+    out->samples[i] = ReadNetworkAndAdvanceUInt16(&data, true);
   return out;
 }
 
+int PNGGetDataSize_bKGD(const struct PNGChunkData_bKGD *obj) {
+  assert(obj);
+  return obj->samples_count == 0 ? 1 : 2 * obj->samples_count;
+}
+
 int PNGWriteData_bKGD(const struct PNGChunkData_bKGD *data, uint8_t *out) {
   assert(data);
 
+  if (data->samples_count == 0) {
+    if (out)
+      WriteNetworkAndAdvanceByte(&out, data->index_in_palette);
+    return 1;
+  }
   if (out)
-    WriteNetworkAndAdvanceByte(&out, data->index_in_palette);
-  return 1;
+    for (int i = 0; i < data->samples_count; ++i)
+      WriteNetworkAndAdvanceUInt16(&out, data->samples[i]);
+  return 2 * data->samples_count;
 }
 
 void PNGFreeData_bKGD(struct PNGChunkData_bKGD *data) {
@@ -354,7 +402,11 @@ bool PNGEqualData_bKGD(const struct PNGChunkData_bKGD *obj1, const struct PNGChu
   if (!obj1 || !obj2)
     return false;
 
-  return obj1->index_in_palette == obj2->index_in_palette;
+  if (obj1->samples_count != obj2->samples_count)
+    return false;
+  if (obj1->samples_count == 0)
+    return obj1->index_in_palette == obj2->index_in_palette;
+  return 0 == memcmp(obj1->samples, obj2->samples, obj1->samples_count * sizeof(uint16_t));
 }
 
 void PNGInitData_gAMA(struct PNGChunkData_gAMA *obj) {
@@ -378,6 +430,11 @@ struct PNGChunkData_gAMA *PNGLoadData_gAMA(const uint8_t *data, int data_size) {
   return out;
 }
 
+int PNGGetDataSize_gAMA(const struct PNGChunkData_gAMA *obj) {
+  assert(obj);
+  return 4;
+}
+
 int PNGWriteData_gAMA(const struct PNGChunkData_gAMA *data, uint8_t *out) {
   assert(data);
 
@@ -428,6 +485,11 @@ struct PNGChunkData_pHYs *PNGLoadData_pHYs(const uint8_t *data, int data_size) {
   return out;
 }
 
+int PNGGetDataSize_pHYs(const struct PNGChunkData_pHYs *obj) {
+  assert(obj);
+  return 9;
+}
+
 int PNGWriteData_pHYs(const struct PNGChunkData_pHYs *data, uint8_t *out) {
   assert(data);
 
@@ -475,6 +537,11 @@ struct PNGChunkData_sRGB *PNGLoadData_sRGB(const uint8_t *data, int data_size) {
   return out;
 }
 
+int PNGGetDataSize_sRGB(const struct PNGChunkData_sRGB *obj) {
+  assert(obj);
+  return 1;
+}
+
 int PNGWriteData_sRGB(const struct PNGChunkData_sRGB *data, uint8_t *out) {
   assert(data);
 
@@ -519,6 +586,11 @@ struct PNGChunkData_IDAT *PNGLoadData_IDAT(const uint8_t *data, int data_size) {
   return out;
 }
 
+int PNGGetDataSize_IDAT(const struct PNGChunkData_IDAT *obj) {
+  assert(obj);
+  return obj->data_size;
+}
+
 int PNGWriteData_IDAT(const struct PNGChunkData_IDAT *data, uint8_t *out) {
   assert(data);
 
@@ -561,6 +633,11 @@ struct PNGChunkData_sBIT *PNGLoadData_sBIT(const uint8_t *data, int data_size) {
   return out;
 }
 
+int PNGGetDataSize_sBIT(const struct PNGChunkData_sBIT *obj) {
+  assert(obj);
+  return 4;
+}
+
 int PNGWriteData_sBIT(const struct PNGChunkData_sBIT *data, uint8_t *out) {
   assert(data);
 
@@ -582,6 +659,246 @@ bool PNGEqualData_sBIT(const struct PNGChunkData_sBIT *obj1, const struct PNGChu
   return 0 == memcmp(obj1->bytes, obj2->bytes, 4);
 }
 
+void PNGInitData_tRNS(struct PNGChunkData_tRNS *obj) {
+  assert(obj);
+
+  memset(obj->bytes, 0, sizeof(obj->bytes));
+  obj->bytes_count = 0;
+}
+
+struct PNGChunkData_tRNS *PNGLoadData_tRNS(const uint8_t *data, int data_size) {
+  if (data_size < 0 || data_size > 256)
+    return NULL;
+
+  struct PNGChunkData_tRNS *out = PNGAllocateData_tRNS();
+  if (!out)
+    return NULL;
+
+  memcpy(out->bytes, data, data_size);
+  out->bytes_count = data_size;
+  return out;
+}
+
+int PNGGetDataSize_tRNS(const struct PNGChunkData_tRNS *obj) {
+  assert(obj);
+  return obj->bytes_count;
+}
+
+int PNGWriteData_tRNS(const struct PNGChunkData_tRNS *data, uint8_t *out) {
+  assert(data);
+
+  if (out)
+    WriteNetworkAndAdvanceBytes(&out, data->bytes, data->bytes_count);
+  return data->bytes_count;
+}
+
+void PNGFreeData_tRNS(struct PNGChunkData_tRNS *data) {
+  free(data);
+}
+
+bool PNGEqualData_tRNS(const struct PNGChunkData_tRNS *obj1, const struct PNGChunkData_tRNS *obj2) {
+  if (!obj1 && !obj2)
+    return true;
+  if (!obj1 || !obj2)
+    return false;
+
+  return obj1->bytes_count == obj2->bytes_count && 0 == memcmp(obj1->bytes, obj2->bytes, obj1->bytes_count);
+}
+
+int PNGGetTransparentSample_tRNS(const struct PNGChunkData_tRNS *obj, int channel) {
+  assert(obj);
+
+  if (channel < 0 || 2 * channel + 2 > obj->bytes_count)
+    return -1;
+  return (obj->bytes[2 * channel] << 8) | obj->bytes[2 * channel + 1];
+}
+
+void PNGInitData_acTL(struct PNGChunkData_acTL *obj) {
+  assert(obj);
+
+  obj->frames_count = 0;
+  obj->plays_count = 0;
+}
+
+struct PNGChunkData_acTL *PNGLoadData_acTL(const uint8_t *data, int data_size) {
+  if (data_size != 8)
+    return NULL;
+
+  struct PNGChunkData_acTL *out = PNGAllocateData_acTL();
+  if (!out)
+    return NULL;
+
+  out->frames_count = ReadNetworkAndAdvanceUInt32(&data, true);
+  out->plays_count = ReadNetworkAndAdvanceUInt32(&data, true);
+  return out;
+}
+
+int PNGGetDataSize_acTL(const struct PNGChunkData_acTL *obj) {
+  assert(obj);
+  return 8;
+}
+
+int PNGWriteData_acTL(const struct PNGChunkData_acTL *data, uint8_t *out) {
+  assert(data);
+
+  if (out) {
+    WriteNetworkAndAdvanceUInt32(&out, data->frames_count);
+    WriteNetworkAndAdvanceUInt32(&out, data->plays_count);
+  }
+  return 8;
+}
+
+void PNGFreeData_acTL(struct PNGChunkData_acTL *data) {
+  free(data);
+}
+
+bool PNGEqualData_acTL(const struct PNGChunkData_acTL *obj1, const struct PNGChunkData_acTL *obj2) {
+  if (!obj1 && !obj2)
+    return true;
+  if (!obj1 || !obj2)
+    return false;
+
+  return obj1->frames_count == obj2->frames_count && obj1->plays_count == obj2->plays_count;
+}
+
+void PNGInitData_fcTL(struct PNGChunkData_fcTL *obj) {
+  assert(obj);
+
+  obj->sequence_number = 0;
+  obj->width = 0;
+  obj->height = 0;
+  obj->x_offset = 0;
+  obj->y_offset = 0;
+  obj->delay_num = 0;
+  obj->delay_den = 0;
+  obj->dispose_op = PNG_DISPOSE_OP_NONE;
+  obj->blend_op = PNG_BLEND_OP_SOURCE;
+}
+
+struct PNGChunkData_fcTL *PNGLoadData_fcTL(const uint8_t *data, int data_size) {
+  if (data_size != 26)
+    return NULL;
+
+  struct PNGChunkData_fcTL *out = PNGAllocateData_fcTL();
+  if (!out)
+    return NULL;
+
+  out->sequence_number = ReadNetworkAndAdvanceUInt32(&data, true);
+  out->width = ReadNetworkAndAdvanceUInt32(&data, true);
+  out->height = ReadNetworkAndAdvanceUInt32(&data, true);
+  out->x_offset = ReadNetworkAndAdvanceUInt32(&data, true);
+  out->y_offset = ReadNetworkAndAdvanceUInt32(&data, true);
+  out->delay_num = ReadNetworkAndAdvanceUInt16(&data, true);
+  out->delay_den = ReadNetworkAndAdvanceUInt16(&data, true);
+  out->dispose_op = ReadNetworkAndAdvanceByte(&data, true);
+  out->blend_op = ReadNetworkAndAdvanceByte(&data, true);
+  return out;
+}
+
+int PNGGetDataSize_fcTL(const struct PNGChunkData_fcTL *obj) {
+  assert(obj);
+  return 26;
+}
+
+int PNGWriteData_fcTL(const struct PNGChunkData_fcTL *data, uint8_t *out) {
+  assert(data);
+
+  if (out) {
+    WriteNetworkAndAdvanceUInt32(&out, data->sequence_number);
+    WriteNetworkAndAdvanceUInt32(&out, data->width);
+    WriteNetworkAndAdvanceUInt32(&out, data->height);
+    WriteNetworkAndAdvanceUInt32(&out, data->x_offset);
+    WriteNetworkAndAdvanceUInt32(&out, data->y_offset);
+    WriteNetworkAndAdvanceUInt16(&out, data->delay_num);
+    WriteNetworkAndAdvanceUInt16(&out, data->delay_den);
+    WriteNetworkAndAdvanceByte(&out, data->dispose_op);
+    WriteNetworkAndAdvanceByte(&out, data->blend_op);
+  }
+  return 26;
+}
+
+void PNGFreeData_fcTL(struct PNGChunkData_fcTL *data) {
+  free(data);
+}
+
+bool PNGEqualData_fcTL(const struct PNGChunkData_fcTL *obj1, const struct PNGChunkData_fcTL *obj2) {
+  if (!obj1 && !obj2)
+    return true;
+  if (!obj1 || !obj2)
+    return false;
+
+  // clang-format off
+  return obj1->sequence_number == obj2->sequence_number &&
+    obj1->width == obj2->width &&
+    obj1->height == obj2->height &&
+    obj1->x_offset == obj2->x_offset &&
+    obj1->y_offset == obj2->y_offset &&
+    obj1->delay_num == obj2->delay_num &&
+    obj1->delay_den == obj2->delay_den &&
+    obj1->dispose_op == obj2->dispose_op &&
+    obj1->blend_op == obj2->blend_op;
+  // clang-format on
+}
+
+void PNGInitData_fdAT(struct PNGChunkData_fdAT *obj) {
+  assert(obj);
+
+  obj->sequence_number = 0;
+  obj->data = NULL;
+  obj->data_size = 0;
+}
+
+struct PNGChunkData_fdAT *PNGLoadData_fdAT(const uint8_t *data, int data_size) {
+  if (data_size < 4)
+    return NULL;
+
+  struct PNGChunkData_fdAT *out = PNGAllocateData_fdAT();
+  if (!out)
+    return NULL;
+
+  out->sequence_number = ReadNetworkAndAdvanceUInt32(&data, true);
+  out->data_size = data_size - 4;
+  out->data = malloc(out->data_size > 0 ? out->data_size : 1);
+  if (!out->data) {
+    free(out);
+    return NULL;
+  }
+
+  memcpy(out->data, data, out->data_size);
+  return out;
+}
+
+int PNGGetDataSize_fdAT(const struct PNGChunkData_fdAT *obj) {
+  assert(obj);
+  return 4 + obj->data_size;
+}
+
+int PNGWriteData_fdAT(const struct PNGChunkData_fdAT *data, uint8_t *out) {
+  assert(data);
+
+  if (out) {
+    WriteNetworkAndAdvanceUInt32(&out, data->sequence_number);
+    WriteNetworkAndAdvanceBytes(&out, data->data, data->data_size);
+  }
+  return 4 + data->data_size;
+}
+
+void PNGFreeData_fdAT(struct PNGChunkData_fdAT *data) {
+  free(data->data);
+  free(data);
+}
+
+bool PNGEqualData_fdAT(const struct PNGChunkData_fdAT *obj1, const struct PNGChunkData_fdAT *obj2) {
+  if (!obj1 && !obj2)
+    return true;
+  if (!obj1 || !obj2)
+    return false;
+
+  if (obj1->sequence_number != obj2->sequence_number || obj1->data_size != obj2->data_size)
+    return false;
+  return 0 == memcmp(obj1->data, obj2->data, obj1->data_size);
+}
+
 void PNGInitData_UnknownData(struct PNGChunkData_UnknownData *obj) {
   assert(obj);
 
@@ -606,6 +923,11 @@ struct PNGChunkData_UnknownData *PNGLoadData_UnknownData(const uint8_t *data, in
   return out;
 }
 
+int PNGGetDataSize_UnknownData(const struct PNGChunkData_UnknownData *obj) {
+  assert(obj);
+  return obj->data_size;
+}
+
 int PNGWriteData_UnknownData(const struct PNGChunkData_UnknownData *data, uint8_t *out) {
   assert(data);
 
@@ -648,6 +970,11 @@ struct PNGChunkData_IEND *PNGLoadData_IEND(const uint8_t *data, int data_size) {
   return out;
 }
 
+int PNGGetDataSize_IEND(const struct PNGChunkData_IEND *obj) {
+  assert(obj);
+  return 0;
+}
+
 int PNGWriteData_IEND(const struct PNGChunkData_IEND *data, uint8_t *out) {
   assert(data);
   return 0;
@@ -668,7 +995,7 @@ bool PNGEqualData_IEND(const struct PNGChunkData_IEND *obj1, const struct PNGChu
 
 struct PNGRawChunk *PNGAllocateRawChunk() {
   struct PNGRawChunk *obj = malloc(sizeof(struct PNGRawChunk));
-  if (!obj)
+  if (obj)
     PNGInitRawChunk(obj);
   return obj;
 }
@@ -717,7 +1044,57 @@ struct PNGRawChunk *PNGLoadRawChunk(const uint8_t *data, int data_size) {
   return chunk;
 }
 
+void PNGInitChunkLoadOptions(struct PNGChunkLoadOptions *obj) {
+  assert(obj);
+
+  obj->allowed_types = NULL;
+  obj->allowed_types_count = 0;
+  obj->skip_ancillary = false;
+  obj->stats = NULL;
+  PNGInitDecodeLimits(&obj->limits);
+}
+
+/*
+ * @return false if IHDR chunk data describes image with more pixels than allowed
+ */
+static bool CheckHeaderLimits(const uint8_t *data, uint32_t data_size, const struct PNGDecodeLimits *limits) {
+  if (!limits->max_pixels || data_size < 8)
+    return true;
+  const uint64_t width = ReadNetworkAndAdvanceUInt32(&data, true);
+  const uint64_t height = ReadNetworkAndAdvanceUInt32(&data, true);
+  return width * height <= limits->max_pixels;
+}
+
+/*
+ * @return true if chunk of type should be loaded according to options
+ */
+static bool IsChunkTypeAccepted(const struct PNGChunkLoadOptions *options, struct ChunkType type) {
+  if (!options)
+    return true;
+  if (options->skip_ancillary && IsChunkTypeAncillary(type))
+    return false;
+  if (!options->allowed_types)
+    return true;
+  for (int i = 0; i < options->allowed_types_count; ++i)
+    if (options->allowed_types[i].bytes == type.bytes)
+      return true;
+  return false;
+}
+
 struct PNGRawChunk *PNGLoadRawChunkList(const uint8_t *data, int data_size, bool data_with_png_signature) {
+  return PNGLoadRawChunkListWithOptions(data, data_size, data_with_png_signature, NULL);
+}
+
+/*
+ * @param[out] out_loaded_size Total data size of loaded chunks
+ */
+static struct PNGRawChunk *LoadRawChunkList(const uint8_t *data, int data_size, bool data_with_png_signature,
+                                            const struct PNGChunkLoadOptions *options, uint64_t *out_loaded_size) {
+  struct PNGDecodeLimits default_limits;
+  PNGInitDecodeLimits(&default_limits);
+  const struct PNGDecodeLimits *limits = options ? &options->limits : &default_limits;
+  uint32_t chunks_count = 0;
+
   const uint8_t *data_end = data + data_size;
   if (data_with_png_signature)
     data += sizeof(s_png_signature);
@@ -738,17 +1115,48 @@ struct PNGRawChunk *PNGLoadRawChunkList(const uint8_t *data, int data_size, bool
     if (chunk_end > data_end)
       return dummyHead.next;
 
+    struct ChunkType type;
+    memcpy(type.byte_array, data + sizeof(uint32_t), sizeof(type.byte_array));
+    /* Limits reject the whole datastream, chunks loaded so far are dropped */
+    const bool count_exceeded = limits->max_chunks_count && ++chunks_count > limits->max_chunks_count;
+    const bool header_exceeded = type.bytes == CHUNK_IHDR.bytes && !CheckHeaderLimits(data + 8, chunk_length, limits);
+    if (count_exceeded || header_exceeded) {
+      PNGFreeRawChunk(dummyHead.next);
+      return NULL;
+    }
+    if (!IsChunkTypeAccepted(options, type)) {
+      data = chunk_end;
+      continue;
+    }
+    if (limits->max_chunk_memory_bytes && *out_loaded_size + chunk_length > limits->max_chunk_memory_bytes) {
+      PNGFreeRawChunk(dummyHead.next);
+      return NULL;
+    }
+
     last_chunk->next = PNGLoadRawChunk(data, 12 + chunk_length);
     if (!last_chunk->next)
       return dummyHead.next;
 
     last_chunk = last_chunk->next;
+    *out_loaded_size += chunk_length;
     data = chunk_end;
   }
 
   return dummyHead.next;
 }
 
+struct PNGRawChunk *PNGLoadRawChunkListWithOptions(const uint8_t *data, int data_size, bool data_with_png_signature,
+                                                   const struct PNGChunkLoadOptions *options) {
+  struct StatsRecorder recorder;
+  StartStatsRecorder(&recorder, options ? options->stats : NULL);
+  const uint64_t start = StartStage(&recorder);
+  uint64_t loaded_size = 0;
+  struct PNGRawChunk *chunk_list = LoadRawChunkList(data, data_size, data_with_png_signature, options, &loaded_size);
+  EndStage(&recorder, PNG_DECODE_STAGE_PARSE, start, (uint64_t)data_size, loaded_size);
+  StopStatsRecorder(&recorder);
+  return chunk_list;
+}
+
 int PNGWriteRawChunk(const struct PNGRawChunk *obj, uint8_t *out) {
   assert(obj);
 
@@ -757,22 +1165,25 @@ int PNGWriteRawChunk(const struct PNGRawChunk *obj, uint8_t *out) {
     if (obj->raw_data)
       data_size = obj->raw_data_size_bytes;
     else if (obj->parsed_data)
-      data_size = obj->data_functions.write_func(obj, NULL);
+      data_size = obj->data_functions.size_func(obj->parsed_data);
 
     const int expected_size = sizeof(int32_t) + sizeof(uint32_t) + data_size + sizeof(uint32_t);
     return expected_size;
   }
 
-  WriteNetworkAndAdvanceInt32(&out, obj->raw_data_size_bytes);
+  /* Length is written after data because serialized parsed_data size is known only after writing */
+  uint8_t *length_out = out;
+  out += sizeof(int32_t);
   WriteNetworkAndAdvanceBytes(&out, obj->type.byte_array, 4);
-  int data_size = obj->raw_data_size_bytes;
-  if (obj->raw_data)
+  int data_size = 0;
+  if (obj->raw_data) {
+    data_size = obj->raw_data_size_bytes;
     WriteNetworkAndAdvanceBytes(&out, obj->raw_data, obj->raw_data_size_bytes);
-  else if (obj->parsed_data) {
-    data_size = obj->data_functions.write_func(obj, NULL);
-    obj->data_functions.write_func(obj, out);
+  } else if (obj->parsed_data) {
+    data_size = obj->data_functions.write_func(obj->parsed_data, out);
     out += data_size;
   }
+  WriteNetworkAndAdvanceInt32(&length_out, data_size);
   WriteNetworkAndAdvanceUInt32(&out, obj->crc);
 
   return sizeof(int32_t) + sizeof(uint32_t) + data_size + sizeof(uint32_t);
@@ -806,6 +1217,14 @@ int PNGWriteRawChunkList(const struct PNGRawChunk *obj, uint8_t *out, bool write
   return total_size;
 }
 
+uint32_t PNGComputeChunkCRC(struct ChunkType type, const uint8_t *data, uint32_t data_size) {
+  uLong crc = crc32(0L, Z_NULL, 0);
+  crc = crc32(crc, type.byte_array, sizeof(type.byte_array));
+  if (data_size > 0)
+    crc = crc32(crc, data, data_size);
+  return (uint32_t)crc;
+}
+
 void PNGFreeRawChunk(struct PNGRawChunk *obj) {
   if (!obj)
     return;
@@ -0,0 +1,417 @@
+#include "png_core/chunk_table.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "file_io.h"
+#include "png_core/chunk_data.h"
+#include "tools.h"
+
+static const int s_initial_entries_capacity = 16;
+static const int s_initial_type_index_capacity = 32;
+
+void PNGInitChunkTable(struct PNGChunkTable* obj) {
+  assert(obj);
+
+  memset(obj, 0, sizeof(struct PNGChunkTable));
+  obj->head = PNG_CHUNK_TABLE_NO_ENTRY;
+  obj->tail = PNG_CHUNK_TABLE_NO_ENTRY;
+  obj->free_head = PNG_CHUNK_TABLE_NO_ENTRY;
+}
+
+void PNGFreeChunkTable(struct PNGChunkTable* obj) {
+  if (!obj)
+    return;
+
+  free(obj->types);
+  free(obj->offsets);
+  free(obj->sizes);
+  free(obj->crcs);
+  free(obj->prev);
+  free(obj->next);
+  free(obj->prev_of_type);
+  free(obj->next_of_type);
+  free(obj->type_index);
+  free(obj->idat_spans);
+  PNGInitChunkTable(obj);
+}
+
+/*
+ * Drop all entries but keep allocated memory
+ */
+static void ClearChunkTable(struct PNGChunkTable* obj) {
+  obj->used = 0;
+  obj->count = 0;
+  obj->head = PNG_CHUNK_TABLE_NO_ENTRY;
+  obj->tail = PNG_CHUNK_TABLE_NO_ENTRY;
+  obj->free_head = PNG_CHUNK_TABLE_NO_ENTRY;
+  if (obj->type_index)
+    memset(obj->type_index, 0, obj->type_index_capacity * sizeof(struct PNGChunkTypeIndexEntry));
+  obj->type_index_used = 0;
+  obj->idat_spans_count = 0;
+  obj->idat_spans_dirty = false;
+}
+
+/*
+ * Grow every per-entry array. Arrays already grown stay valid if some realloc fails
+ */
+static bool GrowEntries(struct PNGChunkTable* obj) {
+  const int new_capacity = obj->capacity ? obj->capacity * 2 : s_initial_entries_capacity;
+
+#define PNG_GROW_ARRAY(field)                                                     \
+  {                                                                               \
+    void* grown = realloc(obj->field, new_capacity * sizeof(obj->field[0]));      \
+    if (!grown)                                                                   \
+      return false;                                                               \
+    obj->field = grown;                                                           \
+  }
+  PNG_GROW_ARRAY(types)
+  PNG_GROW_ARRAY(offsets)
+  PNG_GROW_ARRAY(sizes)
+  PNG_GROW_ARRAY(crcs)
+  PNG_GROW_ARRAY(prev)
+  PNG_GROW_ARRAY(next)
+  PNG_GROW_ARRAY(prev_of_type)
+  PNG_GROW_ARRAY(next_of_type)
+#undef PNG_GROW_ARRAY
+
+  obj->capacity = new_capacity;
+  return true;
+}
+
+static inline uint32_t HashChunkType(uint32_t type, int capacity) {
+  /* Fibonacci hashing, capacity is a power of two */
+  return (type * 2654435769u) & (uint32_t)(capacity - 1);
+}
+
+/*
+ * @return Index entry for type or NULL if type was never indexed
+ */
+static struct PNGChunkTypeIndexEntry* FindTypeIndexEntry(const struct PNGChunkTable* obj, uint32_t type) {
+  if (!obj->type_index)
+    return NULL;
+
+  uint32_t slot = HashChunkType(type, obj->type_index_capacity);
+  while (obj->type_index[slot].type != 0) {
+    if (obj->type_index[slot].type == type)
+      return &obj->type_index[slot];
+    slot = (slot + 1) & (obj->type_index_capacity - 1);
+  }
+  return NULL;
+}
+
+static bool GrowTypeIndex(struct PNGChunkTable* obj) {
+  const int new_capacity = obj->type_index_capacity ? obj->type_index_capacity * 2 : s_initial_type_index_capacity;
+  struct PNGChunkTypeIndexEntry* new_index = calloc(new_capacity, sizeof(struct PNGChunkTypeIndexEntry));
+  if (!new_index)
+    return false;
+
+  for (int i = 0; i < obj->type_index_capacity; ++i) {
+    const struct PNGChunkTypeIndexEntry* entry = &obj->type_index[i];
+    if (entry->type == 0)
+      continue;
+    uint32_t slot = HashChunkType(entry->type, new_capacity);
+    while (new_index[slot].type != 0)
+      slot = (slot + 1) & (new_capacity - 1);
+    new_index[slot] = *entry;
+  }
+
+  free(obj->type_index);
+  obj->type_index = new_index;
+  obj->type_index_capacity = new_capacity;
+  return true;
+}
+
+/*
+ * @return Index entry for type, created if missing. NULL if allocation failed
+ */
+static struct PNGChunkTypeIndexEntry* GetOrAddTypeIndexEntry(struct PNGChunkTable* obj, uint32_t type) {
+  struct PNGChunkTypeIndexEntry* entry = FindTypeIndexEntry(obj, type);
+  if (entry)
+    return entry;
+
+  /* Keep load factor below 1/2 */
+  if ((obj->type_index_used + 1) * 2 > obj->type_index_capacity)
+    if (!GrowTypeIndex(obj))
+      return NULL;
+
+  uint32_t slot = HashChunkType(type, obj->type_index_capacity);
+  while (obj->type_index[slot].type != 0)
+    slot = (slot + 1) & (obj->type_index_capacity - 1);
+
+  entry = &obj->type_index[slot];
+  entry->type = type;
+  entry->first = PNG_CHUNK_TABLE_NO_ENTRY;
+  entry->last = PNG_CHUNK_TABLE_NO_ENTRY;
+  entry->count = 0;
+  ++obj->type_index_used;
+  return entry;
+}
+
+int PNGChunkTableInsert(struct PNGChunkTable* obj, int before, struct ChunkType type, int64_t offset, uint32_t size,
+                        uint32_t crc) {
+  assert(obj);
+
+  if (type.bytes == CHUNK_INVALID.bytes)
+    return PNG_CHUNK_TABLE_NO_ENTRY;
+  if (before != PNG_CHUNK_TABLE_NO_ENTRY && !PNGChunkTableIsLive(obj, before))
+    return PNG_CHUNK_TABLE_NO_ENTRY;
+
+  struct PNGChunkTypeIndexEntry* type_entry = GetOrAddTypeIndexEntry(obj, type.bytes);
+  if (!type_entry)
+    return PNG_CHUNK_TABLE_NO_ENTRY;
+
+  int entry = obj->free_head;
+  if (entry != PNG_CHUNK_TABLE_NO_ENTRY) {
+    obj->free_head = obj->next[entry];
+  } else {
+    if (obj->used == obj->capacity && !GrowEntries(obj))
+      return PNG_CHUNK_TABLE_NO_ENTRY;
+    entry = obj->used++;
+  }
+
+  obj->types[entry] = type.bytes;
+  obj->offsets[entry] = offset;
+  obj->sizes[entry] = size;
+  obj->crcs[entry] = crc;
+
+  /* File order links */
+  const int prev = before == PNG_CHUNK_TABLE_NO_ENTRY ? obj->tail : obj->prev[before];
+  obj->prev[entry] = prev;
+  obj->next[entry] = before;
+  if (prev != PNG_CHUNK_TABLE_NO_ENTRY)
+    obj->next[prev] = entry;
+  else
+    obj->head = entry;
+  if (before != PNG_CHUNK_TABLE_NO_ENTRY)
+    obj->prev[before] = entry;
+  else
+    obj->tail = entry;
+
+  /* Same type links: find nearest preceding chunk of the same type */
+  int prev_of_type = PNG_CHUNK_TABLE_NO_ENTRY;
+  if (before == PNG_CHUNK_TABLE_NO_ENTRY) {
+    prev_of_type = type_entry->last;
+  } else if (obj->types[before] == type.bytes) {
+    prev_of_type = obj->prev_of_type[before];
+  } else if (type_entry->count > 0) {
+    for (int i = prev; i != PNG_CHUNK_TABLE_NO_ENTRY; i = obj->prev[i]) {
+      if (obj->types[i] == type.bytes) {
+        prev_of_type = i;
+        break;
+      }
+    }
+  }
+  const int next_of_type =
+      prev_of_type != PNG_CHUNK_TABLE_NO_ENTRY ? obj->next_of_type[prev_of_type] : type_entry->first;
+  obj->prev_of_type[entry] = prev_of_type;
+  obj->next_of_type[entry] = next_of_type;
+  if (prev_of_type != PNG_CHUNK_TABLE_NO_ENTRY)
+    obj->next_of_type[prev_of_type] = entry;
+  else
+    type_entry->first = entry;
+  if (next_of_type != PNG_CHUNK_TABLE_NO_ENTRY)
+    obj->prev_of_type[next_of_type] = entry;
+  else
+    type_entry->last = entry;
+  ++type_entry->count;
+
+  ++obj->count;
+  if (type.bytes == CHUNK_IDAT.bytes)
+    obj->idat_spans_dirty = true;
+  return entry;
+}
+
+int PNGChunkTableAppend(struct PNGChunkTable* obj, struct ChunkType type, int64_t offset, uint32_t size,
+                        uint32_t crc) {
+  return PNGChunkTableInsert(obj, PNG_CHUNK_TABLE_NO_ENTRY, type, offset, size, crc);
+}
+
+bool PNGChunkTableRemove(struct PNGChunkTable* obj, int entry) {
+  assert(obj);
+
+  if (!PNGChunkTableIsLive(obj, entry))
+    return false;
+
+  struct PNGChunkTypeIndexEntry* type_entry = FindTypeIndexEntry(obj, obj->types[entry]);
+  assert(type_entry);
+
+  const int prev = obj->prev[entry];
+  const int next = obj->next[entry];
+  if (prev != PNG_CHUNK_TABLE_NO_ENTRY)
+    obj->next[prev] = next;
+  else
+    obj->head = next;
+  if (next != PNG_CHUNK_TABLE_NO_ENTRY)
+    obj->prev[next] = prev;
+  else
+    obj->tail = prev;
+
+  const int prev_of_type = obj->prev_of_type[entry];
+  const int next_of_type = obj->next_of_type[entry];
+  if (prev_of_type != PNG_CHUNK_TABLE_NO_ENTRY)
+    obj->next_of_type[prev_of_type] = next_of_type;
+  else
+    type_entry->first = next_of_type;
+  if (next_of_type != PNG_CHUNK_TABLE_NO_ENTRY)
+    obj->prev_of_type[next_of_type] = prev_of_type;
+  else
+    type_entry->last = prev_of_type;
+  --type_entry->count;
+
+  if (obj->types[entry] == CHUNK_IDAT.bytes)
+    obj->idat_spans_dirty = true;
+
+  obj->types[entry] = CHUNK_INVALID.bytes;
+  if (!obj->keep_removed_ids) {
+    obj->next[entry] = obj->free_head;
+    obj->free_head = entry;
+  }
+  --obj->count;
+  return true;
+}
+
+int PNGChunkTableFindFirst(const struct PNGChunkTable* obj, struct ChunkType type) {
+  assert(obj);
+
+  const struct PNGChunkTypeIndexEntry* type_entry = FindTypeIndexEntry(obj, type.bytes);
+  return type_entry ? type_entry->first : PNG_CHUNK_TABLE_NO_ENTRY;
+}
+
+int PNGChunkTableCountOfType(const struct PNGChunkTable* obj, struct ChunkType type) {
+  assert(obj);
+
+  const struct PNGChunkTypeIndexEntry* type_entry = FindTypeIndexEntry(obj, type.bytes);
+  return type_entry ? type_entry->count : 0;
+}
+
+int PNGChunkTableFindAll(const struct PNGChunkTable* obj, struct ChunkType type, int* out_entries) {
+  assert(obj);
+
+  const struct PNGChunkTypeIndexEntry* type_entry = FindTypeIndexEntry(obj, type.bytes);
+  if (!type_entry)
+    return 0;
+
+  if (out_entries) {
+    int i = 0;
+    for (int entry = type_entry->first; entry != PNG_CHUNK_TABLE_NO_ENTRY; entry = obj->next_of_type[entry])
+      out_entries[i++] = entry;
+  }
+  return type_entry->count;
+}
+
+const struct PNGChunkSpan* PNGChunkTableGetIDATSpans(struct PNGChunkTable* obj, int* out_count) {
+  assert(obj);
+  assert(out_count);
+
+  /* Returned when there are no IDAT chunks, so NULL only means failed allocation */
+  static const struct PNGChunkSpan s_no_spans[1] = {{0, 0}};
+
+  *out_count = 0;
+  if (obj->idat_spans_dirty) {
+    const int count = PNGChunkTableCountOfType(obj, CHUNK_IDAT);
+    if (count > obj->idat_spans_capacity) {
+      struct PNGChunkSpan* spans = realloc(obj->idat_spans, count * sizeof(struct PNGChunkSpan));
+      if (!spans)
+        return NULL;
+      obj->idat_spans = spans;
+      obj->idat_spans_capacity = count;
+    }
+
+    int i = 0;
+    for (int entry = PNGChunkTableFindFirst(obj, CHUNK_IDAT); entry != PNG_CHUNK_TABLE_NO_ENTRY;
+         entry = obj->next_of_type[entry]) {
+      obj->idat_spans[i].offset = obj->offsets[entry];
+      obj->idat_spans[i].size = obj->sizes[entry];
+      ++i;
+    }
+    obj->idat_spans_count = count;
+    obj->idat_spans_dirty = false;
+  }
+
+  *out_count = obj->idat_spans_count;
+  return obj->idat_spans_count ? obj->idat_spans : s_no_spans;
+}
+
+bool PNGBuildChunkTable(const uint8_t* data, int64_t data_size, bool data_with_png_signature,
+                        struct PNGChunkTable* out) {
+  assert(out);
+
+  ClearChunkTable(out);
+
+  const uint8_t* const data_begin = data;
+  const uint8_t* const data_end = data + data_size;
+  if (data_with_png_signature) {
+    if (data_size < (int64_t)sizeof(s_png_signature) || memcmp(data, s_png_signature, sizeof(s_png_signature)) != 0)
+      return false;
+    data += sizeof(s_png_signature);
+  }
+
+  while (data < data_end) {
+    if (data_end - data < 12)
+      return false;
+
+    const uint32_t chunk_length = ReadNetworkAndAdvanceUInt32(&data, true);
+    if (chunk_length > (uint32_t)s_png_max_chunk_data_size_bytes || chunk_length + 8 > data_end - data)
+      return false;
+
+    struct ChunkType type;
+    ReadNetworkAndAdvanceBytesInPlace(&data, type.byte_array, sizeof(type.byte_array));
+    const int64_t offset = data - data_begin;
+    data += chunk_length;
+    const uint32_t crc = ReadNetworkAndAdvanceUInt32(&data, true);
+
+    if (PNGChunkTableAppend(out, type, offset, chunk_length, crc) == PNG_CHUNK_TABLE_NO_ENTRY)
+      return false;
+  }
+
+  return true;
+}
+
+bool PNGBuildChunkTableFromFd(int fd, struct PNGChunkTable* out) {
+  assert(out);
+
+  ClearChunkTable(out);
+
+  const int64_t file_size = GetFileSizeBytes(fd);
+  /* Signature and at least one chunk */
+  if (file_size < (int64_t)sizeof(s_png_signature) + 12)
+    return false;
+
+  /* Signature and the first chunk header */
+  uint8_t head[sizeof(s_png_signature) + 8];
+  if (!ReadFileAt(fd, head, sizeof(head), 0) || memcmp(head, s_png_signature, sizeof(s_png_signature)) != 0)
+    return false;
+
+  /* CRC of the current chunk and the next chunk header are read at once */
+  uint8_t buffer[12];
+  memcpy(buffer + 4, head + sizeof(s_png_signature), 8);
+  int64_t position = sizeof(s_png_signature);
+  while (true) {
+    const uint8_t* ptr = buffer + 4;
+    const uint32_t chunk_length = ReadNetworkAndAdvanceUInt32(&ptr, true);
+    struct ChunkType type;
+    ReadNetworkAndAdvanceBytesInPlace(&ptr, type.byte_array, sizeof(type.byte_array));
+
+    const int64_t data_offset = position + 8;
+    const int64_t crc_offset = data_offset + chunk_length;
+    if (chunk_length > (uint32_t)s_png_max_chunk_data_size_bytes || crc_offset + 4 > file_size)
+      return false;
+
+    const bool is_last = crc_offset + 4 == file_size;
+    if (file_size - (crc_offset + 4) > 0 && file_size - (crc_offset + 4) < 8)
+      return false;
+    if (!ReadFileAt(fd, buffer, is_last ? 4 : 12, crc_offset))
+      return false;
+
+    ptr = buffer;
+    const uint32_t crc = ReadNetworkAndAdvanceUInt32(&ptr, true);
+    if (PNGChunkTableAppend(out, type, data_offset, chunk_length, crc) == PNG_CHUNK_TABLE_NO_ENTRY)
+      return false;
+
+    if (is_last)
+      return true;
+    position = crc_offset + 4;
+  }
+}
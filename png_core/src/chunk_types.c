@@ -72,6 +72,34 @@ const struct ChunkType CHUNK_sBIT = {
     .byte4 = 84,
 };
 
+const struct ChunkType CHUNK_tRNS = {
+    .byte1 = 116,
+    .byte2 = 82,
+    .byte3 = 78,
+    .byte4 = 83,
+};
+
+const struct ChunkType CHUNK_acTL = {
+    .byte1 = 97,
+    .byte2 = 99,
+    .byte3 = 84,
+    .byte4 = 76,
+};
+
+const struct ChunkType CHUNK_fcTL = {
+    .byte1 = 102,
+    .byte2 = 99,
+    .byte3 = 84,
+    .byte4 = 76,
+};
+
+const struct ChunkType CHUNK_fdAT = {
+    .byte1 = 102,
+    .byte2 = 100,
+    .byte3 = 65,
+    .byte4 = 84,
+};
+
 bool IsValidChunkType(struct ChunkType type) {
   for (int i = 0; i < 4; ++i) {
     const uint8_t byte = type.byte_array[i];
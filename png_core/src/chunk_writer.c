@@ -0,0 +1,215 @@
+#include "png_core/chunk_writer.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include "tools.h"
+
+/* Amount of chunks passed to sink per call */
+#define PNG_WRITER_BATCH_CHUNKS 64
+
+/*
+ * Pieces of up to PNG_WRITER_BATCH_CHUNKS chunks and storage for their headers and CRCs
+ */
+struct ChunkWriterBatch {
+  struct PNGIOVec vecs[1 + 3 * PNG_WRITER_BATCH_CHUNKS];
+  int vecs_count;
+  uint8_t headers[PNG_WRITER_BATCH_CHUNKS][8];
+  uint8_t crcs[PNG_WRITER_BATCH_CHUNKS][4];
+  int chunks_count;
+};
+
+static void AddPiece(struct ChunkWriterBatch* batch, const void* base, size_t length) {
+  if (length == 0)
+    return;
+  batch->vecs[batch->vecs_count].base = base;
+  batch->vecs[batch->vecs_count].length = length;
+  ++batch->vecs_count;
+}
+
+static bool FlushBatch(struct ChunkWriterBatch* batch, PNGWriteSinkFunc sink, void* user_data) {
+  const bool ok = batch->vecs_count == 0 || sink(batch->vecs, batch->vecs_count, user_data);
+  batch->vecs_count = 0;
+  batch->chunks_count = 0;
+  return ok;
+}
+
+static bool IsSerializedChunk(const struct PNGRawChunk* chunk) {
+  return !chunk->raw_data && chunk->parsed_data;
+}
+
+static void FreeSerializedChunks(uint8_t** serialized, int count) {
+  for (int i = 0; i < count; ++i)
+    free(serialized[i]);
+  free(serialized);
+}
+
+/*
+ * @brief Serialize chunks without raw_data as whole chunks, before anything is passed to sink.
+ * Buffers are sized by size_func, so write_func is called once per chunk
+ * @param[out] out_serialized Array of serialized chunks in list order, NULL if there are none
+ * @return Amount of serialized chunks or -1 if allocation failed
+ */
+static int SerializeChunks(const struct PNGRawChunk* obj, uint8_t*** out_serialized) {
+  int count = 0;
+  for (const struct PNGRawChunk* chunk = obj; chunk; chunk = chunk->next)
+    count += IsSerializedChunk(chunk);
+  *out_serialized = NULL;
+  if (count == 0)
+    return 0;
+
+  uint8_t** serialized = malloc(sizeof(uint8_t*) * count);
+  if (!serialized)
+    return -1;
+  int index = 0;
+  for (const struct PNGRawChunk* chunk = obj; chunk; chunk = chunk->next) {
+    if (!IsSerializedChunk(chunk))
+      continue;
+    serialized[index] = malloc(PNGWriteRawChunk(chunk, NULL));
+    if (!serialized[index]) {
+      FreeSerializedChunks(serialized, index);
+      return -1;
+    }
+    PNGWriteRawChunk(chunk, serialized[index++]);
+  }
+  *out_serialized = serialized;
+  return count;
+}
+
+/*
+ * @param[in] serialized Chunk serialized by SerializeChunks, NULL if chunk is written from raw_data
+ * @return Chunk size in bytes
+ */
+static int64_t AddChunk(struct ChunkWriterBatch* batch, const struct PNGRawChunk* chunk, const uint8_t* serialized) {
+  if (serialized) {
+    const uint8_t* length = serialized;
+    const uint32_t data_size = ReadNetworkAndAdvanceUInt32(&length, true);
+    AddPiece(batch, serialized, 12 + (size_t)data_size);
+    ++batch->chunks_count;
+    return 12 + (int64_t)data_size;
+  }
+
+  const uint32_t data_size = chunk->raw_data ? chunk->raw_data_size_bytes : 0;
+  uint8_t* header = batch->headers[batch->chunks_count];
+  WriteNetworkAndAdvanceUInt32(&header, data_size);
+  WriteNetworkAndAdvanceBytes(&header, chunk->type.byte_array, 4);
+  uint8_t* crc = batch->crcs[batch->chunks_count];
+  WriteNetworkAndAdvanceUInt32(&crc, chunk->crc);
+
+  AddPiece(batch, batch->headers[batch->chunks_count], 8);
+  AddPiece(batch, chunk->raw_data, data_size);
+  AddPiece(batch, batch->crcs[batch->chunks_count], 4);
+  ++batch->chunks_count;
+
+  return 12 + (int64_t)data_size;
+}
+
+int64_t PNGWriteRawChunkListToSink(const struct PNGRawChunk* obj, bool write_png_signature, PNGWriteSinkFunc sink,
+                                   void* user_data) {
+  assert(sink);
+
+  /* All allocations are done before the first piece is written, so failed allocation writes nothing */
+  uint8_t** serialized = NULL;
+  const int serialized_count = SerializeChunks(obj, &serialized);
+  if (serialized_count < 0)
+    return -1;
+  struct ChunkWriterBatch* batch = malloc(sizeof(struct ChunkWriterBatch));
+  if (!batch) {
+    FreeSerializedChunks(serialized, serialized_count);
+    return -1;
+  }
+  batch->vecs_count = 0;
+  batch->chunks_count = 0;
+
+  int64_t total_size = 0;
+  if (write_png_signature) {
+    AddPiece(batch, s_png_signature, sizeof(s_png_signature));
+    total_size += sizeof(s_png_signature);
+  }
+
+  int serialized_index = 0;
+  bool ok = true;
+  for (; ok && obj; obj = obj->next) {
+    total_size += AddChunk(batch, obj, IsSerializedChunk(obj) ? serialized[serialized_index++] : NULL);
+    if (batch->chunks_count == PNG_WRITER_BATCH_CHUNKS)
+      ok = FlushBatch(batch, sink, user_data);
+  }
+  ok = ok && FlushBatch(batch, sink, user_data);
+
+  FreeSerializedChunks(serialized, serialized_count);
+  free(batch);
+  return ok ? total_size : -1;
+}
+
+bool PNGWriteIOVecsToFd(int fd, const struct PNGIOVec* vecs, int vecs_count) {
+#ifdef _WIN32
+  for (int i = 0; i < vecs_count; ++i) {
+    const uint8_t* ptr = vecs[i].base;
+    size_t left = vecs[i].length;
+    while (left > 0) {
+      const int written = _write(fd, ptr, left > INT_MAX ? INT_MAX : (unsigned int)left);
+      if (written < 0)
+        return false;
+      ptr += written;
+      left -= written;
+    }
+  }
+  return true;
+#else
+  struct iovec iov[64];
+  int next = 0;
+  size_t skip = 0;  // Already written bytes of vecs[next]
+  while (next < vecs_count) {
+    int iov_count = 0;
+    for (int i = next; i < vecs_count && iov_count < (int)(sizeof(iov) / sizeof(iov[0])); ++i) {
+      iov[iov_count].iov_base = (void*)((const uint8_t*)vecs[i].base + (i == next ? skip : 0));
+      iov[iov_count].iov_len = vecs[i].length - (i == next ? skip : 0);
+      ++iov_count;
+    }
+
+    ssize_t written = writev(fd, iov, iov_count);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+
+    /* Advance over fully and partially written pieces */
+    while (next < vecs_count && written > 0) {
+      const size_t left = vecs[next].length - skip;
+      if ((size_t)written < left) {
+        skip += written;
+        written = 0;
+      } else {
+        written -= left;
+        skip = 0;
+        ++next;
+      }
+    }
+    /* Skip empty pieces */
+    while (next < vecs_count && vecs[next].length == skip) {
+      skip = 0;
+      ++next;
+    }
+  }
+  return true;
+#endif
+}
+
+static bool FdSink(const struct PNGIOVec* vecs, int vecs_count, void* user_data) {
+  return PNGWriteIOVecsToFd(*(const int*)user_data, vecs, vecs_count);
+}
+
+int64_t PNGWriteRawChunkListToFd(const struct PNGRawChunk* obj, int fd, bool write_png_signature) {
+  return PNGWriteRawChunkListToSink(obj, write_png_signature, FdSink, &fd);
+}
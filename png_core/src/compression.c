@@ -3,6 +3,9 @@
 #include <stdlib.h>
 #include <zlib.h>
 
+#include "deflate.h"
+#include "inflate.h"
+
 // TODO: using data streams: Example: https://github.com/python/cpython/blob/main/Modules/zlibmodule.c#L422
 // and remove decompressed_size argument;
 uint8_t* PNGDataDecompress0(const uint8_t* compressed, int compressed_size, int decompressed_size) {
@@ -16,9 +19,55 @@ uint8_t* PNGDataDecompress0(const uint8_t* compressed, int compressed_size, int
   return decompressed;
 }
 
+uint8_t* PNGDataDecompress0Builtin(const uint8_t* compressed, int compressed_size, int decompressed_size) {
+  if (compressed_size < 0 || decompressed_size < 0)
+    return NULL;
+  uint8_t* decompressed = malloc(decompressed_size ? decompressed_size : 1);
+  if (decompressed && !InflateZlibStream(compressed, compressed_size, decompressed, decompressed_size, 0,
+                                         PNG_INFLATE_ENGINE_BUILTIN)) {
+    free(decompressed);
+    return NULL;
+  }
+  return decompressed;
+}
+
 PNGDataDecompressionFunction PNGGetDataDecompressionFunction(uint8_t compression_method) {
+  return PNGGetDataDecompressionFunctionWithEngine(compression_method, PNG_INFLATE_ENGINE_ZLIB);
+}
+
+PNGDataDecompressionFunction PNGGetDataDecompressionFunctionWithEngine(uint8_t compression_method,
+                                                                      enum PNGInflateEngine engine) {
+  if (compression_method != PNG_COMPRESSION_METHOD_0)
+    return NULL;
+  switch (engine) {
+    case PNG_INFLATE_ENGINE_ZLIB: return PNGDataDecompress0;
+    case PNG_INFLATE_ENGINE_BUILTIN: return PNGDataDecompress0Builtin;
+    default: return NULL;
+  }
+}
+
+void PNGInitCompressionParams(struct PNGCompressionParams* obj) {
+  obj->level = 6;
+  obj->strategy = PNG_COMPRESSION_STRATEGY_DEFAULT;
+  obj->window_bits = 15;
+  obj->mem_level = 8;
+}
+
+uint8_t* PNGDataCompress0(const uint8_t* data, int data_size, int level, int* compressed_size) {
+  struct PNGCompressionParams params;
+  PNGInitCompressionParams(&params);
+  params.level = level;
+  return PNGDataCompress0WithParams(data, data_size, &params, compressed_size);
+}
+
+uint8_t* PNGDataCompress0WithParams(const uint8_t* data, int data_size, const struct PNGCompressionParams* params,
+                                    int* compressed_size) {
+  return DeflateZlibStream(data, data_size, params, NULL, compressed_size, NULL);
+}
+
+PNGDataCompressionFunction PNGGetDataCompressionFunction(uint8_t compression_method) {
   switch (compression_method) {
-    case PNG_COMPRESSION_METHOD_0: return PNGDataDecompress0;
+    case PNG_COMPRESSION_METHOD_0: return PNGDataCompress0;
     default: return NULL;
   }
 }
@@ -0,0 +1,1362 @@
+#include "conversion.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#define PNG_CONVERSION_SSE2 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#define PNG_CONVERSION_NEON 1
+#include <arm_neon.h>
+#endif
+
+#include "stats_recorder.h"
+
+/*
+ * Scalar kernels. Also used for tails of SIMD kernels
+ */
+
+static void Narrow16Scalar(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  (void)obj;
+  for (int i = 0; i < count; ++i)
+    dst[i] = Narrow16To8(((uint32_t)src[2 * i] << 8) | src[2 * i + 1]);
+}
+
+static void Swap16Scalar(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  (void)obj;
+  uint16_t* out = (uint16_t*)dst;
+  for (int i = 0; i < count; ++i)
+    out[i] = (uint16_t)(((uint32_t)src[2 * i] << 8) | src[2 * i + 1]);
+}
+
+static void UnpackSubByte(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  const int per_byte = 8 / obj->bit_depth;
+  const int full_bytes = count / per_byte;
+  /* Constant sizes let memcpy compile into single stores */
+  switch (per_byte) {
+    case 8:
+      for (int i = 0; i < full_bytes; ++i)
+        memcpy(dst + 8 * i, obj->sub_byte_lut[src[i]], 8);
+      break;
+    case 4:
+      for (int i = 0; i < full_bytes; ++i)
+        memcpy(dst + 4 * i, obj->sub_byte_lut[src[i]], 4);
+      break;
+    case 2:
+      for (int i = 0; i < full_bytes; ++i)
+        memcpy(dst + 2 * i, obj->sub_byte_lut[src[i]], 2);
+      break;
+    default: assert(false);
+  }
+  const int rest = count - full_bytes * per_byte;
+  if (rest > 0)
+    memcpy(dst + full_bytes * per_byte, obj->sub_byte_lut[src[full_bytes]], rest);
+}
+
+static void GToRGBAScalar(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  (void)obj;
+  for (int i = 0; i < count; ++i) {
+    dst[4 * i] = dst[4 * i + 1] = dst[4 * i + 2] = src[i];
+    dst[4 * i + 3] = 0xFF;
+  }
+}
+
+static void GAToRGBAScalar(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  (void)obj;
+  for (int i = 0; i < count; ++i) {
+    dst[4 * i] = dst[4 * i + 1] = dst[4 * i + 2] = src[2 * i];
+    dst[4 * i + 3] = src[2 * i + 1];
+  }
+}
+
+static void RGBToRGBAScalar(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  (void)obj;
+  for (int i = 0; i < count; ++i) {
+    dst[4 * i] = src[3 * i];
+    dst[4 * i + 1] = src[3 * i + 1];
+    dst[4 * i + 2] = src[3 * i + 2];
+    dst[4 * i + 3] = 0xFF;
+  }
+}
+
+static void RGBToBGRAScalar(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  (void)obj;
+  for (int i = 0; i < count; ++i) {
+    dst[4 * i] = src[3 * i + 2];
+    dst[4 * i + 1] = src[3 * i + 1];
+    dst[4 * i + 2] = src[3 * i];
+    dst[4 * i + 3] = 0xFF;
+  }
+}
+
+static void RGBAToBGRAScalar(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  (void)obj;
+  for (int i = 0; i < count; ++i) {
+    const uint8_t r = src[4 * i];
+    dst[4 * i] = src[4 * i + 2];
+    dst[4 * i + 1] = src[4 * i + 1];
+    dst[4 * i + 2] = r;
+    dst[4 * i + 3] = src[4 * i + 3];
+  }
+}
+
+static void RGBAToRGBScalar(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  (void)obj;
+  for (int i = 0; i < count; ++i) {
+    dst[3 * i] = src[4 * i];
+    dst[3 * i + 1] = src[4 * i + 1];
+    dst[3 * i + 2] = src[4 * i + 2];
+  }
+}
+
+static void GToRGB(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  (void)obj;
+  for (int i = 0; i < count; ++i)
+    dst[3 * i] = dst[3 * i + 1] = dst[3 * i + 2] = src[i];
+}
+
+static void GAToRGB(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  (void)obj;
+  for (int i = 0; i < count; ++i)
+    dst[3 * i] = dst[3 * i + 1] = dst[3 * i + 2] = src[2 * i];
+}
+
+static void GAToGScalar(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  (void)obj;
+  for (int i = 0; i < count; ++i)
+    dst[i] = src[2 * i];
+}
+
+static void RGBToG(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  (void)obj;
+  for (int i = 0; i < count; ++i)
+    dst[i] = Luminance8(src[3 * i], src[3 * i + 1], src[3 * i + 2]);
+}
+
+static void RGBAToG(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  (void)obj;
+  for (int i = 0; i < count; ++i)
+    dst[i] = Luminance8(src[4 * i], src[4 * i + 1], src[4 * i + 2]);
+}
+
+static void LookupRGBA(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  for (int i = 0; i < count; ++i)
+    memcpy(dst + 4 * i, obj->lut32[src[i]], 4);
+}
+
+static void LookupRGB(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  for (int i = 0; i < count; ++i)
+    memcpy(dst + 3 * i, obj->lut32[src[i]], 3);
+}
+
+static void LookupG(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  for (int i = 0; i < count; ++i)
+    dst[i] = obj->lut8[src[i]];
+}
+
+/* Duplicating the byte gives v * 257 in any byte order */
+static void Widen8To16Scalar(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  (void)obj;
+  for (int i = 0; i < count; ++i)
+    dst[2 * i] = dst[2 * i + 1] = src[i];
+}
+
+/*
+ * Big-endian 16-bit samples to native 16-bit formats. Byte swap is done in the same pass
+ */
+
+static inline uint16_t LoadBE16(const uint8_t* src) {
+  return (uint16_t)((src[0] << 8) | src[1]);
+}
+
+static void G16ToRGBA16Scalar(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  (void)obj;
+  uint16_t* out = (uint16_t*)dst;
+  for (int i = 0; i < count; ++i) {
+    out[4 * i] = out[4 * i + 1] = out[4 * i + 2] = LoadBE16(src + 2 * i);
+    out[4 * i + 3] = 0xFFFF;
+  }
+}
+
+static void GA16ToRGBA16Scalar(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  (void)obj;
+  uint16_t* out = (uint16_t*)dst;
+  for (int i = 0; i < count; ++i) {
+    out[4 * i] = out[4 * i + 1] = out[4 * i + 2] = LoadBE16(src + 4 * i);
+    out[4 * i + 3] = LoadBE16(src + 4 * i + 2);
+  }
+}
+
+static void RGB16ToRGBA16Scalar(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  (void)obj;
+  uint16_t* out = (uint16_t*)dst;
+  for (int i = 0; i < count; ++i) {
+    out[4 * i] = LoadBE16(src + 6 * i);
+    out[4 * i + 1] = LoadBE16(src + 6 * i + 2);
+    out[4 * i + 2] = LoadBE16(src + 6 * i + 4);
+    out[4 * i + 3] = 0xFFFF;
+  }
+}
+
+static void G16ToRGB16(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  (void)obj;
+  uint16_t* out = (uint16_t*)dst;
+  for (int i = 0; i < count; ++i)
+    out[3 * i] = out[3 * i + 1] = out[3 * i + 2] = LoadBE16(src + 2 * i);
+}
+
+static void GA16ToRGB16(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  (void)obj;
+  uint16_t* out = (uint16_t*)dst;
+  for (int i = 0; i < count; ++i)
+    out[3 * i] = out[3 * i + 1] = out[3 * i + 2] = LoadBE16(src + 4 * i);
+}
+
+static void RGBA16ToRGB16Scalar(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  (void)obj;
+  uint16_t* out = (uint16_t*)dst;
+  for (int i = 0; i < count; ++i) {
+    out[3 * i] = LoadBE16(src + 8 * i);
+    out[3 * i + 1] = LoadBE16(src + 8 * i + 2);
+    out[3 * i + 2] = LoadBE16(src + 8 * i + 4);
+  }
+}
+
+static void GA16ToG16Scalar(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  (void)obj;
+  uint16_t* out = (uint16_t*)dst;
+  for (int i = 0; i < count; ++i)
+    out[i] = LoadBE16(src + 4 * i);
+}
+
+static void RGB16ToG16(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  (void)obj;
+  uint16_t* out = (uint16_t*)dst;
+  for (int i = 0; i < count; ++i)
+    out[i] = Luminance16(LoadBE16(src + 6 * i), LoadBE16(src + 6 * i + 2), LoadBE16(src + 6 * i + 4));
+}
+
+static void RGBA16ToG16(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  (void)obj;
+  uint16_t* out = (uint16_t*)dst;
+  for (int i = 0; i < count; ++i)
+    out[i] = Luminance16(LoadBE16(src + 8 * i), LoadBE16(src + 8 * i + 2), LoadBE16(src + 8 * i + 4));
+}
+
+/*
+ * Premultiplication of output pixels. Kernels work in place, opaque pixels are skipped
+ */
+
+static void Premultiply8Scalar(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  (void)obj;
+  for (int i = 0; i < count; ++i) {
+    const uint8_t a = src[4 * i + 3];
+    if (a == 0xFF)
+      continue;
+    dst[4 * i] = Premultiply8(src[4 * i], a);
+    dst[4 * i + 1] = Premultiply8(src[4 * i + 1], a);
+    dst[4 * i + 2] = Premultiply8(src[4 * i + 2], a);
+  }
+}
+
+static void Premultiply16Scalar(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  (void)obj;
+  const uint16_t* in = (const uint16_t*)src;
+  uint16_t* out = (uint16_t*)dst;
+  for (int i = 0; i < count; ++i) {
+    const uint16_t a = in[4 * i + 3];
+    if (a == 0xFFFF)
+      continue;
+    out[4 * i] = Premultiply16(in[4 * i], a);
+    out[4 * i + 1] = Premultiply16(in[4 * i + 1], a);
+    out[4 * i + 2] = Premultiply16(in[4 * i + 2], a);
+  }
+}
+
+/*
+ * Flattening of RGBA rows onto background. Blending works in place, alpha of blended pixels is left undefined
+ */
+
+static void Blend8Scalar(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  for (int i = 0; i < count; ++i) {
+    const uint8_t a = src[4 * i + 3];
+    if (a == 0xFF)
+      continue;
+    dst[4 * i] = Blend8(src[4 * i], obj->background[0], a);
+    dst[4 * i + 1] = Blend8(src[4 * i + 1], obj->background[1], a);
+    dst[4 * i + 2] = Blend8(src[4 * i + 2], obj->background[2], a);
+  }
+}
+
+static void Blend16Scalar(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  const uint16_t* in = (const uint16_t*)src;
+  uint16_t* out = (uint16_t*)dst;
+  for (int i = 0; i < count; ++i) {
+    const uint16_t a = in[4 * i + 3];
+    if (a == 0xFFFF)
+      continue;
+    out[4 * i] = Blend16(in[4 * i], obj->background[0], a);
+    out[4 * i + 1] = Blend16(in[4 * i + 1], obj->background[1], a);
+    out[4 * i + 2] = Blend16(in[4 * i + 2], obj->background[2], a);
+  }
+}
+
+/* Native RGBA16 to native formats without alpha */
+static void NativeRGBA16ToRGB16(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  (void)obj;
+  const uint16_t* in = (const uint16_t*)src;
+  uint16_t* out = (uint16_t*)dst;
+  for (int i = 0; i < count; ++i) {
+    out[3 * i] = in[4 * i];
+    out[3 * i + 1] = in[4 * i + 1];
+    out[3 * i + 2] = in[4 * i + 2];
+  }
+}
+
+static void NativeRGBA16ToG16(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  (void)obj;
+  const uint16_t* in = (const uint16_t*)src;
+  uint16_t* out = (uint16_t*)dst;
+  for (int i = 0; i < count; ++i)
+    out[i] = Luminance16(in[4 * i], in[4 * i + 1], in[4 * i + 2]);
+}
+
+#ifdef PNG_CONVERSION_SSE2
+
+/* Big-endian 16-bit lanes to native (x86 is little endian) */
+static inline __m128i Swap16Lanes(__m128i v) {
+  return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+/* round(v * 255 / 65535) == ((v * 0xFF01 >> 16) + 128) >> 8 for all 16-bit v */
+static inline __m128i Narrow16Lanes(__m128i v) {
+  const __m128i factor = _mm_set1_epi16((short)0xFF01);
+  const __m128i half = _mm_set1_epi16(128);
+  return _mm_srli_epi16(_mm_add_epi16(_mm_mulhi_epu16(v, factor), half), 8);
+}
+
+static void Narrow16SSE2(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  int i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const __m128i lo = Narrow16Lanes(Swap16Lanes(_mm_loadu_si128((const __m128i*)(src + 2 * i))));
+    const __m128i hi = Narrow16Lanes(Swap16Lanes(_mm_loadu_si128((const __m128i*)(src + 2 * i + 16))));
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+  }
+  Narrow16Scalar(obj, src + 2 * i, dst + i, count - i);
+}
+
+static void Swap16SSE2(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  int i = 0;
+  for (; i + 8 <= count; i += 8)
+    _mm_storeu_si128((__m128i*)(dst + 2 * i), Swap16Lanes(_mm_loadu_si128((const __m128i*)(src + 2 * i))));
+  Swap16Scalar(obj, src + 2 * i, dst + 2 * i, count - i);
+}
+
+static void G16ToRGBA16SSE2(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  const __m128i opaque = _mm_set1_epi16(-1);
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m128i g = Swap16Lanes(_mm_loadu_si128((const __m128i*)(src + 2 * i)));
+    const __m128i gg_lo = _mm_unpacklo_epi16(g, g);
+    const __m128i gg_hi = _mm_unpackhi_epi16(g, g);
+    const __m128i ga_lo = _mm_unpacklo_epi16(g, opaque);
+    const __m128i ga_hi = _mm_unpackhi_epi16(g, opaque);
+    _mm_storeu_si128((__m128i*)(dst + 8 * i), _mm_unpacklo_epi32(gg_lo, ga_lo));
+    _mm_storeu_si128((__m128i*)(dst + 8 * i + 16), _mm_unpackhi_epi32(gg_lo, ga_lo));
+    _mm_storeu_si128((__m128i*)(dst + 8 * i + 32), _mm_unpacklo_epi32(gg_hi, ga_hi));
+    _mm_storeu_si128((__m128i*)(dst + 8 * i + 48), _mm_unpackhi_epi32(gg_hi, ga_hi));
+  }
+  G16ToRGBA16Scalar(obj, src + 2 * i, dst + 8 * i, count - i);
+}
+
+static void GToRGBASSE2(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  const __m128i opaque = _mm_set1_epi8((char)0xFF);
+  int i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const __m128i g = _mm_loadu_si128((const __m128i*)(src + i));
+    const __m128i gg_lo = _mm_unpacklo_epi8(g, g);
+    const __m128i gg_hi = _mm_unpackhi_epi8(g, g);
+    const __m128i ga_lo = _mm_unpacklo_epi8(g, opaque);
+    const __m128i ga_hi = _mm_unpackhi_epi8(g, opaque);
+    _mm_storeu_si128((__m128i*)(dst + 4 * i), _mm_unpacklo_epi16(gg_lo, ga_lo));
+    _mm_storeu_si128((__m128i*)(dst + 4 * i + 16), _mm_unpackhi_epi16(gg_lo, ga_lo));
+    _mm_storeu_si128((__m128i*)(dst + 4 * i + 32), _mm_unpacklo_epi16(gg_hi, ga_hi));
+    _mm_storeu_si128((__m128i*)(dst + 4 * i + 48), _mm_unpackhi_epi16(gg_hi, ga_hi));
+  }
+  GToRGBAScalar(obj, src + i, dst + 4 * i, count - i);
+}
+
+static void GAToRGBASSE2(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  const __m128i low_bytes = _mm_set1_epi16(0x00FF);
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m128i ga = _mm_loadu_si128((const __m128i*)(src + 2 * i));
+    const __m128i g = _mm_and_si128(ga, low_bytes);
+    const __m128i gg = _mm_or_si128(g, _mm_slli_epi16(g, 8));
+    _mm_storeu_si128((__m128i*)(dst + 4 * i), _mm_unpacklo_epi16(gg, ga));
+    _mm_storeu_si128((__m128i*)(dst + 4 * i + 16), _mm_unpackhi_epi16(gg, ga));
+  }
+  GAToRGBAScalar(obj, src + 2 * i, dst + 4 * i, count - i);
+}
+
+static void GAToGSSE2(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  const __m128i low_bytes = _mm_set1_epi16(0x00FF);
+  int i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const __m128i lo = _mm_and_si128(_mm_loadu_si128((const __m128i*)(src + 2 * i)), low_bytes);
+    const __m128i hi = _mm_and_si128(_mm_loadu_si128((const __m128i*)(src + 2 * i + 16)), low_bytes);
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+  }
+  GAToGScalar(obj, src + 2 * i, dst + i, count - i);
+}
+
+static void RGBAToBGRASSE2(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  const __m128i ga_mask = _mm_set1_epi32((int)0xFF00FF00);
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const __m128i v = _mm_loadu_si128((const __m128i*)(src + 4 * i));
+    const __m128i ga = _mm_and_si128(v, ga_mask);
+    const __m128i rb = _mm_andnot_si128(ga_mask, v);
+    const __m128i br = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+    _mm_storeu_si128((__m128i*)(dst + 4 * i), _mm_or_si128(ga, br));
+  }
+  RGBAToBGRAScalar(obj, src + 4 * i, dst + 4 * i, count - i);
+}
+
+static void Widen8To16SSE2(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  int i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+    _mm_storeu_si128((__m128i*)(dst + 2 * i), _mm_unpacklo_epi8(v, v));
+    _mm_storeu_si128((__m128i*)(dst + 2 * i + 16), _mm_unpackhi_epi8(v, v));
+  }
+  Widen8To16Scalar(obj, src + i, dst + 2 * i, count - i);
+}
+
+/*
+ * SSSE3 kernels are compiled for the target explicitly and selected at runtime
+ */
+
+__attribute__((target("ssse3"))) static void RGBToRGBASSSE3(const struct RowConverter* obj, const uint8_t* src,
+                                                            uint8_t* dst, int count) {
+  const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+  const __m128i opaque = _mm_set1_epi32((int)0xFF000000);
+  int i = 0;
+  /* 16 bytes are loaded for 4 pixels, so 6 pixels should be left */
+  for (; i + 6 <= count; i += 4) {
+    const __m128i v = _mm_loadu_si128((const __m128i*)(src + 3 * i));
+    _mm_storeu_si128((__m128i*)(dst + 4 * i), _mm_or_si128(_mm_shuffle_epi8(v, shuffle), opaque));
+  }
+  RGBToRGBAScalar(obj, src + 3 * i, dst + 4 * i, count - i);
+}
+
+__attribute__((target("ssse3"))) static void RGBToBGRASSSE3(const struct RowConverter* obj, const uint8_t* src,
+                                                            uint8_t* dst, int count) {
+  const __m128i shuffle = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+  const __m128i opaque = _mm_set1_epi32((int)0xFF000000);
+  int i = 0;
+  for (; i + 6 <= count; i += 4) {
+    const __m128i v = _mm_loadu_si128((const __m128i*)(src + 3 * i));
+    _mm_storeu_si128((__m128i*)(dst + 4 * i), _mm_or_si128(_mm_shuffle_epi8(v, shuffle), opaque));
+  }
+  RGBToBGRAScalar(obj, src + 3 * i, dst + 4 * i, count - i);
+}
+
+__attribute__((target("ssse3"))) static void RGBAToRGBSSSE3(const struct RowConverter* obj, const uint8_t* src,
+                                                            uint8_t* dst, int count) {
+  const __m128i shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+  int i = 0;
+  /* 16 bytes are stored for 4 pixels, so 6 pixels should be left */
+  for (; i + 6 <= count; i += 4) {
+    const __m128i v = _mm_loadu_si128((const __m128i*)(src + 4 * i));
+    _mm_storeu_si128((__m128i*)(dst + 3 * i), _mm_shuffle_epi8(v, shuffle));
+  }
+  RGBAToRGBScalar(obj, src + 4 * i, dst + 3 * i, count - i);
+}
+
+/*
+ * Byte swap of big-endian samples folded into the channel shuffle
+ */
+
+__attribute__((target("ssse3"))) static void Swap16SSSE3(const struct RowConverter* obj, const uint8_t* src,
+                                                         uint8_t* dst, int count) {
+  const __m128i shuffle = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+  int i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const __m128i lo = _mm_loadu_si128((const __m128i*)(src + 2 * i));
+    const __m128i hi = _mm_loadu_si128((const __m128i*)(src + 2 * i + 16));
+    _mm_storeu_si128((__m128i*)(dst + 2 * i), _mm_shuffle_epi8(lo, shuffle));
+    _mm_storeu_si128((__m128i*)(dst + 2 * i + 16), _mm_shuffle_epi8(hi, shuffle));
+  }
+  Swap16Scalar(obj, src + 2 * i, dst + 2 * i, count - i);
+}
+
+__attribute__((target("ssse3"))) static void GA16ToRGBA16SSSE3(const struct RowConverter* obj, const uint8_t* src,
+                                                               uint8_t* dst, int count) {
+  const __m128i shuffle_lo = _mm_setr_epi8(1, 0, 1, 0, 1, 0, 3, 2, 5, 4, 5, 4, 5, 4, 7, 6);
+  const __m128i shuffle_hi = _mm_setr_epi8(9, 8, 9, 8, 9, 8, 11, 10, 13, 12, 13, 12, 13, 12, 15, 14);
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const __m128i v = _mm_loadu_si128((const __m128i*)(src + 4 * i));
+    _mm_storeu_si128((__m128i*)(dst + 8 * i), _mm_shuffle_epi8(v, shuffle_lo));
+    _mm_storeu_si128((__m128i*)(dst + 8 * i + 16), _mm_shuffle_epi8(v, shuffle_hi));
+  }
+  GA16ToRGBA16Scalar(obj, src + 4 * i, dst + 8 * i, count - i);
+}
+
+__attribute__((target("ssse3"))) static void RGB16ToRGBA16SSSE3(const struct RowConverter* obj, const uint8_t* src,
+                                                                uint8_t* dst, int count) {
+  const __m128i shuffle = _mm_setr_epi8(1, 0, 3, 2, 5, 4, -1, -1, 7, 6, 9, 8, 11, 10, -1, -1);
+  const __m128i opaque = _mm_setr_epi16(0, 0, 0, -1, 0, 0, 0, -1);
+  int i = 0;
+  /* 16 bytes are loaded for 2 pixels, so 3 pixels should be left */
+  for (; i + 3 <= count; i += 2) {
+    const __m128i v = _mm_loadu_si128((const __m128i*)(src + 6 * i));
+    _mm_storeu_si128((__m128i*)(dst + 8 * i), _mm_or_si128(_mm_shuffle_epi8(v, shuffle), opaque));
+  }
+  RGB16ToRGBA16Scalar(obj, src + 6 * i, dst + 8 * i, count - i);
+}
+
+__attribute__((target("ssse3"))) static void RGBA16ToRGB16SSSE3(const struct RowConverter* obj, const uint8_t* src,
+                                                                uint8_t* dst, int count) {
+  const __m128i shuffle = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 9, 8, 11, 10, 13, 12, -1, -1, -1, -1);
+  int i = 0;
+  /* 16 bytes are stored for 2 pixels, so 3 pixels should be left */
+  for (; i + 3 <= count; i += 2) {
+    const __m128i v = _mm_loadu_si128((const __m128i*)(src + 8 * i));
+    _mm_storeu_si128((__m128i*)(dst + 6 * i), _mm_shuffle_epi8(v, shuffle));
+  }
+  RGBA16ToRGB16Scalar(obj, src + 8 * i, dst + 6 * i, count - i);
+}
+
+__attribute__((target("ssse3"))) static void GA16ToG16SSSE3(const struct RowConverter* obj, const uint8_t* src,
+                                                            uint8_t* dst, int count) {
+  const __m128i shuffle = _mm_setr_epi8(1, 0, 5, 4, 9, 8, 13, 12, -1, -1, -1, -1, -1, -1, -1, -1);
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m128i lo = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + 4 * i)), shuffle);
+    const __m128i hi = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + 4 * i + 16)), shuffle);
+    _mm_storeu_si128((__m128i*)(dst + 2 * i), _mm_unpacklo_epi64(lo, hi));
+  }
+  GA16ToG16Scalar(obj, src + 4 * i, dst + 2 * i, count - i);
+}
+
+/*
+ * Up to 16 palette entries: every channel is a single byte shuffle of its plane
+ */
+__attribute__((target("ssse3"))) static void LookupRGBASmallSSSE3(const struct RowConverter* obj, const uint8_t* src,
+                                                                  uint8_t* dst, int count) {
+  const __m128i r_plane = _mm_loadu_si128((const __m128i*)obj->lut_planes[0]);
+  const __m128i g_plane = _mm_loadu_si128((const __m128i*)obj->lut_planes[1]);
+  const __m128i b_plane = _mm_loadu_si128((const __m128i*)obj->lut_planes[2]);
+  const __m128i a_plane = _mm_loadu_si128((const __m128i*)obj->lut_planes[3]);
+  int i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const __m128i indices = _mm_loadu_si128((const __m128i*)(src + i));
+    const __m128i r = _mm_shuffle_epi8(r_plane, indices);
+    const __m128i g = _mm_shuffle_epi8(g_plane, indices);
+    const __m128i b = _mm_shuffle_epi8(b_plane, indices);
+    const __m128i a = _mm_shuffle_epi8(a_plane, indices);
+    const __m128i rg_lo = _mm_unpacklo_epi8(r, g);
+    const __m128i rg_hi = _mm_unpackhi_epi8(r, g);
+    const __m128i ba_lo = _mm_unpacklo_epi8(b, a);
+    const __m128i ba_hi = _mm_unpackhi_epi8(b, a);
+    _mm_storeu_si128((__m128i*)(dst + 4 * i), _mm_unpacklo_epi16(rg_lo, ba_lo));
+    _mm_storeu_si128((__m128i*)(dst + 4 * i + 16), _mm_unpackhi_epi16(rg_lo, ba_lo));
+    _mm_storeu_si128((__m128i*)(dst + 4 * i + 32), _mm_unpacklo_epi16(rg_hi, ba_hi));
+    _mm_storeu_si128((__m128i*)(dst + 4 * i + 48), _mm_unpackhi_epi16(rg_hi, ba_hi));
+  }
+  LookupRGBA(obj, src + i, dst + 4 * i, count - i);
+}
+
+/*
+ * Full palette: 8 entries per gather
+ */
+__attribute__((target("avx2"))) static void LookupRGBAAVX2(const struct RowConverter* obj, const uint8_t* src,
+                                                           uint8_t* dst, int count) {
+  const int* table = (const int*)obj->lut32;
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m256i indices = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i)));
+    _mm256_storeu_si256((__m256i*)(dst + 4 * i), _mm256_i32gather_epi32(table, indices, 4));
+  }
+  LookupRGBA(obj, src + i, dst + 4 * i, count - i);
+}
+
+/* Two RGBA pixels in 16-bit lanes. Alpha lanes are multiplied by 255, which keeps them as is */
+static inline __m128i Premultiply8Lanes(__m128i v) {
+  const __m128i alpha_factor = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+  const __m128i color_lanes = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+  const __m128i half = _mm_set1_epi16(128);
+  const __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+  const __m128i t = _mm_add_epi16(_mm_mullo_epi16(v, _mm_or_si128(_mm_and_si128(a, color_lanes), alpha_factor)), half);
+  return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+static void Premultiply8SSE2(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  const __m128i alpha_mask = _mm_set1_epi32((int)0xFF000000);
+  const __m128i zero = _mm_setzero_si128();
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const __m128i v = _mm_loadu_si128((const __m128i*)(src + 4 * i));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(v, alpha_mask), alpha_mask)) == 0xFFFF)
+      continue;
+    const __m128i lo = Premultiply8Lanes(_mm_unpacklo_epi8(v, zero));
+    const __m128i hi = Premultiply8Lanes(_mm_unpackhi_epi8(v, zero));
+    _mm_storeu_si128((__m128i*)(dst + 4 * i), _mm_packus_epi16(lo, hi));
+  }
+  Premultiply8Scalar(obj, src + 4 * i, dst + 4 * i, count - i);
+}
+
+/*
+ * round(p / 65535) of 32-bit products with rounding bias, sign-extended from 16 bits for signed packing
+ */
+static inline __m128i DivideBy65535Lanes(__m128i t) {
+  return _mm_srai_epi32(_mm_add_epi32(t, _mm_srli_epi32(t, 16)), 16);
+}
+
+static void Premultiply16SSE2(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  const __m128i alpha_lanes = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+  const __m128i opaque = _mm_set1_epi16(-1);
+  const __m128i half = _mm_set1_epi32(32768);
+  int i = 0;
+  for (; i + 2 <= count; i += 2) {
+    const __m128i v = _mm_loadu_si128((const __m128i*)(src + 8 * i));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_or_si128(v, _mm_andnot_si128(alpha_lanes, opaque)), opaque)) == 0xFFFF)
+      continue;
+    /* Alpha lanes are multiplied by 65535 */
+    const __m128i a = _mm_or_si128(
+        _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3)), alpha_lanes);
+    const __m128i product_lo = _mm_mullo_epi16(v, a);
+    const __m128i product_hi = _mm_mulhi_epu16(v, a);
+    const __m128i first = DivideBy65535Lanes(_mm_add_epi32(_mm_unpacklo_epi16(product_lo, product_hi), half));
+    const __m128i second = DivideBy65535Lanes(_mm_add_epi32(_mm_unpackhi_epi16(product_lo, product_hi), half));
+    _mm_storeu_si128((__m128i*)(dst + 8 * i), _mm_packs_epi32(first, second));
+  }
+  Premultiply16Scalar(obj, src + 8 * i, dst + 8 * i, count - i);
+}
+
+static void Blend8SSE2(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  const __m128i alpha_mask = _mm_set1_epi32((int)0xFF000000);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i half = _mm_set1_epi16(128);
+  const __m128i opaque = _mm_set1_epi16(255);
+  const __m128i background = _mm_set_epi16(0, (short)obj->background[2], (short)obj->background[1],
+                                           (short)obj->background[0], 0, (short)obj->background[2],
+                                           (short)obj->background[1], (short)obj->background[0]);
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const __m128i v = _mm_loadu_si128((const __m128i*)(src + 4 * i));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(v, alpha_mask), alpha_mask)) == 0xFFFF)
+      continue;
+    __m128i halves[2] = {_mm_unpacklo_epi8(v, zero), _mm_unpackhi_epi8(v, zero)};
+    for (int h = 0; h < 2; ++h) {
+      const __m128i a =
+          _mm_shufflehi_epi16(_mm_shufflelo_epi16(halves[h], _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+      const __m128i t = _mm_add_epi16(
+          _mm_add_epi16(_mm_mullo_epi16(halves[h], a), _mm_mullo_epi16(background, _mm_sub_epi16(opaque, a))), half);
+      halves[h] = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+    }
+    _mm_storeu_si128((__m128i*)(dst + 4 * i), _mm_packus_epi16(halves[0], halves[1]));
+  }
+  Blend8Scalar(obj, src + 4 * i, dst + 4 * i, count - i);
+}
+
+static void Blend16SSE2(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  const __m128i alpha_lanes = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+  const __m128i opaque = _mm_set1_epi16(-1);
+  const __m128i half = _mm_set1_epi32(32768);
+  const __m128i background = _mm_set_epi16(0, (short)obj->background[2], (short)obj->background[1],
+                                           (short)obj->background[0], 0, (short)obj->background[2],
+                                           (short)obj->background[1], (short)obj->background[0]);
+  int i = 0;
+  for (; i + 2 <= count; i += 2) {
+    const __m128i v = _mm_loadu_si128((const __m128i*)(src + 8 * i));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_or_si128(v, _mm_andnot_si128(alpha_lanes, opaque)), opaque)) == 0xFFFF)
+      continue;
+    const __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    const __m128i inverse = _mm_sub_epi16(opaque, a);
+    const __m128i color_lo = _mm_mullo_epi16(v, a);
+    const __m128i color_hi = _mm_mulhi_epu16(v, a);
+    const __m128i background_lo = _mm_mullo_epi16(background, inverse);
+    const __m128i background_hi = _mm_mulhi_epu16(background, inverse);
+    const __m128i first = _mm_add_epi32(_mm_add_epi32(_mm_unpacklo_epi16(color_lo, color_hi), half),
+                                        _mm_unpacklo_epi16(background_lo, background_hi));
+    const __m128i second = _mm_add_epi32(_mm_add_epi32(_mm_unpackhi_epi16(color_lo, color_hi), half),
+                                         _mm_unpackhi_epi16(background_lo, background_hi));
+    _mm_storeu_si128((__m128i*)(dst + 8 * i), _mm_packs_epi32(DivideBy65535Lanes(first), DivideBy65535Lanes(second)));
+  }
+  Blend16Scalar(obj, src + 8 * i, dst + 8 * i, count - i);
+}
+
+static bool HasSSSE3(void) {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("ssse3");
+}
+
+static bool HasAVX2(void) {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+
+#endif  // PNG_CONVERSION_SSE2
+
+#ifdef PNG_CONVERSION_NEON
+
+static void Narrow16NEON(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  const uint16x4_t factor = vdup_n_u16(0xFF01);
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const uint16x8_t v = vreinterpretq_u16_u8(vrev16q_u8(vld1q_u8(src + 2 * i)));
+    const uint16x8_t high = vcombine_u16(vshrn_n_u32(vmull_u16(vget_low_u16(v), factor), 16),
+                                         vshrn_n_u32(vmull_u16(vget_high_u16(v), factor), 16));
+    vst1_u8(dst + i, vrshrn_n_u16(high, 8));
+  }
+  Narrow16Scalar(obj, src + 2 * i, dst + i, count - i);
+}
+
+static void Swap16NEON(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  int i = 0;
+  for (; i + 8 <= count; i += 8)
+    vst1q_u8(dst + 2 * i, vrev16q_u8(vld1q_u8(src + 2 * i)));
+  Swap16Scalar(obj, src + 2 * i, dst + 2 * i, count - i);
+}
+
+static void G16ToRGBA16NEON(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const uint16x8_t g = vreinterpretq_u16_u8(vrev16q_u8(vld1q_u8(src + 2 * i)));
+    const uint16x8x4_t rgba = {{g, g, g, vdupq_n_u16(0xFFFF)}};
+    vst4q_u16((uint16_t*)(dst + 8 * i), rgba);
+  }
+  G16ToRGBA16Scalar(obj, src + 2 * i, dst + 8 * i, count - i);
+}
+
+static void RGB16ToRGBA16NEON(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const uint16x8x3_t rgb = vld3q_u16((const uint16_t*)(src + 6 * i));
+    const uint16x8x4_t rgba = {{vreinterpretq_u16_u8(vrev16q_u8(vreinterpretq_u8_u16(rgb.val[0]))),
+                                vreinterpretq_u16_u8(vrev16q_u8(vreinterpretq_u8_u16(rgb.val[1]))),
+                                vreinterpretq_u16_u8(vrev16q_u8(vreinterpretq_u8_u16(rgb.val[2]))),
+                                vdupq_n_u16(0xFFFF)}};
+    vst4q_u16((uint16_t*)(dst + 8 * i), rgba);
+  }
+  RGB16ToRGBA16Scalar(obj, src + 6 * i, dst + 8 * i, count - i);
+}
+
+static void GToRGBANEON(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  int i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const uint8x16_t g = vld1q_u8(src + i);
+    const uint8x16x4_t rgba = {{g, g, g, vdupq_n_u8(0xFF)}};
+    vst4q_u8(dst + 4 * i, rgba);
+  }
+  GToRGBAScalar(obj, src + i, dst + 4 * i, count - i);
+}
+
+static void GAToRGBANEON(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  int i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const uint8x16x2_t ga = vld2q_u8(src + 2 * i);
+    const uint8x16x4_t rgba = {{ga.val[0], ga.val[0], ga.val[0], ga.val[1]}};
+    vst4q_u8(dst + 4 * i, rgba);
+  }
+  GAToRGBAScalar(obj, src + 2 * i, dst + 4 * i, count - i);
+}
+
+static void GAToGNEON(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  int i = 0;
+  for (; i + 16 <= count; i += 16)
+    vst1q_u8(dst + i, vld2q_u8(src + 2 * i).val[0]);
+  GAToGScalar(obj, src + 2 * i, dst + i, count - i);
+}
+
+static void RGBToRGBANEON(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  int i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const uint8x16x3_t rgb = vld3q_u8(src + 3 * i);
+    const uint8x16x4_t rgba = {{rgb.val[0], rgb.val[1], rgb.val[2], vdupq_n_u8(0xFF)}};
+    vst4q_u8(dst + 4 * i, rgba);
+  }
+  RGBToRGBAScalar(obj, src + 3 * i, dst + 4 * i, count - i);
+}
+
+static void RGBToBGRANEON(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  int i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const uint8x16x3_t rgb = vld3q_u8(src + 3 * i);
+    const uint8x16x4_t bgra = {{rgb.val[2], rgb.val[1], rgb.val[0], vdupq_n_u8(0xFF)}};
+    vst4q_u8(dst + 4 * i, bgra);
+  }
+  RGBToBGRAScalar(obj, src + 3 * i, dst + 4 * i, count - i);
+}
+
+static void RGBAToBGRANEON(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  int i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const uint8x16x4_t rgba = vld4q_u8(src + 4 * i);
+    const uint8x16x4_t bgra = {{rgba.val[2], rgba.val[1], rgba.val[0], rgba.val[3]}};
+    vst4q_u8(dst + 4 * i, bgra);
+  }
+  RGBAToBGRAScalar(obj, src + 4 * i, dst + 4 * i, count - i);
+}
+
+static void RGBAToRGBNEON(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  int i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const uint8x16x4_t rgba = vld4q_u8(src + 4 * i);
+    const uint8x16x3_t rgb = {{rgba.val[0], rgba.val[1], rgba.val[2]}};
+    vst3q_u8(dst + 3 * i, rgb);
+  }
+  RGBAToRGBScalar(obj, src + 4 * i, dst + 3 * i, count - i);
+}
+
+static void Premultiply8NEON(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    uint8x8x4_t v = vld4_u8(src + 4 * i);
+    if (vget_lane_u64(vreinterpret_u64_u8(vmvn_u8(v.val[3])), 0) == 0)
+      continue;
+    /* (t + ((t + 128) >> 8) + 128) >> 8 */
+    for (int c = 0; c < 3; ++c) {
+      const uint16x8_t t = vmull_u8(v.val[c], v.val[3]);
+      v.val[c] = vraddhn_u16(t, vrshrq_n_u16(t, 8));
+    }
+    vst4_u8(dst + 4 * i, v);
+  }
+  Premultiply8Scalar(obj, src + 4 * i, dst + 4 * i, count - i);
+}
+
+static void Blend8NEON(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    uint8x8x4_t v = vld4_u8(src + 4 * i);
+    if (vget_lane_u64(vreinterpret_u64_u8(vmvn_u8(v.val[3])), 0) == 0)
+      continue;
+    const uint8x8_t inverse = vmvn_u8(v.val[3]);
+    for (int c = 0; c < 3; ++c) {
+      const uint16x8_t t = vmlal_u8(vmull_u8(v.val[c], v.val[3]), vdup_n_u8((uint8_t)obj->background[c]), inverse);
+      v.val[c] = vraddhn_u16(t, vrshrq_n_u16(t, 8));
+    }
+    vst4_u8(dst + 4 * i, v);
+  }
+  Blend8Scalar(obj, src + 4 * i, dst + 4 * i, count - i);
+}
+
+#ifdef __aarch64__
+static void LookupRGBASmallNEON(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  const uint8x16_t r_plane = vld1q_u8(obj->lut_planes[0]);
+  const uint8x16_t g_plane = vld1q_u8(obj->lut_planes[1]);
+  const uint8x16_t b_plane = vld1q_u8(obj->lut_planes[2]);
+  const uint8x16_t a_plane = vld1q_u8(obj->lut_planes[3]);
+  int i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const uint8x16_t indices = vld1q_u8(src + i);
+    const uint8x16x4_t rgba = {{vqtbl1q_u8(r_plane, indices), vqtbl1q_u8(g_plane, indices),
+                                vqtbl1q_u8(b_plane, indices), vqtbl1q_u8(a_plane, indices)}};
+    vst4q_u8(dst + 4 * i, rgba);
+  }
+  LookupRGBA(obj, src + i, dst + 4 * i, count - i);
+}
+#endif
+
+static void Widen8To16NEON(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  int i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const uint8x16_t v = vld1q_u8(src + i);
+    const uint8x16x2_t vv = {{v, v}};
+    vst2q_u8(dst + 2 * i, vv);
+  }
+  Widen8To16Scalar(obj, src + i, dst + 2 * i, count - i);
+}
+
+#endif  // PNG_CONVERSION_NEON
+
+/*
+ * Best kernels for current CPU
+ */
+struct ConversionKernels {
+  RowKernel narrow16;
+  RowKernel swap16;
+  RowKernel widen8;
+  /* Big-endian 16-bit sources to native 16-bit formats */
+  RowKernel g16_to_rgba16;
+  RowKernel ga16_to_rgba16;
+  RowKernel rgb16_to_rgba16;
+  RowKernel rgba16_to_rgb16;
+  RowKernel ga16_to_g16;
+  RowKernel g_to_rgba;
+  RowKernel ga_to_rgba;
+  RowKernel ga_to_g;
+  RowKernel rgb_to_rgba;
+  RowKernel rgb_to_bgra;
+  RowKernel rgba_to_bgra;
+  RowKernel rgba_to_rgb;
+  /* Palette lookup for any indices and for indices less than 16 */
+  RowKernel lookup_rgba;
+  RowKernel lookup_rgba_small;
+  RowKernel premultiply8;
+  RowKernel premultiply16;
+  RowKernel blend8;
+  RowKernel blend16;
+};
+
+static struct ConversionKernels GetConversionKernels(void) {
+  struct ConversionKernels kernels;
+#if defined(PNG_CONVERSION_SSE2)
+  const bool ssse3 = HasSSSE3();
+  kernels.narrow16 = Narrow16SSE2;
+  kernels.swap16 = ssse3 ? Swap16SSSE3 : Swap16SSE2;
+  kernels.widen8 = Widen8To16SSE2;
+  kernels.g16_to_rgba16 = G16ToRGBA16SSE2;
+  kernels.ga16_to_rgba16 = ssse3 ? GA16ToRGBA16SSSE3 : GA16ToRGBA16Scalar;
+  kernels.rgb16_to_rgba16 = ssse3 ? RGB16ToRGBA16SSSE3 : RGB16ToRGBA16Scalar;
+  kernels.rgba16_to_rgb16 = ssse3 ? RGBA16ToRGB16SSSE3 : RGBA16ToRGB16Scalar;
+  kernels.ga16_to_g16 = ssse3 ? GA16ToG16SSSE3 : GA16ToG16Scalar;
+  kernels.g_to_rgba = GToRGBASSE2;
+  kernels.ga_to_rgba = GAToRGBASSE2;
+  kernels.ga_to_g = GAToGSSE2;
+  kernels.rgb_to_rgba = ssse3 ? RGBToRGBASSSE3 : RGBToRGBAScalar;
+  kernels.rgb_to_bgra = ssse3 ? RGBToBGRASSSE3 : RGBToBGRAScalar;
+  kernels.rgba_to_bgra = RGBAToBGRASSE2;
+  kernels.rgba_to_rgb = ssse3 ? RGBAToRGBSSSE3 : RGBAToRGBScalar;
+  kernels.lookup_rgba = HasAVX2() ? LookupRGBAAVX2 : LookupRGBA;
+  kernels.lookup_rgba_small = ssse3 ? LookupRGBASmallSSSE3 : LookupRGBA;
+  kernels.premultiply8 = Premultiply8SSE2;
+  kernels.premultiply16 = Premultiply16SSE2;
+  kernels.blend8 = Blend8SSE2;
+  kernels.blend16 = Blend16SSE2;
+#elif defined(PNG_CONVERSION_NEON)
+  kernels.narrow16 = Narrow16NEON;
+  kernels.swap16 = Swap16NEON;
+  kernels.widen8 = Widen8To16NEON;
+  kernels.g16_to_rgba16 = G16ToRGBA16NEON;
+  kernels.ga16_to_rgba16 = GA16ToRGBA16Scalar;
+  kernels.rgb16_to_rgba16 = RGB16ToRGBA16NEON;
+  kernels.rgba16_to_rgb16 = RGBA16ToRGB16Scalar;
+  kernels.ga16_to_g16 = GA16ToG16Scalar;
+  kernels.g_to_rgba = GToRGBANEON;
+  kernels.ga_to_rgba = GAToRGBANEON;
+  kernels.ga_to_g = GAToGNEON;
+  kernels.rgb_to_rgba = RGBToRGBANEON;
+  kernels.rgb_to_bgra = RGBToBGRANEON;
+  kernels.rgba_to_bgra = RGBAToBGRANEON;
+  kernels.rgba_to_rgb = RGBAToRGBNEON;
+  kernels.lookup_rgba = LookupRGBA;
+#ifdef __aarch64__
+  kernels.lookup_rgba_small = LookupRGBASmallNEON;
+#else
+  kernels.lookup_rgba_small = LookupRGBA;
+#endif
+  kernels.premultiply8 = Premultiply8NEON;
+  kernels.premultiply16 = Premultiply16Scalar;
+  kernels.blend8 = Blend8NEON;
+  kernels.blend16 = Blend16Scalar;
+#else
+  kernels.narrow16 = Narrow16Scalar;
+  kernels.swap16 = Swap16Scalar;
+  kernels.widen8 = Widen8To16Scalar;
+  kernels.g16_to_rgba16 = G16ToRGBA16Scalar;
+  kernels.ga16_to_rgba16 = GA16ToRGBA16Scalar;
+  kernels.rgb16_to_rgba16 = RGB16ToRGBA16Scalar;
+  kernels.rgba16_to_rgb16 = RGBA16ToRGB16Scalar;
+  kernels.ga16_to_g16 = GA16ToG16Scalar;
+  kernels.g_to_rgba = GToRGBAScalar;
+  kernels.ga_to_rgba = GAToRGBAScalar;
+  kernels.ga_to_g = GAToGScalar;
+  kernels.rgb_to_rgba = RGBToRGBAScalar;
+  kernels.rgb_to_bgra = RGBToBGRAScalar;
+  kernels.rgba_to_bgra = RGBAToBGRAScalar;
+  kernels.rgba_to_rgb = RGBAToRGBScalar;
+  kernels.lookup_rgba = LookupRGBA;
+  kernels.lookup_rgba_small = LookupRGBA;
+  kernels.premultiply8 = Premultiply8Scalar;
+  kernels.premultiply16 = Premultiply16Scalar;
+  kernels.blend8 = Blend8Scalar;
+  kernels.blend16 = Blend16Scalar;
+#endif
+  return kernels;
+}
+
+/*
+ * 8-bit source samples to 8-bit format via `expand`, then every byte duplicated
+ */
+static void Pack16From8(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count) {
+  const uint8_t* expanded = src;
+  if (obj->expand) {
+    obj->expand(obj, src, obj->scratch_expanded, count);
+    expanded = obj->scratch_expanded;
+  }
+  obj->widen(obj, expanded, dst, count * obj->out_pixel_size / 2);
+}
+
+static void BuildSubByteLUT(struct RowConverter* obj, bool scale) {
+  const int depth = obj->bit_depth;
+  const int mask = (1 << depth) - 1;
+  const int factor = scale ? 255 / mask : 1;
+  for (int byte = 0; byte < 256; ++byte)
+    for (int j = 0; j < 8 / depth; ++j)
+      obj->sub_byte_lut[byte][j] = (uint8_t)(((byte >> (8 - depth * (j + 1))) & mask) * factor);
+}
+
+static void BuildPaletteLUT(struct RowConverter* obj, const uint8_t* palette_rgba, int palette_size, bool bgra) {
+  for (int i = 0; i < 256; ++i) {
+    uint8_t rgba[4] = {0, 0, 0, 0xFF};
+    if (palette_rgba && i < palette_size)
+      memcpy(rgba, palette_rgba + 4 * i, 4);
+    obj->lut32[i][0] = bgra ? rgba[2] : rgba[0];
+    obj->lut32[i][1] = rgba[1];
+    obj->lut32[i][2] = bgra ? rgba[0] : rgba[2];
+    obj->lut32[i][3] = rgba[3];
+    obj->lut8[i] = Luminance8(rgba[0], rgba[1], rgba[2]);
+  }
+  for (int c = 0; c < 4; ++c)
+    for (int i = 0; i < 16; ++i)
+      obj->lut_planes[c][i] = obj->lut32[i][c];
+}
+
+/*
+ * Kernel packing 8-bit samples into 8-bit format. NULL means samples are already in the format
+ */
+static RowKernel SelectPack8(const struct ConversionKernels* kernels, enum PNGImageType type, int bit_depth,
+                             enum PNGPixelFormat format) {
+  switch (format) {
+    case PNG_PIXEL_FORMAT_RGBA8:
+    case PNG_PIXEL_FORMAT_BGRA8: {
+      const bool bgra = format == PNG_PIXEL_FORMAT_BGRA8;
+      switch (type) {
+        /* Grey pixels are the same in both orders */
+        case PNG_IMAGE_TYPE_GREYSCALE: return kernels->g_to_rgba;
+        case PNG_IMAGE_TYPE_GREYSCALEWITHAPLHA: return kernels->ga_to_rgba;
+        case PNG_IMAGE_TYPE_TRUECOLOR: return bgra ? kernels->rgb_to_bgra : kernels->rgb_to_rgba;
+        case PNG_IMAGE_TYPE_TRUECOLORWITHALPHA: return bgra ? kernels->rgba_to_bgra : NULL;
+        case PNG_IMAGE_TYPE_INDEXED: return bit_depth <= 4 ? kernels->lookup_rgba_small : kernels->lookup_rgba;
+      }
+      break;
+    }
+    case PNG_PIXEL_FORMAT_RGB8: {
+      switch (type) {
+        case PNG_IMAGE_TYPE_GREYSCALE: return GToRGB;
+        case PNG_IMAGE_TYPE_GREYSCALEWITHAPLHA: return GAToRGB;
+        case PNG_IMAGE_TYPE_TRUECOLOR: return NULL;
+        case PNG_IMAGE_TYPE_TRUECOLORWITHALPHA: return kernels->rgba_to_rgb;
+        case PNG_IMAGE_TYPE_INDEXED: return LookupRGB;
+      }
+      break;
+    }
+    case PNG_PIXEL_FORMAT_G8: {
+      switch (type) {
+        case PNG_IMAGE_TYPE_GREYSCALE: return NULL;
+        case PNG_IMAGE_TYPE_GREYSCALEWITHAPLHA: return kernels->ga_to_g;
+        case PNG_IMAGE_TYPE_TRUECOLOR: return RGBToG;
+        case PNG_IMAGE_TYPE_TRUECOLORWITHALPHA: return RGBAToG;
+        case PNG_IMAGE_TYPE_INDEXED: return LookupG;
+      }
+      break;
+    }
+    default: break;
+  }
+  assert(false);
+  return NULL;
+}
+
+/*
+ * Kernel packing big-endian 16-bit samples into native 16-bit format.
+ * NULL means the layout is the same and only byte swap is needed
+ */
+static RowKernel SelectPack16(const struct ConversionKernels* kernels, enum PNGImageType type,
+                              enum PNGPixelFormat format) {
+  switch (format) {
+    case PNG_PIXEL_FORMAT_RGBA16: {
+      switch (type) {
+        case PNG_IMAGE_TYPE_GREYSCALE: return kernels->g16_to_rgba16;
+        case PNG_IMAGE_TYPE_GREYSCALEWITHAPLHA: return kernels->ga16_to_rgba16;
+        case PNG_IMAGE_TYPE_TRUECOLOR: return kernels->rgb16_to_rgba16;
+        default: return NULL;
+      }
+    }
+    case PNG_PIXEL_FORMAT_RGB16: {
+      switch (type) {
+        case PNG_IMAGE_TYPE_GREYSCALE: return G16ToRGB16;
+        case PNG_IMAGE_TYPE_GREYSCALEWITHAPLHA: return GA16ToRGB16;
+        case PNG_IMAGE_TYPE_TRUECOLORWITHALPHA: return kernels->rgba16_to_rgb16;
+        default: return NULL;
+      }
+    }
+    case PNG_PIXEL_FORMAT_G16: {
+      switch (type) {
+        case PNG_IMAGE_TYPE_GREYSCALEWITHAPLHA: return kernels->ga16_to_g16;
+        case PNG_IMAGE_TYPE_TRUECOLOR: return RGB16ToG16;
+        case PNG_IMAGE_TYPE_TRUECOLORWITHALPHA: return RGBA16ToG16;
+        default: return NULL;
+      }
+    }
+    default: break;
+  }
+  assert(false);
+  return NULL;
+}
+
+/*
+ * 8-bit format with the same channels as 16-bit one
+ */
+static enum PNGPixelFormat GetNarrowPixelFormat(enum PNGPixelFormat format) {
+  switch (format) {
+    case PNG_PIXEL_FORMAT_RGB16: return PNG_PIXEL_FORMAT_RGB8;
+    case PNG_PIXEL_FORMAT_G16: return PNG_PIXEL_FORMAT_G8;
+    default: return PNG_PIXEL_FORMAT_RGBA8;
+  }
+}
+
+bool InitRowConverter(struct RowConverter* obj, enum PNGImageType type, int bit_depth, int width,
+                      enum PNGPixelFormat format, const uint8_t* palette_rgba, int palette_size) {
+  assert(obj);
+
+  memset(obj, 0, sizeof(struct RowConverter));
+  obj->width = width;
+  obj->samples_count = width * PNGGetChannelCount(type);
+  obj->out_pixel_size = PNGGetPixelFormatSizeBytes(format);
+  obj->bit_depth = bit_depth;
+  if (obj->out_pixel_size == 0)
+    return false;
+
+  const struct ConversionKernels kernels = GetConversionKernels();
+  const bool sub_byte = bit_depth < 8;
+  const bool wide = bit_depth == 16;
+  /* Palette indices are not scaled, greyscale samples are scaled to full range */
+  const bool scale_sub_byte = type != PNG_IMAGE_TYPE_INDEXED;
+  BuildPaletteLUT(obj, palette_rgba, palette_size, format == PNG_PIXEL_FORMAT_BGRA8);
+
+  switch (format) {
+    case PNG_PIXEL_FORMAT_INDEXED8: {
+      if (type != PNG_IMAGE_TYPE_INDEXED && (type != PNG_IMAGE_TYPE_GREYSCALE || wide))
+        return false;
+      if (sub_byte) {
+        /* Palette of greyscale image holds scaled values, indices are raw samples */
+        BuildSubByteLUT(obj, false);
+        obj->unpack = UnpackSubByte;
+      }
+      break;
+    }
+    case PNG_PIXEL_FORMAT_RGBA16:
+    case PNG_PIXEL_FORMAT_RGB16:
+    case PNG_PIXEL_FORMAT_G16: {
+      if (wide) {
+        /* Samples are swapped straight into the output when channels match */
+        obj->pack = SelectPack16(&kernels, type, format);
+        if (!obj->pack)
+          obj->unpack = kernels.swap16;
+      } else {
+        if (sub_byte) {
+          BuildSubByteLUT(obj, scale_sub_byte);
+          obj->unpack = UnpackSubByte;
+        }
+        obj->expand = SelectPack8(&kernels, type, bit_depth, GetNarrowPixelFormat(format));
+        obj->widen = kernels.widen8;
+        obj->pack = Pack16From8;
+      }
+      break;
+    }
+    default: {
+      if (wide) {
+        obj->unpack = kernels.narrow16;
+      } else if (sub_byte) {
+        BuildSubByteLUT(obj, scale_sub_byte);
+        obj->unpack = UnpackSubByte;
+      }
+      obj->pack = SelectPack8(&kernels, type, bit_depth, format);
+      break;
+    }
+  }
+
+  /* Samples are kept 16-bit only for 16-bit output */
+  if (obj->unpack && obj->pack) {
+    obj->scratch = ScratchMalloc((size_t)obj->samples_count * 2 + 1);
+    if (!obj->scratch)
+      return false;
+  }
+  if (obj->pack == Pack16From8 && obj->expand) {
+    obj->scratch_expanded = ScratchMalloc((size_t)width * 4 + 1);
+    if (!obj->scratch_expanded) {
+      FreeRowConverter(obj);
+      return false;
+    }
+  }
+  return true;
+}
+
+void SetRowConverterColorKey(struct RowConverter* obj, const uint8_t* key, int key_size) {
+  assert(obj);
+  assert(key_size > 0 && key_size <= (int)sizeof(obj->color_key));
+
+  if (obj->out_pixel_size == 4)
+    obj->alpha_offset = 3;
+  else if (obj->out_pixel_size == 8)
+    obj->alpha_offset = 6;
+  else
+    return;
+  memcpy(obj->color_key, key, key_size);
+  obj->color_key_size = key_size;
+}
+
+/*
+ * Zero alpha of output pixels whose source pixel equals color key
+ */
+static void ApplyColorKey(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst) {
+  const int pixel_size = obj->out_pixel_size;
+  uint8_t* alpha = dst + obj->alpha_offset;
+  /* Constant sizes let memcmp compile into plain comparisons */
+  switch (obj->color_key_size) {
+    case 2:
+      for (int x = 0; x < obj->width; ++x)
+        if (0 == memcmp(src + 2 * x, obj->color_key, 2))
+          memset(alpha + x * pixel_size, 0, pixel_size / 4);
+      break;
+    case 3:
+      for (int x = 0; x < obj->width; ++x)
+        if (0 == memcmp(src + 3 * x, obj->color_key, 3))
+          memset(alpha + x * pixel_size, 0, pixel_size / 4);
+      break;
+    case 6:
+      for (int x = 0; x < obj->width; ++x)
+        if (0 == memcmp(src + 6 * x, obj->color_key, 6))
+          memset(alpha + x * pixel_size, 0, pixel_size / 4);
+      break;
+    default: assert(false);
+  }
+}
+
+void SetRowConverterTransfer(struct RowConverter* obj, const uint8_t* lut8, const uint16_t* lut16) {
+  assert(obj);
+
+  obj->transfer8 = lut8;
+  obj->transfer16 = lut16;
+}
+
+void SetRowConverterPremultiply(struct RowConverter* obj) {
+  assert(obj);
+
+  const struct ConversionKernels kernels = GetConversionKernels();
+  if (obj->out_pixel_size == 4)
+    obj->premultiply = kernels.premultiply8;
+  else if (obj->out_pixel_size == 8)
+    obj->premultiply = kernels.premultiply16;
+}
+
+bool SetRowConverterBackground(struct RowConverter* obj, enum PNGPixelFormat format, const uint16_t* background_rgb16) {
+  assert(obj);
+  assert(background_rgb16);
+
+  const struct ConversionKernels kernels = GetConversionKernels();
+  if (obj->out_pixel_size == 4 && format == PNG_PIXEL_FORMAT_RGB8)
+    obj->drop_alpha = kernels.rgba_to_rgb;
+  else if (obj->out_pixel_size == 4 && format == PNG_PIXEL_FORMAT_G8)
+    obj->drop_alpha = RGBAToG;
+  else if (obj->out_pixel_size == 8 && format == PNG_PIXEL_FORMAT_RGB16)
+    obj->drop_alpha = NativeRGBA16ToRGB16;
+  else if (obj->out_pixel_size == 8 && format == PNG_PIXEL_FORMAT_G16)
+    obj->drop_alpha = NativeRGBA16ToG16;
+  else
+    return false;
+
+  obj->blend = obj->out_pixel_size == 4 ? kernels.blend8 : kernels.blend16;
+  for (int c = 0; c < 3; ++c)
+    obj->background[c] = obj->out_pixel_size == 4 ? Narrow16To8(background_rgb16[c]) : background_rgb16[c];
+
+  ScratchFree(obj->scratch_flattened);
+  obj->scratch_flattened = ScratchMalloc((size_t)obj->width * obj->out_pixel_size);
+  if (!obj->scratch_flattened) {
+    obj->blend = NULL;
+    obj->drop_alpha = NULL;
+    return false;
+  }
+  return true;
+}
+
+/*
+ * Map color samples of output row through transfer table. Every fourth sample of 4-channel formats is alpha
+ */
+static void ApplyTransfer(const struct RowConverter* obj, uint8_t* dst) {
+  switch (obj->out_pixel_size) {
+    case 1:
+    case 3:
+      if (obj->transfer8)
+        for (int i = 0; i < obj->width * obj->out_pixel_size; ++i)
+          dst[i] = obj->transfer8[dst[i]];
+      break;
+    case 4:
+      if (obj->transfer8)
+        for (int x = 0; x < obj->width; ++x) {
+          uint8_t* pixel = dst + 4 * x;
+          pixel[0] = obj->transfer8[pixel[0]];
+          pixel[1] = obj->transfer8[pixel[1]];
+          pixel[2] = obj->transfer8[pixel[2]];
+        }
+      break;
+    case 2:
+    case 6:
+      if (obj->transfer16) {
+        uint16_t* samples = (uint16_t*)dst;
+        for (int i = 0; i < obj->width * obj->out_pixel_size / 2; ++i)
+          samples[i] = obj->transfer16[samples[i]];
+      }
+      break;
+    case 8:
+      if (obj->transfer16)
+        for (int x = 0; x < obj->width; ++x) {
+          uint16_t* pixel = (uint16_t*)dst + 4 * x;
+          pixel[0] = obj->transfer16[pixel[0]];
+          pixel[1] = obj->transfer16[pixel[1]];
+          pixel[2] = obj->transfer16[pixel[2]];
+        }
+      break;
+    default: break;
+  }
+}
+
+void FreeRowConverter(struct RowConverter* obj) {
+  if (!obj)
+    return;
+
+  ScratchFree(obj->scratch);
+  ScratchFree(obj->scratch_expanded);
+  ScratchFree(obj->scratch_flattened);
+  obj->scratch = NULL;
+  obj->scratch_expanded = NULL;
+  obj->scratch_flattened = NULL;
+}
+
+void ConvertRow(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst) {
+  assert(obj);
+
+  /* Flattened pixels keep alpha until blending */
+  uint8_t* row = obj->blend ? obj->scratch_flattened : dst;
+  const uint8_t* samples = src;
+  if (obj->unpack) {
+    /* Without pack step samples go straight to the output row */
+    uint8_t* unpacked = obj->pack ? obj->scratch : row;
+    obj->unpack(obj, src, unpacked, obj->samples_count);
+    samples = unpacked;
+  }
+
+  if (obj->pack)
+    obj->pack(obj, samples, row, obj->width);
+  else if (samples != row)
+    memcpy(row, samples, (size_t)obj->width * obj->out_pixel_size);
+
+  /* Applied to the row while it is still in cache */
+  if (obj->transfer8 || obj->transfer16)
+    ApplyTransfer(obj, row);
+  if (obj->color_key_size > 0)
+    ApplyColorKey(obj, src, row);
+  /* Color is multiplied in the output space, after correction and transparency */
+  if (obj->premultiply)
+    obj->premultiply(obj, row, row, obj->width);
+  if (obj->blend) {
+    obj->blend(obj, row, row, obj->width);
+    obj->drop_alpha(obj, row, dst, obj->width);
+  }
+}
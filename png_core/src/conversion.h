@@ -0,0 +1,165 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "png_core/pixel_format.h"
+
+struct RowConverter;
+
+/*
+ * Conversion step over `count` samples or pixels of a row
+ */
+typedef void (*RowKernel)(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst, int count);
+
+/*
+ * Converts defiltered scanlines of one image into pixel format.
+ * Conversion is split into two steps:
+ *   unpack: sub-byte and 16-bit samples into 8-bit samples, or 16-bit byte swap if channels already match output;
+ *   pack: channel expansion, swizzle or palette lookup into output pixels.
+ * 16-bit samples go to 16-bit formats in a single pack step that also swaps bytes.
+ * Kernels are chosen once per image from source type, bit depth and CPU features.
+ */
+struct RowConverter {
+  int width;
+  int samples_count;
+  int out_pixel_size;
+  int bit_depth;
+
+  /* Can be NULL if scanline samples are used as is */
+  RowKernel unpack;
+  /* Can be NULL if unpacked samples are the output pixels */
+  RowKernel pack;
+  /* Steps of 16-bit pack from 8-bit sources: samples to 8-bit format (NULL if already in it), then to 16 bits */
+  RowKernel expand;
+  RowKernel widen;
+
+  /* Unpacked samples */
+  uint8_t* scratch;
+  /* Intermediate 8-bit row of 16-bit pack */
+  uint8_t* scratch_expanded;
+
+  /* Palette entry -> RGBA8 or BGRA8 pixel */
+  uint8_t lut32[256][4];
+  /* Channels of the first 16 entries of `lut32` as separate planes, for byte shuffles */
+  uint8_t lut_planes[4][16];
+  /* Palette entry -> luminance */
+  uint8_t lut8[256];
+  /* Packed byte -> up to 8 unpacked samples */
+  uint8_t sub_byte_lut[256][8];
+
+  /* Source pixel bytes of transparent color. Matching pixels get zero alpha */
+  uint8_t color_key[6];
+  int color_key_size;
+  /* Offset of alpha in output pixel */
+  int alpha_offset;
+
+  /* Multiplies color of output pixels by alpha in place. NULL if disabled */
+  RowKernel premultiply;
+
+  /*
+   * Flattening onto background. Pixels are converted into RGBA row of `out_pixel_size`, blended in place,
+   * then alpha is dropped into the output row. NULL if disabled
+   */
+  RowKernel blend;
+  RowKernel drop_alpha;
+  uint8_t* scratch_flattened;
+  /* Background in bit depth of the RGBA row */
+  uint16_t background[3];
+
+  /* Transfer tables applied to color samples of output pixels, NULL if samples are kept as is */
+  const uint8_t* transfer8;
+  const uint16_t* transfer16;
+};
+
+/*
+ * @brief Prepare converter for image rows
+ * @param[in] palette_rgba RGBA8 palette entries for indexed images. Can be NULL for other types
+ * @return false if conversion is not supported or allocation failed
+ */
+bool InitRowConverter(struct RowConverter* obj, enum PNGImageType type, int bit_depth, int width,
+                      enum PNGPixelFormat format, const uint8_t* palette_rgba, int palette_size);
+
+/*
+ * @brief Make pixels of color equal to `key` transparent. Ignored for formats without alpha
+ * @param[in] key Source pixel bytes as stored in scanline
+ * @param key_size Source pixel size: 2 for 16-bit grey, 3 or 6 for 8 or 16-bit truecolor
+ */
+void SetRowConverterColorKey(struct RowConverter* obj, const uint8_t* key, int key_size);
+
+/*
+ * @brief Map color samples of output pixels through lookup table. Alpha is kept as is.
+ * Not used for PNG_PIXEL_FORMAT_INDEXED8, whose palette is corrected instead
+ * @param[in] lut8 256 entries for 8-bit formats, must outlive converter. Can be NULL
+ * @param[in] lut16 65536 entries for 16-bit formats, must outlive converter. Can be NULL
+ */
+void SetRowConverterTransfer(struct RowConverter* obj, const uint8_t* lut8, const uint16_t* lut16);
+
+/*
+ * @brief Premultiply color of output pixels by alpha. Ignored for formats without alpha
+ */
+void SetRowConverterPremultiply(struct RowConverter* obj);
+
+/*
+ * @brief Blend pixels onto background and drop alpha. Converter must be initialized for RGBA8 or RGBA16
+ * @param format Output format without alpha of the same bit depth: RGB8 or G8 for RGBA8, RGB16 or G16 for RGBA16
+ * @param[in] background_rgb16 16-bit R, G, B of background
+ * @return false if format is not supported or allocation failed
+ */
+bool SetRowConverterBackground(struct RowConverter* obj, enum PNGPixelFormat format, const uint16_t* background_rgb16);
+
+void FreeRowConverter(struct RowConverter* obj);
+
+/*
+ * @brief Convert one defiltered scanline
+ * @param[in] src Scanline without filter type byte
+ * @param[out] dst Output row of `width * out_pixel_size` bytes
+ */
+void ConvertRow(const struct RowConverter* obj, const uint8_t* src, uint8_t* dst);
+
+/*
+ * Round 16-bit sample to 8 bits: round(v * 255 / 65535)
+ */
+static inline uint8_t Narrow16To8(uint32_t v) {
+  return (uint8_t)((v * 0xFF01u + 0x800000u) >> 24);
+}
+
+/*
+ * round(c * a / 255) without division
+ */
+static inline uint8_t Premultiply8(uint32_t c, uint32_t a) {
+  const uint32_t t = c * a + 128u;
+  return (uint8_t)((t + (t >> 8)) >> 8);
+}
+
+/*
+ * round(c * a / 65535) without division
+ */
+static inline uint16_t Premultiply16(uint32_t c, uint32_t a) {
+  const uint32_t t = c * a + 32768u;
+  return (uint16_t)((t + (t >> 16)) >> 16);
+}
+
+/*
+ * round((c * a + background * (255 - a)) / 255)
+ */
+static inline uint8_t Blend8(uint32_t c, uint32_t background, uint32_t a) {
+  const uint32_t t = c * a + background * (255u - a) + 128u;
+  return (uint8_t)((t + (t >> 8)) >> 8);
+}
+
+static inline uint16_t Blend16(uint32_t c, uint32_t background, uint32_t a) {
+  const uint32_t t = c * a + background * (65535u - a) + 32768u;
+  return (uint16_t)((t + (t >> 16)) >> 16);
+}
+
+/*
+ * Rec. 709 luminance of 8-bit R,G,B with 15-bit fixed point weights
+ */
+static inline uint8_t Luminance8(uint32_t r, uint32_t g, uint32_t b) {
+  return (uint8_t)((6969u * r + 23434u * g + 2365u * b + 16384u) >> 15);
+}
+
+static inline uint16_t Luminance16(uint32_t r, uint32_t g, uint32_t b) {
+  return (uint16_t)((6969u * r + 23434u * g + 2365u * b + 16384u) >> 15);
+}
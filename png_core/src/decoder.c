@@ -2,19 +2,37 @@
 #include "png_core/compression.h"
 #include "png_core/filtering.h"
 
+#include <limits.h>
 #include <memory.h>
 #include <stdlib.h>
 #include <math.h>
 
+#include "conversion.h"
+#include "decoding.h"
+#include "gamma.h"
+#include "inflate.h"
+#include "stats_recorder.h"
+#include "tensor.h"
+#include "tools.h"
+
 const int8_t s_png_valid_bit_depths[5] = {1, 2, 4, 8, 16};
 const int8_t s_png_valid_color_types[5] = {0, 2, 3, 4, 6};
 
-static bool ConcatenateAllIDATChunks(const struct PNGRawChunk* chunk_list, uint8_t ** out, int * out_size) {
+/*
+ * Concatenated data is a scratch buffer, freed with ScratchFree
+ */
+static bool ConcatenateAllIDATChunks(const struct PNGRawChunk* chunk_list, struct StatsRecorder* recorder,
+                                     uint8_t** out, int* out_size) {
+  const uint64_t start = StartStage(recorder);
   const struct PNGRawChunk* chunk = chunk_list;
 
   int concat_total_size = 0;
+  int chunks_count = 0;
+  int idat_chunks_count = 0;
   while (chunk) {
+    ++chunks_count;
     if (chunk->type.bytes == CHUNK_IDAT.bytes) {
+      ++idat_chunks_count;
       if (chunk->parsed_data) {
         const struct PNGChunkData_IDAT* data = (struct PNGChunkData_IDAT*)chunk->parsed_data;
         concat_total_size += data->data_size;
@@ -22,9 +40,13 @@ static bool ConcatenateAllIDATChunks(const struct PNGRawChunk* chunk_list, uint8
     }
     chunk = chunk->next;
   }
+  if (recorder->stats) {
+    recorder->stats->chunks_count = chunks_count;
+    recorder->stats->idat_chunks_count = idat_chunks_count;
+  }
 
   chunk = chunk_list;
-  uint8_t* concatenated_idat = malloc(concat_total_size);
+  uint8_t* concatenated_idat = ScratchMalloc(concat_total_size);
   uint8_t* ptr = concatenated_idat;
 
   if (!concatenated_idat)
@@ -43,69 +65,167 @@ static bool ConcatenateAllIDATChunks(const struct PNGRawChunk* chunk_list, uint8
 
   *out = concatenated_idat;
   *out_size = concat_total_size;
+  EndStage(recorder, PNG_DECODE_STAGE_CONCAT, start, concat_total_size, concat_total_size);
   return true;
 }
 
+/*
+ * @brief Inflate concatenated IDAT data and free it.
+ * Data is inflated in place of PNGGetDataDecompressionFunction result, so decompressor state is counted too
+ * @param max_ratio Limit of inflated bytes per compressed byte, 0 for none
+ * @return Filtered scanlines, a scratch buffer. NULL if data is corrupted, exceeds ratio or allocation failed
+ */
+static uint8_t* InflateImageData(const struct PNGChunkData_IHDR* header, uint8_t* idat_concated,
+                                 int idat_concated_size, uint32_t max_ratio, enum PNGInflateEngine engine,
+                                 struct StatsRecorder* recorder) {
+  const uint64_t start = StartStage(recorder);
+  const int filtered_size = (int)PNGGetFilteredImageSizeBytes(header);
+  uint8_t* filtered = ScratchMalloc(filtered_size);
+  if (filtered && !InflateZlibStream(idat_concated, idat_concated_size, filtered, filtered_size, max_ratio, engine)) {
+    ScratchFree(filtered);
+    filtered = NULL;
+  }
+  ScratchFree(idat_concated);
+  if (filtered)
+    EndStage(recorder, PNG_DECODE_STAGE_INFLATE, start, idat_concated_size, filtered_size);
+  return filtered;
+}
+
+void PNGInitDecodeStats(struct PNGDecodeStats* obj) {
+  memset(obj, 0, sizeof(struct PNGDecodeStats));
+}
+
+const char* PNGGetDecodeStageName(enum PNGDecodeStage stage) {
+  switch (stage) {
+    case PNG_DECODE_STAGE_PARSE: return "parse";
+    case PNG_DECODE_STAGE_SETUP: return "setup";
+    case PNG_DECODE_STAGE_CONCAT: return "concat";
+    case PNG_DECODE_STAGE_INFLATE: return "inflate";
+    case PNG_DECODE_STAGE_DEFILTER: return "defilter";
+    case PNG_DECODE_STAGE_CONVERT: return "convert";
+    default: return NULL;
+  }
+}
+
+void PNGInitDecodeLimits(struct PNGDecodeLimits* obj) {
+  obj->max_pixels = (uint64_t)1 << 28;
+  obj->max_output_bytes = (uint64_t)1 << 30;
+  obj->max_chunk_memory_bytes = (uint64_t)1 << 30;
+  obj->max_inflate_ratio = 0;
+  obj->max_chunks_count = 1u << 20;
+}
+
 void PNGInitRawImage(struct PNGRawImage* obj) {
   memset(obj, 0, sizeof(struct PNGRawImage));
 }
 
-int PNGGetPlainImageSizeBits(const struct PNGChunkData_IHDR* header) {
+int64_t PNGGetPlainImageSizeBits(const struct PNGChunkData_IHDR* header) {
   const int channels_in_px = PNGGetChannelCount(header->color_type);
   const int bits_in_px = channels_in_px * header->bit_depth;
-  const int bits_in_total_image = header->width * header->height * bits_in_px;
-  return bits_in_total_image;
+  return MultiplySizes(MultiplySizes(header->width, header->height), bits_in_px);
 }
 
-bool PNGGetRawImage(struct PNGRawChunk* chunk_list, struct PNGRawImage * out) {
-  uint8_t* idat_concated = NULL;
-  int idat_concated_size = 0;
+int64_t PNGGetScanlineSizeBytes(const struct PNGChunkData_IHDR* header) {
+  const int64_t bits_in_scanline =
+      (int64_t)header->width * PNGGetChannelCount(header->color_type) * header->bit_depth;
+  return (bits_in_scanline + 7) / 8;
+}
 
-  if (!ConcatenateAllIDATChunks(chunk_list, &idat_concated, &idat_concated_size))
-    return false;
+int GetFilterPixelSizeBytes(const struct PNGChunkData_IHDR* header) {
+  return (PNGGetChannelCount(header->color_type) * header->bit_depth + 7) / 8;
+}
 
-  const struct PNGChunkData_IHDR* header = NULL;
-  struct PNGRawChunk* chunk = chunk_list;
-  while (chunk) {
-    if (!header && chunk->type.bytes == CHUNK_IHDR.bytes) {
-      header = (struct PNGChunkData_IHDR*)chunk->parsed_data;
-      break;
-    }
-    chunk = chunk->next;
+const struct PNGRawChunk* FindChunk(const struct PNGRawChunk* chunk_list, struct ChunkType type) {
+  for (const struct PNGRawChunk* chunk = chunk_list; chunk; chunk = chunk->next) {
+    if (chunk->type.bytes == type.bytes)
+      return chunk;
   }
-  if (!header) {
-    free(idat_concated);
+  return NULL;
+}
+
+/*
+ * @brief Check image against limits before anything is allocated.
+ * Also rejects sizes that do not fit int, used for buffer sizes and offsets
+ * @param output_size Size of decoded output in bytes, -1 if it does not fit int64_t
+ * @return false if a limit is exceeded
+ */
+static bool CheckImageLimits(const struct PNGRawChunk* chunk_list, const struct PNGChunkData_IHDR* header,
+                             const struct PNGDecodeLimits* limits, int64_t output_size) {
+  if (header->width <= 0 || header->height <= 0)
+    return false;
+  if (limits->max_pixels && (uint64_t)header->width * (uint64_t)header->height > limits->max_pixels)
     return false;
-  }
 
-  const PNGDataDecompressionFunction decompression_func = PNGGetDataDecompressionFunction(header->compression_method);
-  if (!decompression_func) {
-    free(idat_concated);
+  const int64_t filtered_size = PNGGetFilteredImageSizeBytes(header);
+  if (filtered_size < 0 || filtered_size > INT_MAX || output_size < 0)
     return false;
-  }
-  const int filtered_size = PNGGetFilteredImageSizeBytes(header);
-  uint8_t* decompressed = decompression_func(idat_concated, idat_concated_size, filtered_size);
-  free(idat_concated);
-  if (!decompressed)
+  if (limits->max_output_bytes &&
+      ((uint64_t)output_size > limits->max_output_bytes || (uint64_t)filtered_size > limits->max_output_bytes))
     return false;
 
+  uint64_t idat_size = 0;
+  for (const struct PNGRawChunk* chunk = chunk_list; chunk; chunk = chunk->next)
+    if (chunk->type.bytes == CHUNK_IDAT.bytes && chunk->parsed_data)
+      idat_size += ((const struct PNGChunkData_IDAT*)chunk->parsed_data)->data_size;
+  if (idat_size > INT_MAX)
+    return false;
+  return !limits->max_inflate_ratio || (uint64_t)filtered_size <= idat_size * limits->max_inflate_ratio;
+}
+
+bool PNGGetRawImage(struct PNGRawChunk* chunk_list, struct PNGRawImage* out) {
+  return PNGGetRawImageWithOptions(chunk_list, NULL, out);
+}
+
+static bool GetRawImage(struct PNGRawChunk* chunk_list, const struct PNGRawImageOptions* options,
+                        struct StatsRecorder* recorder, struct PNGRawImage* out) {
+  const uint64_t setup_start = StartStage(recorder);
+  const struct PNGRawChunk* header_chunk = FindChunk(chunk_list, CHUNK_IHDR);
+  const struct PNGChunkData_IHDR* header = header_chunk ? header_chunk->parsed_data : NULL;
+  if (!header || !PNGGetDataDecompressionFunction(header->compression_method))
+    return false;
+  /* Bit depth 0 would divide by zero in defiltering */
+  if (!PNGIsValidImageFormat(header->color_type, header->bit_depth))
+    return false;
   const PNGDataDefilteringFunction defiltering_function = PNGGetDefilteringFunction(header->filter_method);
-  if (!defiltering_function) {
-    free(decompressed);
+  if (!defiltering_function)
     return false;
-  }
-  const int plain_size_bytes = ceil(PNGGetPlainImageSizeBits(header) / 8.0);
+  /* Plain image size is int in PNGRawImage */
+  const int64_t plain_size = MultiplySizes(PNGGetScanlineSizeBytes(header), header->height);
+  if (!CheckImageLimits(chunk_list, header, &options->limits, plain_size > INT_MAX ? -1 : plain_size))
+    return false;
+  AddStageTime(recorder, PNG_DECODE_STAGE_SETUP, setup_start);
+
+  uint8_t* idat_concated = NULL;
+  int idat_concated_size = 0;
+  if (!ConcatenateAllIDATChunks(chunk_list, recorder, &idat_concated, &idat_concated_size))
+    return false;
+
+  const int filtered_size = (int)PNGGetFilteredImageSizeBytes(header);
+  uint8_t* decompressed =
+      InflateImageData(header, idat_concated, idat_concated_size, options->limits.max_inflate_ratio,
+                       options->inflate_engine, recorder);
+  if (!decompressed)
+    return false;
+
+  const uint64_t defilter_start = StartStage(recorder);
+  const int scanline_size_bytes = (int)PNGGetScanlineSizeBytes(header);
+  const int plain_size_bytes = (int)plain_size;
   uint8_t* plain_data = malloc(plain_size_bytes);
   if (!plain_data) {
-    free(decompressed);
+    ScratchFree(decompressed);
     return false;
   }
-  const int pixel_size_bytes = PNGGetChannelCount(header->color_type) * header->bit_depth;
-  if (!defiltering_function(decompressed, filtered_size, header->width, pixel_size_bytes, plain_data)) {
-    free(decompressed);
+  RecordOutputAllocation(recorder, plain_size_bytes);
+  /* Scanlines of sub-byte pixels are defiltered as scanlines of 1-byte pixels */
+  const int pixel_size_bytes = GetFilterPixelSizeBytes(header);
+  if (!defiltering_function(decompressed, filtered_size, scanline_size_bytes / pixel_size_bytes, pixel_size_bytes,
+                            plain_data)) {
+    ScratchFree(decompressed);
+    free(plain_data);
     return false;
   }
-  free(decompressed);
+  ScratchFree(decompressed);
+  EndStage(recorder, PNG_DECODE_STAGE_DEFILTER, defilter_start, filtered_size, plain_size_bytes);
 
   PNGInitRawImage(out);
   out->type = header->color_type;
@@ -117,3 +237,515 @@ bool PNGGetRawImage(struct PNGRawChunk* chunk_list, struct PNGRawImage * out) {
   return true;
 }
 
+void PNGInitRawImageOptions(struct PNGRawImageOptions* obj) {
+  obj->inflate_engine = PNG_INFLATE_ENGINE_BUILTIN;
+  obj->stats = NULL;
+  PNGInitDecodeLimits(&obj->limits);
+}
+
+bool PNGGetRawImageWithOptions(struct PNGRawChunk* chunk_list, const struct PNGRawImageOptions* options,
+                               struct PNGRawImage* out) {
+  struct PNGRawImageOptions default_options;
+  if (!options) {
+    PNGInitRawImageOptions(&default_options);
+    options = &default_options;
+  }
+  struct StatsRecorder recorder;
+  StartStatsRecorder(&recorder, options->stats);
+  const bool ok = GetRawImage(chunk_list, options, &recorder, out);
+  StopStatsRecorder(&recorder);
+  return ok;
+}
+
+bool PNGGetRawImageWithStats(struct PNGRawChunk* chunk_list, struct PNGRawImage* out, struct PNGDecodeStats* stats) {
+  struct PNGRawImageOptions options;
+  PNGInitRawImageOptions(&options);
+  options.stats = stats;
+  return PNGGetRawImageWithOptions(chunk_list, &options, out);
+}
+
+void PNGInitDecodeOptions(struct PNGDecodeOptions* obj) {
+  obj->format = PNG_PIXEL_FORMAT_RGBA8;
+  obj->flip_vertically = false;
+  obj->gamma_correction = PNG_GAMMA_CORRECTION_NONE;
+  obj->premultiply_alpha = false;
+  obj->alpha_flattening = PNG_ALPHA_FLATTENING_NONE;
+  obj->background_rgb16[0] = obj->background_rgb16[1] = obj->background_rgb16[2] = 0xFFFF;
+  obj->inflate_engine = PNG_INFLATE_ENGINE_BUILTIN;
+  obj->stats = NULL;
+  PNGInitDecodeLimits(&obj->limits);
+}
+
+void PNGInitImage(struct PNGImage* obj) {
+  memset(obj, 0, sizeof(struct PNGImage));
+}
+
+void PNGFreeImage(struct PNGImage* obj) {
+  if (!obj)
+    return;
+  free(obj->data);
+  PNGInitImage(obj);
+}
+
+bool FillPalette(const struct PNGRawChunk* chunk_list, const struct PNGChunkData_IHDR* header,
+                 const struct PNGChunkData_tRNS* transparency, struct PNGImage* image) {
+  if (header->color_type == PNG_IMAGE_TYPE_GREYSCALE && header->bit_depth <= 8) {
+    const int size = 1 << header->bit_depth;
+    for (int i = 0; i < size; ++i) {
+      const uint8_t value = (uint8_t)(i * 255 / (size - 1));
+      image->palette[i][0] = image->palette[i][1] = image->palette[i][2] = value;
+      image->palette[i][3] = 0xFF;
+    }
+    image->palette_size = size;
+
+    const int transparent = transparency ? PNGGetTransparentSample_tRNS(transparency, 0) : -1;
+    if (transparent >= 0 && transparent < size)
+      image->palette[transparent][3] = 0;
+    return true;
+  }
+
+  if (header->color_type != PNG_IMAGE_TYPE_INDEXED)
+    return true;
+
+  const struct PNGRawChunk* palette_chunk = FindChunk(chunk_list, CHUNK_PLTE);
+  const struct PNGChunkData_PLTE* palette = palette_chunk ? palette_chunk->parsed_data : NULL;
+  if (!palette || palette->entries_count > 256)
+    return false;
+  for (int i = 0; i < palette->entries_count; ++i) {
+    image->palette[i][0] = palette->entries[i].red;
+    image->palette[i][1] = palette->entries[i].green;
+    image->palette[i][2] = palette->entries[i].blue;
+    image->palette[i][3] = transparency && i < transparency->bytes_count ? transparency->bytes[i] : 0xFF;
+  }
+  image->palette_size = palette->entries_count;
+  return true;
+}
+
+enum PNGImageType GetConversionImageType(const struct PNGChunkData_IHDR* header,
+                                         const struct PNGChunkData_tRNS* transparency) {
+  if (transparency && header->color_type == PNG_IMAGE_TYPE_GREYSCALE && header->bit_depth <= 8)
+    return PNG_IMAGE_TYPE_INDEXED;
+  return header->color_type;
+}
+
+void SetColorKey(const struct PNGChunkData_IHDR* header, const struct PNGChunkData_tRNS* transparency,
+                 struct RowConverter* converter) {
+  if (header->color_type == PNG_IMAGE_TYPE_GREYSCALE && header->bit_depth == 16) {
+    if (transparency->bytes_count >= 2)
+      SetRowConverterColorKey(converter, transparency->bytes, 2);
+  } else if (header->color_type == PNG_IMAGE_TYPE_TRUECOLOR && transparency->bytes_count >= 6) {
+    if (header->bit_depth == 16) {
+      SetRowConverterColorKey(converter, transparency->bytes, 6);
+    } else if ((transparency->bytes[0] | transparency->bytes[2] | transparency->bytes[4]) == 0) {
+      /* Key with a sample above 255 matches no 8-bit pixel */
+      const uint8_t key[3] = {transparency->bytes[1], transparency->bytes[3], transparency->bytes[5]};
+      SetRowConverterColorKey(converter, key, 3);
+    }
+  }
+}
+
+/*
+ * @brief Get transfer table from curve of image samples to requested one
+ * @param bit_depth Depth of corrected samples, 8 or 16
+ * @return false if allocation failed
+ */
+static bool GetGammaCorrectionLUT(const struct PNGRawChunk* chunk_list, enum PNGGammaCorrection correction,
+                                  int bit_depth, struct TransferLUT* out) {
+  struct TransferCurve source = {.srgb = true, .gamma = 0};
+  const struct PNGRawChunk* gamma_chunk = FindChunk(chunk_list, CHUNK_gAMA);
+  const struct PNGChunkData_gAMA* gamma = gamma_chunk ? gamma_chunk->parsed_data : NULL;
+  if (!FindChunk(chunk_list, CHUNK_sRGB) && gamma && gamma->gamma > 0) {
+    source.srgb = false;
+    source.gamma = gamma->gamma;
+  }
+
+  const struct TransferCurve target = {.srgb = correction == PNG_GAMMA_CORRECTION_SRGB, .gamma = 100000};
+  return GetTransferLUT(source, target, bit_depth, out);
+}
+
+static int GetSampleBitDepth(enum PNGPixelFormat format) {
+  switch (format) {
+    case PNG_PIXEL_FORMAT_RGBA16:
+    case PNG_PIXEL_FORMAT_RGB16:
+    case PNG_PIXEL_FORMAT_G16: return 16;
+    default: return 8;
+  }
+}
+
+/*
+ * Correct color channels of palette entries, so indexed pixels cost nothing extra
+ */
+static void CorrectPalette(const uint8_t* lut, struct PNGImage* image) {
+  for (int i = 0; i < image->palette_size; ++i)
+    for (int c = 0; c < 3; ++c)
+      image->palette[i][c] = lut[image->palette[i][c]];
+}
+
+/* Palette entries of PNG_PIXEL_FORMAT_INDEXED8 have alpha */
+static bool HasAlpha(enum PNGPixelFormat format) {
+  switch (format) {
+    case PNG_PIXEL_FORMAT_RGBA8:
+    case PNG_PIXEL_FORMAT_BGRA8:
+    case PNG_PIXEL_FORMAT_RGBA16:
+    case PNG_PIXEL_FORMAT_INDEXED8: return true;
+    default: return false;
+  }
+}
+
+/*
+ * @brief Get 16-bit background color from bKGD chunk, before gamma correction of palette
+ * @param[in] header Header returned by GetDecodableHeader, its bit depth is not 0
+ * @return false if image has no valid bKGD chunk
+ */
+static bool GetFileBackground(const struct PNGRawChunk* chunk_list, const struct PNGChunkData_IHDR* header,
+                              const struct PNGImage* image, uint16_t* out_rgb16) {
+  const struct PNGRawChunk* background_chunk = FindChunk(chunk_list, CHUNK_bKGD);
+  const struct PNGChunkData_bKGD* background = background_chunk ? background_chunk->parsed_data : NULL;
+  if (!background)
+    return false;
+
+  if (header->color_type == PNG_IMAGE_TYPE_INDEXED) {
+    if (background->samples_count != 0 || background->index_in_palette >= image->palette_size)
+      return false;
+    for (int c = 0; c < 3; ++c)
+      out_rgb16[c] = image->palette[background->index_in_palette][c] * 257;
+    return true;
+  }
+
+  const bool truecolor = header->color_type & 2;
+  if (background->samples_count != (truecolor ? 3 : 1))
+    return false;
+  const uint32_t max = (1u << header->bit_depth) - 1;
+  for (int c = 0; c < 3; ++c) {
+    const uint32_t sample = background->samples[truecolor ? c : 0] & max;
+    out_rgb16[c] = (uint16_t)((sample * 65535 + max / 2) / max);
+  }
+  return true;
+}
+
+static void CorrectBackground(const struct TransferLUT* transfer, uint16_t* rgb16) {
+  for (int c = 0; c < 3; ++c) {
+    if (transfer->lut16)
+      rgb16[c] = transfer->lut16[rgb16[c]];
+    else if (transfer->lut8)
+      rgb16[c] = transfer->lut8[Narrow16To8(rgb16[c])] * 257;
+  }
+}
+
+static void PremultiplyPalette(struct PNGImage* image) {
+  for (int i = 0; i < image->palette_size; ++i)
+    for (int c = 0; c < 3; ++c)
+      image->palette[i][c] = Premultiply8(image->palette[i][c], image->palette[i][3]);
+}
+
+const struct PNGChunkData_IHDR* GetDecodableHeader(const struct PNGRawChunk* chunk_list) {
+  const struct PNGRawChunk* header_chunk = FindChunk(chunk_list, CHUNK_IHDR);
+  const struct PNGChunkData_IHDR* header = header_chunk ? header_chunk->parsed_data : NULL;
+  if (!header || header->width <= 0 || header->height <= 0 || header->interlace_method != 0)
+    return NULL;
+  /* Samples of other depths can't be unpacked, bit depth 0 would divide by zero */
+  if (!PNGIsValidImageFormat(header->color_type, header->bit_depth))
+    return NULL;
+  if (header->filter_method != PNG_FILTERING_METHOD_0)
+    return NULL;
+  if (!PNGGetDataDecompressionFunction(header->compression_method))
+    return NULL;
+  return header;
+}
+
+/*
+ * Consumer of defiltered scanlines
+ * @param[in] scanline Scanline without filter type byte
+ */
+typedef void (*ScanlineFunc)(void* context, int y, const uint8_t* scanline);
+
+/*
+ * @brief Decompress image data and pass each defiltered scanline to `func` while it is still in cache
+ * @param[in] header Header that passed CheckImageLimits
+ * @param output_row_size Bytes written by `func` per scanline, for statistics
+ * @return false if data is corrupted, exceeds inflate ratio or allocation failed
+ */
+static bool DecodeScanlines(const struct PNGRawChunk* chunk_list, const struct PNGChunkData_IHDR* header,
+                            const struct PNGDecodeLimits* limits, enum PNGInflateEngine engine,
+                            struct StatsRecorder* recorder, ScanlineFunc func, void* context, size_t output_row_size) {
+  uint8_t* idat_concated = NULL;
+  int idat_concated_size = 0;
+  if (!ConcatenateAllIDATChunks(chunk_list, recorder, &idat_concated, &idat_concated_size))
+    return false;
+  uint8_t* filtered =
+      InflateImageData(header, idat_concated, idat_concated_size, limits->max_inflate_ratio, engine, recorder);
+  if (!filtered)
+    return false;
+
+  /* Scanlines are defiltered in place, so the previous defiltered scanline is right before the current one */
+  const int scanline_size_bytes = (int)PNGGetScanlineSizeBytes(header);
+  const int pixel_size_bytes = GetFilterPixelSizeBytes(header);
+  const uint8_t* previous = NULL;
+  bool ok = true;
+  uint64_t time = StartStage(recorder);
+  for (int y = 0; ok && y < header->height; ++y) {
+    uint8_t* scanline = filtered + (size_t)y * (scanline_size_bytes + 1);
+    ok = PNGDefilterScanline0(scanline[0], scanline + 1, previous, scanline + 1, scanline_size_bytes,
+                              pixel_size_bytes);
+    if (!ok)
+      break;
+    time = AddStageTime(recorder, PNG_DECODE_STAGE_DEFILTER, time);
+    func(context, y, scanline + 1);
+    time = AddStageTime(recorder, PNG_DECODE_STAGE_CONVERT, time);
+    previous = scanline + 1;
+  }
+
+  ScratchFree(filtered);
+  if (ok) {
+    const uint64_t plain_size = (uint64_t)scanline_size_bytes * header->height;
+    AddStageBytes(recorder, PNG_DECODE_STAGE_DEFILTER, plain_size + header->height, plain_size);
+    AddStageBytes(recorder, PNG_DECODE_STAGE_CONVERT, plain_size, (uint64_t)output_row_size * header->height);
+  }
+  return ok;
+}
+
+struct ImageRowsContext {
+  const struct RowConverter* converter;
+  struct PNGImage* image;
+  bool flip_vertically;
+};
+
+static void ConvertImageRow(void* context, int y, const uint8_t* scanline) {
+  const struct ImageRowsContext* rows = context;
+  const int row = rows->flip_vertically ? rows->image->height - 1 - y : y;
+  ConvertRow(rows->converter, scanline, rows->image->data + (size_t)row * rows->image->row_stride);
+}
+
+bool PrepareImageConversion(const struct PNGRawChunk* chunk_list, const struct PNGChunkData_IHDR* header,
+                            const struct PNGDecodeOptions* options, struct ImageConversion* conversion,
+                            struct PNGImage* out) {
+  PNGInitImage(out);
+  /* Row stride is int */
+  const int64_t row_stride = MultiplySizes(header->width, PNGGetPixelFormatSizeBytes(options->format));
+  if (row_stride > INT_MAX ||
+      !CheckImageLimits(chunk_list, header, &options->limits, MultiplySizes(row_stride, header->height)))
+    return false;
+
+  const struct PNGRawChunk* transparency_chunk = FindChunk(chunk_list, CHUNK_tRNS);
+  const struct PNGChunkData_tRNS* transparency = transparency_chunk ? transparency_chunk->parsed_data : NULL;
+  if (!FillPalette(chunk_list, header, transparency, out))
+    return false;
+
+  const enum PNGImageType conversion_type = GetConversionImageType(header, transparency);
+
+  /* Pixels with alpha are converted to RGBA of output bit depth first, then blended */
+  const bool has_transparency = transparency || header->color_type == PNG_IMAGE_TYPE_GREYSCALEWITHAPLHA ||
+                                header->color_type == PNG_IMAGE_TYPE_TRUECOLORWITHALPHA;
+  const bool flatten =
+      options->alpha_flattening != PNG_ALPHA_FLATTENING_NONE && has_transparency && !HasAlpha(options->format);
+  enum PNGPixelFormat conversion_format = options->format;
+  uint16_t background[3] = {options->background_rgb16[0], options->background_rgb16[1], options->background_rgb16[2]};
+  bool file_background = false;
+  if (flatten) {
+    conversion_format = GetSampleBitDepth(options->format) == 16 ? PNG_PIXEL_FORMAT_RGBA16 : PNG_PIXEL_FORMAT_RGBA8;
+    if (options->alpha_flattening == PNG_ALPHA_FLATTENING_FILE_BACKGROUND)
+      file_background = GetFileBackground(chunk_list, header, out, background);
+  }
+
+  /* Palette and 8-bit formats use 8-bit table, 16-bit formats use 16-bit one */
+  const bool correct_palette =
+      conversion_type == PNG_IMAGE_TYPE_INDEXED || options->format == PNG_PIXEL_FORMAT_INDEXED8;
+  const int transfer_bit_depth = correct_palette ? 8 : GetSampleBitDepth(options->format);
+  struct TransferLUT* transfer = &conversion->transfer;
+  memset(transfer, 0, sizeof(*transfer));
+  if (options->gamma_correction != PNG_GAMMA_CORRECTION_NONE) {
+    if (!GetGammaCorrectionLUT(chunk_list, options->gamma_correction, transfer_bit_depth, transfer))
+      return false;
+    if (correct_palette && transfer->lut8)
+      CorrectPalette(transfer->lut8, out);
+    if (file_background)
+      CorrectBackground(transfer, background);
+  }
+  if (options->premultiply_alpha && correct_palette && HasAlpha(options->format))
+    PremultiplyPalette(out);
+
+  struct RowConverter* converter = &conversion->converter;
+  if (!InitRowConverter(converter, conversion_type, header->bit_depth, header->width, conversion_format,
+                        &out->palette[0][0], out->palette_size) ||
+      (flatten && !SetRowConverterBackground(converter, options->format, background))) {
+    FreeImageConversion(conversion);
+    return false;
+  }
+  if (transparency)
+    SetColorKey(header, transparency, converter);
+  if (!correct_palette) {
+    SetRowConverterTransfer(converter, transfer->lut8, transfer->lut16);
+    if (options->premultiply_alpha && HasAlpha(options->format))
+      SetRowConverterPremultiply(converter);
+  }
+  if (options->format != PNG_PIXEL_FORMAT_INDEXED8)
+    out->palette_size = 0;
+
+  out->format = options->format;
+  out->width = header->width;
+  out->height = header->height;
+  out->row_stride = (int)row_stride;
+  out->data_size = (size_t)out->row_stride * header->height;
+  return true;
+}
+
+void FreeImageConversion(struct ImageConversion* obj) {
+  FreeRowConverter(&obj->converter);
+  FreeTransferLUT(&obj->transfer);
+}
+
+static bool DecodeImage(const struct PNGRawChunk* chunk_list, const struct PNGDecodeOptions* options,
+                        struct StatsRecorder* recorder, struct PNGImage* out) {
+  PNGInitImage(out);
+  const uint64_t setup_start = StartStage(recorder);
+
+  const struct PNGChunkData_IHDR* header = GetDecodableHeader(chunk_list);
+  struct ImageConversion conversion;
+  if (!header || !PrepareImageConversion(chunk_list, header, options, &conversion, out))
+    return false;
+  out->data = malloc(out->data_size);
+  if (!out->data) {
+    FreeImageConversion(&conversion);
+    PNGFreeImage(out);
+    return false;
+  }
+  RecordOutputAllocation(recorder, out->data_size);
+  AddStageTime(recorder, PNG_DECODE_STAGE_SETUP, setup_start);
+
+  struct ImageRowsContext rows = {&conversion.converter, out, options->flip_vertically};
+  const bool ok =
+      DecodeScanlines(chunk_list, header, &options->limits, options->inflate_engine, recorder, ConvertImageRow,
+                      &rows, out->row_stride);
+  FreeImageConversion(&conversion);
+  if (!ok)
+    PNGFreeImage(out);
+  return ok;
+}
+
+bool PNGDecodeImage(const struct PNGRawChunk* chunk_list, const struct PNGDecodeOptions* options,
+                    struct PNGImage* out) {
+  struct PNGDecodeOptions default_options;
+  if (!options) {
+    PNGInitDecodeOptions(&default_options);
+    options = &default_options;
+  }
+  struct StatsRecorder recorder;
+  StartStatsRecorder(&recorder, options->stats);
+  const bool ok = DecodeImage(chunk_list, options, &recorder, out);
+  StopStatsRecorder(&recorder);
+  return ok;
+}
+
+void PNGInitTensorOptions(struct PNGTensorOptions* obj) {
+  obj->type = PNG_TENSOR_TYPE_FLOAT32;
+  obj->channels = 3;
+  for (int c = 0; c < 4; ++c) {
+    obj->scale[c] = 1.0f;
+    obj->offset[c] = 0.0f;
+  }
+  obj->inflate_engine = PNG_INFLATE_ENGINE_BUILTIN;
+  obj->stats = NULL;
+  PNGInitDecodeLimits(&obj->limits);
+}
+
+void PNGInitTensor(struct PNGTensor* obj) {
+  memset(obj, 0, sizeof(struct PNGTensor));
+}
+
+void PNGFreeTensor(struct PNGTensor* obj) {
+  if (!obj)
+    return;
+  free(obj->data);
+  PNGInitTensor(obj);
+}
+
+struct TensorRowsContext {
+  const struct RowConverter* converter;
+  const struct TensorWriter* writer;
+  uint8_t* row;
+  void* tensor;
+};
+
+static void ConvertTensorRow(void* context, int y, const uint8_t* scanline) {
+  const struct TensorRowsContext* rows = context;
+  ConvertRow(rows->converter, scanline, rows->row);
+  WriteTensorRow(rows->writer, rows->row, y, rows->tensor);
+}
+
+static bool DecodeTensor(const struct PNGRawChunk* chunk_list, const struct PNGTensorOptions* options,
+                         struct StatsRecorder* recorder, struct PNGTensor* out) {
+  PNGInitTensor(out);
+  const uint64_t setup_start = StartStage(recorder);
+
+  const struct PNGChunkData_IHDR* header = GetDecodableHeader(chunk_list);
+  if (!header)
+    return false;
+  const int64_t tensor_size = MultiplySizes(MultiplySizes((int64_t)header->width * header->height, options->channels),
+                                            PNGGetTensorTypeSizeBytes(options->type));
+  if (!CheckImageLimits(chunk_list, header, &options->limits, tensor_size))
+    return false;
+
+  const struct PNGRawChunk* transparency_chunk = FindChunk(chunk_list, CHUNK_tRNS);
+  const struct PNGChunkData_tRNS* transparency = transparency_chunk ? transparency_chunk->parsed_data : NULL;
+  struct PNGImage palette;
+  PNGInitImage(&palette);
+  if (!FillPalette(chunk_list, header, transparency, &palette))
+    return false;
+  const enum PNGImageType conversion_type = GetConversionImageType(header, transparency);
+
+  /* Rows are converted to G or RGBA keeping 16-bit precision, then split into planes */
+  const int bit_depth = header->bit_depth == 16 ? 16 : 8;
+  enum PNGPixelFormat format = bit_depth == 16 ? PNG_PIXEL_FORMAT_RGBA16 : PNG_PIXEL_FORMAT_RGBA8;
+  if (options->channels == 1)
+    format = bit_depth == 16 ? PNG_PIXEL_FORMAT_G16 : PNG_PIXEL_FORMAT_G8;
+
+  struct RowConverter converter;
+  struct TensorWriter writer;
+  memset(&writer, 0, sizeof(struct TensorWriter));
+  const bool converter_ready = InitRowConverter(&converter, conversion_type, header->bit_depth, header->width, format,
+                                                &palette.palette[0][0], palette.palette_size);
+  if (converter_ready && transparency)
+    SetColorKey(header, transparency, &converter);
+  uint8_t* row = NULL;
+  const size_t row_size = (size_t)header->width * PNGGetPixelFormatSizeBytes(format);
+  if (converter_ready && InitTensorWriter(&writer, options->type, header->width, header->height, options->channels,
+                                          bit_depth, options->scale, options->offset)) {
+    row = ScratchMalloc(row_size);
+    out->type = options->type;
+    out->channels = options->channels;
+    out->width = header->width;
+    out->height = header->height;
+    out->data_size = writer.plane_size * options->channels * PNGGetTensorTypeSizeBytes(options->type);
+    out->data = malloc(out->data_size);
+  }
+
+  bool ok = row && out->data;
+  if (ok) {
+    RecordOutputAllocation(recorder, out->data_size);
+    AddStageTime(recorder, PNG_DECODE_STAGE_SETUP, setup_start);
+    struct TensorRowsContext rows = {&converter, &writer, row, out->data};
+    const size_t tensor_row_size = (size_t)header->width * options->channels * PNGGetTensorTypeSizeBytes(options->type);
+    ok = DecodeScanlines(chunk_list, header, &options->limits, options->inflate_engine, recorder, ConvertTensorRow,
+                         &rows, tensor_row_size);
+  }
+  ScratchFree(row);
+  FreeTensorWriter(&writer);
+  FreeRowConverter(&converter);
+  if (!ok)
+    PNGFreeTensor(out);
+  return ok;
+}
+
+bool PNGDecodeTensor(const struct PNGRawChunk* chunk_list, const struct PNGTensorOptions* options,
+                     struct PNGTensor* out) {
+  struct PNGTensorOptions default_options;
+  if (!options) {
+    PNGInitTensorOptions(&default_options);
+    options = &default_options;
+  }
+  struct StatsRecorder recorder;
+  StartStatsRecorder(&recorder, options->stats);
+  const bool ok = DecodeTensor(chunk_list, options, &recorder, out);
+  StopStatsRecorder(&recorder);
+  return ok;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "png_core/chunk_data.h"
+#include "png_core/decoder.h"
+
+#include "conversion.h"
+#include "gamma.h"
+
+/*
+ * Steps of decoding shared by still images and animation frames, implemented in decoder.c
+ */
+
+const struct PNGRawChunk* FindChunk(const struct PNGRawChunk* chunk_list, struct ChunkType type);
+
+/*
+ * @return Header of image that can be decoded, NULL otherwise. Color type and bit depth of the header are valid
+ */
+const struct PNGChunkData_IHDR* GetDecodableHeader(const struct PNGRawChunk* chunk_list);
+
+/*
+ * Pixel size used by filters: bytes per complete pixel, rounded up to 1
+ */
+int GetFilterPixelSizeBytes(const struct PNGChunkData_IHDR* header);
+
+/*
+ * Fill output palette: PLTE entries for indexed images, grey ramp for greyscale ones.
+ * Alpha of entries comes from tRNS
+ * @return false if indexed image has no palette
+ */
+bool FillPalette(const struct PNGRawChunk* chunk_list, const struct PNGChunkData_IHDR* header,
+                 const struct PNGChunkData_tRNS* transparency, struct PNGImage* image);
+
+/*
+ * Image type passed to InitRowConverter. Transparent grey of up to 8 bits is a palette entry with zero alpha,
+ * so such images are expanded as indexed
+ */
+enum PNGImageType GetConversionImageType(const struct PNGChunkData_IHDR* header,
+                                         const struct PNGChunkData_tRNS* transparency);
+
+/*
+ * Set transparent color of 16-bit greyscale and truecolor images. Its samples are compared as stored in scanline
+ */
+void SetColorKey(const struct PNGChunkData_IHDR* header, const struct PNGChunkData_tRNS* transparency,
+                 struct RowConverter* converter);
+
+/*
+ * Row conversion of image into output format of decoding options
+ */
+struct ImageConversion {
+  struct RowConverter converter;
+  struct TransferLUT transfer;
+};
+
+/*
+ * @brief Check image against limits and set up conversion from chunks before image data:
+ * palette, transparency, gamma correction, premultiplication and flattening
+ * @param[in] header Header returned by GetDecodableHeader
+ * @param[out] conversion Conversion to free with FreeImageConversion if true is returned
+ * @param[out] out Image properties and palette, without data
+ * @return false if a limit is exceeded, conversion is not supported or allocation failed
+ */
+bool PrepareImageConversion(const struct PNGRawChunk* chunk_list, const struct PNGChunkData_IHDR* header,
+                            const struct PNGDecodeOptions* options, struct ImageConversion* conversion,
+                            struct PNGImage* out);
+
+void FreeImageConversion(struct ImageConversion* obj);
@@ -0,0 +1,82 @@
+#include "deflate.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <zlib.h>
+
+#include "stats_recorder.h"
+
+/* Output is requested from zlib in parts of this size, so race is checked while data is deflated */
+#define PNG_DEFLATE_OUTPUT_PART_SIZE (32 * 1024)
+
+void InitDeflateRace(struct DeflateRace* obj, uint64_t deadline_ns) {
+  atomic_init(&obj->best_size, INT64_MAX);
+  obj->deadline_ns = deadline_ns;
+}
+
+static bool IsValidParams(const struct PNGCompressionParams* params) {
+  return params->level >= Z_DEFAULT_COMPRESSION && params->level <= Z_BEST_COMPRESSION &&
+         params->strategy >= PNG_COMPRESSION_STRATEGY_DEFAULT && params->strategy <= PNG_COMPRESSION_STRATEGY_FIXED &&
+         params->window_bits >= 9 && params->window_bits <= MAX_WBITS && params->mem_level >= 1 &&
+         params->mem_level <= MAX_MEM_LEVEL;
+}
+
+/*
+ * @return true if compression cannot win the race anymore
+ */
+static bool IsRaceLost(const struct DeflateRace* race, uint64_t compressed_size) {
+  if (!race)
+    return false;
+  const int64_t best_size = atomic_load_explicit(&race->best_size, memory_order_relaxed);
+  if (best_size == INT64_MAX)
+    return false;
+  return compressed_size > (uint64_t)best_size || (race->deadline_ns && GetMonotonicTimeNs() > race->deadline_ns);
+}
+
+uint8_t* DeflateZlibStream(const uint8_t* data, int data_size, const struct PNGCompressionParams* params,
+                           const struct DeflateRace* race, int* compressed_size, bool* lost) {
+  if (lost)
+    *lost = false;
+  if (data_size < 0 || !IsValidParams(params))
+    return NULL;
+
+  z_stream stream = {0};
+  if (deflateInit2(&stream, params->level, Z_DEFLATED, params->window_bits, params->mem_level, params->strategy) !=
+      Z_OK)
+    return NULL;
+  const uLong bound = deflateBound(&stream, data_size);
+  uint8_t* compressed = bound <= INT_MAX ? malloc(bound) : NULL;
+  if (!compressed) {
+    deflateEnd(&stream);
+    return NULL;
+  }
+
+  stream.next_in = (Bytef*)data;
+  stream.avail_in = data_size;
+  stream.next_out = compressed;
+  int ret = Z_OK;
+  while (ret == Z_OK) {
+    const uLong available = bound - stream.total_out;
+    stream.avail_out = available < PNG_DEFLATE_OUTPUT_PART_SIZE ? (uInt)available : PNG_DEFLATE_OUTPUT_PART_SIZE;
+    ret = deflate(&stream, Z_FINISH);
+    if (ret == Z_OK && IsRaceLost(race, stream.total_out)) {
+      if (lost)
+        *lost = true;
+      break;
+    }
+  }
+  deflateEnd(&stream);
+  if (ret != Z_STREAM_END) {
+    free(compressed);
+    return NULL;
+  }
+  *compressed_size = (int)stream.total_out;
+  return compressed;
+}
+
+bool IsSameDeflateWindow(int data_size, int window_bits1, int window_bits2) {
+  /* Matches of zlib stay MIN_LOOKAHEAD (262) bytes behind window end */
+  const int64_t needed_size = (int64_t)data_size + 262;
+  return window_bits1 == window_bits2 ||
+         (needed_size <= ((int64_t)1 << window_bits1) && needed_size <= ((int64_t)1 << window_bits2));
+}
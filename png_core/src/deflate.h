@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "png_core/compression.h"
+
+/*
+ * Shared state of concurrent compressions of which only the smallest result is kept
+ */
+struct DeflateRace {
+  /* Smallest finished compressed size so far, INT64_MAX if none. Compression stops once its output exceeds it */
+  atomic_int_least64_t best_size;
+  /* Monotonic time after which compression stops if some compression has finished. 0 for no deadline */
+  uint64_t deadline_ns;
+};
+
+void InitDeflateRace(struct DeflateRace* obj, uint64_t deadline_ns);
+
+/*
+ * @brief Compress data into zlib stream
+ * @param[in, out] race Race to stop compression on, nullable. Its best size is not updated
+ * @param[out] lost Set if compression was stopped by race, nullable
+ * @return zlib stream to free with free() or NULL if parameters are invalid, compression was stopped
+ * or error occurred
+ */
+uint8_t* DeflateZlibStream(const uint8_t* data, int data_size, const struct PNGCompressionParams* params,
+                           const struct DeflateRace* race, int* compressed_size, bool* lost);
+
+/*
+ * @return true if compressing data of `data_size` bytes with windows of `window_bits1` and `window_bits2`
+ * gives the same stream except for window size in zlib header
+ */
+bool IsSameDeflateWindow(int data_size, int window_bits1, int window_bits2);
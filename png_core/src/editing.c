@@ -0,0 +1,290 @@
+#include "png_core/editing.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "file_io.h"
+#include "png_core/chunk_data.h"
+#include "png_core/chunk_writer.h"
+#include "tools.h"
+
+void PNGInitEditPlan(struct PNGEditPlan* obj) {
+  assert(obj);
+
+  PNGInitChunkTable(&obj->table);
+  obj->table.keep_removed_ids = true;
+  obj->inserted = NULL;
+  obj->inserted_count = 0;
+  obj->inserted_capacity = 0;
+  obj->idat_chunk_size = 0;
+}
+
+void PNGFreeEditPlan(struct PNGEditPlan* obj) {
+  if (!obj)
+    return;
+
+  PNGFreeChunkTable(&obj->table);
+  for (int i = 0; i < obj->inserted_count; ++i)
+    free(obj->inserted[i].data);
+  free(obj->inserted);
+  PNGInitEditPlan(obj);
+}
+
+bool PNGCreateEditPlanFromFd(int fd, struct PNGEditPlan* out) {
+  assert(out);
+
+  PNGFreeEditPlan(out);
+  return PNGBuildChunkTableFromFd(fd, &out->table);
+}
+
+bool PNGEditPlanRemoveChunk(struct PNGEditPlan* obj, int entry) {
+  assert(obj);
+  return PNGChunkTableRemove(&obj->table, entry);
+}
+
+int PNGEditPlanRemoveType(struct PNGEditPlan* obj, struct ChunkType type) {
+  assert(obj);
+
+  int removed = 0;
+  int entry = PNGChunkTableFindFirst(&obj->table, type);
+  while (entry != PNG_CHUNK_TABLE_NO_ENTRY) {
+    const int next = obj->table.next_of_type[entry];
+    removed += PNGChunkTableRemove(&obj->table, entry);
+    entry = next;
+  }
+  return removed;
+}
+
+int PNGEditPlanRemoveAncillary(struct PNGEditPlan* obj, const struct ChunkType* keep_types, int keep_types_count) {
+  assert(obj);
+
+  int removed = 0;
+  int entry = obj->table.head;
+  while (entry != PNG_CHUNK_TABLE_NO_ENTRY) {
+    const int next = obj->table.next[entry];
+    const struct ChunkType type = PNGChunkTableGetType(&obj->table, entry);
+
+    bool keep = !IsChunkTypeAncillary(type);
+    for (int i = 0; i < keep_types_count && !keep; ++i)
+      keep = keep_types[i].bytes == type.bytes;
+    if (!keep)
+      removed += PNGChunkTableRemove(&obj->table, entry);
+
+    entry = next;
+  }
+  return removed;
+}
+
+int PNGEditPlanInsertChunk(struct PNGEditPlan* obj, int before, struct ChunkType type, const uint8_t* data,
+                           uint32_t data_size) {
+  assert(obj);
+
+  if (data_size > (uint32_t)s_png_max_chunk_data_size_bytes)
+    return PNG_CHUNK_TABLE_NO_ENTRY;
+
+  if (obj->inserted_count == obj->inserted_capacity) {
+    const int new_capacity = obj->inserted_capacity ? obj->inserted_capacity * 2 : 4;
+    struct PNGEditInsertedChunk* inserted = realloc(obj->inserted, new_capacity * sizeof(struct PNGEditInsertedChunk));
+    if (!inserted)
+      return PNG_CHUNK_TABLE_NO_ENTRY;
+    obj->inserted = inserted;
+    obj->inserted_capacity = new_capacity;
+  }
+
+  uint8_t* copy = malloc(data_size ? data_size : 1);
+  if (!copy)
+    return PNG_CHUNK_TABLE_NO_ENTRY;
+  if (data_size > 0)
+    memcpy(copy, data, data_size);
+
+  const int index = obj->inserted_count;
+  const uint32_t crc = PNGComputeChunkCRC(type, copy, data_size);
+  const int entry = PNGChunkTableInsert(&obj->table, before, type, -1 - (int64_t)index, data_size, crc);
+  if (entry == PNG_CHUNK_TABLE_NO_ENTRY) {
+    free(copy);
+    return PNG_CHUNK_TABLE_NO_ENTRY;
+  }
+
+  obj->inserted[index].data = copy;
+  obj->inserted[index].data_size = data_size;
+  ++obj->inserted_count;
+  return entry;
+}
+
+int PNGEditPlanReplaceChunk(struct PNGEditPlan* obj, int entry, const uint8_t* data, uint32_t data_size) {
+  assert(obj);
+
+  if (!PNGChunkTableIsLive(&obj->table, entry))
+    return PNG_CHUNK_TABLE_NO_ENTRY;
+
+  const struct ChunkType type = PNGChunkTableGetType(&obj->table, entry);
+  const int new_entry = PNGEditPlanInsertChunk(obj, entry, type, data, data_size);
+  if (new_entry == PNG_CHUNK_TABLE_NO_ENTRY)
+    return PNG_CHUNK_TABLE_NO_ENTRY;
+  PNGChunkTableRemove(&obj->table, entry);
+  return new_entry;
+}
+
+int PNGEditPlanInsertText(struct PNGEditPlan* obj, const char* keyword, const char* text) {
+  assert(obj);
+  assert(keyword);
+  assert(text);
+
+  const size_t keyword_length = strlen(keyword);
+  if (keyword_length < 1 || keyword_length > 79)
+    return PNG_CHUNK_TABLE_NO_ENTRY;
+
+  int before = PNGChunkTableFindFirst(&obj->table, CHUNK_IDAT);
+  if (before == PNG_CHUNK_TABLE_NO_ENTRY)
+    before = PNGChunkTableFindFirst(&obj->table, CHUNK_IEND);
+
+  /* PNGWriteData_tEXt only reads the object */
+  struct PNGChunkData_tEXt data;
+  data.keyword = (char*)keyword;
+  data.text = (char*)text;
+  const int data_size = PNGWriteData_tEXt(&data, NULL);
+  uint8_t* serialized = malloc(data_size);
+  if (!serialized)
+    return PNG_CHUNK_TABLE_NO_ENTRY;
+  PNGWriteData_tEXt(&data, serialized);
+
+  const int entry = PNGEditPlanInsertChunk(obj, before, CHUNK_tEXt, serialized, data_size);
+  free(serialized);
+  return entry;
+}
+
+bool PNGEditPlanSetIDATChunkSize(struct PNGEditPlan* obj, uint32_t chunk_size) {
+  assert(obj);
+
+  if (chunk_size > (uint32_t)s_png_max_chunk_data_size_bytes)
+    return false;
+  obj->idat_chunk_size = chunk_size;
+  return true;
+}
+
+/*
+ * Write chunk from data in memory: header, data and CRC at once
+ */
+static bool WriteChunk(int out_fd, struct ChunkType type, const uint8_t* data, uint32_t data_size, uint32_t crc) {
+  uint8_t header[8];
+  uint8_t* ptr = header;
+  WriteNetworkAndAdvanceUInt32(&ptr, data_size);
+  WriteNetworkAndAdvanceBytes(&ptr, type.byte_array, sizeof(type.byte_array));
+  uint8_t crc_bytes[4];
+  ptr = crc_bytes;
+  WriteNetworkAndAdvanceUInt32(&ptr, crc);
+
+  const struct PNGIOVec vecs[3] = {
+      {header, sizeof(header)},
+      {data, data_size},
+      {crc_bytes, sizeof(crc_bytes)},
+  };
+  return PNGWriteIOVecsToFd(out_fd, vecs, 3);
+}
+
+/*
+ * Write run of consecutive IDAT chunks starting at `entry` as chunks of `idat_chunk_size` data bytes
+ * @param[out] out_next Entry following the run
+ * @return Amount of bytes written or -1 if error occurred
+ */
+static int64_t WriteRechunkedIDAT(const struct PNGEditPlan* obj, int entry, int in_fd, int out_fd, int* out_next) {
+  const uint32_t chunk_size = obj->idat_chunk_size;
+  uint8_t* buffer = malloc(chunk_size);
+  if (!buffer)
+    return -1;
+
+  int64_t total_size = 0;
+  uint32_t filled = 0;
+  bool ok = true;
+  for (; ok && entry != PNG_CHUNK_TABLE_NO_ENTRY && obj->table.types[entry] == CHUNK_IDAT.bytes;
+       entry = obj->table.next[entry]) {
+    const int64_t offset = obj->table.offsets[entry];
+    const uint32_t size = obj->table.sizes[entry];
+    for (uint32_t consumed = 0; ok && consumed < size;) {
+      const uint32_t portion = size - consumed < chunk_size - filled ? size - consumed : chunk_size - filled;
+      if (offset >= 0)
+        ok = ReadFileAt(in_fd, buffer + filled, portion, offset + consumed);
+      else
+        memcpy(buffer + filled, obj->inserted[-1 - offset].data + consumed, portion);
+      consumed += portion;
+      filled += portion;
+
+      if (ok && filled == chunk_size) {
+        ok = WriteChunk(out_fd, CHUNK_IDAT, buffer, filled, PNGComputeChunkCRC(CHUNK_IDAT, buffer, filled));
+        total_size += 12 + (int64_t)filled;
+        filled = 0;
+      }
+    }
+  }
+  /* Rest of data. Empty chunk is written only if there were no data at all */
+  if (ok && (filled > 0 || total_size == 0)) {
+    ok = WriteChunk(out_fd, CHUNK_IDAT, buffer, filled, PNGComputeChunkCRC(CHUNK_IDAT, buffer, filled));
+    total_size += 12 + (int64_t)filled;
+  }
+
+  free(buffer);
+  *out_next = entry;
+  return ok ? total_size : -1;
+}
+
+/*
+ * Write inserted chunk: header, data and CRC at once
+ */
+static bool WriteInsertedChunk(const struct PNGEditPlan* obj, int entry, int out_fd) {
+  const struct PNGEditInsertedChunk* inserted = &obj->inserted[-1 - obj->table.offsets[entry]];
+  return WriteChunk(out_fd, PNGChunkTableGetType(&obj->table, entry), inserted->data, inserted->data_size,
+                    obj->table.crcs[entry]);
+}
+
+int64_t PNGWriteEditPlanToFd(const struct PNGEditPlan* obj, int in_fd, int out_fd) {
+  assert(obj);
+
+  const struct PNGIOVec signature = {s_png_signature, sizeof(s_png_signature)};
+  if (!PNGWriteIOVecsToFd(out_fd, &signature, 1))
+    return -1;
+  int64_t total_size = sizeof(s_png_signature);
+
+  /* Range of consecutive kept chunks in source file, copied at once */
+  int64_t copy_begin = 0;
+  int64_t copy_end = 0;
+
+  int entry = obj->table.head;
+  while (entry != PNG_CHUNK_TABLE_NO_ENTRY) {
+    const int64_t offset = obj->table.offsets[entry];
+    const int64_t chunk_size = 12 + (int64_t)obj->table.sizes[entry];
+
+    if (obj->idat_chunk_size > 0 && obj->table.types[entry] == CHUNK_IDAT.bytes) {
+      if (copy_end > copy_begin && !CopyFileRange(in_fd, copy_begin, copy_end - copy_begin, out_fd))
+        return -1;
+      copy_begin = copy_end = 0;
+      const int64_t written = WriteRechunkedIDAT(obj, entry, in_fd, out_fd, &entry);
+      if (written < 0)
+        return -1;
+      total_size += written;
+      continue;
+    }
+
+    total_size += chunk_size;
+    if (offset >= 0) {
+      const int64_t chunk_begin = offset - 8;
+      if (chunk_begin != copy_end) {
+        if (copy_end > copy_begin && !CopyFileRange(in_fd, copy_begin, copy_end - copy_begin, out_fd))
+          return -1;
+        copy_begin = chunk_begin;
+      }
+      copy_end = chunk_begin + chunk_size;
+    } else {
+      if (copy_end > copy_begin && !CopyFileRange(in_fd, copy_begin, copy_end - copy_begin, out_fd))
+        return -1;
+      copy_begin = copy_end = 0;
+      if (!WriteInsertedChunk(obj, entry, out_fd))
+        return -1;
+    }
+    entry = obj->table.next[entry];
+  }
+
+  if (copy_end > copy_begin && !CopyFileRange(in_fd, copy_begin, copy_end - copy_begin, out_fd))
+    return -1;
+  return total_size;
+}
@@ -0,0 +1,1049 @@
+#include "png_core/encoder.h"
+
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "png_core/chunk_types.h"
+#include "png_core/compression.h"
+#include "png_core/pixel_format.h"
+
+#include "deflate.h"
+#include "stats_recorder.h"
+#include "thread_pool.h"
+#include "tools.h"
+
+void PNGInitEncodeOptions(struct PNGEncodeOptions* obj) {
+  obj->filter_selection = PNG_FILTER_SELECTION_ADAPTIVE;
+  PNGInitCompressionParams(&obj->compression);
+  obj->idat_chunk_size = 65536;
+  obj->palette = NULL;
+  obj->transparency = NULL;
+  obj->reduce = false;
+}
+
+static bool IsValidPalette(const struct PNGChunkData_PLTE* palette, const struct PNGChunkData_IHDR* header) {
+  switch (header->color_type) {
+    case PNG_IMAGE_TYPE_INDEXED: {
+      if (!palette)
+        return false;
+      return palette->entries_count >= 1 && palette->entries_count <= (1 << header->bit_depth);
+    }
+    case PNG_IMAGE_TYPE_TRUECOLOR:
+    case PNG_IMAGE_TYPE_TRUECOLORWITHALPHA:
+      return !palette || (palette->entries_count >= 1 && palette->entries_count <= 256);
+    /* PLTE must not appear for greyscale images */
+    default: return !palette;
+  }
+}
+
+static bool IsValidTransparency(const struct PNGChunkData_tRNS* transparency, const struct PNGChunkData_PLTE* palette,
+                                const struct PNGChunkData_IHDR* header) {
+  if (!transparency)
+    return true;
+  int samples_count = 0;
+  switch (header->color_type) {
+    /* Palette is already checked */
+    case PNG_IMAGE_TYPE_INDEXED:
+      return transparency->bytes_count >= 1 && transparency->bytes_count <= palette->entries_count;
+    case PNG_IMAGE_TYPE_GREYSCALE: samples_count = 1; break;
+    case PNG_IMAGE_TYPE_TRUECOLOR: samples_count = 3; break;
+    /* tRNS must not appear for images with alpha channel */
+    default: return false;
+  }
+  if (transparency->bytes_count != 2 * samples_count)
+    return false;
+  for (int i = 0; i < samples_count; ++i)
+    if (PNGGetTransparentSample_tRNS(transparency, i) >= (1 << header->bit_depth))
+      return false;
+  return true;
+}
+
+/*
+ * @brief Check image and chunk options, derive image height
+ * @param[out] header Header of non-interlaced image
+ * @return false if image or options are invalid
+ */
+static bool PrepareHeader(const struct PNGRawImage* image, const struct PNGChunkData_PLTE* palette,
+                          const struct PNGChunkData_tRNS* transparency, uint32_t idat_chunk_size,
+                          struct PNGChunkData_IHDR* header) {
+  if (!image->data || image->data_size <= 0 || image->scanline_pixel_count <= 0)
+    return false;
+  if (!PNGIsValidImageFormat(image->type, image->channel_bit_depth))
+    return false;
+  if (idat_chunk_size == 0 || idat_chunk_size > INT_MAX)
+    return false;
+
+  PNGInitData_IHDR(header);
+  header->width = image->scanline_pixel_count;
+  header->height = 1;
+  header->bit_depth = (int8_t)image->channel_bit_depth;
+  header->color_type = (int8_t)image->type;
+  header->compression_method = PNG_COMPRESSION_METHOD_0;
+  header->filter_method = PNG_FILTERING_METHOD_0;
+  header->interlace_method = 0;
+
+  const int64_t scanline_size_bytes = PNGGetScanlineSizeBytes(header);
+  if (scanline_size_bytes > image->data_size || image->data_size % scanline_size_bytes)
+    return false;
+  header->height = (int32_t)(image->data_size / scanline_size_bytes);
+  /* Each filtered scanline gets filter type byte */
+  if (image->data_size > INT_MAX - header->height)
+    return false;
+  return IsValidPalette(palette, header) && IsValidTransparency(transparency, palette, header);
+}
+
+/*
+ * Image with PLTE and tRNS data as written into datastream
+ */
+struct EncodedImage {
+  struct PNGReducedImage reduced;
+  const struct PNGChunkData_PLTE* palette;
+  const struct PNGChunkData_tRNS* transparency;
+  struct PNGChunkData_IHDR header;
+};
+
+/*
+ * @brief Check image and options, reduce image if requested
+ * @param[out] out Image to encode, free with FreeEncodedImage if true is returned
+ * @return false if image or options are invalid or allocation failed
+ */
+static bool PrepareEncodedImage(const struct PNGRawImage* image, const struct PNGChunkData_PLTE* palette,
+                                const struct PNGChunkData_tRNS* transparency, bool reduce,
+                                uint32_t idat_chunk_size, struct EncodedImage* out) {
+  if (!PrepareHeader(image, palette, transparency, idat_chunk_size, &out->header))
+    return false;
+  out->palette = palette;
+  out->transparency = transparency;
+  if (!reduce || transparency || image->type == PNG_IMAGE_TYPE_INDEXED) {
+    memset(&out->reduced, 0, sizeof(out->reduced));
+    PNGInitData_PLTE(&out->reduced.palette);
+    PNGInitData_tRNS(&out->reduced.transparency);
+    out->reduced.image = *image;
+    return true;
+  }
+
+  if (!PNGReduceRawImage(image, &out->reduced))
+    return false;
+  const enum PNGImageType type = out->reduced.image.type;
+  /* Suggested palette stays valid for truecolor images only */
+  if (type != PNG_IMAGE_TYPE_TRUECOLOR && type != PNG_IMAGE_TYPE_TRUECOLORWITHALPHA)
+    out->palette = NULL;
+  if (out->reduced.palette.entries_count)
+    out->palette = &out->reduced.palette;
+  if (out->reduced.transparency.bytes_count)
+    out->transparency = &out->reduced.transparency;
+  if (!PrepareHeader(&out->reduced.image, out->palette, out->transparency, idat_chunk_size, &out->header)) {
+    PNGFreeReducedImage(&out->reduced);
+    return false;
+  }
+  return true;
+}
+
+static void FreeEncodedImage(struct EncodedImage* obj) {
+  PNGFreeReducedImage(&obj->reduced);
+}
+
+/*
+ * @return Filter selection applied to image for requested one
+ */
+static enum PNGFilterSelection GetAppliedFilterSelection(const struct PNGChunkData_IHDR* header,
+                                                         enum PNGFilterSelection selection) {
+  if (selection == PNG_FILTER_SELECTION_ADAPTIVE &&
+      (header->color_type == PNG_IMAGE_TYPE_INDEXED || header->bit_depth < 8))
+    return PNG_FILTER_SELECTION_NONE;
+  return selection;
+}
+
+/*
+ * @return Filtered scanlines of size image->data_size + header->height to free with free() or NULL if error occurred
+ */
+static uint8_t* FilterImageData(const struct PNGRawImage* image, const struct PNGChunkData_IHDR* header,
+                                enum PNGFilterSelection selection) {
+  const int scanline_size_bytes = (int)PNGGetScanlineSizeBytes(header);
+  /* Scanlines of sub-byte pixels are filtered as scanlines of 1-byte pixels */
+  const int pixel_size_bytes = (PNGGetChannelCount(header->color_type) * header->bit_depth + 7) / 8;
+  uint8_t* filtered = malloc(image->data_size + header->height);
+  if (!filtered)
+    return NULL;
+  if (!PNGFilterScanlines0(image->data, image->data_size, scanline_size_bytes, pixel_size_bytes,
+                           GetAppliedFilterSelection(header, selection), filtered)) {
+    free(filtered);
+    return NULL;
+  }
+  return filtered;
+}
+
+/*
+ * @brief Create chunk with data parsed from serialized `data`, which is also used for CRC
+ * @return Chunk or NULL if allocation failed
+ */
+static struct PNGRawChunk* CreateChunk(struct ChunkType type, const uint8_t* data, uint32_t data_size) {
+  struct PNGRawChunk* chunk = PNGAllocateRawChunk();
+  if (!chunk)
+    return NULL;
+  chunk->type = type;
+  chunk->data_functions = PNGGetChunkDataStructFunctions(type);
+  chunk->parsed_data = chunk->data_functions.load_func(data, data_size);
+  if (!chunk->parsed_data) {
+    PNGFreeRawChunk(chunk);
+    return NULL;
+  }
+  chunk->crc = PNGComputeChunkCRC(type, data, data_size);
+  return chunk;
+}
+
+/*
+ * @brief Build chunk list IHDR, PLTE, tRNS, IDAT..., IEND around zlib stream
+ * @return Chunk list or NULL if allocation failed
+ */
+static struct PNGRawChunk* CreateChunkList(const struct EncodedImage* image, const uint8_t* compressed,
+                                           int compressed_size, uint32_t idat_chunk_size) {
+  /* Largest serialized chunk besides IDAT is PLTE of 256 entries */
+  uint8_t serialized[3 * 256];
+  struct PNGRawChunk* list = CreateChunk(CHUNK_IHDR, serialized, PNGWriteData_IHDR(&image->header, serialized));
+  struct PNGRawChunk* last = list;
+  if (last && image->palette) {
+    last->next = CreateChunk(CHUNK_PLTE, serialized, PNGWriteData_PLTE(image->palette, serialized));
+    last = last->next;
+  }
+  if (last && image->transparency) {
+    last->next = CreateChunk(CHUNK_tRNS, serialized, PNGWriteData_tRNS(image->transparency, serialized));
+    last = last->next;
+  }
+  /* Empty zlib stream is impossible, so there is at least one IDAT chunk */
+  for (int offset = 0; last && offset < compressed_size; offset += (int)idat_chunk_size) {
+    const int remaining = compressed_size - offset;
+    const int size = remaining < (int)idat_chunk_size ? remaining : (int)idat_chunk_size;
+    last->next = CreateChunk(CHUNK_IDAT, compressed + offset, size);
+    last = last->next;
+  }
+  if (last) {
+    last->next = CreateChunk(CHUNK_IEND, NULL, 0);
+    last = last->next;
+  }
+
+  if (!last) {
+    PNGFreeRawChunk(list);
+    return NULL;
+  }
+  return list;
+}
+
+/*
+ * @brief Write chunk list with signature into new buffer and free the list
+ * @return Datastream or NULL if list is NULL or allocation failed
+ */
+static uint8_t* WriteAndFreeChunkList(struct PNGRawChunk* list, int* out_size) {
+  if (!list)
+    return NULL;
+
+  const int size = PNGWriteRawChunkList(list, NULL, true);
+  uint8_t* out = malloc(size);
+  if (out) {
+    PNGWriteRawChunkList(list, out, true);
+    *out_size = size;
+  }
+  PNGFreeRawChunk(list);
+  return out;
+}
+
+struct PNGRawChunk* PNGEncodeRawImageToChunkList(const struct PNGRawImage* image,
+                                                 const struct PNGEncodeOptions* options) {
+  struct PNGEncodeOptions default_options;
+  if (!options) {
+    PNGInitEncodeOptions(&default_options);
+    options = &default_options;
+  }
+  struct EncodedImage encoded;
+  if (!PrepareEncodedImage(image, options->palette, options->transparency, options->reduce, options->idat_chunk_size,
+                           &encoded))
+    return NULL;
+
+  const struct PNGRawImage* plain = &encoded.reduced.image;
+  uint8_t* filtered = FilterImageData(plain, &encoded.header, options->filter_selection);
+  int compressed_size = 0;
+  uint8_t* compressed =
+      filtered ? PNGDataCompress0WithParams(filtered, plain->data_size + encoded.header.height, &options->compression,
+                                            &compressed_size)
+               : NULL;
+  free(filtered);
+  struct PNGRawChunk* list =
+      compressed ? CreateChunkList(&encoded, compressed, compressed_size, options->idat_chunk_size) : NULL;
+  PNGFreeCompressionData(compressed);
+  FreeEncodedImage(&encoded);
+  return list;
+}
+
+uint8_t* PNGEncodeRawImage(const struct PNGRawImage* image, const struct PNGEncodeOptions* options, int* out_size) {
+  return WriteAndFreeChunkList(PNGEncodeRawImageToChunkList(image, options), out_size);
+}
+
+void PNGInitOptimizeOptions(struct PNGOptimizeOptions* obj) {
+  obj->effort = 2;
+  obj->time_budget_ms = 0;
+  obj->threads_count = 0;
+  obj->idat_chunk_size = 65536;
+  obj->palette = NULL;
+  obj->transparency = NULL;
+  obj->reduce = true;
+}
+
+/*
+ * Values of each parameter tried by effort level, most promising first
+ */
+struct OptimizeSearchSpace {
+  const enum PNGFilterSelection* filters;
+  int filters_count;
+  const enum PNGCompressionStrategy* strategies;
+  int strategies_count;
+  const int* levels;
+  int levels_count;
+  const int* window_bits;
+  int window_bits_count;
+  const int* mem_levels;
+  int mem_levels_count;
+};
+
+#define PNG_OPTIMIZE_COUNT(array) ((int)(sizeof(array) / sizeof(array[0])))
+
+static const enum PNGFilterSelection s_optimize_filters[] = {
+    PNG_FILTER_SELECTION_ADAPTIVE, PNG_FILTER_SELECTION_NONE,    PNG_FILTER_SELECTION_SUB,
+    PNG_FILTER_SELECTION_UP,       PNG_FILTER_SELECTION_AVERAGE, PNG_FILTER_SELECTION_PAETH};
+static const enum PNGCompressionStrategy s_optimize_strategies[] = {
+    PNG_COMPRESSION_STRATEGY_DEFAULT, PNG_COMPRESSION_STRATEGY_FILTERED, PNG_COMPRESSION_STRATEGY_RLE,
+    PNG_COMPRESSION_STRATEGY_HUFFMAN_ONLY, PNG_COMPRESSION_STRATEGY_FIXED};
+static const int s_optimize_levels[] = {9, 8, 7, 6, 5, 4, 3, 2, 1};
+static const int s_optimize_window_bits[] = {15, 12, 9};
+static const int s_optimize_mem_levels[] = {9, 8, 6, 4};
+
+/*
+ * Effort 1..3 take leading values of the lists above
+ */
+static struct OptimizeSearchSpace GetOptimizeSearchSpace(int effort) {
+  struct OptimizeSearchSpace space = {s_optimize_filters, 2, s_optimize_strategies, 2, s_optimize_levels, 1,
+                                      s_optimize_window_bits, 1, s_optimize_mem_levels, 1};
+  if (effort >= 2) {
+    space.filters_count = PNG_OPTIMIZE_COUNT(s_optimize_filters);
+    space.strategies_count = 3;
+    space.mem_levels_count = 2;
+  }
+  if (effort >= 3) {
+    space.strategies_count = PNG_OPTIMIZE_COUNT(s_optimize_strategies);
+    space.levels_count = PNG_OPTIMIZE_COUNT(s_optimize_levels);
+    space.window_bits_count = PNG_OPTIMIZE_COUNT(s_optimize_window_bits);
+    space.mem_levels_count = PNG_OPTIMIZE_COUNT(s_optimize_mem_levels);
+  }
+  return space;
+}
+
+struct OptimizeTrial {
+  /* Index in OptimizeSearch::filtered */
+  int filter_index;
+  struct PNGCompressionParams params;
+};
+
+/*
+ * @return false if trial gives the same size as one listed before it
+ */
+static bool IsDistinctTrial(const struct OptimizeSearchSpace* space, int level_index, int window_index,
+                            enum PNGCompressionStrategy strategy, int data_size) {
+  /* Huffman-only and RLE compressors ignore level and window */
+  if ((strategy == PNG_COMPRESSION_STRATEGY_HUFFMAN_ONLY || strategy == PNG_COMPRESSION_STRATEGY_RLE) &&
+      (level_index > 0 || window_index > 0))
+    return false;
+  return window_index == 0 ||
+         !IsSameDeflateWindow(data_size, space->window_bits[window_index], space->window_bits[window_index - 1]);
+}
+
+/*
+ * Best trial found by one worker
+ */
+struct OptimizeWorker {
+  uint8_t* compressed;
+  int compressed_size;
+  int trial_index;
+
+  int finished_trials_count;
+  int stopped_trials_count;
+};
+
+struct OptimizeSearch {
+  const struct OptimizeTrial* trials;
+  int trials_count;
+  /* Filtered image data of each filter selection of search space */
+  uint8_t* filtered[PNG_OPTIMIZE_COUNT(s_optimize_filters)];
+  int filtered_size;
+
+  atomic_int next_trial;
+  struct DeflateRace race;
+  struct OptimizeWorker* workers;
+};
+
+static void LowerBestSize(struct DeflateRace* race, int64_t size) {
+  int64_t best_size = atomic_load(&race->best_size);
+  while (size < best_size && !atomic_compare_exchange_weak(&race->best_size, &best_size, size)) {
+  }
+}
+
+static void RunOptimizeWorker(void* context, int worker_index) {
+  struct OptimizeSearch* search = context;
+  struct OptimizeWorker* worker = &search->workers[worker_index];
+  while (true) {
+    if (search->race.deadline_ns && atomic_load(&search->race.best_size) != INT64_MAX &&
+        GetMonotonicTimeNs() > search->race.deadline_ns)
+      break;
+    const int trial_index = atomic_fetch_add(&search->next_trial, 1);
+    if (trial_index >= search->trials_count)
+      break;
+
+    const struct OptimizeTrial* trial = &search->trials[trial_index];
+    int size = 0;
+    bool lost = false;
+    uint8_t* compressed = DeflateZlibStream(search->filtered[trial->filter_index], search->filtered_size,
+                                            &trial->params, &search->race, &size, &lost);
+    if (!compressed) {
+      worker->stopped_trials_count += lost;
+      continue;
+    }
+    ++worker->finished_trials_count;
+
+    /* Trials are taken in order, so a later trial of this worker wins only by size */
+    if (size > atomic_load(&search->race.best_size) || (worker->compressed && size >= worker->compressed_size)) {
+      free(compressed);
+      continue;
+    }
+    LowerBestSize(&search->race, size);
+    free(worker->compressed);
+    worker->compressed = compressed;
+    worker->compressed_size = size;
+    worker->trial_index = trial_index;
+  }
+}
+
+/*
+ * @brief List distinct trials of search space and filter image data for them
+ * @return false if allocation failed
+ */
+static bool PrepareOptimizeSearch(const struct PNGRawImage* image, const struct PNGChunkData_IHDR* header,
+                                  int effort, struct OptimizeSearch* search) {
+  const struct OptimizeSearchSpace space = GetOptimizeSearchSpace(effort);
+  search->filtered_size = image->data_size + header->height;
+  const int max_trials_count = space.filters_count * space.strategies_count * space.levels_count *
+                               space.window_bits_count * space.mem_levels_count;
+  struct OptimizeTrial* trials = malloc(sizeof(struct OptimizeTrial) * max_trials_count);
+  search->trials = trials;
+  search->trials_count = 0;
+  if (!trials)
+    return false;
+
+  for (int f = 0; f < space.filters_count; ++f) {
+    const enum PNGFilterSelection selection = space.filters[f];
+    /* Adaptive selection that falls back to None repeats None */
+    if (GetAppliedFilterSelection(header, selection) != selection)
+      continue;
+    search->filtered[f] = FilterImageData(image, header, selection);
+    if (!search->filtered[f])
+      return false;
+  }
+
+  for (int m = 0; m < space.mem_levels_count; ++m)
+    for (int w = 0; w < space.window_bits_count; ++w)
+      for (int l = 0; l < space.levels_count; ++l)
+        for (int s = 0; s < space.strategies_count; ++s) {
+          if (!IsDistinctTrial(&space, l, w, space.strategies[s], search->filtered_size))
+            continue;
+          for (int f = 0; f < space.filters_count; ++f) {
+            if (!search->filtered[f])
+              continue;
+            struct OptimizeTrial* trial = &trials[search->trials_count++];
+            trial->filter_index = f;
+            trial->params.level = space.levels[l];
+            trial->params.strategy = space.strategies[s];
+            trial->params.window_bits = space.window_bits[w];
+            trial->params.mem_level = space.mem_levels[m];
+          }
+        }
+  return true;
+}
+
+uint8_t* PNGOptimizeRawImage(const struct PNGRawImage* image, const struct PNGOptimizeOptions* options,
+                             int* out_size, struct PNGOptimizeResult* result) {
+  struct PNGOptimizeOptions default_options;
+  if (!options) {
+    PNGInitOptimizeOptions(&default_options);
+    options = &default_options;
+  }
+  if (options->effort < 1 || options->effort > 3 || options->threads_count < 0)
+    return NULL;
+  struct EncodedImage encoded;
+  if (!PrepareEncodedImage(image, options->palette, options->transparency, options->reduce, options->idat_chunk_size,
+                           &encoded))
+    return NULL;
+
+  const uint64_t start_ns = GetMonotonicTimeNs();
+  struct OptimizeSearch search;
+  memset(search.filtered, 0, sizeof(search.filtered));
+  const bool prepared = PrepareOptimizeSearch(&encoded.reduced.image, &encoded.header, options->effort, &search);
+
+  int workers_count = options->threads_count ? options->threads_count : GetOnlineCPUCount();
+  workers_count = workers_count < search.trials_count ? workers_count : search.trials_count;
+  search.workers = prepared ? calloc(workers_count, sizeof(struct OptimizeWorker)) : NULL;
+  if (search.workers) {
+    atomic_init(&search.next_trial, 0);
+    InitDeflateRace(&search.race,
+                    options->time_budget_ms ? start_ns + (uint64_t)options->time_budget_ms * 1000000u : 0);
+    workers_count = RunParallel(RunOptimizeWorker, &search, workers_count);
+  }
+  for (int i = 0; i < PNG_OPTIMIZE_COUNT(search.filtered); ++i)
+    free(search.filtered[i]);
+
+  /* Smallest size, then first listed trial */
+  const struct OptimizeWorker* best = NULL;
+  int finished_trials_count = 0;
+  int stopped_trials_count = 0;
+  for (int i = 0; search.workers && i < workers_count; ++i) {
+    const struct OptimizeWorker* worker = &search.workers[i];
+    finished_trials_count += worker->finished_trials_count;
+    stopped_trials_count += worker->stopped_trials_count;
+    if (worker->compressed &&
+        (!best || worker->compressed_size < best->compressed_size ||
+         (worker->compressed_size == best->compressed_size && worker->trial_index < best->trial_index)))
+      best = worker;
+  }
+
+  uint8_t* out = NULL;
+  if (best) {
+    const struct OptimizeTrial* trial = &search.trials[best->trial_index];
+    out = WriteAndFreeChunkList(
+        CreateChunkList(&encoded, best->compressed, best->compressed_size, options->idat_chunk_size), out_size);
+    if (out && result) {
+      PNGInitEncodeOptions(&result->encode_options);
+      result->encode_options.filter_selection = s_optimize_filters[trial->filter_index];
+      result->encode_options.compression = trial->params;
+      result->encode_options.idat_chunk_size = options->idat_chunk_size;
+      result->encode_options.palette = options->palette;
+      result->encode_options.transparency = options->transparency;
+      result->encode_options.reduce = options->reduce;
+      result->trials_count = search.trials_count;
+      result->finished_trials_count = finished_trials_count;
+      result->stopped_trials_count = stopped_trials_count;
+      result->skipped_trials_count = search.trials_count - finished_trials_count - stopped_trials_count;
+    }
+  }
+
+  for (int i = 0; search.workers && i < workers_count; ++i)
+    free(search.workers[i].compressed);
+  free(search.workers);
+  free((void*)search.trials);
+  FreeEncodedImage(&encoded);
+  return out;
+}
+
+void PNGInitEncodeAnimationOptions(struct PNGEncodeAnimationOptions* obj) {
+  PNGInitEncodeOptions(&obj->encode);
+  obj->plays_count = 0;
+  obj->threads_count = 0;
+  obj->optimize_frames = true;
+}
+
+/*
+ * Region of canvas in pixels
+ */
+struct FrameRect {
+  int x;
+  int y;
+  int width;
+  int height;
+};
+
+/*
+ * Canvas before a frame is rendered: pixels of `base` frame with `cleared` region of transparent black ones.
+ * Whole canvas is cleared if base is NULL
+ */
+struct CanvasView {
+  const uint8_t* base;
+  struct FrameRect cleared;
+};
+
+/*
+ * Frame as written into datastream
+ */
+struct AnimationFrame {
+  struct PNGChunkData_fcTL control;
+  /* Plain scanlines of frame region, freed once compressed */
+  uint8_t* data;
+  int data_size;
+  uint8_t* compressed;
+  int compressed_size;
+};
+
+struct AnimationEncoder {
+  const struct PNGChunkData_IHDR* header;
+  int scanline_size;
+  int pixel_bits;
+  /* Offset and size of alpha sample in pixel of 8 and 16-bit images with alpha channel. Size is 0 for others */
+  int alpha_offset;
+  int alpha_size;
+  /* Canvas row with cleared region */
+  uint8_t* canvas_row;
+  /* Row of cleared canvas */
+  uint8_t* zero_row;
+  uint8_t* payload_row;
+};
+
+static bool InitAnimationEncoder(struct AnimationEncoder* obj, const struct PNGChunkData_IHDR* header) {
+  const int channels_count = PNGGetChannelCount(header->color_type);
+  obj->header = header;
+  obj->scanline_size = (int)PNGGetScanlineSizeBytes(header);
+  obj->pixel_bits = channels_count * header->bit_depth;
+  obj->alpha_size = 0;
+  obj->alpha_offset = 0;
+  if (header->color_type == PNG_IMAGE_TYPE_GREYSCALEWITHAPLHA ||
+      header->color_type == PNG_IMAGE_TYPE_TRUECOLORWITHALPHA) {
+    obj->alpha_size = header->bit_depth / 8;
+    obj->alpha_offset = (channels_count - 1) * obj->alpha_size;
+  }
+  obj->canvas_row = malloc(obj->scanline_size);
+  obj->zero_row = calloc(1, obj->scanline_size);
+  obj->payload_row = malloc(obj->scanline_size);
+  return obj->canvas_row && obj->zero_row && obj->payload_row;
+}
+
+static void FreeAnimationEncoder(struct AnimationEncoder* obj) {
+  free(obj->canvas_row);
+  free(obj->zero_row);
+  free(obj->payload_row);
+}
+
+static int GetRectByteOffset(const struct AnimationEncoder* obj, int x) {
+  return (int)((int64_t)x * obj->pixel_bits / 8);
+}
+
+static int GetRectRowSize(const struct AnimationEncoder* obj, int width) {
+  return (int)(((int64_t)width * obj->pixel_bits + 7) / 8);
+}
+
+/*
+ * Cleared pixels are zero samples only in images with alpha channel, in others they have no stored value
+ */
+static bool HasClearedPixels(const struct CanvasView* view) {
+  return !view->base || view->cleared.width > 0;
+}
+
+static const uint8_t* GetCanvasRow(const struct AnimationEncoder* obj, const struct CanvasView* view, int y) {
+  if (!view->base)
+    return obj->zero_row;
+  const uint8_t* row = view->base + (size_t)y * obj->scanline_size;
+  const struct FrameRect* cleared = &view->cleared;
+  if (cleared->width == 0 || y < cleared->y || y >= cleared->y + cleared->height)
+    return row;
+  memcpy(obj->canvas_row, row, obj->scanline_size);
+  memset(obj->canvas_row + GetRectByteOffset(obj, cleared->x), 0, GetRectRowSize(obj, cleared->width));
+  return obj->canvas_row;
+}
+
+/*
+ * @brief Find bounding rectangle of frame pixels that differ from canvas.
+ * Rectangle of sub-byte pixels is widened to whole bytes
+ * @return false if frame equals canvas
+ */
+static bool FindChangedRect(const struct AnimationEncoder* obj, const struct CanvasView* view, const uint8_t* frame,
+                            struct FrameRect* out) {
+  int first_byte = INT_MAX;
+  int last_byte = -1;
+  int first_row = -1;
+  int last_row = -1;
+  for (int y = 0; y < obj->header->height; ++y) {
+    const uint8_t* canvas = GetCanvasRow(obj, view, y);
+    const uint8_t* row = frame + (size_t)y * obj->scanline_size;
+    if (!memcmp(canvas, row, obj->scanline_size))
+      continue;
+    int left = 0;
+    while (canvas[left] == row[left])
+      ++left;
+    int right = obj->scanline_size - 1;
+    while (canvas[right] == row[right])
+      --right;
+    first_byte = left < first_byte ? left : first_byte;
+    last_byte = right > last_byte ? right : last_byte;
+    if (first_row < 0)
+      first_row = y;
+    last_row = y;
+  }
+  if (last_row < 0)
+    return false;
+
+  if (obj->pixel_bits >= 8) {
+    const int pixel_size = obj->pixel_bits / 8;
+    out->x = first_byte / pixel_size;
+    out->width = last_byte / pixel_size + 1 - out->x;
+  } else {
+    const int pixels_in_byte = 8 / obj->pixel_bits;
+    const int end = (last_byte + 1) * pixels_in_byte;
+    out->x = first_byte * pixels_in_byte;
+    out->width = (end < obj->header->width ? end : obj->header->width) - out->x;
+  }
+  out->y = first_row;
+  out->height = last_row - first_row + 1;
+  return true;
+}
+
+static bool IsAlphaSample(const uint8_t* sample, int size, uint8_t value) {
+  for (int i = 0; i < size; ++i)
+    if (sample[i] != value)
+      return false;
+  return true;
+}
+
+/*
+ * @brief Write frame pixels of rectangle row. With blend op over, pixels equal to canvas become transparent black
+ * @return false if blend op over does not reproduce a changed pixel: it is not opaque and canvas one is not
+ *   fully transparent, or it is fully transparent itself
+ */
+static bool WritePayloadRow(const struct AnimationEncoder* obj, const uint8_t* canvas_row, const uint8_t* frame_row,
+                            const struct FrameRect* rect, bool over, uint8_t* dst) {
+  const int offset = GetRectByteOffset(obj, rect->x);
+  const int size = GetRectRowSize(obj, rect->width);
+  memcpy(dst, frame_row + offset, size);
+  if (!over)
+    return true;
+
+  const int pixel_size = obj->pixel_bits / 8;
+  const uint8_t* canvas = canvas_row + offset;
+  for (int i = 0; i < size; i += pixel_size) {
+    if (!memcmp(canvas + i, dst + i, pixel_size)) {
+      memset(dst + i, 0, pixel_size);
+      continue;
+    }
+    const uint8_t* alpha = dst + i + obj->alpha_offset;
+    if (IsAlphaSample(alpha, obj->alpha_size, 0xFF))
+      continue;
+    if (IsAlphaSample(alpha, obj->alpha_size, 0) || !IsAlphaSample(canvas + i + obj->alpha_offset, obj->alpha_size, 0))
+      return false;
+  }
+  return true;
+}
+
+/*
+ * @brief Estimate compressed size of frame region: bytes left after Sub filter, as runs and repeats cost little
+ * @return false if blend op cannot be used for the region
+ */
+static bool EstimateFrameSize(const struct AnimationEncoder* obj, const struct CanvasView* view, const uint8_t* frame,
+                              const struct FrameRect* rect, bool over, int64_t* out) {
+  const int size = GetRectRowSize(obj, rect->width);
+  const int pixel_size = obj->pixel_bits >= 8 ? obj->pixel_bits / 8 : 1;
+  int64_t estimate = 0;
+  for (int y = rect->y; y < rect->y + rect->height; ++y) {
+    const uint8_t* row = obj->payload_row;
+    if (!WritePayloadRow(obj, GetCanvasRow(obj, view, y), frame + (size_t)y * obj->scanline_size, rect, over,
+                         obj->payload_row))
+      return false;
+    for (int i = 0; i < size; ++i)
+      estimate += row[i] != (i >= pixel_size ? row[i - pixel_size] : 0);
+  }
+  *out = estimate;
+  return true;
+}
+
+/*
+ * @return false if allocation failed
+ */
+static bool WriteFramePayload(const struct AnimationEncoder* obj, const struct CanvasView* view, const uint8_t* frame,
+                              const struct FrameRect* rect, bool over, struct AnimationFrame* out) {
+  const int row_size = GetRectRowSize(obj, rect->width);
+  out->data_size = row_size * rect->height;
+  out->data = malloc(out->data_size);
+  if (!out->data)
+    return false;
+  for (int y = 0; y < rect->height; ++y)
+    WritePayloadRow(obj, GetCanvasRow(obj, view, rect->y + y), frame + (size_t)(rect->y + y) * obj->scanline_size,
+                    rect, over, out->data + (size_t)y * row_size);
+
+  out->control.x_offset = (uint32_t)rect->x;
+  out->control.y_offset = (uint32_t)rect->y;
+  out->control.width = (uint32_t)rect->width;
+  out->control.height = (uint32_t)rect->height;
+  out->control.blend_op = over ? PNG_BLEND_OP_OVER : PNG_BLEND_OP_SOURCE;
+  return true;
+}
+
+/*
+ * @brief Extend delay of frame by delay of equal next one
+ * @return false if sum is not representable
+ */
+static bool MergeFrameDelay(struct PNGChunkData_fcTL* control, const struct PNGEncodeAnimationFrame* frame) {
+  const uint16_t delay_den = control->delay_den ? control->delay_den : 100;
+  const uint16_t frame_delay_den = frame->delay_den ? frame->delay_den : 100;
+  if (delay_den != frame_delay_den || (uint32_t)control->delay_num + frame->delay_num > UINT16_MAX)
+    return false;
+  control->delay_num += frame->delay_num;
+  return true;
+}
+
+/*
+ * Frame region, dispose op of the previous frame and blend op chosen by estimated size
+ */
+struct FrameChoice {
+  struct CanvasView canvas;
+  struct FrameRect rect;
+  bool over;
+  uint8_t previous_dispose_op;
+  int64_t estimate;
+};
+
+/*
+ * @brief Try canvases left by each dispose op of the previous frame, with each blend op
+ * @param[in] canvas Canvas before the previous frame was rendered
+ * @param is_second Previous frame is the first one, whose dispose op previous is not used
+ */
+static void ChooseFrameOps(const struct AnimationEncoder* obj, const uint8_t* frame, const uint8_t* previous,
+                           const struct FrameRect* previous_rect, const struct CanvasView* canvas, bool is_second,
+                           struct FrameChoice* out) {
+  const struct CanvasView canvases[3] = {
+      [PNG_DISPOSE_OP_NONE] = {previous, {0, 0, 0, 0}},
+      [PNG_DISPOSE_OP_BACKGROUND] = {previous, *previous_rect},
+      [PNG_DISPOSE_OP_PREVIOUS] = *canvas,
+  };
+  out->estimate = INT64_MAX;
+  for (int dispose_op = PNG_DISPOSE_OP_NONE; dispose_op <= PNG_DISPOSE_OP_PREVIOUS; ++dispose_op) {
+    const struct CanvasView* view = &canvases[dispose_op];
+    if ((dispose_op == PNG_DISPOSE_OP_PREVIOUS && is_second) || (HasClearedPixels(view) && !obj->alpha_size))
+      continue;
+    /* Frame equal to canvas still needs a region, a single pixel */
+    struct FrameRect rect = {0, 0, 1, 1};
+    FindChangedRect(obj, view, frame, &rect);
+    for (int over = 0; over <= (obj->alpha_size ? 1 : 0); ++over) {
+      int64_t estimate = 0;
+      if (!EstimateFrameSize(obj, view, frame, &rect, over, &estimate) || estimate >= out->estimate)
+        continue;
+      out->canvas = *view;
+      out->rect = rect;
+      out->over = over;
+      out->previous_dispose_op = (uint8_t)dispose_op;
+      out->estimate = estimate;
+    }
+  }
+}
+
+/*
+ * @brief Choose region and ops of each frame and write its plain data
+ * @param[out] out Frames to write, at least `frames_count`
+ * @return Frames count after merging equal frames or -1 if allocation failed
+ */
+static int PlanAnimationFrames(const struct AnimationEncoder* obj, const struct PNGEncodeAnimationFrame* frames,
+                               int frames_count, bool optimize, struct AnimationFrame* out) {
+  const struct FrameRect full = {0, 0, obj->header->width, obj->header->height};
+  const size_t image_size = (size_t)frames[0].image.data_size;
+  /* Canvas before the previous frame was rendered */
+  struct CanvasView canvas = {NULL, {0, 0, 0, 0}};
+  const uint8_t* previous = NULL;
+  struct FrameRect previous_rect = full;
+  int count = 0;
+  for (int i = 0; i < frames_count; ++i) {
+    const uint8_t* frame = frames[i].image.data;
+    if (optimize && previous && !memcmp(frame, previous, image_size) &&
+        MergeFrameDelay(&out[count - 1].control, &frames[i]))
+      continue;
+
+    struct FrameChoice choice = {canvas, full, false, PNG_DISPOSE_OP_NONE, 0};
+    if (optimize && previous) {
+      ChooseFrameOps(obj, frame, previous, &previous_rect, &canvas, count == 1, &choice);
+      out[count - 1].control.dispose_op = choice.previous_dispose_op;
+    }
+    struct AnimationFrame* current = &out[count++];
+    PNGInitData_fcTL(&current->control);
+    current->control.delay_num = frames[i].delay_num;
+    current->control.delay_den = frames[i].delay_den;
+    if (!WriteFramePayload(obj, &choice.canvas, frame, &choice.rect, choice.over, current))
+      return -1;
+
+    canvas = choice.canvas;
+    previous = frame;
+    previous_rect = choice.rect;
+  }
+  return count;
+}
+
+struct AnimationCompression {
+  const struct PNGChunkData_IHDR* header;
+  const struct PNGEncodeOptions* options;
+  struct AnimationFrame* frames;
+  int frames_count;
+  atomic_int next_frame;
+};
+
+static void CompressAnimationFrames(void* context, int worker_index) {
+  (void)worker_index;
+  struct AnimationCompression* compression = context;
+  for (int i = atomic_fetch_add(&compression->next_frame, 1); i < compression->frames_count;
+       i = atomic_fetch_add(&compression->next_frame, 1)) {
+    struct AnimationFrame* frame = &compression->frames[i];
+    struct PNGChunkData_IHDR header = *compression->header;
+    header.width = (int32_t)frame->control.width;
+    header.height = (int32_t)frame->control.height;
+    struct PNGRawImage image;
+    PNGInitRawImage(&image);
+    image.type = header.color_type;
+    image.data = frame->data;
+    image.data_size = frame->data_size;
+    image.scanline_pixel_count = header.width;
+    image.channel_bit_depth = header.bit_depth;
+
+    uint8_t* filtered = FilterImageData(&image, &header, compression->options->filter_selection);
+    frame->compressed = filtered ? PNGDataCompress0WithParams(filtered, frame->data_size + header.height,
+                                                              &compression->options->compression,
+                                                              &frame->compressed_size)
+                                 : NULL;
+    free(filtered);
+    free(frame->data);
+    frame->data = NULL;
+  }
+}
+
+/*
+ * @brief Append data chunks of frame. The first frame is stored in IDAT chunks, others in fdAT ones
+ * @param buffer Space for sequence number and `chunk_size` bytes of fdAT data
+ * @return Last appended chunk or NULL if allocation failed
+ */
+static struct PNGRawChunk* AppendFrameData(struct PNGRawChunk* last, const struct AnimationFrame* frame, bool first,
+                                           uint32_t chunk_size, uint32_t* sequence_number, uint8_t* buffer) {
+  for (int offset = 0; last && offset < frame->compressed_size; offset += (int)chunk_size) {
+    const int remaining = frame->compressed_size - offset;
+    const int size = remaining < (int)chunk_size ? remaining : (int)chunk_size;
+    if (first) {
+      last->next = CreateChunk(CHUNK_IDAT, frame->compressed + offset, size);
+    } else {
+      uint8_t* ptr = buffer;
+      WriteNetworkAndAdvanceUInt32(&ptr, (*sequence_number)++);
+      memcpy(ptr, frame->compressed + offset, size);
+      last->next = CreateChunk(CHUNK_fdAT, buffer, size + 4);
+    }
+    last = last->next;
+  }
+  return last;
+}
+
+/*
+ * @brief Build chunk list IHDR, acTL, PLTE, tRNS, frames, IEND
+ * @return Chunk list or NULL if allocation failed
+ */
+static struct PNGRawChunk* CreateAnimationChunkList(const struct EncodedImage* image,
+                                                    const struct AnimationFrame* frames, int frames_count,
+                                                    uint32_t plays_count, uint32_t chunk_size) {
+  int max_compressed_size = 0;
+  for (int i = 1; i < frames_count; ++i)
+    if (frames[i].compressed_size > max_compressed_size)
+      max_compressed_size = frames[i].compressed_size;
+  const int buffer_size = 4 + (max_compressed_size < (int)chunk_size ? max_compressed_size : (int)chunk_size);
+  uint8_t* buffer = malloc(buffer_size);
+  if (!buffer)
+    return NULL;
+
+  /* Largest serialized chunk besides data ones is PLTE of 256 entries */
+  uint8_t serialized[3 * 256];
+  struct PNGRawChunk* list = CreateChunk(CHUNK_IHDR, serialized, PNGWriteData_IHDR(&image->header, serialized));
+  struct PNGRawChunk* last = list;
+  if (last) {
+    struct PNGChunkData_acTL animation;
+    PNGInitData_acTL(&animation);
+    animation.frames_count = (uint32_t)frames_count;
+    animation.plays_count = plays_count;
+    last->next = CreateChunk(CHUNK_acTL, serialized, PNGWriteData_acTL(&animation, serialized));
+    last = last->next;
+  }
+  if (last && image->palette) {
+    last->next = CreateChunk(CHUNK_PLTE, serialized, PNGWriteData_PLTE(image->palette, serialized));
+    last = last->next;
+  }
+  if (last && image->transparency) {
+    last->next = CreateChunk(CHUNK_tRNS, serialized, PNGWriteData_tRNS(image->transparency, serialized));
+    last = last->next;
+  }
+  uint32_t sequence_number = 0;
+  for (int i = 0; last && i < frames_count; ++i) {
+    struct PNGChunkData_fcTL control = frames[i].control;
+    control.sequence_number = sequence_number++;
+    last->next = CreateChunk(CHUNK_fcTL, serialized, PNGWriteData_fcTL(&control, serialized));
+    last = AppendFrameData(last->next, &frames[i], i == 0, chunk_size, &sequence_number, buffer);
+  }
+  if (last) {
+    last->next = CreateChunk(CHUNK_IEND, NULL, 0);
+    last = last->next;
+  }
+  free(buffer);
+
+  if (!last) {
+    PNGFreeRawChunk(list);
+    return NULL;
+  }
+  return list;
+}
+
+struct PNGRawChunk* PNGEncodeAnimationToChunkList(const struct PNGEncodeAnimationFrame* frames, int frames_count,
+                                                  const struct PNGEncodeAnimationOptions* options) {
+  struct PNGEncodeAnimationOptions default_options;
+  if (!options) {
+    PNGInitEncodeAnimationOptions(&default_options);
+    options = &default_options;
+  }
+  if (!frames || frames_count < 1 || options->threads_count < 0)
+    return NULL;
+  struct EncodedImage encoded;
+  if (!PrepareEncodedImage(&frames[0].image, options->encode.palette, options->encode.transparency, false,
+                           options->encode.idat_chunk_size, &encoded))
+    return NULL;
+  bool ok = true;
+  for (int i = 1; ok && i < frames_count; ++i) {
+    const struct PNGRawImage* image = &frames[i].image;
+    ok = image->data && image->type == frames[0].image.type &&
+         image->channel_bit_depth == frames[0].image.channel_bit_depth &&
+         image->scanline_pixel_count == frames[0].image.scanline_pixel_count &&
+         image->data_size == frames[0].image.data_size;
+  }
+
+  struct AnimationEncoder encoder;
+  struct AnimationFrame* planned = ok ? calloc(frames_count, sizeof(struct AnimationFrame)) : NULL;
+  int planned_count = -1;
+  if (planned && InitAnimationEncoder(&encoder, &encoded.header))
+    planned_count = PlanAnimationFrames(&encoder, frames, frames_count, options->optimize_frames, planned);
+  if (planned)
+    FreeAnimationEncoder(&encoder);
+
+  struct PNGRawChunk* list = NULL;
+  if (planned_count > 0) {
+    struct AnimationCompression compression;
+    compression.header = &encoded.header;
+    compression.options = &options->encode;
+    compression.frames = planned;
+    compression.frames_count = planned_count;
+    atomic_init(&compression.next_frame, 0);
+    const int workers_count = options->threads_count ? options->threads_count : GetOnlineCPUCount();
+    RunParallel(CompressAnimationFrames, &compression, workers_count < planned_count ? workers_count : planned_count);
+
+    ok = true;
+    for (int i = 0; i < planned_count; ++i)
+      ok = ok && planned[i].compressed;
+    if (ok)
+      list = CreateAnimationChunkList(&encoded, planned, planned_count, options->plays_count,
+                                      options->encode.idat_chunk_size);
+  }
+
+  for (int i = 0; planned && i < frames_count; ++i) {
+    free(planned[i].data);
+    PNGFreeCompressionData(planned[i].compressed);
+  }
+  free(planned);
+  FreeEncodedImage(&encoded);
+  return list;
+}
+
+uint8_t* PNGEncodeAnimation(const struct PNGEncodeAnimationFrame* frames, int frames_count,
+                            const struct PNGEncodeAnimationOptions* options, int* out_size) {
+  return WriteAndFreeChunkList(PNGEncodeAnimationToChunkList(frames, frames_count, options), out_size);
+}
+
+void PNGFreeEncodedData(uint8_t* data) {
+  free(data);
+}
@@ -0,0 +1,179 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "file_io.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+/* Buffer size of read/write copying fallback */
+static const size_t s_copy_buffer_size = 1 << 16;
+
+#ifdef _WIN32
+
+bool ReadFileAt(int fd, void* buffer, size_t size, int64_t offset) {
+  if (_lseeki64(fd, offset, SEEK_SET) < 0)
+    return false;
+  uint8_t* ptr = buffer;
+  while (size > 0) {
+    const int read_bytes = _read(fd, ptr, size > INT32_MAX ? INT32_MAX : (unsigned int)size);
+    if (read_bytes <= 0)
+      return false;
+    ptr += read_bytes;
+    size -= read_bytes;
+  }
+  return true;
+}
+
+static bool WriteFull(int fd, const uint8_t* ptr, size_t size) {
+  while (size > 0) {
+    const int written = _write(fd, ptr, size > INT32_MAX ? INT32_MAX : (unsigned int)size);
+    if (written < 0)
+      return false;
+    ptr += written;
+    size -= written;
+  }
+  return true;
+}
+
+#else
+
+bool ReadFileAt(int fd, void* buffer, size_t size, int64_t offset) {
+  uint8_t* ptr = buffer;
+  while (size > 0) {
+    const ssize_t read_bytes = pread(fd, ptr, size, offset);
+    if (read_bytes < 0 && errno == EINTR)
+      continue;
+    if (read_bytes <= 0)
+      return false;
+    ptr += read_bytes;
+    size -= read_bytes;
+    offset += read_bytes;
+  }
+  return true;
+}
+
+static bool WriteFull(int fd, const uint8_t* ptr, size_t size) {
+  while (size > 0) {
+    const ssize_t written = write(fd, ptr, size);
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written < 0)
+      return false;
+    ptr += written;
+    size -= written;
+  }
+  return true;
+}
+
+#endif  // _WIN32
+
+int64_t GetFileSizeBytes(int fd) {
+#ifdef _WIN32
+  struct _stat64 info;
+  if (_fstat64(fd, &info) != 0)
+    return -1;
+#else
+  struct stat info;
+  if (fstat(fd, &info) != 0)
+    return -1;
+#endif
+  return info.st_size;
+}
+
+bool CopyFileRange(int in_fd, int64_t offset, int64_t size, int out_fd) {
+#ifdef __linux__
+  /* Both functions may copy less than requested or be unsupported for this pair of files */
+  bool copy_file_range_supported = true;
+  while (size > 0 && copy_file_range_supported) {
+    loff_t in_offset = offset;
+    const ssize_t copied = copy_file_range(in_fd, &in_offset, out_fd, NULL, size, 0);
+    if (copied < 0 && errno == EINTR)
+      continue;
+    if (copied <= 0) {
+      copy_file_range_supported = false;
+      break;
+    }
+    offset += copied;
+    size -= copied;
+  }
+  while (size > 0) {
+    off_t in_offset = offset;
+    const ssize_t copied = sendfile(out_fd, in_fd, &in_offset, size);
+    if (copied < 0 && errno == EINTR)
+      continue;
+    if (copied <= 0)
+      break;
+    offset += copied;
+    size -= copied;
+  }
+#endif  // __linux__
+
+  if (size == 0)
+    return true;
+
+  uint8_t* buffer = malloc(s_copy_buffer_size);
+  if (!buffer)
+    return false;
+  while (size > 0) {
+    const size_t portion = size < (int64_t)s_copy_buffer_size ? (size_t)size : s_copy_buffer_size;
+    if (!ReadFileAt(in_fd, buffer, portion, offset) || !WriteFull(out_fd, buffer, portion)) {
+      free(buffer);
+      return false;
+    }
+    offset += portion;
+    size -= portion;
+  }
+  free(buffer);
+  return true;
+}
+
+int ReadWholeFile(const char* path, int64_t max_size, uint8_t** out, int64_t* out_size) {
+#ifdef _WIN32
+  const int fd = _open(path, _O_RDONLY | _O_BINARY);
+#else
+  const int fd = open(path, O_RDONLY | O_CLOEXEC);
+#endif
+  if (fd < 0)
+    return errno;
+  int error = 0;
+  const int64_t size = GetFileSizeBytes(fd);
+  uint8_t* data = NULL;
+  if (size < 0)
+    error = errno;
+  else if (size > max_size)
+    error = EFBIG;
+  else if (!(data = malloc(size > 0 ? (size_t)size : 1)))
+    error = ENOMEM;
+  else {
+    errno = 0;
+    /* Without errno the file shrank after its size was taken */
+    if (!ReadFileAt(fd, data, (size_t)size, 0))
+      error = errno ? errno : EIO;
+  }
+#ifdef _WIN32
+  _close(fd);
+#else
+  close(fd);
+#endif
+  if (error) {
+    free(data);
+    return error;
+  }
+  *out = data;
+  *out_size = size;
+  return 0;
+}
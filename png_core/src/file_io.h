@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @return File size in bytes or -1 if error occurred
+ */
+int64_t GetFileSizeBytes(int fd);
+
+/**
+ * Read exactly `size` bytes at `offset` without moving file position
+ * @return false if error occurred or file is too short
+ */
+bool ReadFileAt(int fd, void* buffer, size_t size, int64_t offset);
+
+/**
+ * Copy `size` bytes starting at `offset` of `in_fd` to current position of `out_fd`.
+ * Uses in-kernel copying (`copy_file_range`, `sendfile`) where available, falls back to read/write
+ * @return false if error occurred
+ */
+bool CopyFileRange(int in_fd, int64_t offset, int64_t size, int out_fd);
+
+/**
+ * Read whole file at `path` with blocking open and pread
+ * @param max_size Files larger than this are not read
+ * @param[out] out Malloc'ed file contents of at least 1 byte, to free with free()
+ * @param[out] out_size File size
+ * @return 0 or errno of failed operation, EFBIG if file exceeds `max_size`
+ */
+int ReadWholeFile(const char* path, int64_t max_size, uint8_t** out, int64_t* out_size);
@@ -0,0 +1,434 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "file_read_queue.h"
+
+#include <stdlib.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+/* io_uring is used through raw system calls, so that the library does not depend on liburing */
+#if defined(__linux__) && defined(__NR_io_uring_setup)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <linux/stat.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/* Size of a single read request, reads of larger files are continued */
+static const int64_t s_max_read_size = 1 << 30;
+
+/*
+ * Operation of completion, kept in the low bits of its user data next to slot index
+ */
+enum FileOperation {
+  FILE_OPERATION_OPEN = 0,
+  FILE_OPERATION_STAT = 1,
+  FILE_OPERATION_READ = 2,
+};
+
+struct FileSlot {
+  const char* path;
+  int tag;
+  int64_t max_size;
+  /* Operations in flight */
+  int operations_count;
+  int fd;
+  int error;
+  /* Written by kernel, so slot must not move while its file is read */
+  struct statx stat;
+  uint8_t* data;
+  int64_t size;
+  int64_t read_size;
+  /* Next slot of free list or read list, -1 for the last one */
+  int next;
+};
+
+struct FileReadQueue {
+  int ring_fd;
+  void* ring;
+  size_t ring_size;
+  /* The same as ring if kernel maps both rings at once */
+  void* completion_ring;
+  size_t completion_ring_size;
+  struct io_uring_sqe* entries;
+  size_t entries_size;
+
+  uint32_t* submission_head;
+  uint32_t* submission_tail;
+  uint32_t submission_mask;
+  uint32_t submission_entries_count;
+  uint32_t* submission_array;
+  uint32_t* completion_head;
+  uint32_t* completion_tail;
+  uint32_t completion_mask;
+  struct io_uring_cqe* completions;
+
+  /* Entries prepared since the last io_uring_enter */
+  unsigned unsubmitted_count;
+  /* Operations prepared or submitted and not completed yet */
+  int operations_count;
+
+  struct FileSlot* slots;
+  int slots_count;
+  int free_slot;
+  /* Read files in order of completion */
+  int first_read_slot;
+  int last_read_slot;
+  int pending_count;
+};
+
+static uint32_t LoadAcquire(const uint32_t* ptr) {
+  return atomic_load_explicit((const _Atomic uint32_t*)ptr, memory_order_acquire);
+}
+
+static void StoreRelease(uint32_t* ptr, uint32_t value) {
+  atomic_store_explicit((_Atomic uint32_t*)ptr, value, memory_order_release);
+}
+
+/*
+ * @return Amount of submitted entries or -1 with errno
+ */
+static int EnterRing(struct FileReadQueue* obj, unsigned min_complete) {
+  return (int)syscall(__NR_io_uring_enter, obj->ring_fd, obj->unsubmitted_count, min_complete,
+                      min_complete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+/*
+ * @brief Submit prepared entries and wait for `min_complete` completions
+ * @return false if io_uring failed
+ */
+static bool SubmitEntries(struct FileReadQueue* obj, unsigned min_complete) {
+  while (true) {
+    const int submitted = EnterRing(obj, min_complete);
+    if (submitted >= 0) {
+      obj->unsubmitted_count -= submitted;
+      /* Entries are left unsubmitted only if completions are to be reaped first */
+      return true;
+    }
+    if (errno == EINTR)
+      continue;
+    /* Completion ring is full, completions are reaped by caller */
+    return errno == EAGAIN || errno == EBUSY;
+  }
+}
+
+static struct io_uring_sqe* GetSubmissionEntry(struct FileReadQueue* obj) {
+  const uint32_t tail = *obj->submission_tail;
+  if (tail - LoadAcquire(obj->submission_head) >= obj->submission_entries_count)
+    return NULL;
+  const uint32_t index = tail & obj->submission_mask;
+  struct io_uring_sqe* entry = &obj->entries[index];
+  memset(entry, 0, sizeof(*entry));
+  obj->submission_array[index] = index;
+  return entry;
+}
+
+static void PushSubmissionEntry(struct FileReadQueue* obj, struct io_uring_sqe* entry, int slot_index,
+                                enum FileOperation operation) {
+  entry->user_data = (uint64_t)slot_index << 2 | operation;
+  StoreRelease(obj->submission_tail, *obj->submission_tail + 1);
+  ++obj->unsubmitted_count;
+  ++obj->operations_count;
+  ++obj->slots[slot_index].operations_count;
+}
+
+static void SetFileError(struct FileSlot* slot, int error) {
+  if (!slot->error)
+    slot->error = error;
+}
+
+/*
+ * @brief Prepare read of the rest of file
+ * @return false if submission ring is full, which does not happen since every slot has at most two entries in it
+ */
+static bool PrepareRead(struct FileReadQueue* obj, int slot_index) {
+  struct FileSlot* slot = &obj->slots[slot_index];
+  struct io_uring_sqe* entry = GetSubmissionEntry(obj);
+  if (!entry)
+    return false;
+  const int64_t remaining = slot->size - slot->read_size;
+  entry->opcode = IORING_OP_READ;
+  entry->fd = slot->fd;
+  entry->addr = (uint64_t)(uintptr_t)(slot->data + slot->read_size);
+  entry->len = (uint32_t)(remaining < s_max_read_size ? remaining : s_max_read_size);
+  entry->off = (uint64_t)slot->read_size;
+  PushSubmissionEntry(obj, entry, slot_index, FILE_OPERATION_READ);
+  return true;
+}
+
+static void FinishFile(struct FileReadQueue* obj, int slot_index) {
+  struct FileSlot* slot = &obj->slots[slot_index];
+  if (slot->fd >= 0)
+    close(slot->fd);
+  slot->fd = -1;
+  if (slot->error) {
+    free(slot->data);
+    slot->data = NULL;
+  }
+  slot->next = -1;
+  if (obj->last_read_slot >= 0)
+    obj->slots[obj->last_read_slot].next = slot_index;
+  else
+    obj->first_read_slot = slot_index;
+  obj->last_read_slot = slot_index;
+}
+
+static void HandleCompletion(struct FileReadQueue* obj, int slot_index, enum FileOperation operation, int result) {
+  struct FileSlot* slot = &obj->slots[slot_index];
+  --slot->operations_count;
+  switch (operation) {
+  case FILE_OPERATION_OPEN:
+    if (result < 0)
+      SetFileError(slot, -result);
+    else
+      slot->fd = result;
+    break;
+  case FILE_OPERATION_STAT:
+    if (result < 0)
+      SetFileError(slot, -result);
+    else if (slot->stat.stx_size > (uint64_t)slot->max_size)
+      SetFileError(slot, EFBIG);
+    else
+      slot->size = (int64_t)slot->stat.stx_size;
+    break;
+  case FILE_OPERATION_READ:
+    /* Interrupted read is repeated below */
+    if (result < 0 && result != -EINTR && result != -EAGAIN)
+      SetFileError(slot, -result);
+    else if (result == 0)
+      /* File shrank after its size was taken */
+      SetFileError(slot, EIO);
+    else if (result > 0)
+      slot->read_size += result;
+    break;
+  }
+  /* Open and statx complete in any order */
+  if (slot->operations_count > 0)
+    return;
+
+  if (!slot->error && !slot->data && !(slot->data = malloc(slot->size > 0 ? (size_t)slot->size : 1)))
+    SetFileError(slot, ENOMEM);
+  if (!slot->error && slot->read_size < slot->size) {
+    if (PrepareRead(obj, slot_index))
+      return;
+    SetFileError(slot, EAGAIN);
+  }
+  FinishFile(obj, slot_index);
+}
+
+static void ReapCompletions(struct FileReadQueue* obj) {
+  uint32_t head = *obj->completion_head;
+  const uint32_t tail = LoadAcquire(obj->completion_tail);
+  for (; head != tail; ++head) {
+    const struct io_uring_cqe* completion = &obj->completions[head & obj->completion_mask];
+    --obj->operations_count;
+    HandleCompletion(obj, (int)(completion->user_data >> 2), (enum FileOperation)(completion->user_data & 3),
+                     completion->res);
+  }
+  StoreRelease(obj->completion_head, head);
+}
+
+static bool AreOperationsSupported(int ring_fd) {
+  const int ops_count = 256;
+  const size_t probe_size = sizeof(struct io_uring_probe) + ops_count * sizeof(struct io_uring_probe_op);
+  struct io_uring_probe* probe = calloc(1, probe_size);
+  if (!probe)
+    return false;
+  bool supported = syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PROBE, probe, ops_count) == 0;
+  const int required_ops[] = {IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ};
+  for (size_t i = 0; supported && i < sizeof(required_ops) / sizeof(required_ops[0]); ++i)
+    supported = required_ops[i] <= probe->last_op && (probe->ops[required_ops[i]].flags & IO_URING_OP_SUPPORTED);
+  free(probe);
+  return supported;
+}
+
+static void* MapRing(int ring_fd, size_t size, off_t offset) {
+  void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, offset);
+  return ptr == MAP_FAILED ? NULL : ptr;
+}
+
+static bool MapRings(struct FileReadQueue* obj, const struct io_uring_params* params) {
+  obj->ring_size = params->sq_off.array + params->sq_entries * sizeof(uint32_t);
+  obj->completion_ring_size = params->cq_off.cqes + params->cq_entries * sizeof(struct io_uring_cqe);
+  const bool single_mmap = params->features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap && obj->completion_ring_size > obj->ring_size)
+    obj->ring_size = obj->completion_ring_size;
+  obj->ring = MapRing(obj->ring_fd, obj->ring_size, IORING_OFF_SQ_RING);
+  obj->completion_ring = single_mmap ? obj->ring : MapRing(obj->ring_fd, obj->completion_ring_size, IORING_OFF_CQ_RING);
+  obj->entries_size = params->sq_entries * sizeof(struct io_uring_sqe);
+  obj->entries = MapRing(obj->ring_fd, obj->entries_size, IORING_OFF_SQES);
+  if (!obj->ring || !obj->completion_ring || !obj->entries)
+    return false;
+
+  uint8_t* ring = obj->ring;
+  obj->submission_head = (uint32_t*)(ring + params->sq_off.head);
+  obj->submission_tail = (uint32_t*)(ring + params->sq_off.tail);
+  obj->submission_mask = *(uint32_t*)(ring + params->sq_off.ring_mask);
+  obj->submission_entries_count = params->sq_entries;
+  obj->submission_array = (uint32_t*)(ring + params->sq_off.array);
+  uint8_t* completion_ring = obj->completion_ring;
+  obj->completion_head = (uint32_t*)(completion_ring + params->cq_off.head);
+  obj->completion_tail = (uint32_t*)(completion_ring + params->cq_off.tail);
+  obj->completion_mask = *(uint32_t*)(completion_ring + params->cq_off.ring_mask);
+  obj->completions = (struct io_uring_cqe*)(completion_ring + params->cq_off.cqes);
+  return true;
+}
+
+struct FileReadQueue* CreateFileReadQueue(int files_count) {
+  if (files_count < 1)
+    return NULL;
+  struct FileReadQueue* obj = calloc(1, sizeof(struct FileReadQueue));
+  if (!obj)
+    return NULL;
+  obj->free_slot = -1;
+  obj->first_read_slot = -1;
+  obj->last_read_slot = -1;
+  obj->slots = calloc(files_count, sizeof(struct FileSlot));
+  obj->slots_count = files_count;
+
+  /* Open and statx of every file are in flight at once */
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  obj->ring_fd = (int)syscall(__NR_io_uring_setup, 2 * files_count, &params);
+  if (!obj->slots || obj->ring_fd < 0 || !AreOperationsSupported(obj->ring_fd) || !MapRings(obj, &params)) {
+    FreeFileReadQueue(obj);
+    return NULL;
+  }
+  for (int i = files_count - 1; i >= 0; --i) {
+    obj->slots[i].fd = -1;
+    obj->slots[i].next = obj->free_slot;
+    obj->free_slot = i;
+  }
+  return obj;
+}
+
+bool QueueFileRead(struct FileReadQueue* obj, const char* path, int64_t max_size, int tag) {
+  const int slot_index = obj->free_slot;
+  if (slot_index < 0)
+    return false;
+  struct FileSlot* slot = &obj->slots[slot_index];
+  obj->free_slot = slot->next;
+  slot->path = path;
+  slot->tag = tag;
+  slot->max_size = max_size;
+  slot->operations_count = 0;
+  slot->fd = -1;
+  slot->error = 0;
+  slot->data = NULL;
+  slot->size = 0;
+  slot->read_size = 0;
+  slot->next = -1;
+  ++obj->pending_count;
+
+  /* Two free entries are guaranteed: submission ring has two per slot */
+  struct io_uring_sqe* entry = GetSubmissionEntry(obj);
+  entry->opcode = IORING_OP_OPENAT;
+  entry->fd = AT_FDCWD;
+  entry->addr = (uint64_t)(uintptr_t)path;
+  entry->open_flags = O_RDONLY | O_CLOEXEC;
+  PushSubmissionEntry(obj, entry, slot_index, FILE_OPERATION_OPEN);
+
+  entry = GetSubmissionEntry(obj);
+  entry->opcode = IORING_OP_STATX;
+  entry->fd = AT_FDCWD;
+  entry->addr = (uint64_t)(uintptr_t)path;
+  entry->len = STATX_SIZE;
+  entry->off = (uint64_t)(uintptr_t)&slot->stat;
+  PushSubmissionEntry(obj, entry, slot_index, FILE_OPERATION_STAT);
+  return true;
+}
+
+bool WaitFileRead(struct FileReadQueue* obj, bool wait, struct FileReadResult* out) {
+  ReapCompletions(obj);
+  while (obj->first_read_slot < 0 && obj->operations_count > 0) {
+    if ((wait || obj->unsubmitted_count > 0) && !SubmitEntries(obj, wait ? 1 : 0))
+      return false;
+    ReapCompletions(obj);
+    if (!wait)
+      break;
+  }
+  const int slot_index = obj->first_read_slot;
+  if (slot_index < 0)
+    return false;
+
+  struct FileSlot* slot = &obj->slots[slot_index];
+  obj->first_read_slot = slot->next;
+  if (obj->first_read_slot < 0)
+    obj->last_read_slot = -1;
+  out->tag = slot->tag;
+  out->error = slot->error;
+  out->data = slot->data;
+  out->data_size = slot->error ? 0 : slot->size;
+  slot->data = NULL;
+  slot->next = obj->free_slot;
+  obj->free_slot = slot_index;
+  --obj->pending_count;
+  return true;
+}
+
+int GetPendingFileReadCount(const struct FileReadQueue* obj) {
+  return obj->pending_count;
+}
+
+void FreeFileReadQueue(struct FileReadQueue* obj) {
+  if (!obj)
+    return;
+  if (obj->ring && obj->completion_ring && obj->entries) {
+    /* Kernel writes into slots and buffers until their operations complete */
+    while (obj->operations_count > 0 && SubmitEntries(obj, 1))
+      ReapCompletions(obj);
+  }
+  for (int i = 0; obj->slots && i < obj->slots_count; ++i)
+    free(obj->slots[i].data);
+  if (obj->entries)
+    munmap(obj->entries, obj->entries_size);
+  if (obj->completion_ring && obj->completion_ring != obj->ring)
+    munmap(obj->completion_ring, obj->completion_ring_size);
+  if (obj->ring)
+    munmap(obj->ring, obj->ring_size);
+  if (obj->ring_fd >= 0)
+    close(obj->ring_fd);
+  free(obj->slots);
+  free(obj);
+}
+
+#else
+
+struct FileReadQueue* CreateFileReadQueue(int files_count) {
+  (void)files_count;
+  return NULL;
+}
+
+bool QueueFileRead(struct FileReadQueue* obj, const char* path, int64_t max_size, int tag) {
+  (void)obj;
+  (void)path;
+  (void)max_size;
+  (void)tag;
+  return false;
+}
+
+bool WaitFileRead(struct FileReadQueue* obj, bool wait, struct FileReadResult* out) {
+  (void)obj;
+  (void)wait;
+  (void)out;
+  return false;
+}
+
+int GetPendingFileReadCount(const struct FileReadQueue* obj) {
+  (void)obj;
+  return 0;
+}
+
+void FreeFileReadQueue(struct FileReadQueue* obj) {
+  (void)obj;
+}
+
+#endif  // __linux__ && __NR_io_uring_setup
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Whole-file reads submitted through io_uring: open and statx of a file are submitted together,
+ * then the file is read in one request. Only the thread that created the queue may use it
+ */
+struct FileReadQueue;
+
+/*
+ * Read file submitted with QueueFileRead
+ */
+struct FileReadResult {
+  /* Value passed to QueueFileRead */
+  int tag;
+  /* 0 or errno of failed operation, EFBIG if file exceeds maximum size */
+  int error;
+  /* Malloc'ed file contents of at least 1 byte, to free with free(). NULL on error */
+  uint8_t* data;
+  int64_t data_size;
+};
+
+/*
+ * @param files_count Files read at once
+ * @return Queue or NULL if io_uring or one of its open, statx, read operations is not supported, or allocation failed
+ */
+struct FileReadQueue* CreateFileReadQueue(int files_count);
+
+/*
+ * @brief Start reading file. Operations are submitted by the next WaitFileRead
+ * @param path Path that stays valid until file is returned by WaitFileRead
+ * @param max_size Files larger than this are not read
+ * @return false if `files_count` files are already being read
+ */
+bool QueueFileRead(struct FileReadQueue* obj, const char* path, int64_t max_size, int tag);
+
+/*
+ * @brief Submit queued operations and return a read file
+ * @param wait Block until a file is read. Otherwise return only already read files
+ * @return false if no file is read: nothing is being read, or `wait` is false and no file is read yet
+ */
+bool WaitFileRead(struct FileReadQueue* obj, bool wait, struct FileReadResult* out);
+
+/*
+ * @return Files queued and not returned by WaitFileRead yet
+ */
+int GetPendingFileReadCount(const struct FileReadQueue* obj);
+
+/*
+ * @brief Wait for operations in flight and free queue with buffers of files not returned yet
+ * @param obj Queue, nullable
+ */
+void FreeFileReadQueue(struct FileReadQueue* obj);
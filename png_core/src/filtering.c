@@ -1,14 +1,16 @@
 #include "png_core/filtering.h"
 
 #include <assert.h>
-#include <math.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "png_core/chunk_data.h"
 #include "png_core/decoder.h"
 
+#include "tools.h"
+
 enum Filter0FuncType {
   NONE = 0,
   SUB = 1,
@@ -20,32 +22,19 @@ enum Filter0FuncType {
 static uint8_t FuncNoneFilter(uint8_t x, uint8_t a, uint8_t b, uint8_t c) {
   return x;
 }
-static uint8_t FuncNoneDefilter(uint8_t x, uint8_t a, uint8_t b, uint8_t c) {
-  return x;
-}
 
 static uint8_t FuncSubFilter(uint8_t x, uint8_t a, uint8_t b, uint8_t c) {
   return ((int)x - a + 256) % 256;
 }
-static uint8_t FuncSubDefilter(uint8_t x, uint8_t a, uint8_t b, uint8_t c) {
-  return ((int)x + a) % 256;
-}
 
 static uint8_t FuncUpFilter(uint8_t x, uint8_t a, uint8_t b, uint8_t c) {
   return ((int)x - b + 256) % 256;
 }
-static uint8_t FuncUpDefilter(uint8_t x, uint8_t a, uint8_t b, uint8_t c) {
-  return ((int)x + b) % 256;
-}
 
 static uint8_t FuncAverageFilter(uint8_t x, uint8_t a, uint8_t b, uint8_t c) {
-  const int sum = (int)floor((a + b) / 2.0);
+  const int sum = ((int)a + b) >> 1;
   return (((int)x + 256) - sum) % 256;
 }
-static uint8_t FuncAverageDefilter(uint8_t x, uint8_t a, uint8_t b, uint8_t c) {
-  const int sum = (int)floor((a + b) / 2.0);
-  return ((int)x + sum) % 256;
-}
 
 static uint8_t Paeth(uint8_t a, uint8_t b, uint8_t c) {
   const int p = (int)a + b - c;
@@ -60,34 +49,183 @@ static uint8_t Paeth(uint8_t a, uint8_t b, uint8_t c) {
 }
 
 static uint8_t FuncPaethFilter(uint8_t x, uint8_t a, uint8_t b, uint8_t c) {
-  // TODO IMPLEMENT
-  assert(false && "Not implemented");
-  return 0;
+  return ((int)x - Paeth(a, b, c) + 256) % 256;
 }
 
-static uint8_t FuncPaethDefilter(uint8_t x, uint8_t a, uint8_t b, uint8_t c) {
-  return (x + Paeth(a, b, c)) % 256;
-}
-
-typedef uint8_t (*Method0DefilteringFunction)(uint8_t, uint8_t, uint8_t, uint8_t);
-typedef Method0DefilteringFunction Method0FilteringFunction;
-
-static Method0DefilteringFunction s_method0_defiltering_functions[5] = {
-    FuncNoneDefilter, FuncSubDefilter, FuncUpDefilter, FuncAverageDefilter, FuncPaethDefilter};
+typedef uint8_t (*Method0FilteringFunction)(uint8_t, uint8_t, uint8_t, uint8_t);
 
 static Method0FilteringFunction s_method0_filtering_functions[5] = {FuncNoneFilter, FuncSubFilter, FuncUpFilter,
                                                                     FuncAverageFilter, FuncPaethFilter};
 
 /*
- * @brief Defilter a single byte using compression method 0
- * @param type Filtering function type
- * @param a - corresponding byte in left defiltered pixel
- * @param b - corresponding byte in top defiltered pixel
- * @param c - corresponding byte in top-left defiltered pixel
+ * Bytes left of the first pixel and bytes of missing previous scanline are treated as 0.
+ * Inlined with constant `func`, so each filter type gets its own loop
+ */
+static inline void FilterScanlineWith(Method0FilteringFunction func, const uint8_t* scanline, const uint8_t* previous,
+                                      uint8_t* filtered, int size, int bpp) {
+  const int head = bpp < size ? bpp : size;
+  if (!previous) {
+    for (int i = 0; i < head; ++i)
+      filtered[i] = func(scanline[i], 0, 0, 0);
+    for (int i = head; i < size; ++i)
+      filtered[i] = func(scanline[i], scanline[i - bpp], 0, 0);
+    return;
+  }
+  for (int i = 0; i < head; ++i)
+    filtered[i] = func(scanline[i], 0, previous[i], 0);
+  for (int i = head; i < size; ++i)
+    filtered[i] = func(scanline[i], scanline[i - bpp], previous[i], previous[i - bpp]);
+}
+
+bool PNGFilterScanline0(uint8_t filter_type, const uint8_t* scanline, const uint8_t* previous, uint8_t* filtered,
+                        int scanline_size_bytes, int pixel_size_bytes) {
+  const int size = scanline_size_bytes;
+  const int bpp = pixel_size_bytes;
+  switch (filter_type) {
+    case NONE: memcpy(filtered, scanline, size); return true;
+    case SUB: FilterScanlineWith(FuncSubFilter, scanline, previous, filtered, size, bpp); return true;
+    case UP: FilterScanlineWith(FuncUpFilter, scanline, previous, filtered, size, bpp); return true;
+    case AVERAGE: FilterScanlineWith(FuncAverageFilter, scanline, previous, filtered, size, bpp); return true;
+    case PAETH: FilterScanlineWith(FuncPaethFilter, scanline, previous, filtered, size, bpp); return true;
+    default: return false;
+  }
+}
+
+/*
+ * Heuristic of adaptive filter selection: filtered bytes are treated as signed differences
  */
-static inline uint8_t DefilterByteMethod0(uint8_t func_type, uint8_t x, uint8_t a, uint8_t b, uint8_t c) {
-  assert(func_type >= 0 && func_type <= 4);
-  return s_method0_defiltering_functions[func_type](x, a, b, c);
+static uint64_t SumAbsoluteDifferences(const uint8_t* filtered, int size) {
+  uint64_t sum = 0;
+  for (int i = 0; i < size; ++i)
+    sum += abs((int8_t)filtered[i]);
+  return sum;
+}
+
+/*
+ * @param[out] out Filter type byte followed by filtered scanline
+ * @param spare Scratch buffer of scanline size
+ */
+static void FilterScanlineAdaptive(const uint8_t* scanline, const uint8_t* previous, uint8_t* out, uint8_t* spare,
+                                   int size, int bpp) {
+  /* Candidates are filtered in turns into spare buffer, which is swapped with the best one if it wins */
+  uint8_t* best = out + 1;
+  uint8_t best_type = NONE;
+  PNGFilterScanline0(NONE, scanline, previous, best, size, bpp);
+  uint64_t best_sum = SumAbsoluteDifferences(best, size);
+  for (uint8_t type = SUB; type <= PAETH; ++type) {
+    /* Up, Average and Paeth only repeat None and Sub without previous scanline */
+    if (!previous && type > SUB)
+      break;
+    PNGFilterScanline0(type, scanline, previous, spare, size, bpp);
+    const uint64_t sum = SumAbsoluteDifferences(spare, size);
+    if (sum < best_sum) {
+      uint8_t* tmp = best;
+      best = spare;
+      spare = tmp;
+      best_sum = sum;
+      best_type = type;
+    }
+  }
+  if (best != out + 1)
+    memcpy(out + 1, best, size);
+  out[0] = best_type;
+}
+
+bool PNGFilterScanlines0(const uint8_t* plain, int plain_size, int scanline_size_bytes, int pixel_size_bytes,
+                         enum PNGFilterSelection selection, uint8_t* filtered) {
+  if (scanline_size_bytes <= 0 || pixel_size_bytes <= 0 || plain_size < 0 || plain_size % scanline_size_bytes)
+    return false;
+  if (selection < PNG_FILTER_SELECTION_NONE || selection > PNG_FILTER_SELECTION_ADAPTIVE)
+    return false;
+
+  uint8_t* spare = NULL;
+  if (selection == PNG_FILTER_SELECTION_ADAPTIVE) {
+    spare = malloc(scanline_size_bytes);
+    if (!spare)
+      return false;
+  }
+
+  const int scanlines_count = plain_size / scanline_size_bytes;
+  const uint8_t* previous = NULL;
+  for (int i = 0; i < scanlines_count; ++i) {
+    const uint8_t* scanline = plain + (size_t)i * scanline_size_bytes;
+    uint8_t* out = filtered + (size_t)i * (1 + scanline_size_bytes);
+    if (spare) {
+      FilterScanlineAdaptive(scanline, previous, out, spare, scanline_size_bytes, pixel_size_bytes);
+    } else {
+      out[0] = (uint8_t)selection;
+      PNGFilterScanline0(out[0], scanline, previous, out + 1, scanline_size_bytes, pixel_size_bytes);
+    }
+    previous = scanline;
+  }
+
+  free(spare);
+  return true;
+}
+
+bool PNGDefilterScanline0(uint8_t filter_type, const uint8_t* filtered, const uint8_t* previous, uint8_t* defiltered,
+                          int scanline_size_bytes, int pixel_size_bytes) {
+  const int bpp = pixel_size_bytes;
+  const int size = scanline_size_bytes;
+  const uint8_t* f = filtered;
+  uint8_t* d = defiltered;
+  const uint8_t* p = previous;
+
+  /* Each byte depends only on the same filtered byte and already defiltered bytes, so defiltering in place is fine */
+  switch (filter_type) {
+    case NONE: {
+      if (d != f)
+        memmove(d, f, size);
+      return true;
+    }
+    case SUB: {
+      for (int i = 0; i < bpp && i < size; ++i)
+        d[i] = f[i];
+      for (int i = bpp; i < size; ++i)
+        d[i] = f[i] + d[i - bpp];
+      return true;
+    }
+    case UP: {
+      if (!p) {
+        if (d != f)
+          memmove(d, f, size);
+        return true;
+      }
+      for (int i = 0; i < size; ++i)
+        d[i] = f[i] + p[i];
+      return true;
+    }
+    case AVERAGE: {
+      if (!p) {
+        for (int i = 0; i < bpp && i < size; ++i)
+          d[i] = f[i];
+        for (int i = bpp; i < size; ++i)
+          d[i] = f[i] + (d[i - bpp] >> 1);
+        return true;
+      }
+      for (int i = 0; i < bpp && i < size; ++i)
+        d[i] = f[i] + (p[i] >> 1);
+      for (int i = bpp; i < size; ++i)
+        d[i] = f[i] + ((d[i - bpp] + p[i]) >> 1);
+      return true;
+    }
+    case PAETH: {
+      /* Without previous scanline Paeth predictor is always the left byte */
+      if (!p) {
+        for (int i = 0; i < bpp && i < size; ++i)
+          d[i] = f[i];
+        for (int i = bpp; i < size; ++i)
+          d[i] = f[i] + d[i - bpp];
+        return true;
+      }
+      for (int i = 0; i < bpp && i < size; ++i)
+        d[i] = f[i] + p[i];
+      for (int i = bpp; i < size; ++i)
+        d[i] = f[i] + Paeth(d[i - bpp], p[i], p[i - bpp]);
+      return true;
+    }
+    default: return false;
+  }
 }
 
 bool PNGDefilterScanlines0(const uint8_t* filtered, int filtered_size, int scanline_width_px, int pixel_size_bytes,
@@ -95,17 +233,13 @@ bool PNGDefilterScanlines0(const uint8_t* filtered, int filtered_size, int scanl
   const int scanline_size_bytes = scanline_width_px * pixel_size_bytes;
   const int scanlines_count = filtered_size / (1 + scanline_size_bytes);
 
-  int restored_idx = 0;
+  const uint8_t* previous = NULL;
   for (int i = 0; i < scanlines_count; ++i) {
-    const uint8_t filter_type = filtered[i * (1 + scanline_size_bytes)];
-    for (int j = 0; j < scanline_size_bytes; ++j) {
-      const uint8_t x = filtered[i * (1 + scanline_size_bytes) + (j + 1)];
-      const uint8_t a = j >= pixel_size_bytes ? defiltered[i * scanline_size_bytes + (j - pixel_size_bytes)] : 0;
-      const uint8_t b = i > 0 ? defiltered[(i - 1) * scanline_size_bytes + j] : 0;
-      const uint8_t c =
-          i > 0 ? j >= pixel_size_bytes ? defiltered[(i - 1) * scanline_size_bytes + (j - pixel_size_bytes)] : 0 : 0;
-      defiltered[restored_idx++] = DefilterByteMethod0(filter_type, x, a, b, c);
-    }
+    const uint8_t* scanline = filtered + (size_t)i * (1 + scanline_size_bytes);
+    uint8_t* restored = defiltered + (size_t)i * scanline_size_bytes;
+    if (!PNGDefilterScanline0(scanline[0], scanline + 1, previous, restored, scanline_size_bytes, pixel_size_bytes))
+      return false;
+    previous = restored;
   }
 
   return true;
@@ -118,11 +252,12 @@ PNGDataDefilteringFunction PNGGetDefilteringFunction(uint8_t filtering_method) {
   }
 }
 
-int PNGGetFilteredImageSizeBytes(const struct PNGChunkData_IHDR* header) {
-  const int bytes_in_total_image = PNGGetPlainImageSizeBits(header);
+int64_t PNGGetFilteredImageSizeBytes(const struct PNGChunkData_IHDR* header) {
+  const int64_t scanline_size_bytes = PNGGetScanlineSizeBytes(header);
   switch (header->filter_method) {
     case PNG_FILTERING_METHOD_0: {
-      return bytes_in_total_image + header->height;
+      /* Each scanline is preceded by filter type byte */
+      return MultiplySizes(scanline_size_bytes + 1, header->height);
     }
     default: break;
   }
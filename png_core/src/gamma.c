@@ -0,0 +1,132 @@
+#include "gamma.h"
+
+#include <math.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+/* Amount of cached tables. Tables beyond it are created per image */
+#define PNG_TRANSFER_CACHE_SIZE 32
+
+struct TransferCacheEntry {
+  struct TransferCurve source;
+  struct TransferCurve target;
+  int bit_depth;
+  void* lut;
+};
+
+static struct TransferCacheEntry s_transfer_cache[PNG_TRANSFER_CACHE_SIZE];
+static int s_transfer_cache_count = 0;
+/* Guards cache entries. Held only for lookups and insertions, tables are computed outside of it */
+static atomic_flag s_transfer_cache_lock = ATOMIC_FLAG_INIT;
+
+static void LockTransferCache(void) {
+  while (atomic_flag_test_and_set_explicit(&s_transfer_cache_lock, memory_order_acquire)) {
+  }
+}
+
+static void UnlockTransferCache(void) {
+  atomic_flag_clear_explicit(&s_transfer_cache_lock, memory_order_release);
+}
+
+static bool EqualCurves(struct TransferCurve a, struct TransferCurve b) {
+  return a.srgb == b.srgb && (a.srgb || a.gamma == b.gamma);
+}
+
+/* Must be called under lock */
+static void* FindCachedLUT(struct TransferCurve source, struct TransferCurve target, int bit_depth) {
+  for (int i = 0; i < s_transfer_cache_count; ++i) {
+    const struct TransferCacheEntry* entry = &s_transfer_cache[i];
+    if (entry->bit_depth == bit_depth && EqualCurves(entry->source, source) && EqualCurves(entry->target, target))
+      return entry->lut;
+  }
+  return NULL;
+}
+
+static double ToLinear(struct TransferCurve curve, double value) {
+  if (curve.srgb)
+    return value <= 0.04045 ? value / 12.92 : pow((value + 0.055) / 1.055, 2.4);
+  return pow(value, 100000.0 / curve.gamma);
+}
+
+static double FromLinear(struct TransferCurve curve, double value) {
+  if (curve.srgb)
+    return value <= 0.0031308 ? value * 12.92 : 1.055 * pow(value, 1.0 / 2.4) - 0.055;
+  return pow(value, curve.gamma / 100000.0);
+}
+
+static void* CreateLUT(struct TransferCurve source, struct TransferCurve target, int bit_depth) {
+  const int size = 1 << bit_depth;
+  const double max = size - 1;
+  void* lut = malloc((size_t)size * (bit_depth == 16 ? 2 : 1));
+  if (!lut)
+    return NULL;
+
+  for (int i = 0; i < size; ++i) {
+    const double value = FromLinear(target, ToLinear(source, i / max)) * max + 0.5;
+    const double clamped = value < 0 ? 0 : (value > max ? max : value);
+    if (bit_depth == 16)
+      ((uint16_t*)lut)[i] = (uint16_t)clamped;
+    else
+      ((uint8_t*)lut)[i] = (uint8_t)clamped;
+  }
+  return lut;
+}
+
+bool GetTransferLUT(struct TransferCurve source, struct TransferCurve target, int bit_depth, struct TransferLUT* out) {
+  out->lut8 = NULL;
+  out->lut16 = NULL;
+  out->owned = false;
+  /* Zero gamma is invalid, samples are kept as is */
+  if (EqualCurves(source, target) || (!source.srgb && !source.gamma) || (!target.srgb && !target.gamma))
+    return true;
+
+  LockTransferCache();
+  void* lut = FindCachedLUT(source, target, bit_depth);
+  UnlockTransferCache();
+
+  if (!lut) {
+    void* created = CreateLUT(source, target, bit_depth);
+    if (!created)
+      return false;
+
+    /* Another thread could create the same table meanwhile */
+    LockTransferCache();
+    lut = FindCachedLUT(source, target, bit_depth);
+    if (!lut && s_transfer_cache_count < PNG_TRANSFER_CACHE_SIZE) {
+      struct TransferCacheEntry* entry = &s_transfer_cache[s_transfer_cache_count++];
+      entry->source = source;
+      entry->target = target;
+      entry->bit_depth = bit_depth;
+      entry->lut = created;
+      lut = created;
+      created = NULL;
+    }
+    UnlockTransferCache();
+
+    if (!lut) {
+      lut = created;
+      out->owned = true;
+    } else {
+      free(created);
+    }
+  }
+
+  if (bit_depth == 16)
+    out->lut16 = lut;
+  else
+    out->lut8 = lut;
+  return true;
+}
+
+void FreeTransferLUT(struct TransferLUT* obj) {
+  if (!obj)
+    return;
+
+  if (obj->owned) {
+    free((void*)obj->lut8);
+    free((void*)obj->lut16);
+  }
+  obj->lut8 = NULL;
+  obj->lut16 = NULL;
+  obj->owned = false;
+}
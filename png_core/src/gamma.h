@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Transfer function of stored samples
+ */
+struct TransferCurve {
+  /* sRGB curve. `gamma` is ignored */
+  bool srgb;
+  /* Encoding gamma times 100000, as in gAMA chunk: sample = linear ^ (gamma / 100000) */
+  uint32_t gamma;
+};
+
+/*
+ * Lookup table converting samples from one curve to another.
+ * Tables are cached process-wide and shared between threads, they are never modified after creation
+ */
+struct TransferLUT {
+  /* 256 or 65536 entries */
+  const uint8_t* lut8;
+  const uint16_t* lut16;
+  /* Table is not in cache and should be freed with FreeTransferLUT */
+  bool owned;
+};
+
+/*
+ * @brief Get table converting samples encoded with `source` curve into `target` curve
+ * @param bit_depth 8 or 16
+ * @param[out] out Table. Both pointers are NULL if curves are the same
+ * @return false if allocation failed
+ */
+bool GetTransferLUT(struct TransferCurve source, struct TransferCurve target, int bit_depth, struct TransferLUT* out);
+
+void FreeTransferLUT(struct TransferLUT* obj);
@@ -0,0 +1,128 @@
+/**
+ * @file png_core/animation.h
+ *
+ * @brief Frame by frame decoding of animated PNG (APNG) datastreams
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "chunk_data.h"
+#include "compression.h"
+#include "decode_limits.h"
+#include "pixel_format.h"
+#include "png_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Options of PNGCreateAnimationDecoder
+ */
+struct PNGAnimationOptions {
+  /* Canvas format, PNG_PIXEL_FORMAT_RGBA8 or PNG_PIXEL_FORMAT_RGBA16. Default is PNG_PIXEL_FORMAT_RGBA8 */
+  enum PNGPixelFormat format;
+  /*
+   * Frames inflated and defiltered ahead in parallel, one per worker thread. 0 for one per online CPU.
+   * Default is 0
+   */
+  int threads_count;
+  /* Default is PNG_INFLATE_ENGINE_BUILTIN */
+  enum PNGInflateEngine inflate_engine;
+  /* Checked for the canvas and every frame. Default is PNGInitDecodeLimits one */
+  struct PNGDecodeLimits limits;
+};
+
+/**
+ * @brief Initialize options with default values
+ * @param[in, out] obj Options obj, not null
+ */
+PNG_CORE_API void PNGInitAnimationOptions(struct PNGAnimationOptions* obj);
+
+/**
+ * Animation properties
+ */
+struct PNGAnimationInfo {
+  /* Canvas size, the one of IHDR */
+  int width;
+  int height;
+  /* Frames returned by PNGDecodeNextFrame. 1 for images without acTL chunk */
+  int frames_count;
+  /* Times to play animation, 0 for infinite looping */
+  uint32_t plays_count;
+  /* The default image (IDAT) is the first frame. Otherwise it is only shown by decoders without APNG support */
+  bool default_image_is_frame;
+};
+
+/**
+ * Frame composed by PNGDecodeNextFrame
+ */
+struct PNGAnimationFrame {
+  /* Frame index from 0 */
+  int index;
+  /* Frame region, delay and operations. Covers whole canvas for images without acTL chunk */
+  struct PNGChunkData_fcTL control;
+  /* Delay before the next frame in seconds */
+  double delay_seconds;
+  /*
+   * Whole canvas with the frame rendered, owned by decoder. Valid until the next call of
+   * PNGDecodeNextFrame, PNGRewindAnimation or PNGFreeAnimationDecoder
+   */
+  const uint8_t* canvas;
+  size_t canvas_size;
+  /* Distance between starts of canvas rows in bytes */
+  int row_stride;
+};
+
+/**
+ * Decoder of animation frames that keeps one canvas and per-worker buffers for all frames
+ */
+struct PNGAnimationDecoder;
+
+/**
+ * @brief Parse animation control chunks and allocate canvas.
+ * Frame sequence numbers, regions and count are validated up front; data of each frame is checked when it is decoded.
+ * Images without acTL chunk are decoded as a single frame. Interlaced images are not supported
+ * @param[in] chunk_list Chunk list with parsed data. Must outlive decoder
+ * @param[in] options Decoding options. NULL for defaults
+ * @return Decoder to free with PNGFreeAnimationDecoder or NULL if image is invalid, exceeds limits
+ *   or allocation failed
+ */
+PNG_CORE_API struct PNGAnimationDecoder* PNGCreateAnimationDecoder(const struct PNGRawChunk* chunk_list,
+                                                                   const struct PNGAnimationOptions* options);
+
+/**
+ * @param[in] obj Decoder, not null
+ * @param[out] out Animation properties
+ */
+PNG_CORE_API void PNGGetAnimationInfo(const struct PNGAnimationDecoder* obj, struct PNGAnimationInfo* out);
+
+/**
+ * @brief Dispose previous frame and render the next one onto canvas.
+ * Data of the next frames is inflated, defiltered and converted in parallel a batch at a time,
+ * frames are composed on calling thread in order
+ * @param[in, out] obj Decoder, not null
+ * @param[out] out Composed frame
+ * @return 1 if frame is composed, 0 if all frames have been returned, -1 if frame data is corrupted,
+ *   exceeds limits or allocation failed. Decoder can only be rewound after error
+ */
+PNG_CORE_API int PNGDecodeNextFrame(struct PNGAnimationDecoder* obj, struct PNGAnimationFrame* out);
+
+/**
+ * @brief Clear canvas and start from the first frame, e.g. for the next play
+ * @param[in, out] obj Decoder, not null
+ */
+PNG_CORE_API void PNGRewindAnimation(struct PNGAnimationDecoder* obj);
+
+/**
+ * @param[in] obj Decoder, nullable
+ */
+PNG_CORE_API void PNGFreeAnimationDecoder(struct PNGAnimationDecoder* obj);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
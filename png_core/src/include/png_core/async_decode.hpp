@@ -0,0 +1,272 @@
+/**
+ * @file png_core/async_decode.hpp
+ *
+ * @brief C++20 coroutine decoding of datastreams read from awaitable sources
+ */
+
+#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <new>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "decoder.h"
+#include "stream_decoder.h"
+
+namespace png_core {
+
+/**
+ * Thrown by async_decode if datastream is corrupted, truncated, exceeds limits or cannot be converted
+ */
+class decode_error : public std::runtime_error {
+public:
+  using std::runtime_error::runtime_error;
+};
+
+namespace detail {
+
+/*
+ * Coroutine frames allocated through allocator passed after std::allocator_arg, or through std::allocator.
+ * A copy of allocator and the function freeing the frame are stored after the frame, so the frame is freed
+ * without knowing allocator type
+ */
+class frame_allocation {
+public:
+  static void* operator new(std::size_t size) { return allocate(size, std::allocator<std::byte>()); }
+
+  template <class Alloc, class... Args>
+  static void* operator new(std::size_t size, std::allocator_arg_t, const Alloc& alloc, const Args&...) {
+    return allocate(size, alloc);
+  }
+
+  static void operator delete(void* frame, std::size_t size) noexcept {
+    deallocate_fn deallocate;
+    std::memcpy(&deallocate, static_cast<std::byte*>(frame) + tail_offset(size), sizeof(deallocate));
+    deallocate(frame, size);
+  }
+
+  /* Placement form of the allocator overload of operator new */
+  template <class Alloc, class... Args>
+  static void operator delete(void* frame, std::size_t size, std::allocator_arg_t, const Alloc&,
+                              const Args&...) noexcept {
+    operator delete(frame, size);
+  }
+
+private:
+  using block = std::max_align_t;
+  using deallocate_fn = void (*)(void* frame, std::size_t size) noexcept;
+
+  static constexpr std::size_t tail_offset(std::size_t size) {
+    return (size + alignof(block) - 1) / alignof(block) * alignof(block);
+  }
+
+  /* Frame, then free function, then allocator, in blocks */
+  template <class BlockAlloc>
+  static constexpr std::size_t blocks_count(std::size_t size) {
+    return (tail_offset(size) + alignof(block) + sizeof(BlockAlloc) + sizeof(block) - 1) / sizeof(block);
+  }
+
+  template <class BlockAlloc>
+  static BlockAlloc* stored_allocator(void* frame, std::size_t size) {
+    static_assert(sizeof(deallocate_fn) <= alignof(block) && alignof(BlockAlloc) <= alignof(block));
+    return reinterpret_cast<BlockAlloc*>(static_cast<std::byte*>(frame) + tail_offset(size) + alignof(block));
+  }
+
+  template <class Alloc>
+  static void* allocate(std::size_t size, const Alloc& alloc) {
+    using block_alloc = typename std::allocator_traits<Alloc>::template rebind_alloc<block>;
+    block_alloc blocks(alloc);
+    void* frame =
+        std::to_address(std::allocator_traits<block_alloc>::allocate(blocks, blocks_count<block_alloc>(size)));
+    const deallocate_fn deallocate = &deallocate_frame<block_alloc>;
+    std::memcpy(static_cast<std::byte*>(frame) + tail_offset(size), &deallocate, sizeof(deallocate));
+    ::new (static_cast<void*>(stored_allocator<block_alloc>(frame, size))) block_alloc(std::move(blocks));
+    return frame;
+  }
+
+  template <class BlockAlloc>
+  static void deallocate_frame(void* frame, std::size_t size) noexcept {
+    BlockAlloc* stored = std::launder(stored_allocator<BlockAlloc>(frame, size));
+    BlockAlloc blocks(std::move(*stored));
+    stored->~BlockAlloc();
+    std::allocator_traits<BlockAlloc>::deallocate(blocks, static_cast<block*>(frame), blocks_count<BlockAlloc>(size));
+  }
+};
+
+struct stream_decoder_deleter {
+  void operator()(PNGStreamDecoder* obj) const noexcept { PNGFreeStreamDecoder(obj); }
+};
+
+}  // namespace detail
+
+/**
+ * Coroutine producing values on demand, awaited with next(). Producer may itself suspend on other awaitables,
+ * it runs on the thread that resumes it and switches to consumer without returning to a scheduler
+ */
+template <class T>
+class async_generator {
+public:
+  class promise_type : public detail::frame_allocation {
+  public:
+    async_generator get_return_object() noexcept {
+      return async_generator(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    auto final_suspend() const noexcept { return resume_consumer{}; }
+    auto yield_value(T value) noexcept(std::is_nothrow_move_constructible_v<T>) {
+      value_.emplace(std::move(value));
+      return resume_consumer{};
+    }
+    void return_void() const noexcept {}
+    void unhandled_exception() noexcept { exception_ = std::current_exception(); }
+
+  private:
+    friend class async_generator;
+
+    struct resume_consumer {
+      bool await_ready() const noexcept { return false; }
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> producer) const noexcept {
+        return producer.promise().consumer_;
+      }
+      void await_resume() const noexcept {}
+    };
+
+    std::optional<T> value_;
+    std::exception_ptr exception_;
+    std::coroutine_handle<> consumer_;
+  };
+
+  async_generator(async_generator&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+  async_generator& operator=(async_generator&& other) noexcept {
+    if (this != &other) {
+      reset();
+      handle_ = std::exchange(other.handle_, {});
+    }
+    return *this;
+  }
+  ~async_generator() { reset(); }
+
+  /**
+   * @brief Resume producer until it yields the next value or finishes. Must not be called again before
+   * the awaiter is resumed, generator must not be destroyed meanwhile
+   * @return Awaitable of the next value, std::nullopt after the last one. Rethrows exception of producer
+   */
+  auto next() noexcept {
+    struct next_awaiter {
+      std::coroutine_handle<promise_type> producer;
+
+      bool await_ready() const noexcept { return !producer || producer.done(); }
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<> consumer) const noexcept {
+        producer.promise().consumer_ = consumer;
+        producer.promise().value_.reset();
+        return producer;
+      }
+      std::optional<T> await_resume() const {
+        if (!producer)
+          return std::nullopt;
+        promise_type& promise = producer.promise();
+        if (promise.exception_)
+          std::rethrow_exception(std::exchange(promise.exception_, {}));
+        if (producer.done())
+          return std::nullopt;
+        return std::move(promise.value_);
+      }
+    };
+    return next_awaiter{handle_};
+  }
+
+private:
+  explicit async_generator(std::coroutine_handle<promise_type> handle) noexcept : handle_(handle) {}
+
+  void reset() noexcept {
+    if (handle_)
+      handle_.destroy();
+    handle_ = {};
+  }
+
+  std::coroutine_handle<promise_type> handle_;
+};
+
+/**
+ * @return Options initialized by PNGInitDecodeOptions
+ */
+inline PNGDecodeOptions default_decode_options() noexcept {
+  PNGDecodeOptions options;
+  PNGInitDecodeOptions(&options);
+  return options;
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+/* GCC frees coroutine frames with the sized operator delete and compares it with the template operator new by name */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+/**
+ * @brief Decode datastream pulled from source, yielding rows as soon as their scanlines are inflated.
+ * Input pieces are passed to PNGStreamDecoder as they are, rows are views of its row buffer: nothing is copied.
+ * Frame is allocated through `alloc`, so many decodes can run on a few threads without heap contention
+ * @param alloc Allocator of coroutine frame, copied into it
+ * @param source Object with read() returning awaitable of std::span<const std::byte>: next piece of datastream,
+ *   valid until read() is called again. Empty span at the end of input. Must outlive the generator
+ * @param options Decoding options, as of PNGCreateStreamDecoder
+ * @param[out] info Image properties filled before the first row, nullable. Must outlive the generator
+ * @return Generator of rows, top to bottom. Each row is valid until the next value is awaited.
+ *   Throws decode_error on the awaiting side if datastream cannot be decoded
+ */
+template <class Alloc, class Source>
+async_generator<std::span<const std::byte>> async_decode(std::allocator_arg_t, const Alloc& alloc, Source& source,
+                                                         PNGDecodeOptions options = default_decode_options(),
+                                                         PNGImage* info = nullptr) {
+  (void)alloc;
+  std::unique_ptr<PNGStreamDecoder, detail::stream_decoder_deleter> decoder(PNGCreateStreamDecoder(&options));
+  if (!decoder)
+    throw decode_error("decoding options are not supported");
+
+  std::span<const std::byte> input;
+  bool input_ended = false;
+  while (true) {
+    std::size_t consumed = 0;
+    PNGStreamRow row;
+    const PNGStreamStatus status = PNGStreamDecode(
+        decoder.get(), reinterpret_cast<const uint8_t*>(input.data()), input.size(), &consumed, &row);
+    input = input.subspan(consumed);
+    if (status == PNG_STREAM_ROW) {
+      if (row.y == 0 && info)
+        PNGGetStreamImageInfo(decoder.get(), info);
+      co_yield std::span<const std::byte>(reinterpret_cast<const std::byte*>(row.data), row.size);
+    } else if (status == PNG_STREAM_END) {
+      co_return;
+    } else if (status == PNG_STREAM_ERROR) {
+      throw decode_error("datastream is corrupted, exceeds limits or cannot be converted");
+    } else if (input_ended) {
+      throw decode_error("datastream is truncated");
+    } else {
+      input = co_await source.read();
+      input_ended = input.empty();
+    }
+  }
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+/**
+ * @brief async_decode with frame allocated through std::allocator
+ */
+template <class Source>
+async_generator<std::span<const std::byte>> async_decode(Source& source,
+                                                         PNGDecodeOptions options = default_decode_options(),
+                                                         PNGImage* info = nullptr) {
+  return async_decode(std::allocator_arg, std::allocator<std::byte>(), source, options, info);
+}
+
+}  // namespace png_core
@@ -0,0 +1,120 @@
+/**
+ * @file png_core/batch.h
+ *
+ * @brief Reading and decoding of many PNG files at once
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "chunk_data.h"
+#include "decoder.h"
+#include "png_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Way files are read by PNGDecodeBatch
+ */
+enum PNGBatchIOEngine {
+  /* io_uring where kernel supports it, PNG_BATCH_IO_ENGINE_PREAD otherwise */
+  PNG_BATCH_IO_ENGINE_AUTO = 0,
+  /*
+   * Linux io_uring: opens, statx and reads of many files are in flight at once, submitted by one thread
+   * while other threads decode files already read
+   */
+  PNG_BATCH_IO_ENGINE_IO_URING = 1,
+  /* Every decoding thread reads its next file with blocking open and pread */
+  PNG_BATCH_IO_ENGINE_PREAD = 2,
+};
+
+/**
+ * Options of PNGDecodeBatch
+ */
+struct PNGBatchOptions {
+  /* Default is PNG_BATCH_IO_ENGINE_AUTO */
+  enum PNGBatchIOEngine io_engine;
+  /*
+   * Files being read plus read files waiting for decoding, at most 4096. Bounds memory held by batch.
+   * Not used by PNG_BATCH_IO_ENGINE_PREAD. Default is 64
+   */
+  int queue_depth;
+  /* Decoding threads, 0 for one per online CPU. Default is 0 */
+  int threads_count;
+  /*
+   * Decoding options of every file, its limits are also checked while chunks are loaded.
+   * stats is not used, files are decoded concurrently. See collect_stats
+   */
+  struct PNGDecodeOptions decode;
+  /* Collect statistics of loading and decoding every file into PNGBatchItem::stats. Default is false */
+  bool collect_stats;
+  /* Larger files are not read. Default is 256 MiB */
+  int max_file_size;
+};
+
+/**
+ * @brief Initialize options with default values
+ * @param[in, out] obj Options obj, not null
+ */
+PNG_CORE_API void PNGInitBatchOptions(struct PNGBatchOptions* obj);
+
+/**
+ * File of batch passed to PNGBatchCallback
+ */
+struct PNGBatchItem {
+  /* Index of file path */
+  int index;
+  const char* path;
+  /* 0 if file is read, errno of failed open or read otherwise. EFBIG if file exceeds max_file_size */
+  int error;
+  /* File contents, NULL if file is not read. Valid until callback returns */
+  const uint8_t* data;
+  int data_size;
+  /* Loaded chunks, NULL if file is not a PNG datastream or exceeds limits. Valid until callback returns */
+  const struct PNGRawChunk* chunk_list;
+  /* PNGDecodeImage succeeded */
+  bool decoded;
+  /* Decoded image. Freed after callback returns, unless callback takes its data and sets it to NULL */
+  struct PNGImage image;
+  /* Statistics of read file if collect_stats is set, NULL otherwise. Valid until callback returns */
+  const struct PNGDecodeStats* stats;
+};
+
+/**
+ * Function called for every file of batch, read or not, in order of completion.
+ * Called concurrently from decoding threads
+ */
+typedef void (*PNGBatchCallback)(void* user_data, struct PNGBatchItem* item);
+
+/**
+ * Outcome of PNGDecodeBatch
+ */
+struct PNGBatchResult {
+  /* Engine that read files */
+  enum PNGBatchIOEngine io_engine;
+  int read_files_count;
+  int decoded_files_count;
+};
+
+/**
+ * @brief Read and decode files, overlapping reads of the next files with decoding of files already read.
+ * Read buffers go straight to chunk loading and decoding on the threads, no file is read twice
+ * @param[in] paths File paths, valid until function returns
+ * @param paths_count Amount of paths
+ * @param[in] options Options. NULL for defaults
+ * @param callback Function called for every file, not null
+ * @param user_data Passed to callback
+ * @param[out] result Batch outcome, nullable
+ * @return false if options are invalid, requested engine is not supported or batch failed before every file was
+ *   passed to callback. Errors of single files are reported to callback
+ */
+PNG_CORE_API bool PNGDecodeBatch(const char* const* paths, int paths_count, const struct PNGBatchOptions* options,
+                                 PNGBatchCallback callback, void* user_data, struct PNGBatchResult* result);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
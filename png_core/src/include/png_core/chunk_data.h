@@ -14,6 +14,8 @@
 #include <stdint.h>
 
 #include "chunk_types.h"
+#include "decode_limits.h"
+#include "decode_stats.h"
 #include "png_core.h"
 
 #ifdef __cplusplus
@@ -62,6 +64,13 @@ typedef void* (*PNGChunkDataStructLoadFunc)(const uint8_t* /* raw_data */, int /
  */
 typedef uint32_t (*PNGChunkDataStructWriteFunc)(const void* /* obj */, uint8_t* /* out */);
 
+/**
+ * Function that computes size of chunk data written by PNGChunkDataStructWriteFunc without writing it
+ * @param[in] obj Chunk data structure object, not NULL
+ * @return Chunk data size in bytes
+ */
+typedef uint32_t (*PNGChunkDataStructSizeFunc)(const void* /* obj */);
+
 /**
  * Function that frees chunk data structure object
  * @param[in] obj Chunk data structure object, nullable
@@ -69,13 +78,14 @@ typedef uint32_t (*PNGChunkDataStructWriteFunc)(const void* /* obj */, uint8_t*
 typedef void (*PNGChunkDataStructFreeFunc)(void* /* obj */);
 
 /**
- * Declare Construct/Write/Free functions for chunk data structure.
- * See PNGChunkDataStructLoadFunc, PNGChunkDataStructWriteFunc, PNGChunkDataStructFreeFunc.
+ * Declare Construct/Write/Size/Free functions for chunk data structure.
+ * See PNGChunkDataStructLoadFunc, PNGChunkDataStructWriteFunc, PNGChunkDataStructSizeFunc, PNGChunkDataStructFreeFunc.
  * @example for PNG_DECLARE_CHUNK_DATA_STRUCT_FUNCTIONS(IHDR):
  *   PNG_CORE_API struct PNGChunkData_IHDR* PNGAllocateData_IHDR();
  *   PNG_CORE_API void PNGInitData_IHDR(struct PNGChunkData_IHDR* obj);
  *   PNG_CORE_API struct PNGChunkData_IHDR* PNGLoadData_IHDR(const uint8_t* data, int data_size);
  *   PNG_CORE_API int PNGWriteData_IHDR(const struct PNGChunkData_IHDR* data, void* out);
+ *   PNG_CORE_API int PNGGetDataSize_IHDR(const struct PNGChunkData_IHDR* obj);
  *   PNG_CORE_API void PNGFreeData_IHDR(struct PNGChunkData_IHDR* data, void* out);
  */
 #define PNG_DECLARE_CHUNK_DATA_STRUCT_FUNCTIONS(chunk_type)                                                    \
@@ -83,6 +93,7 @@ typedef void (*PNGChunkDataStructFreeFunc)(void* /* obj */);
   PNG_CORE_API void PNGInitData_##chunk_type(struct PNGChunkData_##chunk_type* obj);                           \
   PNG_CORE_API struct PNGChunkData_##chunk_type* PNGLoadData_##chunk_type(const uint8_t* data, int data_size); \
   PNG_CORE_API int PNGWriteData_##chunk_type(const struct PNGChunkData_##chunk_type* obj, uint8_t* out);       \
+  PNG_CORE_API int PNGGetDataSize_##chunk_type(const struct PNGChunkData_##chunk_type* obj);                   \
   PNG_CORE_API void PNGFreeData_##chunk_type(struct PNGChunkData_##chunk_type* obj);                           \
   PNG_CORE_API bool PNGEqualData_##chunk_type(const struct PNGChunkData_##chunk_type* obj1,                    \
                                               const struct PNGChunkData_##chunk_type* obj2);
@@ -95,6 +106,7 @@ struct PNGChunkDataStructFunctions {
   PNGChunkDataStructInitFunc init_func;
   PNGChunkDataStructLoadFunc load_func;
   PNGChunkDataStructWriteFunc write_func;
+  PNGChunkDataStructSizeFunc size_func;
   PNGChunkDataStructFreeFunc free_func;
 };
 PNG_CORE_API void PNGInitChunkDataStructFunctions(struct PNGChunkDataStructFunctions* obj);
@@ -143,7 +155,12 @@ PNG_DECLARE_CHUNK_DATA_STRUCT_FUNCTIONS(PLTE)
 
 /* bKGD */
 struct PNGChunkData_bKGD {
+  /* Background of indexed images */
   uint8_t index_in_palette;
+  /* Background of greyscale (1 sample) or truecolor (3 samples) images in image bit depth */
+  uint16_t samples[3];
+  /* 0 for indexed images */
+  int samples_count;
 };
 PNG_DECLARE_CHUNK_DATA_STRUCT_FUNCTIONS(bKGD)
 
@@ -207,6 +224,81 @@ struct PNGChunkData_sBIT {
 };
 PNG_DECLARE_CHUNK_DATA_STRUCT_FUNCTIONS(sBIT)
 
+/* tRNS. Layout of bytes depends on image color type:
+ * indexed - alpha of the first `bytes_count` palette entries,
+ * greyscale - 2-byte transparent grey sample,
+ * truecolor - 2-byte transparent R, G, B samples */
+struct PNGChunkData_tRNS {
+  uint8_t bytes[256];
+  int bytes_count;
+};
+PNG_DECLARE_CHUNK_DATA_STRUCT_FUNCTIONS(tRNS)
+
+/*
+ * @brief Get sample of transparent color of greyscale or truecolor image
+ * @param channel 0 for grey, 0-2 for red, green and blue
+ * @return Sample value or -1 if chunk is too short
+ */
+PNG_CORE_API int PNGGetTransparentSample_tRNS(const struct PNGChunkData_tRNS* obj, int channel);
+
+/* acTL. Animation control of APNG datastream */
+struct PNGChunkData_acTL {
+  /* Number of frames, the default image is counted if it is the first frame */
+  uint32_t frames_count;
+  /* Number of times to loop animation, 0 for infinite looping */
+  uint32_t plays_count;
+};
+PNG_DECLARE_CHUNK_DATA_STRUCT_FUNCTIONS(acTL)
+
+/*
+ * Region of output buffer changes after the frame is shown, before the next one is rendered
+ */
+enum PNGDisposeOp {
+  /* Left as is */
+  PNG_DISPOSE_OP_NONE = 0,
+  /* Cleared to fully transparent black */
+  PNG_DISPOSE_OP_BACKGROUND = 1,
+  /* Reverted to contents before the frame was rendered */
+  PNG_DISPOSE_OP_PREVIOUS = 2,
+};
+
+/*
+ * How frame is rendered into its region of output buffer
+ */
+enum PNGBlendOp {
+  /* Frame pixels overwrite the region including alpha */
+  PNG_BLEND_OP_SOURCE = 0,
+  /* Frame is composited over the region with its alpha */
+  PNG_BLEND_OP_OVER = 1,
+};
+
+/* fcTL. Frame control, precedes IDAT or fdAT chunks of the frame */
+struct PNGChunkData_fcTL {
+  /* Sequence number of the chunk, shared by fcTL and fdAT chunks starting from 0 */
+  uint32_t sequence_number;
+  /* Frame region, must lie within the image */
+  uint32_t width;
+  uint32_t height;
+  uint32_t x_offset;
+  uint32_t y_offset;
+  /* Frame delay is delay_num / delay_den seconds, denominator 0 means 100 */
+  uint16_t delay_num;
+  uint16_t delay_den;
+  /* enum PNGDisposeOp */
+  uint8_t dispose_op;
+  /* enum PNGBlendOp */
+  uint8_t blend_op;
+};
+PNG_DECLARE_CHUNK_DATA_STRUCT_FUNCTIONS(fcTL)
+
+/* fdAT. Frame data, the same as IDAT data preceded by sequence number */
+struct PNGChunkData_fdAT {
+  uint32_t sequence_number;
+  uint8_t* data;
+  int data_size;
+};
+PNG_DECLARE_CHUNK_DATA_STRUCT_FUNCTIONS(fdAT)
+
 struct PNGChunkData_UnknownData {
   uint8_t* data;
   int data_size;
@@ -270,14 +362,48 @@ PNG_CORE_API struct PNGRawChunk* PNGLoadRawChunk(const uint8_t* data, int data_s
  * @brief Load and parse chunk list from network-ordered buffer
  * @param[in] data Buffer chunks stream.
  * @param data_size Buffer size in bytes
- * @return Loaded and parsed chunk or NULL, if error occurred
+ * @return Loaded and parsed chunk or NULL, if error occurred or a default limit is exceeded
  */
 PNG_CORE_API struct PNGRawChunk* PNGLoadRawChunkList(const uint8_t* data, int data_size, bool data_with_png_signature);
 
+/**
+ * @brief Options of selective chunk list loading.
+ * A chunk is loaded only if it passes all enabled filters, other chunks are stepped over without copying or parsing
+ */
+struct PNGChunkLoadOptions {
+  /* Types allow-list. NULL to allow any type */
+  const struct ChunkType* allowed_types;
+  int allowed_types_count;
+  /* Skip chunks for which IsChunkTypeAncillary() is true */
+  bool skip_ancillary;
+  /* Parse stage statistics are added to it if not NULL */
+  struct PNGDecodeStats* stats;
+  /* Chunk count, chunk memory and pixels of IHDR are checked before chunks are loaded */
+  struct PNGDecodeLimits limits;
+};
+
+/**
+ * @brief Initialize options with default values: every chunk is loaded, default limits are used
+ * @param[in, out] obj Options obj, not null
+ */
+PNG_CORE_API void PNGInitChunkLoadOptions(struct PNGChunkLoadOptions* obj);
+
+/**
+ * @brief Load and parse chunk list from network-ordered buffer, skipping chunks rejected by options
+ * @param[in] data Buffer chunks stream.
+ * @param data_size Buffer size in bytes
+ * @param[in] options Loading options. NULL to load every chunk with default limits
+ * @return Loaded and parsed chunk or NULL, if error occurred, all chunks were skipped or a limit is exceeded.
+ *   Chunks before other errors are returned, as with PNGLoadRawChunkList
+ */
+PNG_CORE_API struct PNGRawChunk* PNGLoadRawChunkListWithOptions(const uint8_t* data, int data_size,
+                                                                bool data_with_png_signature,
+                                                                const struct PNGChunkLoadOptions* options);
+
 /**
  * @brief Write chunk into network-ordered buffer
  * If present, writes raw_data. Tries to write parsed_data otherwise
- * @note Call with out==NULL to get size in bytes
+ * @note Call with out==NULL to get size in bytes. Size of parsed_data is computed by size_func, without write_func
  * @param[in] obj Chunk to write, not null
  * @param[out] out Buffer
  * @return Amount of bytes written
@@ -287,13 +413,21 @@ PNG_CORE_API int PNGWriteRawChunk(const struct PNGRawChunk* obj, uint8_t* out);
 /**
  * @brief Write chunk list into network-ordered buffer
  * If present, writes raw_data. Tries to write parsed_data otherwise
- * @note Call with out==NULL to get size in bytes
+ * @note Call with out==NULL to get size in bytes. Size of parsed_data is computed by size_func, without write_func
  * @param[in] obj Chunk to write, not null
  * @param[out] out Buffer
  * @return Amount of bytes written
  */
 PNG_CORE_API int PNGWriteRawChunkList(const struct PNGRawChunk* obj, uint8_t* out, bool write_png_signature);
 
+/**
+ * @brief Calculate chunk CRC on the type and data fields
+ * @param[in] data Chunk data, can be NULL if data_size is 0
+ * @param data_size Data size in bytes
+ * @return CRC to write after chunk data
+ */
+PNG_CORE_API uint32_t PNGComputeChunkCRC(struct ChunkType type, const uint8_t* data, uint32_t data_size);
+
 /**
  * @brief Free *whole* PNGRawChunk list.
  * Each node should provide valid freeing function for data object.
@@ -0,0 +1,187 @@
+/**
+ * @file png_core/chunk_table.h
+ *
+ * @brief Contiguous index of chunks of a PNG datastream with O(1) lookup by chunk type
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "chunk_types.h"
+#include "png_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Entry id meaning "no entry"
+ */
+#define PNG_CHUNK_TABLE_NO_ENTRY (-1)
+
+/**
+ * Location of chunk data inside a datastream
+ */
+struct PNGChunkSpan {
+  /* Offset of the first data byte from the beginning of the datastream */
+  int64_t offset;
+  /* Data size in bytes */
+  uint32_t size;
+};
+
+/**
+ * Per-type index entry. See PNGChunkTable::type_index
+ */
+struct PNGChunkTypeIndexEntry {
+  /* ChunkType::bytes, 0 for unused slot */
+  uint32_t type;
+  int first;
+  int last;
+  int count;
+};
+
+/**
+ * @brief Struct-of-arrays index of chunks.
+ * Does not own or copy chunk data, only stores where the data lives.
+ * Entries are addressed by id and never move. File order is kept in `prev`/`next` links
+ * and chunks of the same type are additionally linked with `prev_of_type`/`next_of_type`,
+ * so append and remove are O(1), first/all-of-type queries do not visit other chunks.
+ * Insertion before a chunk of another type walks back to the nearest chunk of the same type,
+ * so it is O(1) only for types without chunks or when inserting next to a chunk of the same type.
+ * Indexes serialized datastreams, used by edit plans. Chunk lists (PNGRawChunk) are not indexed by it:
+ * the decoder visits every chunk of a list once anyway to collect IDAT data.
+ */
+struct PNGChunkTable {
+  /* Per-entry arrays, `capacity` elements each */
+  uint32_t* types;
+  int64_t* offsets;
+  uint32_t* sizes;
+  uint32_t* crcs;
+  int* prev;
+  int* next;
+  int* prev_of_type;
+  int* next_of_type;
+  int capacity;
+  /* Amount of ever used entry slots */
+  int used;
+  /* Amount of live entries */
+  int count;
+  /* First and last entries in file order */
+  int head;
+  int tail;
+  /* Removed entries slots to reuse, linked through `next` */
+  int free_head;
+  /* Do not reuse slots of removed entries, so their ids never address other chunks. Kept by ClearChunkTable */
+  bool keep_removed_ids;
+
+  /* Open addressing hash table: chunk type -> first/last entry of that type */
+  struct PNGChunkTypeIndexEntry* type_index;
+  int type_index_capacity;
+  int type_index_used;
+
+  /* IDAT data spans in file order. Rebuilt on demand after IDAT entries change */
+  struct PNGChunkSpan* idat_spans;
+  int idat_spans_count;
+  int idat_spans_capacity;
+  bool idat_spans_dirty;
+};
+
+/**
+ * @brief Initialize empty table
+ * @param[in, out] obj Table, not null
+ */
+PNG_CORE_API void PNGInitChunkTable(struct PNGChunkTable* obj);
+
+/**
+ * @brief Free memory owned by table and reinitialize it as empty
+ * @param[in, out] obj Table, nullable
+ */
+PNG_CORE_API void PNGFreeChunkTable(struct PNGChunkTable* obj);
+
+/**
+ * @brief Index chunks of network-ordered buffer. Only chunk headers and CRCs are read, data is not copied
+ * @param[in] data Buffer with chunks stream
+ * @param data_size Buffer size in bytes
+ * @param[out] out Table to fill, should be initialized. Previous content is dropped
+ * @return false if datastream is malformed or allocation failed
+ */
+PNG_CORE_API bool PNGBuildChunkTable(const uint8_t* data, int64_t data_size, bool data_with_png_signature,
+                                     struct PNGChunkTable* out);
+
+/**
+ * @brief Index chunks of PNG file. Only signature, chunk headers and CRCs are read, file position is not changed
+ * @param fd File descriptor opened for reading
+ * @param[out] out Table to fill, should be initialized. Previous content is dropped
+ * @return false if file is not a valid PNG datastream, read failed or allocation failed
+ */
+PNG_CORE_API bool PNGBuildChunkTableFromFd(int fd, struct PNGChunkTable* out);
+
+/**
+ * @brief Add chunk to the end of the table
+ * @return Id of new entry or PNG_CHUNK_TABLE_NO_ENTRY if allocation failed
+ */
+PNG_CORE_API int PNGChunkTableAppend(struct PNGChunkTable* obj, struct ChunkType type, int64_t offset, uint32_t size,
+                                     uint32_t crc);
+
+/**
+ * @brief Add chunk before another one
+ * @note Costs O(1) plus distance to the nearest preceding chunk of the same type, O(1) if `before` has the same type
+ * @param before Entry id to insert before. PNG_CHUNK_TABLE_NO_ENTRY to append
+ * @return Id of new entry or PNG_CHUNK_TABLE_NO_ENTRY if allocation failed or `before` is not live
+ */
+PNG_CORE_API int PNGChunkTableInsert(struct PNGChunkTable* obj, int before, struct ChunkType type, int64_t offset,
+                                     uint32_t size, uint32_t crc);
+
+/**
+ * @brief Remove entry. Its id may be reused by next insertions
+ * @return false if entry is not live
+ */
+PNG_CORE_API bool PNGChunkTableRemove(struct PNGChunkTable* obj, int entry);
+
+/**
+ * @return Id of the first chunk of type in file order or PNG_CHUNK_TABLE_NO_ENTRY
+ */
+PNG_CORE_API int PNGChunkTableFindFirst(const struct PNGChunkTable* obj, struct ChunkType type);
+
+/**
+ * @return Amount of chunks of type
+ */
+PNG_CORE_API int PNGChunkTableCountOfType(const struct PNGChunkTable* obj, struct ChunkType type);
+
+/**
+ * @brief Get ids of all chunks of type in file order
+ * @param[out] out_entries Buffer to write ids into. Can be NULL
+ * @return Amount of chunks of type
+ */
+PNG_CORE_API int PNGChunkTableFindAll(const struct PNGChunkTable* obj, struct ChunkType type, int* out_entries);
+
+/**
+ * @brief Get data spans of all IDAT chunks in file order
+ * @param[out] out_count Amount of spans, not null. 0 if allocation failed
+ * @return Pointer to spans owned by table, valid until next table modification. Not NULL if there are no IDAT
+ *   chunks, NULL only if allocation failed
+ */
+PNG_CORE_API const struct PNGChunkSpan* PNGChunkTableGetIDATSpans(struct PNGChunkTable* obj, int* out_count);
+
+/**
+ * @return true if entry id addresses a chunk which is not removed
+ */
+static inline bool PNGChunkTableIsLive(const struct PNGChunkTable* obj, int entry) {
+  /* Removed entries have CHUNK_INVALID type */
+  return entry >= 0 && entry < obj->used && obj->types[entry] != CHUNK_INVALID.bytes;
+}
+
+/**
+ * @return Chunk type of live entry
+ */
+static inline struct ChunkType PNGChunkTableGetType(const struct PNGChunkTable* obj, int entry) {
+  struct ChunkType type;
+  type.bytes = obj->types[entry];
+  return type;
+}
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
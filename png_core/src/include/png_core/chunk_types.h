@@ -34,6 +34,10 @@ extern const struct ChunkType CHUNK_IEND;
 extern const struct ChunkType CHUNK_gAMA;
 extern const struct ChunkType CHUNK_IDAT;
 extern const struct ChunkType CHUNK_sBIT;
+extern const struct ChunkType CHUNK_tRNS;
+extern const struct ChunkType CHUNK_acTL;
+extern const struct ChunkType CHUNK_fcTL;
+extern const struct ChunkType CHUNK_fdAT;
 
 /*
  * Checks is bytes are valid chunk type
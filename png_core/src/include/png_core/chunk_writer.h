@@ -0,0 +1,66 @@
+/**
+ * @file png_core/chunk_writer.h
+ *
+ * @brief Streaming chunk list writing without preallocated output buffer
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "chunk_data.h"
+#include "png_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Piece of output datastream. Has the same members as POSIX `struct iovec`
+ */
+struct PNGIOVec {
+  const void* base;
+  size_t length;
+};
+
+/**
+ * Function receiving consecutive pieces of serialized datastream.
+ * Pieces are valid only during the call
+ * @param[in] vecs Pieces to write in order
+ * @param vecs_count Amount of pieces
+ * @param user_data Pointer passed to writing function
+ * @return false to abort writing
+ */
+typedef bool (*PNGWriteSinkFunc)(const struct PNGIOVec* vecs, int vecs_count, void* user_data);
+
+/**
+ * @brief Write chunk list to sink.
+ * Signature, chunk headers, data and CRCs are passed as separate pieces, raw_data is never copied.
+ * Chunks without raw_data are sized by size_func and serialized by a single write_func call, each into a single
+ * piece, before anything is passed to sink. So failed allocation writes nothing.
+ * @param[in] obj Chunk list to write, nullable
+ * @param sink Sink function, not null
+ * @return Amount of bytes written or -1 if sink failed or allocation failed
+ */
+PNG_CORE_API int64_t PNGWriteRawChunkListToSink(const struct PNGRawChunk* obj, bool write_png_signature,
+                                                PNGWriteSinkFunc sink, void* user_data);
+
+/**
+ * @brief Write chunk list to file descriptor using scatter-gather output (`writev`)
+ * @param[in] obj Chunk list to write, nullable
+ * @param fd Opened for writing file descriptor
+ * @return Amount of bytes written or -1 if error occurred
+ */
+PNG_CORE_API int64_t PNGWriteRawChunkListToFd(const struct PNGRawChunk* obj, int fd, bool write_png_signature);
+
+/**
+ * @brief Write all pieces to file descriptor, retrying on partial writes
+ * @return false if error occurred
+ */
+PNG_CORE_API bool PNGWriteIOVecsToFd(int fd, const struct PNGIOVec* vecs, int vecs_count);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
@@ -13,16 +13,91 @@ enum PNGCompressionMethod {
   PNG_COMPRESSION_METHOD_0 = 0
 };
 
+/*
+ * Implementations of decompression
+ */
+enum PNGInflateEngine {
+  /* zlib library */
+  PNG_INFLATE_ENGINE_ZLIB = 0,
+  /* Built-in inflater that decodes straight into output of known size */
+  PNG_INFLATE_ENGINE_BUILTIN = 1,
+};
+
 /*
  * Decompress using compression method 0
  */
 PNG_CORE_API uint8_t* PNGDataDecompress0(const uint8_t* compressed, int compressed_size, int decompressed_size);
 
+/*
+ * Decompress using compression method 0 by built-in inflater.
+ * Unlike PNGDataDecompress0, data must decompress into exactly `decompressed_size` bytes
+ */
+PNG_CORE_API uint8_t* PNGDataDecompress0Builtin(const uint8_t* compressed, int compressed_size,
+                                                int decompressed_size);
+
 typedef uint8_t* (*PNGDataDecompressionFunction)(const uint8_t* compressed, int compressed_size, int decompressed_size);
 
+/*
+ * @return Decompression function of zlib engine, NULL if method is unknown
+ */
 PNG_CORE_API PNGDataDecompressionFunction PNGGetDataDecompressionFunction(uint8_t compression_method);
 
-// TODO ADD COMPRESSION FUNCTIONS?
+/*
+ * @return Decompression function of engine, NULL if method or engine is unknown
+ */
+PNG_CORE_API PNGDataDecompressionFunction PNGGetDataDecompressionFunctionWithEngine(uint8_t compression_method,
+                                                                                 enum PNGInflateEngine engine);
+
+/*
+ * Match search strategies of zlib deflate, values are the same as zlib ones
+ */
+enum PNGCompressionStrategy {
+  PNG_COMPRESSION_STRATEGY_DEFAULT = 0,
+  /* Favors literals, for data produced by filters */
+  PNG_COMPRESSION_STRATEGY_FILTERED = 1,
+  /* No matches, Huffman coding only */
+  PNG_COMPRESSION_STRATEGY_HUFFMAN_ONLY = 2,
+  /* Matches of distance 1 only */
+  PNG_COMPRESSION_STRATEGY_RLE = 3,
+  /* Fixed Huffman codes only */
+  PNG_COMPRESSION_STRATEGY_FIXED = 4,
+};
+
+/*
+ * Parameters of zlib deflate for compression method 0
+ */
+struct PNGCompressionParams {
+  /* From 0 (store) to 9 (best), -1 for zlib default. Default is 6 */
+  int level;
+  enum PNGCompressionStrategy strategy;
+  /* Base two logarithm of window size from 9 to 15. Default is 15 */
+  int window_bits;
+  /* Memory of compressor state from 1 to 9, larger gives longer blocks. Default is 8 */
+  int mem_level;
+};
+PNG_CORE_API void PNGInitCompressionParams(struct PNGCompressionParams* obj);
+
+/*
+ * Compress using compression method 0 with default parameters of `level`
+ * @param level zlib compression level from 0 (store) to 9 (best), -1 for zlib default
+ * @param[out] compressed_size Size of returned zlib stream in bytes
+ * @return zlib stream to free with PNGFreeCompressionData or NULL if error occurred
+ */
+PNG_CORE_API uint8_t* PNGDataCompress0(const uint8_t* data, int data_size, int level, int* compressed_size);
+
+/*
+ * Compress using compression method 0
+ * @return zlib stream to free with PNGFreeCompressionData or NULL if parameters are invalid or error occurred
+ */
+PNG_CORE_API uint8_t* PNGDataCompress0WithParams(const uint8_t* data, int data_size,
+                                                 const struct PNGCompressionParams* params, int* compressed_size);
+
+typedef uint8_t* (*PNGDataCompressionFunction)(const uint8_t* data, int data_size, int level, int* compressed_size);
+
+/*
+ * @return Compression function, NULL if method is unknown
+ */
+PNG_CORE_API PNGDataCompressionFunction PNGGetDataCompressionFunction(uint8_t compression_method);
 
 PNG_CORE_API void PNGFreeCompressionData(uint8_t* data);
 
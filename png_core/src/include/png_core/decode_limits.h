@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "png_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Resource limits of loading and decoding. Limits are checked from chunk headers and IHDR before anything is
+ * allocated, and inflate ratio again while data is inflated. Zero disables a limit
+ */
+struct PNGDecodeLimits {
+  /* Width times height. Default is 2^28 */
+  uint64_t max_pixels;
+  /* Size of decoded output, and of inflated scanlines, each. Default is 1 GiB */
+  uint64_t max_output_bytes;
+  /* Total data size of loaded chunks. Default is 1 GiB */
+  uint64_t max_chunk_memory_bytes;
+  /* Inflated bytes per compressed byte, checked for every prefix of image data. Default is 0 */
+  uint32_t max_inflate_ratio;
+  /* Chunks in datastream, including skipped ones. Default is 2^20 */
+  uint32_t max_chunks_count;
+};
+PNG_CORE_API void PNGInitDecodeLimits(struct PNGDecodeLimits* obj);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
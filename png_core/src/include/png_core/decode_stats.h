@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "png_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Stages of loading and decoding an image
+ */
+enum PNGDecodeStage {
+  /* Chunk framing and parsing of chunk data while loading chunk list */
+  PNG_DECODE_STAGE_PARSE = 0,
+  /* Header validation, palette, transfer tables and row converter preparation */
+  PNG_DECODE_STAGE_SETUP = 1,
+  /* Copying IDAT chunks data into one buffer */
+  PNG_DECODE_STAGE_CONCAT = 2,
+  /* Decompression of concatenated IDAT data */
+  PNG_DECODE_STAGE_INFLATE = 3,
+  /* Reconstruction of scanlines from filtered ones */
+  PNG_DECODE_STAGE_DEFILTER = 4,
+  /* Conversion of scanlines into output pixels or tensor elements */
+  PNG_DECODE_STAGE_CONVERT = 5,
+  PNG_DECODE_STAGE_COUNT = 6,
+};
+
+struct PNGDecodeStageStats {
+  /* Time spent in stage, measured by monotonic clock */
+  uint64_t duration_ns;
+  uint64_t bytes_in;
+  uint64_t bytes_out;
+};
+
+/*
+ * Statistics of one decode. Stage fields, allocation count and live bytes are added to, peaks are maximums,
+ * so one object can collect loading and decoding of the same image or several decodes of a context.
+ * Clock is not read at all if no stats object is given
+ */
+struct PNGDecodeStats {
+  struct PNGDecodeStageStats stages[PNG_DECODE_STAGE_COUNT];
+  /* Chunks in decoded chunk list */
+  int chunks_count;
+  int idat_chunks_count;
+  /*
+   * Memory of decode calls: output, IDAT data, inflated data, zlib state, converter and tensor rows.
+   * Chunk list loading and process-wide gamma tables are not counted
+   */
+  int allocations_count;
+  /* Highest total size of buffers alive at the same time, output excluded */
+  size_t peak_scratch_bytes;
+  /* Highest total size of buffers alive at the same time, output included */
+  size_t peak_bytes;
+  /* Bytes allocated by calls and still alive when they returned, that is output */
+  size_t live_bytes;
+};
+PNG_CORE_API void PNGInitDecodeStats(struct PNGDecodeStats* obj);
+
+/*
+ * @return Short lowercase stage name like "inflate", or NULL for invalid stage
+ */
+PNG_CORE_API const char* PNGGetDecodeStageName(enum PNGDecodeStage stage);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
@@ -1,6 +1,11 @@
 #pragma once
 
+#include <stddef.h>
+
 #include "chunk_data.h"
+#include "compression.h"
+#include "decode_limits.h"
+#include "decode_stats.h"
 #include "pixel_format.h"
 #include "png_core.h"
 
@@ -20,10 +25,184 @@ struct PNGRawImage {
 };
 PNG_CORE_API void PNGInitRawImage(struct PNGRawImage* obj);
 
-PNG_CORE_API int PNGGetPlainImageSizeBits(const struct PNGChunkData_IHDR* header);
+/*
+ * @return Size of plain image in bits, -1 if it does not fit int64_t
+ */
+PNG_CORE_API int64_t PNGGetPlainImageSizeBits(const struct PNGChunkData_IHDR* header);
+
+/*
+ * @return Size of a defiltered scanline in bytes, including padding bits of the last byte
+ */
+PNG_CORE_API int64_t PNGGetScanlineSizeBytes(const struct PNGChunkData_IHDR* header);
 
+/*
+ * @brief Decode image into stored format with default limits
+ * @return false if image is malformed, exceeds limits or allocation failed
+ */
 PNG_CORE_API bool PNGGetRawImage(struct PNGRawChunk* chunk_list, struct PNGRawImage* out);
 
+/*
+ * Options of PNGGetRawImageWithOptions
+ */
+struct PNGRawImageOptions {
+  /* Default is PNG_INFLATE_ENGINE_BUILTIN */
+  enum PNGInflateEngine inflate_engine;
+  /* Statistics of the call are added to it if not NULL */
+  struct PNGDecodeStats* stats;
+  struct PNGDecodeLimits limits;
+};
+PNG_CORE_API void PNGInitRawImageOptions(struct PNGRawImageOptions* obj);
+
+/*
+ * @param[in] options Can be NULL for defaults
+ */
+PNG_CORE_API bool PNGGetRawImageWithOptions(struct PNGRawChunk* chunk_list, const struct PNGRawImageOptions* options,
+                                            struct PNGRawImage* out);
+
+/*
+ * @brief PNGGetRawImage that adds its statistics to `stats`
+ * @param[in, out] stats Statistics, nullable
+ */
+PNG_CORE_API bool PNGGetRawImageWithStats(struct PNGRawChunk* chunk_list, struct PNGRawImage* out,
+                                          struct PNGDecodeStats* stats);
+
+/*
+ * Transfer function of decoded color samples.
+ * Source one is taken from sRGB chunk, then gAMA chunk. Images without both are treated as sRGB
+ */
+enum PNGGammaCorrection {
+  /* Samples are kept as stored */
+  PNG_GAMMA_CORRECTION_NONE = 0,
+  /* Samples are re-encoded with sRGB curve */
+  PNG_GAMMA_CORRECTION_SRGB = 1,
+  /* Samples are linear light */
+  PNG_GAMMA_CORRECTION_LINEAR = 2,
+};
+
+/*
+ * Blending of transparent pixels onto background for formats without alpha
+ */
+enum PNGAlphaFlattening {
+  /* Alpha is dropped */
+  PNG_ALPHA_FLATTENING_NONE = 0,
+  /* Background is taken from bKGD chunk. Images without it use caller background */
+  PNG_ALPHA_FLATTENING_FILE_BACKGROUND = 1,
+  /* Background is always given by caller */
+  PNG_ALPHA_FLATTENING_CUSTOM_BACKGROUND = 2,
+};
+
+/*
+ * Options of PNGDecodeImage
+ */
+struct PNGDecodeOptions {
+  /* Output pixel format. Default is PNG_PIXEL_FORMAT_RGBA8 */
+  enum PNGPixelFormat format;
+  /* Store rows bottom to top */
+  bool flip_vertically;
+  /* Default is PNG_GAMMA_CORRECTION_NONE. Palette of PNG_PIXEL_FORMAT_INDEXED8 image is corrected instead of pixels */
+  enum PNGGammaCorrection gamma_correction;
+  /* Multiply color by alpha. Palette of PNG_PIXEL_FORMAT_INDEXED8 image is premultiplied instead of pixels */
+  bool premultiply_alpha;
+  /* Used for PNG_PIXEL_FORMAT_RGB8, G8, RGB16 and G16. Default is PNG_ALPHA_FLATTENING_NONE */
+  enum PNGAlphaFlattening alpha_flattening;
+  /* 16-bit R, G, B of caller background, in output transfer function. Default is white */
+  uint16_t background_rgb16[3];
+  /* Default is PNG_INFLATE_ENGINE_BUILTIN */
+  enum PNGInflateEngine inflate_engine;
+  /* Statistics of the call are added to it if not NULL */
+  struct PNGDecodeStats* stats;
+  struct PNGDecodeLimits limits;
+};
+PNG_CORE_API void PNGInitDecodeOptions(struct PNGDecodeOptions* obj);
+
+/*
+ * Decoded image in requested pixel format
+ */
+struct PNGImage {
+  enum PNGPixelFormat format;
+  int width;
+  int height;
+  /* Distance between starts of rows in bytes */
+  int row_stride;
+  uint8_t* data;
+  size_t data_size;
+  /* RGBA8 palette entries of PNG_PIXEL_FORMAT_INDEXED8 image */
+  uint8_t palette[256][4];
+  int palette_size;
+};
+PNG_CORE_API void PNGInitImage(struct PNGImage* obj);
+
+/*
+ * @brief Free image data and reinitialize it as empty
+ * @param[in, out] obj Image, nullable
+ */
+PNG_CORE_API void PNGFreeImage(struct PNGImage* obj);
+
+/*
+ * @brief Decode image and convert its pixels into requested format.
+ * Scanlines are defiltered and converted one by one right after decompression,
+ * no intermediate image in stored format is allocated.
+ * PNG_PIXEL_FORMAT_INDEXED8 is supported for indexed and up to 8-bit greyscale images.
+ * tRNS chunk sets palette alpha or makes pixels of its color transparent in formats with alpha
+ * @param[in] chunk_list Loaded chunks
+ * @param[in] options Options. Can be NULL for defaults
+ * @param[out] out Decoded image. Should be freed with PNGFreeImage
+ * @return false if image is malformed, interlaced, exceeds limits, conversion is not supported or allocation failed
+ */
+PNG_CORE_API bool PNGDecodeImage(const struct PNGRawChunk* chunk_list, const struct PNGDecodeOptions* options,
+                                 struct PNGImage* out);
+
+/*
+ * Options of PNGDecodeTensor.
+ * Element of channel c is `sample / max_sample * scale[c] + offset[c]`,
+ * so normalization by mean and std is `scale = 1 / std`, `offset = -mean / std`
+ */
+struct PNGTensorOptions {
+  /* Default is PNG_TENSOR_TYPE_FLOAT32 */
+  enum PNGTensorType type;
+  /* 1 for luminance, 3 for R,G,B, 4 for R,G,B,A. Default is 3 */
+  int channels;
+  /* Default is 1 */
+  float scale[4];
+  /* Default is 0 */
+  float offset[4];
+  /* Default is PNG_INFLATE_ENGINE_BUILTIN */
+  enum PNGInflateEngine inflate_engine;
+  /* Statistics of the call are added to it if not NULL */
+  struct PNGDecodeStats* stats;
+  struct PNGDecodeLimits limits;
+};
+PNG_CORE_API void PNGInitTensorOptions(struct PNGTensorOptions* obj);
+
+/*
+ * Planar (CHW) tensor. Plane of channel c starts at element `c * width * height`
+ */
+struct PNGTensor {
+  enum PNGTensorType type;
+  int channels;
+  int width;
+  int height;
+  void* data;
+  size_t data_size;
+};
+PNG_CORE_API void PNGInitTensor(struct PNGTensor* obj);
+
+/*
+ * @brief Free tensor data and reinitialize it as empty
+ * @param[in, out] obj Tensor, nullable
+ */
+PNG_CORE_API void PNGFreeTensor(struct PNGTensor* obj);
+
+/*
+ * @brief Decode image into normalized planar tensor.
+ * Each scanline is defiltered, converted and normalized into all planes before the next one is processed
+ * @param[in] options Can be NULL for defaults
+ * @param[out] out Tensor, must be freed with PNGFreeTensor
+ * @return false if image or options are not supported, image exceeds limits, data is corrupted or allocation failed
+ */
+PNG_CORE_API bool PNGDecodeTensor(const struct PNGRawChunk* chunk_list, const struct PNGTensorOptions* options,
+                                  struct PNGTensor* out);
+
 #ifdef __cplusplus
 }  // extern "C"
 #endif
@@ -0,0 +1,136 @@
+/**
+ * @file png_core/editing.h
+ *
+ * @brief Chunk-level editing of PNG files without loading unchanged chunks into memory
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "chunk_table.h"
+#include "chunk_types.h"
+#include "png_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Data of chunk added to edit plan
+ */
+struct PNGEditInsertedChunk {
+  uint8_t* data;
+  uint32_t data_size;
+};
+
+/**
+ * @brief Edit plan: which chunks of source file are kept, removed or inserted.
+ * Kept chunks are copied from source file byte by byte, their CRCs are not recalculated.
+ * Only inserted chunks are serialized and get new CRCs.
+ */
+struct PNGEditPlan {
+  /*
+   * Resulting chunks in file order.
+   * Source chunks have non-negative data offsets in source file,
+   * inserted chunks have offset `-1 - index` where `index` is position in `inserted`.
+   * Ids of removed chunks are not reused, so operations on them fail
+   */
+  struct PNGChunkTable table;
+
+  struct PNGEditInsertedChunk* inserted;
+  int inserted_count;
+  int inserted_capacity;
+
+  /* Data size of rewritten IDAT chunks. 0 to keep IDAT chunks as is */
+  uint32_t idat_chunk_size;
+};
+
+/**
+ * @brief Initialize empty plan
+ * @param[in, out] obj Plan, not null
+ */
+PNG_CORE_API void PNGInitEditPlan(struct PNGEditPlan* obj);
+
+/**
+ * @brief Free memory owned by plan and reinitialize it as empty
+ * @param[in, out] obj Plan, nullable
+ */
+PNG_CORE_API void PNGFreeEditPlan(struct PNGEditPlan* obj);
+
+/**
+ * @brief Create plan that keeps every chunk of source file. Only chunk headers are read
+ * @param fd Source file descriptor opened for reading
+ * @param[out] out Initialized plan. Previous content is dropped
+ * @return false if source file is not a valid PNG datastream or error occurred
+ */
+PNG_CORE_API bool PNGCreateEditPlanFromFd(int fd, struct PNGEditPlan* out);
+
+/**
+ * @brief Remove chunk from plan
+ * @param entry Entry id in `table`
+ * @return false if entry does not exist or is already removed
+ */
+PNG_CORE_API bool PNGEditPlanRemoveChunk(struct PNGEditPlan* obj, int entry);
+
+/**
+ * @brief Remove all chunks of type
+ * @return Amount of removed chunks
+ */
+PNG_CORE_API int PNGEditPlanRemoveType(struct PNGEditPlan* obj, struct ChunkType type);
+
+/**
+ * @brief Remove all ancillary chunks except listed types
+ * @param[in] keep_types Types to keep. Can be NULL
+ * @param keep_types_count Amount of types to keep
+ * @return Amount of removed chunks
+ */
+PNG_CORE_API int PNGEditPlanRemoveAncillary(struct PNGEditPlan* obj, const struct ChunkType* keep_types,
+                                            int keep_types_count);
+
+/**
+ * @brief Insert new chunk. Data is copied, CRC is calculated
+ * @param before Entry id to insert before. PNG_CHUNK_TABLE_NO_ENTRY to append
+ * @return Entry id of inserted chunk or PNG_CHUNK_TABLE_NO_ENTRY if `before` is removed or error occurred
+ */
+PNG_CORE_API int PNGEditPlanInsertChunk(struct PNGEditPlan* obj, int before, struct ChunkType type,
+                                        const uint8_t* data, uint32_t data_size);
+
+/**
+ * @brief Replace chunk with new one of the same type at the same position
+ * @return Entry id of new chunk or PNG_CHUNK_TABLE_NO_ENTRY if entry is removed or error occurred
+ */
+PNG_CORE_API int PNGEditPlanReplaceChunk(struct PNGEditPlan* obj, int entry, const uint8_t* data, uint32_t data_size);
+
+/**
+ * @brief Insert tEXt chunk before the first IDAT chunk (or before IEND if there is no IDAT)
+ * @param[in] keyword Keyword, 1-79 latin-1 characters
+ * @param[in] text Text
+ * @return Entry id of new chunk or PNG_CHUNK_TABLE_NO_ENTRY if error occurred
+ */
+PNG_CORE_API int PNGEditPlanInsertText(struct PNGEditPlan* obj, const char* keyword, const char* text);
+
+/**
+ * @brief Rewrite sequence of IDAT chunks into chunks of `chunk_size` data bytes (the last one may be smaller).
+ * Compressed data is reused as is, only chunk boundaries and CRCs change.
+ * @note Use `N * page_size - 12` to make every full IDAT chunk occupy whole pages
+ * @param chunk_size New IDAT data size. 0 to keep IDAT chunks as is
+ * @return false if chunk_size exceeds max chunk data size
+ */
+PNG_CORE_API bool PNGEditPlanSetIDATChunkSize(struct PNGEditPlan* obj, uint32_t chunk_size);
+
+/**
+ * @brief Write edited file.
+ * Ranges of consecutive kept chunks are copied in kernel where possible (`copy_file_range`, `sendfile`).
+ * IDAT chunks are read and get new CRCs only if IDAT chunk size is set
+ * @param[in] obj Plan
+ * @param in_fd Source file the plan was created from
+ * @param out_fd Destination file descriptor, written from its current position
+ * @return Amount of bytes written or -1 if error occurred
+ */
+PNG_CORE_API int64_t PNGWriteEditPlanToFd(const struct PNGEditPlan* obj, int in_fd, int out_fd);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
@@ -0,0 +1,196 @@
+/**
+ * @file png_core/encoder.h
+ *
+ * @brief Encoding of plain images into PNG datastreams
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "chunk_data.h"
+#include "compression.h"
+#include "decoder.h"
+#include "filtering.h"
+#include "png_core.h"
+#include "reduction.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Options of PNGEncodeRawImage
+ */
+struct PNGEncodeOptions {
+  /*
+   * Default is PNG_FILTER_SELECTION_ADAPTIVE.
+   * Adaptive selection uses None filter type for indexed images and bit depths less than 8
+   */
+  enum PNGFilterSelection filter_selection;
+  /* Default is PNGInitCompressionParams one */
+  struct PNGCompressionParams compression;
+  /* Maximum data size of IDAT chunk. Default is 65536 */
+  uint32_t idat_chunk_size;
+  /* Palette written to PLTE chunk. Required for indexed images, optional for truecolor ones */
+  const struct PNGChunkData_PLTE* palette;
+  /* Transparency written to tRNS chunk. Optional for images without alpha channel */
+  const struct PNGChunkData_tRNS* transparency;
+  /*
+   * Store image in colour type and bit depth found by PNGReduceRawImage. Default is false.
+   * Indexed images and images with transparency option are not reduced.
+   * Palette option is kept only if image stays truecolor
+   */
+  bool reduce;
+};
+
+/**
+ * @brief Initialize options with default values
+ * @param[in, out] obj Options obj, not null
+ */
+PNG_CORE_API void PNGInitEncodeOptions(struct PNGEncodeOptions* obj);
+
+/**
+ * @brief Build chunk list IHDR, PLTE, tRNS, IDAT..., IEND of non-interlaced image.
+ * Chunks have only parsed_data and CRCs of their serialized data
+ * @param[in] image Plain image as returned by PNGGetRawImage: scanlines in stored format without padding between them.
+ *   Image height is data_size divided by scanline size
+ * @param[in] options Encoding options. NULL for defaults
+ * @return Chunk list to free with PNGFreeRawChunk or NULL if image or options are invalid or allocation failed
+ */
+PNG_CORE_API struct PNGRawChunk* PNGEncodeRawImageToChunkList(const struct PNGRawImage* image,
+                                                              const struct PNGEncodeOptions* options);
+
+/**
+ * @brief Encode image into PNG datastream with signature using PNGWriteRawChunkList
+ * @param[in] image Plain image, see PNGEncodeRawImageToChunkList
+ * @param[in] options Encoding options. NULL for defaults
+ * @param[out] out_size Size of returned datastream in bytes
+ * @return Datastream to free with PNGFreeEncodedData or NULL if error occurred
+ */
+PNG_CORE_API uint8_t* PNGEncodeRawImage(const struct PNGRawImage* image, const struct PNGEncodeOptions* options,
+                                        int* out_size);
+
+/**
+ * Search budget of PNGOptimizeRawImage
+ */
+struct PNGOptimizeOptions {
+  /*
+   * Search space from 1 to 3. Default is 2.
+   * 1 tries adaptive and None filters with two zlib strategies,
+   * 2 every filter selection with three strategies and two memLevels,
+   * 3 also every level, windows and more memLevels
+   */
+  int effort;
+  /* Trials are stopped after this time once any of them has finished, in milliseconds. 0 for no limit */
+  uint32_t time_budget_ms;
+  /* Worker threads, 0 for one per online CPU. Default is 0 */
+  int threads_count;
+  /* The same as in PNGEncodeOptions */
+  uint32_t idat_chunk_size;
+  const struct PNGChunkData_PLTE* palette;
+  const struct PNGChunkData_tRNS* transparency;
+  /* The same as in PNGEncodeOptions, default is true */
+  bool reduce;
+};
+
+/**
+ * @brief Initialize options with default values
+ * @param[in, out] obj Options obj, not null
+ */
+PNG_CORE_API void PNGInitOptimizeOptions(struct PNGOptimizeOptions* obj);
+
+/**
+ * Outcome of PNGOptimizeRawImage search
+ */
+struct PNGOptimizeResult {
+  /* Options of the smallest trial. PNGEncodeRawImage with them gives the same datastream */
+  struct PNGEncodeOptions encode_options;
+  /* Trials in search space */
+  int trials_count;
+  int finished_trials_count;
+  /* Trials stopped when their output exceeded the best size so far or time ran out */
+  int stopped_trials_count;
+  /* Trials not started since time ran out */
+  int skipped_trials_count;
+};
+
+/**
+ * @brief Encode image trying combinations of filter selections and zlib parameters on worker threads,
+ * keeping the smallest datastream. Ties are resolved in favor of trial listed first, so result does not depend
+ * on thread timing unless time budget runs out.
+ * Every filter selection of search space is applied once up front and kept in memory during search
+ * @param[in] image Plain image, see PNGEncodeRawImageToChunkList
+ * @param[in] options Search options. NULL for defaults
+ * @param[out] out_size Size of returned datastream in bytes
+ * @param[out] result Search outcome, nullable
+ * @return Datastream to free with PNGFreeEncodedData or NULL if error occurred
+ */
+PNG_CORE_API uint8_t* PNGOptimizeRawImage(const struct PNGRawImage* image, const struct PNGOptimizeOptions* options,
+                                          int* out_size, struct PNGOptimizeResult* result);
+
+/**
+ * Frame of PNGEncodeAnimation
+ */
+struct PNGEncodeAnimationFrame {
+  /* Plain image of whole canvas, see PNGEncodeRawImageToChunkList. All frames have the same type, bit depth and size */
+  struct PNGRawImage image;
+  /* Frame is shown for delay_num / delay_den seconds, denominator 0 means 100 */
+  uint16_t delay_num;
+  uint16_t delay_den;
+};
+
+/**
+ * Options of PNGEncodeAnimation
+ */
+struct PNGEncodeAnimationOptions {
+  /* Filtering, compression, chunk size, palette and transparency of every frame. reduce is ignored */
+  struct PNGEncodeOptions encode;
+  /* Times to play animation, 0 for infinite looping. Default is 0 */
+  uint32_t plays_count;
+  /* Worker threads compressing frames, 0 for one per online CPU. Default is 0 */
+  int threads_count;
+  /*
+   * Store only the region that differs from canvas left by the previous frame, choosing its dispose op and
+   * blend op by estimated data size, and merge equal consecutive frames. Default is true.
+   * Otherwise every frame covers whole canvas
+   */
+  bool optimize_frames;
+};
+
+/**
+ * @brief Initialize options with default values
+ * @param[in, out] obj Options obj, not null
+ */
+PNG_CORE_API void PNGInitEncodeAnimationOptions(struct PNGEncodeAnimationOptions* obj);
+
+/**
+ * @brief Build APNG chunk list IHDR, acTL, PLTE, tRNS, fcTL, IDAT..., then fcTL, fdAT... of each next frame, IEND.
+ * The first frame is the default image. Frames are diffed in order, then compressed on worker threads,
+ * so work and size of frames grow with changed area rather than canvas size
+ * @param[in] frames Frames in display order
+ * @param frames_count Frames count, at least 1
+ * @param[in] options Encoding options. NULL for defaults
+ * @return Chunk list to free with PNGFreeRawChunk or NULL if frames or options are invalid or allocation failed
+ */
+PNG_CORE_API struct PNGRawChunk* PNGEncodeAnimationToChunkList(const struct PNGEncodeAnimationFrame* frames,
+                                                               int frames_count,
+                                                               const struct PNGEncodeAnimationOptions* options);
+
+/**
+ * @brief Encode animation into APNG datastream with signature using PNGWriteRawChunkList
+ * @param[in] frames Frames in display order, see PNGEncodeAnimationToChunkList
+ * @param frames_count Frames count, at least 1
+ * @param[in] options Encoding options. NULL for defaults
+ * @param[out] out_size Size of returned datastream in bytes
+ * @return Datastream to free with PNGFreeEncodedData or NULL if error occurred
+ */
+PNG_CORE_API uint8_t* PNGEncodeAnimation(const struct PNGEncodeAnimationFrame* frames, int frames_count,
+                                         const struct PNGEncodeAnimationOptions* options, int* out_size);
+
+PNG_CORE_API void PNGFreeEncodedData(uint8_t* data);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
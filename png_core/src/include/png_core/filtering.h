@@ -14,6 +14,60 @@ enum PNGFilteringMethod {
   PNG_FILTERING_METHOD_0 = 0
 };
 
+/*
+ * Filter type choice of filtering method 0
+ */
+enum PNGFilterSelection {
+  /* Every scanline uses the same filter type */
+  PNG_FILTER_SELECTION_NONE = 0,
+  PNG_FILTER_SELECTION_SUB = 1,
+  PNG_FILTER_SELECTION_UP = 2,
+  PNG_FILTER_SELECTION_AVERAGE = 3,
+  PNG_FILTER_SELECTION_PAETH = 4,
+  /* Each scanline uses filter type with the minimum sum of absolute differences */
+  PNG_FILTER_SELECTION_ADAPTIVE = 5,
+};
+
+/*
+ * @brief Filter single scanline using filtering method 0
+ * @param filter_type Filter type to apply
+ * @param scanline Plain scanline
+ * @param previous Plain previous scanline. NULL for the first scanline
+ * @param[out] filtered Buffer for filtered scanline without filter type byte. Must not overlap `scanline`
+ * @param scanline_size_bytes Scanline size in bytes
+ * @param pixel_size_bytes Pixel size in bytes rounded up to 1 byte for bit depths less than 8
+ * @return false if filter type is unknown
+ */
+PNG_CORE_API bool PNGFilterScanline0(uint8_t filter_type, const uint8_t* scanline, const uint8_t* previous,
+                                     uint8_t* filtered, int scanline_size_bytes, int pixel_size_bytes);
+
+/*
+ * @brief Filter scanlines
+ * @param plain A sequence of plain scanlines
+ * @param plain_size Size of `plain` in bytes
+ * @param scanline_size_bytes Scanline size in bytes
+ * @param pixel_size_bytes Pixel size in bytes rounded up to 1 byte for bit depths less than 8
+ * @param selection Filter type of scanlines
+ * @param[out] filtered A pre-allocated buffer of size plain_size + plain_size / scanline_size_bytes
+ * to write sequence of filtered scanlines with preceding filter types
+ * @return false if arguments are invalid or allocation failed
+ */
+PNG_CORE_API bool PNGFilterScanlines0(const uint8_t* plain, int plain_size, int scanline_size_bytes,
+                                      int pixel_size_bytes, enum PNGFilterSelection selection, uint8_t* filtered);
+
+/*
+ * @brief Defilter single scanline using filtering method 0
+ * @param filter_type Filter type byte preceding the scanline
+ * @param filtered Filtered scanline without filter type byte
+ * @param previous Defiltered previous scanline. NULL for the first scanline
+ * @param[out] defiltered Buffer for restored scanline. Can be the same as `filtered`
+ * @param scanline_size_bytes Scanline size in bytes without filter type byte
+ * @param pixel_size_bytes Pixel size in bytes rounded up to 1 byte for bit depths less than 8
+ * @return false if filter type is unknown
+ */
+PNG_CORE_API bool PNGDefilterScanline0(uint8_t filter_type, const uint8_t* filtered, const uint8_t* previous,
+                                       uint8_t* defiltered, int scanline_size_bytes, int pixel_size_bytes);
+
 /*
  * @brief Defilter scanlines
  * @param filtered A sequence of filtered scanlines with preceding filtering function types
@@ -31,9 +85,9 @@ typedef bool (*PNGDataDefilteringFunction)(const uint8_t* filtered, int filtered
 PNG_CORE_API PNGDataDefilteringFunction PNGGetDefilteringFunction(uint8_t filtering_method);
 
 /*
- * @return -1 if error. Otherwise size of a plain image after filtering stage
+ * @return -1 if error or size does not fit int64_t. Otherwise size of a plain image after filtering stage
  */
-PNG_CORE_API int PNGGetFilteredImageSizeBytes(const struct PNGChunkData_IHDR* header);
+PNG_CORE_API int64_t PNGGetFilteredImageSizeBytes(const struct PNGChunkData_IHDR* header);
 
 #ifdef __cplusplus
 }  // extern "C"
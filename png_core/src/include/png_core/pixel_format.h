@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "png_core.h"
@@ -21,8 +22,52 @@ enum PNGImageType {
   PNG_IMAGE_TYPE_TRUECOLORWITHALPHA = 6,
 };
 
+/*
+ * Layout of decoded pixels. Samples are stored in the listed order
+ */
+enum PNGPixelFormat {
+  /* 8-bit R,G,B,A */
+  PNG_PIXEL_FORMAT_RGBA8 = 0,
+  /* 8-bit R,G,B */
+  PNG_PIXEL_FORMAT_RGB8 = 1,
+  /* 8-bit B,G,R,A */
+  PNG_PIXEL_FORMAT_BGRA8 = 2,
+  /* 8-bit greyscale (luminance for color images) */
+  PNG_PIXEL_FORMAT_G8 = 3,
+  /* 16-bit R,G,B,A in native byte order */
+  PNG_PIXEL_FORMAT_RGBA16 = 4,
+  /* 8-bit palette index with separate RGBA8 palette */
+  PNG_PIXEL_FORMAT_INDEXED8 = 5,
+  /* 16-bit greyscale in native byte order */
+  PNG_PIXEL_FORMAT_G16 = 6,
+  /* 16-bit R,G,B in native byte order */
+  PNG_PIXEL_FORMAT_RGB16 = 7,
+};
+
+/*
+ * Element type of decoded tensors
+ */
+enum PNGTensorType {
+  /* IEEE 754 single precision */
+  PNG_TENSOR_TYPE_FLOAT32 = 0,
+  /* IEEE 754 half precision */
+  PNG_TENSOR_TYPE_FLOAT16 = 1,
+  /* Upper half of single precision, rounded to nearest even */
+  PNG_TENSOR_TYPE_BFLOAT16 = 2,
+};
+
 PNG_CORE_API int PNGGetChannelCount(enum PNGImageType image_type);
 
+/*
+ * @return Size of a pixel in bytes or 0 if format is unknown
+ */
+PNG_CORE_API int PNGGetPixelFormatSizeBytes(enum PNGPixelFormat format);
+
+/*
+ * @return Size of a tensor element in bytes or 0 if type is unknown
+ */
+PNG_CORE_API int PNGGetTensorTypeSizeBytes(enum PNGTensorType type);
+
 /*
  * Get list of allowed bit depths
  * @param[out] out_depths Buffer to write allowed bit depths into. Can be NULL
@@ -30,6 +75,11 @@ PNG_CORE_API int PNGGetChannelCount(enum PNGImageType image_type);
  */
 PNG_CORE_API int PNGGetAllowedBitDepths(enum PNGImageType image_type, uint8_t* out_depths);
 
+/*
+ * @return true if image_type is a PNG color type and bit_depth is allowed for it
+ */
+PNG_CORE_API bool PNGIsValidImageFormat(enum PNGImageType image_type, int bit_depth);
+
 #ifdef __cplusplus
 }  // extern "C"
 #endif
@@ -0,0 +1,321 @@
+/**
+ * @file png_core/raii.hpp
+ *
+ * @brief C++20 owners and views over chunk lists and images of the C API.
+ * Owners only hold pointers returned by the C API, views and ranges point into them: nothing is copied or allocated
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <ranges>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include "chunk_data.h"
+#include "chunk_types.h"
+#include "decoder.h"
+#include "pixel_format.h"
+
+namespace png_core {
+
+/**
+ * Non-owning view of a chunk, valid while its list is alive
+ */
+class chunk_view {
+public:
+  chunk_view() noexcept = default;
+  explicit chunk_view(const PNGRawChunk* chunk) noexcept : chunk_(chunk) {}
+
+  /**
+   * @return false for the view of no chunk
+   */
+  explicit operator bool() const noexcept { return chunk_ != nullptr; }
+  const PNGRawChunk* get() const noexcept { return chunk_; }
+
+  ChunkType type() const noexcept { return chunk_->type; }
+  /**
+   * @return Four letters of chunk type
+   */
+  std::string_view type_name() const noexcept {
+    return {reinterpret_cast<const char*>(chunk_->type.byte_array), sizeof(chunk_->type.byte_array)};
+  }
+  bool is(ChunkType type) const noexcept { return chunk_->type.bytes == type.bytes; }
+  uint32_t crc() const noexcept { return chunk_->crc; }
+
+  /**
+   * @return Chunk data as loaded from datastream. Empty for chunks built with parsed data only
+   */
+  std::span<const uint8_t> payload() const noexcept {
+    if (!chunk_->raw_data)
+      return {};
+    return {chunk_->raw_data, chunk_->raw_data_size_bytes};
+  }
+
+  /**
+   * @return Parsed data as chunk data struct of type, e.g. PNGChunkData_IHDR. NULL if chunk is not parsed
+   */
+  template <class ChunkData>
+  const ChunkData* parsed() const noexcept {
+    return static_cast<const ChunkData*>(chunk_->parsed_data);
+  }
+
+  bool operator==(const chunk_view& other) const noexcept = default;
+
+private:
+  const PNGRawChunk* chunk_ = nullptr;
+};
+
+/**
+ * Forward iterator over linked chunks, ended by std::default_sentinel
+ */
+class chunk_iterator {
+public:
+  using value_type = chunk_view;
+  using difference_type = std::ptrdiff_t;
+  using iterator_category = std::forward_iterator_tag;
+
+  chunk_iterator() noexcept = default;
+  explicit chunk_iterator(const PNGRawChunk* chunk) noexcept : chunk_(chunk) {}
+
+  chunk_view operator*() const noexcept { return chunk_view(chunk_); }
+  chunk_iterator& operator++() noexcept {
+    chunk_ = chunk_->next;
+    return *this;
+  }
+  chunk_iterator operator++(int) noexcept {
+    chunk_iterator previous = *this;
+    ++*this;
+    return previous;
+  }
+
+  bool operator==(const chunk_iterator& other) const noexcept = default;
+  bool operator==(std::default_sentinel_t) const noexcept { return chunk_ == nullptr; }
+
+private:
+  const PNGRawChunk* chunk_ = nullptr;
+};
+
+/**
+ * View of chunks from a chunk to the end of its list. Composes with std::views
+ */
+class chunk_range : public std::ranges::view_interface<chunk_range> {
+public:
+  chunk_range() noexcept = default;
+  explicit chunk_range(const PNGRawChunk* first) noexcept : first_(first) {}
+
+  chunk_iterator begin() const noexcept { return chunk_iterator(first_); }
+  std::default_sentinel_t end() const noexcept { return {}; }
+
+private:
+  const PNGRawChunk* first_ = nullptr;
+};
+
+}  // namespace png_core
+
+/* Iterators point into chunk list, not into the range */
+template <>
+inline constexpr bool std::ranges::enable_borrowed_range<png_core::chunk_range> = true;
+
+namespace png_core {
+
+/**
+ * @brief Range adaptor keeping chunks of type, as in `list | of_type(CHUNK_IDAT)`
+ */
+inline auto of_type(ChunkType type) {
+  return std::views::filter([type](chunk_view chunk) { return chunk.is(type); });
+}
+
+/**
+ * @brief Range adaptor turning chunks into their payloads
+ */
+inline auto payloads() {
+  return std::views::transform([](chunk_view chunk) { return chunk.payload(); });
+}
+
+/**
+ * Move-only owner of chunk list, freed with PNGFreeRawChunk
+ */
+class chunk_list {
+public:
+  chunk_list() noexcept = default;
+  /**
+   * @param[in] owned Chunk list taken over, nullable
+   */
+  explicit chunk_list(PNGRawChunk* owned) noexcept : chunks_(owned) {}
+
+  /**
+   * @brief Load chunk list with PNGLoadRawChunkListWithOptions
+   * @param[in] options Loading options. NULL to load every chunk with default limits
+   * @return Empty list if datastream is invalid or a limit is exceeded
+   */
+  static chunk_list load(std::span<const uint8_t> data, bool data_with_png_signature = true,
+                         const PNGChunkLoadOptions* options = nullptr) noexcept {
+    if (data.size() > INT32_MAX)
+      return {};
+    return chunk_list(PNGLoadRawChunkListWithOptions(data.data(), (int)data.size(), data_with_png_signature, options));
+  }
+
+  explicit operator bool() const noexcept { return chunks_ != nullptr; }
+  PNGRawChunk* get() const noexcept { return chunks_.get(); }
+  /**
+   * @return Chunk list to free with PNGFreeRawChunk
+   */
+  PNGRawChunk* release() noexcept { return chunks_.release(); }
+
+  chunk_iterator begin() const noexcept { return chunk_iterator(chunks_.get()); }
+  std::default_sentinel_t end() const noexcept { return {}; }
+  chunk_range chunks() const noexcept { return chunk_range(chunks_.get()); }
+
+  /**
+   * @return The first chunk of type, or view of no chunk
+   */
+  chunk_view find(ChunkType type) const noexcept {
+    for (chunk_view chunk : chunks())
+      if (chunk.is(type))
+        return chunk;
+    return {};
+  }
+
+private:
+  struct deleter {
+    void operator()(PNGRawChunk* obj) const noexcept { PNGFreeRawChunk(obj); }
+  };
+
+  std::unique_ptr<PNGRawChunk, deleter> chunks_;
+};
+
+/**
+ * Non-owning view of decoded pixels with extents height and width, as of std::mdspan.
+ * `Byte` is uint8_t or const uint8_t
+ */
+template <class Byte>
+class basic_image_view {
+public:
+  basic_image_view() noexcept = default;
+  basic_image_view(Byte* data, int width, int height, int row_stride, int pixel_size) noexcept
+      : data_(data), width_(width), height_(height), row_stride_(row_stride), pixel_size_(pixel_size) {}
+  /**
+   * @param image Image with pixel format of whole bytes
+   */
+  explicit basic_image_view(const PNGImage& image) noexcept
+      : basic_image_view(image.data, image.width, image.height, image.row_stride,
+                         PNGGetPixelFormatSizeBytes(image.format)) {}
+  template <class Other>
+    requires std::is_convertible_v<Other*, Byte*>
+  basic_image_view(const basic_image_view<Other>& other) noexcept
+      : basic_image_view(other.data(), other.width(), other.height(), other.row_stride(), other.pixel_size()) {}
+
+  static constexpr std::size_t rank() noexcept { return 2; }
+  /**
+   * @return Height for rank 0, width for rank 1
+   */
+  std::size_t extent(std::size_t rank) const noexcept { return rank == 0 ? height_ : width_; }
+
+  Byte* data() const noexcept { return data_; }
+  int width() const noexcept { return width_; }
+  int height() const noexcept { return height_; }
+  int row_stride() const noexcept { return row_stride_; }
+  int pixel_size() const noexcept { return pixel_size_; }
+  bool empty() const noexcept { return !data_; }
+
+  /**
+   * @return Pixels of row y, without padding up to row stride
+   */
+  std::span<Byte> row(int y) const noexcept {
+    return {data_ + (std::size_t)y * row_stride_, (std::size_t)width_ * pixel_size_};
+  }
+  std::span<Byte> operator[](int y) const noexcept { return row(y); }
+  /**
+   * @return Samples of pixel x of row y
+   */
+  std::span<Byte> operator()(int y, int x) const noexcept {
+    return row(y).subspan((std::size_t)x * pixel_size_, pixel_size_);
+  }
+
+  /**
+   * @return Range of rows, top to bottom
+   */
+  auto rows() const noexcept {
+    return std::views::iota(0, height_) | std::views::transform([view = *this](int y) { return view.row(y); });
+  }
+
+private:
+  Byte* data_ = nullptr;
+  int width_ = 0;
+  int height_ = 0;
+  int row_stride_ = 0;
+  int pixel_size_ = 0;
+};
+
+using image_view = basic_image_view<uint8_t>;
+using const_image_view = basic_image_view<const uint8_t>;
+
+/**
+ * Move-only owner of decoded image, freed with PNGFreeImage
+ */
+class image {
+public:
+  image() noexcept { PNGInitImage(&image_); }
+  /**
+   * @param owned Image taken over, its data is freed by this owner
+   */
+  explicit image(const PNGImage& owned) noexcept : image_(owned) {}
+  image(image&& other) noexcept : image_(other.release()) {}
+  image& operator=(image&& other) noexcept {
+    if (this != &other) {
+      PNGFreeImage(&image_);
+      image_ = other.release();
+    }
+    return *this;
+  }
+  ~image() { PNGFreeImage(&image_); }
+
+  /**
+   * @brief Decode image with PNGDecodeImage
+   * @param options Decoding options. NULL for defaults
+   * @return Empty image if decoding failed
+   */
+  static image decode(const chunk_list& chunks, const PNGDecodeOptions* options = nullptr) noexcept {
+    image decoded;
+    if (chunks && !PNGDecodeImage(chunks.get(), options, &decoded.image_))
+      PNGInitImage(&decoded.image_);
+    return decoded;
+  }
+
+  explicit operator bool() const noexcept { return image_.data != nullptr; }
+  const PNGImage& get() const noexcept { return image_; }
+  /**
+   * @return Image which data is to be freed with PNGFreeImage. This owner becomes empty
+   */
+  PNGImage release() noexcept { return std::exchange(image_, empty()); }
+
+  PNGPixelFormat format() const noexcept { return image_.format; }
+  int width() const noexcept { return image_.width; }
+  int height() const noexcept { return image_.height; }
+  std::span<uint8_t> data() noexcept { return {image_.data, image_.data_size}; }
+  std::span<const uint8_t> data() const noexcept { return {image_.data, image_.data_size}; }
+  /**
+   * @return RGBA8 entries of PNG_PIXEL_FORMAT_INDEXED8 image
+   */
+  std::span<const uint8_t[4]> palette() const noexcept { return {image_.palette, (std::size_t)image_.palette_size}; }
+
+  image_view view() noexcept { return image_view(image_); }
+  const_image_view view() const noexcept { return const_image_view(image_); }
+
+private:
+  static PNGImage empty() noexcept {
+    PNGImage obj;
+    PNGInitImage(&obj);
+    return obj;
+  }
+
+  PNGImage image_;
+};
+
+}  // namespace png_core
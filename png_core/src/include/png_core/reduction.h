@@ -0,0 +1,56 @@
+/**
+ * @file png_core/reduction.h
+ *
+ * @brief Lossless reduction of colour type and bit depth before encoding
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "chunk_data.h"
+#include "decoder.h"
+#include "png_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Image in colour type and bit depth that decode to the same samples as source image
+ */
+struct PNGReducedImage {
+  /* Reduced plain image. Its data is the source one if image is not changed */
+  struct PNGRawImage image;
+  /* Palette of indexed image, entries_count is 0 for other colour types */
+  struct PNGChunkData_PLTE palette;
+  /* Alpha of palette entries or transparent color, bytes_count is 0 if there is no transparency */
+  struct PNGChunkData_tRNS transparency;
+  /* image.data was allocated by reduction */
+  bool owns_data;
+};
+
+/**
+ * @brief Find the smallest equivalent colour type and bit depth of image and convert it.
+ * Detected cases: samples that fit lower bit depth (e.g. 16-bit samples with equal bytes),
+ * opaque alpha, alpha of a single fully transparent color (replaced by tRNS),
+ * equal red, green and blue samples and up to 256 colors (indexed with PLTE and tRNS).
+ * Depths are taken from PNGGetAllowedBitDepths. Of greyscale or truecolor and indexed results the one with
+ * fewer image and palette bytes is chosen.
+ * Indexed images are not changed
+ * @param[in] image Plain image, see PNGEncodeRawImageToChunkList
+ * @param[out] out Reduced image, free with PNGFreeReducedImage
+ * @return false if image is invalid or allocation failed
+ */
+PNG_CORE_API bool PNGReduceRawImage(const struct PNGRawImage* image, struct PNGReducedImage* out);
+
+/**
+ * @brief Free memory owned by reduced image
+ * @param[in, out] obj Reduced image, nullable
+ */
+PNG_CORE_API void PNGFreeReducedImage(struct PNGReducedImage* obj);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
@@ -0,0 +1,88 @@
+/**
+ * @file png_core/stream_decoder.h
+ *
+ * @brief Push-style decoding of datastreams that arrive in pieces
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "decoder.h"
+#include "png_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Outcome of PNGStreamDecode
+ */
+enum PNGStreamStatus {
+  /* Datastream is corrupted, truncated, exceeds limits, conversion is not supported or allocation failed */
+  PNG_STREAM_ERROR = -1,
+  /* Input is consumed, more is needed */
+  PNG_STREAM_NEED_INPUT = 0,
+  /* A row is decoded */
+  PNG_STREAM_ROW = 1,
+  /* IEND chunk is read after every row. Input after it is not consumed */
+  PNG_STREAM_END = 2,
+};
+
+/**
+ * Row returned by PNGStreamDecode
+ */
+struct PNGStreamRow {
+  /* Row index from 0, top to bottom */
+  int y;
+  /* Row in output pixel format, owned by decoder. Valid until the next call of PNGStreamDecode */
+  const uint8_t* data;
+  int size;
+};
+
+/**
+ * Decoder fed with consecutive pieces of a datastream. It keeps two scanlines and one output row,
+ * image data is inflated straight from input pieces
+ */
+struct PNGStreamDecoder;
+
+/**
+ * @brief Create decoder. Interlaced images are not supported
+ * @param[in] options Options, as of PNGDecodeImage. flip_vertically is not supported, inflate_engine is not used:
+ *   image data is inflated with zlib as it arrives. Every PNGStreamDecode call adds to stats, which must outlive
+ *   the decoder. Inflate, defilter and convert stages are timed per scanline. NULL for defaults
+ * @return Decoder to free with PNGFreeStreamDecoder or NULL if options are not supported or allocation failed
+ */
+PNG_CORE_API struct PNGStreamDecoder* PNGCreateStreamDecoder(const struct PNGDecodeOptions* options);
+
+/**
+ * @brief Consume input until a row is decoded, input runs out or datastream ends.
+ * Chunks before image data are buffered until it starts, image data is not copied
+ * @param[in, out] obj Decoder, not null
+ * @param[in] data Next piece of datastream, starting with signature. Nullable if size is 0
+ * @param size Piece size in bytes. 0 to get rows inflated from previous pieces
+ * @param[out] consumed Bytes of piece consumed. The rest is passed to the next call
+ * @param[out] out Decoded row if PNG_STREAM_ROW is returned
+ * @return Status. After PNG_STREAM_ERROR and PNG_STREAM_END the same status is returned
+ */
+PNG_CORE_API enum PNGStreamStatus PNGStreamDecode(struct PNGStreamDecoder* obj, const uint8_t* data, size_t size,
+                                                  size_t* consumed, struct PNGStreamRow* out);
+
+/**
+ * @param[in] obj Decoder, not null
+ * @param[out] out Image properties and palette of PNG_PIXEL_FORMAT_INDEXED8 images. Data is NULL, data_size is
+ *   size of the whole image
+ * @return false if image data has not started yet
+ */
+PNG_CORE_API bool PNGGetStreamImageInfo(const struct PNGStreamDecoder* obj, struct PNGImage* out);
+
+/**
+ * @param[in] obj Decoder, nullable
+ */
+PNG_CORE_API void PNGFreeStreamDecoder(struct PNGStreamDecoder* obj);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
@@ -0,0 +1,723 @@
+#include "inflate.h"
+
+#include <limits.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <zlib.h>
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#define PNG_INFLATE_SSE2 1
+#include <immintrin.h>
+#endif
+
+#include "stats_recorder.h"
+#include "tools.h"
+
+static voidpf ZlibAlloc(voidpf opaque, uInt items, uInt size) {
+  (void)opaque;
+  if (size && items > SIZE_MAX / size)
+    return Z_NULL;
+  return ScratchMalloc((size_t)items * size);
+}
+
+static void ZlibFree(voidpf opaque, voidpf address) {
+  (void)opaque;
+  ScratchFree(address);
+}
+
+/* Input is given to zlib in parts of this size, so ratio is checked while data is inflated */
+#define PNG_INFLATE_INPUT_PART_SIZE (64 * 1024)
+
+static bool InflateWithZlib(const uint8_t* compressed, size_t compressed_size, uint8_t* out, size_t out_size,
+                            uint32_t max_ratio) {
+  z_stream stream = {0};
+  stream.zalloc = ZlibAlloc;
+  stream.zfree = ZlibFree;
+  if (inflateInit(&stream) != Z_OK)
+    return false;
+
+  /* zlib counters are 32-bit, so sizes are passed in parts */
+  const size_t input_part_size = max_ratio ? PNG_INFLATE_INPUT_PART_SIZE : UINT_MAX;
+  uint64_t total_in = 0;
+  uint64_t total_out = 0;
+  int ret = Z_OK;
+  while (ret == Z_OK) {
+    if (!stream.avail_in) {
+      stream.avail_in = (uInt)(compressed_size > input_part_size ? input_part_size : compressed_size);
+      stream.next_in = (Bytef*)compressed;
+      compressed += stream.avail_in;
+      compressed_size -= stream.avail_in;
+    }
+    if (!stream.avail_out) {
+      stream.avail_out = out_size > UINT_MAX ? UINT_MAX : (uInt)out_size;
+      stream.next_out = out;
+      out += stream.avail_out;
+      out_size -= stream.avail_out;
+    }
+    const uInt avail_in = stream.avail_in;
+    const uInt avail_out = stream.avail_out;
+    /* Z_BUF_ERROR means no progress: input ended or output is full before the end of stream */
+    ret = inflate(&stream, Z_NO_FLUSH);
+    total_in += avail_in - stream.avail_in;
+    total_out += avail_out - stream.avail_out;
+    if (max_ratio && total_out > total_in * max_ratio)
+      ret = Z_DATA_ERROR;
+  }
+  const bool ok = ret == Z_STREAM_END && !stream.avail_out && !out_size;
+  inflateEnd(&stream);
+  return ok;
+}
+
+/*
+ * Built-in engine. Output size is known, so the stream is decoded in one pass straight into output with no window.
+ * Bits are read through 64-bit buffer refilled by one unaligned load, codes are decoded by table lookups
+ */
+
+#define PNG_INFLATE_MAX_CODE_LENGTH 15
+#define PNG_INFLATE_LITLEN_SYMBOLS_COUNT 288
+#define PNG_INFLATE_DIST_SYMBOLS_COUNT 32
+#define PNG_INFLATE_CODE_LENGTH_SYMBOLS_COUNT 19
+/* Bits of codes resolved by main table. Longer codes continue in subtables */
+#define PNG_INFLATE_LITLEN_TABLE_BITS 11
+#define PNG_INFLATE_DIST_TABLE_BITS 8
+#define PNG_INFLATE_CODE_LENGTH_TABLE_BITS 7
+/* Main table and subtables. Every subtable of complete code holds at least two codes */
+#define PNG_INFLATE_TABLE_SIZE(table_bits, symbols_count) \
+  ((1 << (table_bits)) + (symbols_count) / 2 * (1 << (PNG_INFLATE_MAX_CODE_LENGTH - (table_bits))))
+#define PNG_INFLATE_LITLEN_TABLE_SIZE \
+  PNG_INFLATE_TABLE_SIZE(PNG_INFLATE_LITLEN_TABLE_BITS, PNG_INFLATE_LITLEN_SYMBOLS_COUNT)
+#define PNG_INFLATE_DIST_TABLE_SIZE PNG_INFLATE_TABLE_SIZE(PNG_INFLATE_DIST_TABLE_BITS, PNG_INFLATE_DIST_SYMBOLS_COUNT)
+/* Match copies of words may write this many bytes past match end */
+#define PNG_INFLATE_COPY_SLACK 16
+/* Adler-32 sums fit 32 bits for this many bytes between reductions */
+#define PNG_ADLER32_BLOCK_SIZE 5552
+#define PNG_ADLER32_MODULUS 65521
+
+/*
+ * Table entry: bits 0-4 are code length at the table level, bits 5-7 are kind,
+ * bits 8-15 are count of extra bits or subtable index bits, bits 16-31 are value
+ */
+enum HuffmanEntryKind {
+  HUFFMAN_ENTRY_LITERAL = 0,
+  /* Two literals whose codes fit main table index together, first one in the low byte of value */
+  HUFFMAN_ENTRY_LITERAL_PAIR = 1,
+  /* Base of length, distance or code length symbol, extra bits follow the code */
+  HUFFMAN_ENTRY_BASE = 2,
+  HUFFMAN_ENTRY_END_OF_BLOCK = 3,
+  /* Value is subtable offset */
+  HUFFMAN_ENTRY_SUBTABLE = 4,
+  HUFFMAN_ENTRY_INVALID = 5,
+};
+
+enum HuffmanAlphabet {
+  HUFFMAN_ALPHABET_LITLEN,
+  HUFFMAN_ALPHABET_DIST,
+  HUFFMAN_ALPHABET_CODE_LENGTH,
+};
+
+static inline uint32_t MakeHuffmanEntry(enum HuffmanEntryKind kind, uint32_t extra_bits, uint32_t value) {
+  return (uint32_t)kind << 5 | extra_bits << 8 | value << 16;
+}
+
+static inline int GetEntryCodeLength(uint32_t entry) {
+  return entry & 31;
+}
+
+static inline enum HuffmanEntryKind GetEntryKind(uint32_t entry) {
+  return (enum HuffmanEntryKind)((entry >> 5) & 7);
+}
+
+static inline int GetEntryExtraBits(uint32_t entry) {
+  return (entry >> 8) & 0xFF;
+}
+
+static inline uint32_t GetEntryValue(uint32_t entry) {
+  return entry >> 16;
+}
+
+static const uint16_t s_length_bases[29] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                            31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t s_length_extra_bits[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                                2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t s_dist_bases[30] = {1,    2,    3,    4,    5,    7,    9,    13,    17,    25,
+                                          33,   49,   65,   97,   129,  193,  257,  385,   513,   769,
+                                          1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t s_dist_extra_bits[30] = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                              6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+static const uint8_t s_code_length_order[PNG_INFLATE_CODE_LENGTH_SYMBOLS_COUNT] = {16, 17, 18, 0, 8,  7, 9,  6, 10, 5,
+                                                                                   11, 4,  12, 3, 13, 2, 14, 1, 15};
+
+static uint32_t GetSymbolEntry(enum HuffmanAlphabet alphabet, int symbol) {
+  switch (alphabet) {
+    case HUFFMAN_ALPHABET_LITLEN:
+      if (symbol < 256)
+        return MakeHuffmanEntry(HUFFMAN_ENTRY_LITERAL, 0, symbol);
+      if (symbol == 256)
+        return MakeHuffmanEntry(HUFFMAN_ENTRY_END_OF_BLOCK, 0, 0);
+      if (symbol < 286)
+        return MakeHuffmanEntry(HUFFMAN_ENTRY_BASE, s_length_extra_bits[symbol - 257], s_length_bases[symbol - 257]);
+      return MakeHuffmanEntry(HUFFMAN_ENTRY_INVALID, 0, 0);
+    case HUFFMAN_ALPHABET_DIST:
+      if (symbol < 30)
+        return MakeHuffmanEntry(HUFFMAN_ENTRY_BASE, s_dist_extra_bits[symbol], s_dist_bases[symbol]);
+      return MakeHuffmanEntry(HUFFMAN_ENTRY_INVALID, 0, 0);
+    case HUFFMAN_ALPHABET_CODE_LENGTH: return MakeHuffmanEntry(HUFFMAN_ENTRY_BASE, 0, symbol);
+  }
+  return MakeHuffmanEntry(HUFFMAN_ENTRY_INVALID, 0, 0);
+}
+
+static uint32_t ReverseBits(uint32_t code, int length) {
+  uint32_t reversed = 0;
+  for (int i = 0; i < length; ++i, code >>= 1)
+    reversed = reversed << 1 | (code & 1);
+  return reversed;
+}
+
+/*
+ * @brief Build lookup table of canonical Huffman code, indexed by next bits of stream.
+ * Codes are accepted on the same terms as zlib: no oversubscribed codes, incomplete ones only with one symbol
+ * @param table_size Size of `table` including space for subtables
+ * @return false if code lengths don't describe valid code
+ */
+static bool BuildHuffmanTable(const uint8_t* lengths, int symbols_count, enum HuffmanAlphabet alphabet, int table_bits,
+                              uint32_t* table, int table_size) {
+  int counts[PNG_INFLATE_MAX_CODE_LENGTH + 1] = {0};
+  for (int i = 0; i < symbols_count; ++i)
+    ++counts[lengths[i]];
+  counts[0] = 0;
+
+  int max_length = 0;
+  int left = 1;
+  for (int length = 1; length <= PNG_INFLATE_MAX_CODE_LENGTH; ++length) {
+    left = 2 * left - counts[length];
+    if (left < 0)
+      return false;
+    if (counts[length])
+      max_length = length;
+  }
+  const int main_size = 1 << table_bits;
+  if (left > 0) {
+    if (alphabet == HUFFMAN_ALPHABET_CODE_LENGTH || max_length > 1)
+      return false;
+    /* Index bits of missing codes are not consumed, stream is rejected on them */
+    for (int i = 0; i < main_size; ++i)
+      table[i] = MakeHuffmanEntry(HUFFMAN_ENTRY_INVALID, 0, 0);
+  }
+
+  /* Symbols in canonical order: by code length, then by value. Codes increase along it */
+  int offsets[PNG_INFLATE_MAX_CODE_LENGTH + 1];
+  uint32_t next_codes[PNG_INFLATE_MAX_CODE_LENGTH + 1];
+  offsets[0] = 0;
+  next_codes[0] = 0;
+  for (int length = 1; length <= PNG_INFLATE_MAX_CODE_LENGTH; ++length) {
+    offsets[length] = offsets[length - 1] + counts[length - 1];
+    next_codes[length] = (next_codes[length - 1] + counts[length - 1]) << 1;
+  }
+  uint16_t sorted[PNG_INFLATE_LITLEN_SYMBOLS_COUNT];
+  for (int i = 0; i < symbols_count; ++i)
+    if (lengths[i])
+      sorted[offsets[lengths[i]]++] = (uint16_t)i;
+  const int sorted_count = offsets[PNG_INFLATE_MAX_CODE_LENGTH];
+
+  /* Codes are read starting from their first bit, so tables are indexed by reversed codes */
+  uint16_t reversed_codes[PNG_INFLATE_LITLEN_SYMBOLS_COUNT];
+  uint8_t subtable_lengths[1 << PNG_INFLATE_LITLEN_TABLE_BITS];
+  memset(subtable_lengths, 0, main_size);
+  for (int i = 0; i < sorted_count; ++i) {
+    const int length = lengths[sorted[i]];
+    reversed_codes[i] = (uint16_t)ReverseBits(next_codes[length]++, length);
+    if (length > table_bits)
+      subtable_lengths[reversed_codes[i] & (main_size - 1)] = (uint8_t)length;
+  }
+
+  /* Codes sharing main table index are adjacent in canonical order, the last one is the longest */
+  int prefix = -1;
+  int subtable_offset = main_size;
+  int subtable_bits = 0;
+  int next_subtable_offset = main_size;
+  for (int i = 0; i < sorted_count; ++i) {
+    const int length = lengths[sorted[i]];
+    const uint32_t entry = GetSymbolEntry(alphabet, sorted[i]);
+    if (length <= table_bits) {
+      for (int j = reversed_codes[i]; j < main_size; j += 1 << length)
+        table[j] = entry | length;
+      continue;
+    }
+    if ((reversed_codes[i] & (main_size - 1)) != prefix) {
+      prefix = reversed_codes[i] & (main_size - 1);
+      subtable_offset = next_subtable_offset;
+      subtable_bits = subtable_lengths[prefix] - table_bits;
+      next_subtable_offset += 1 << subtable_bits;
+      if (next_subtable_offset > table_size)
+        return false;
+      table[prefix] = MakeHuffmanEntry(HUFFMAN_ENTRY_SUBTABLE, subtable_bits, subtable_offset) | table_bits;
+    }
+    for (int j = reversed_codes[i] >> table_bits; j < 1 << subtable_bits; j += 1 << (length - table_bits))
+      table[subtable_offset + j] = entry | (length - table_bits);
+  }
+
+  if (alphabet != HUFFMAN_ALPHABET_LITLEN)
+    return true;
+  /*
+   * Literal is paired with the next one if both codes fit index. Entry of the next one is at index without bits of
+   * the first code, which is lower, so going down reads entries not paired yet
+   */
+  for (int i = main_size - 1; i >= 0; --i) {
+    const uint32_t first = table[i];
+    if (GetEntryKind(first) != HUFFMAN_ENTRY_LITERAL)
+      continue;
+    const uint32_t second = table[i >> GetEntryCodeLength(first)];
+    const int pair_length = GetEntryCodeLength(first) + GetEntryCodeLength(second);
+    if (GetEntryKind(second) == HUFFMAN_ENTRY_LITERAL && pair_length <= table_bits)
+      table[i] = MakeHuffmanEntry(HUFFMAN_ENTRY_LITERAL_PAIR, 0, GetEntryValue(first) | GetEntryValue(second) << 8) |
+                 pair_length;
+  }
+  return true;
+}
+
+/*
+ * Tables of dynamic blocks, allocated with the first such block
+ */
+struct DynamicHuffmanTables {
+  uint32_t litlen[PNG_INFLATE_LITLEN_TABLE_SIZE];
+  uint32_t dist[PNG_INFLATE_DIST_TABLE_SIZE];
+  uint32_t code_length[1 << PNG_INFLATE_CODE_LENGTH_TABLE_BITS];
+  uint8_t lengths[PNG_INFLATE_LITLEN_SYMBOLS_COUNT + PNG_INFLATE_DIST_SYMBOLS_COUNT];
+};
+
+/* Fixed code tables are built once per process */
+static uint32_t s_fixed_litlen_table[1 << PNG_INFLATE_LITLEN_TABLE_BITS];
+static uint32_t s_fixed_dist_table[1 << PNG_INFLATE_DIST_TABLE_BITS];
+static atomic_bool s_fixed_tables_ready = false;
+static atomic_flag s_fixed_tables_lock = ATOMIC_FLAG_INIT;
+
+static void InitFixedHuffmanTables(void) {
+  if (atomic_load_explicit(&s_fixed_tables_ready, memory_order_acquire))
+    return;
+  while (atomic_flag_test_and_set_explicit(&s_fixed_tables_lock, memory_order_acquire)) {
+  }
+  if (!atomic_load_explicit(&s_fixed_tables_ready, memory_order_relaxed)) {
+    uint8_t lengths[PNG_INFLATE_LITLEN_SYMBOLS_COUNT];
+    memset(lengths, 8, 144);
+    memset(lengths + 144, 9, 112);
+    memset(lengths + 256, 7, 24);
+    memset(lengths + 280, 8, 8);
+    BuildHuffmanTable(lengths, PNG_INFLATE_LITLEN_SYMBOLS_COUNT, HUFFMAN_ALPHABET_LITLEN, PNG_INFLATE_LITLEN_TABLE_BITS,
+                      s_fixed_litlen_table, 1 << PNG_INFLATE_LITLEN_TABLE_BITS);
+    memset(lengths, 5, PNG_INFLATE_DIST_SYMBOLS_COUNT);
+    BuildHuffmanTable(lengths, PNG_INFLATE_DIST_SYMBOLS_COUNT, HUFFMAN_ALPHABET_DIST, PNG_INFLATE_DIST_TABLE_BITS,
+                      s_fixed_dist_table, 1 << PNG_INFLATE_DIST_TABLE_BITS);
+    atomic_store_explicit(&s_fixed_tables_ready, true, memory_order_release);
+  }
+  atomic_flag_clear_explicit(&s_fixed_tables_lock, memory_order_release);
+}
+
+struct BitReader {
+  const uint8_t* begin;
+  const uint8_t* next;
+  const uint8_t* end;
+  /* Bits not consumed yet start from the lowest one. Bits above `bits_count` are zeros or next bits of input */
+  uint64_t bits;
+  int bits_count;
+  /* Zero bytes fed after end of input. Stream is truncated if they are consumed */
+  int overrun_count;
+};
+
+static inline uint64_t LoadLittleEndian64(const uint8_t* src) {
+  uint64_t value;
+  memcpy(&value, src, sizeof(value));
+#if PNG_IS_LITTLE_ENDIAN
+  return value;
+#else
+  return __builtin_bswap64(value);
+#endif
+}
+
+/*
+ * @brief Fill buffer up to at least 56 bits, enough for length and distance codes with extra bits
+ */
+static inline void RefillBits(struct BitReader* reader) {
+  if (reader->end - reader->next >= 8) {
+    /* Bytes that fit only partially are loaded again by the next refill */
+    reader->bits |= LoadLittleEndian64(reader->next) << reader->bits_count;
+    reader->next += (63 - reader->bits_count) >> 3;
+    reader->bits_count |= 56;
+    return;
+  }
+  while (reader->bits_count < 56) {
+    if (reader->next < reader->end)
+      reader->bits |= (uint64_t)*reader->next++ << reader->bits_count;
+    else
+      ++reader->overrun_count;
+    reader->bits_count += 8;
+  }
+}
+
+static inline uint32_t PeekBits(const struct BitReader* reader, int count) {
+  return (uint32_t)reader->bits & ((1u << count) - 1);
+}
+
+static inline void ConsumeBits(struct BitReader* reader, int count) {
+  reader->bits >>= count;
+  reader->bits_count -= count;
+}
+
+static inline uint32_t ReadBits(struct BitReader* reader, int count) {
+  const uint32_t value = PeekBits(reader, count);
+  ConsumeBits(reader, count);
+  return value;
+}
+
+/*
+ * @brief Drop bits up to byte boundary and give whole buffered bytes back to input
+ * @return false if bytes past end of input were consumed
+ */
+static bool AlignBitReader(struct BitReader* reader) {
+  const int buffered_count = reader->bits_count >> 3;
+  if (reader->overrun_count > buffered_count)
+    return false;
+  reader->next -= buffered_count - reader->overrun_count;
+  reader->bits = 0;
+  reader->bits_count = 0;
+  reader->overrun_count = 0;
+  return true;
+}
+
+static inline uint32_t DecodeSymbol(struct BitReader* reader, const uint32_t* table, int table_bits) {
+  uint32_t entry = table[PeekBits(reader, table_bits)];
+  if (GetEntryKind(entry) == HUFFMAN_ENTRY_SUBTABLE) {
+    ConsumeBits(reader, table_bits);
+    entry = table[GetEntryValue(entry) + PeekBits(reader, GetEntryExtraBits(entry))];
+  }
+  ConsumeBits(reader, GetEntryCodeLength(entry));
+  return entry;
+}
+
+/*
+ * @brief Copy match that may overlap itself, so pattern of `distance` bytes repeats.
+ * Words may go up to PNG_INFLATE_COPY_SLACK bytes past match end, following output overwrites them
+ */
+static inline void CopyMatchWide(uint8_t* out, size_t distance, size_t length) {
+  const uint8_t* src = out - distance;
+  uint8_t* const match_end = out + length;
+  if (distance >= 16) {
+    do {
+      memcpy(out, src, 16);
+      out += 16;
+      src += 16;
+    } while (out < match_end);
+  } else if (distance == 1) {
+    memset(out, *src, 16);
+    if (length > 16)
+      memset(out + 16, *src, length - 16);
+  } else {
+    /* Pattern also repeats with period of the smallest multiple of distance not shorter than a word */
+    const size_t period = (8 + distance - 1) / distance * distance;
+    for (size_t i = 0; i < period - distance; ++i)
+      out[i] = src[i];
+    out += period - distance;
+    src = out - period;
+    do {
+      memcpy(out, src, 8);
+      out += 8;
+      src += 8;
+    } while (out < match_end);
+  }
+}
+
+static inline void CopyMatch(uint8_t* out, const uint8_t* out_end, size_t distance, size_t length) {
+  if ((size_t)(out_end - out) >= length + PNG_INFLATE_COPY_SLACK) {
+    CopyMatchWide(out, distance, length);
+    return;
+  }
+  const uint8_t* src = out - distance;
+  for (uint8_t* const match_end = out + length; out < match_end; ++out, ++src)
+    *out = *src;
+}
+
+/* Fast loop writes up to three literal entries of two bytes and a match, with no output checks */
+#define PNG_INFLATE_FAST_OUTPUT_MARGIN (3 * 2 + 258 + PNG_INFLATE_COPY_SLACK)
+/* Fast loop refills twice per iteration */
+#define PNG_INFLATE_FAST_INPUT_MARGIN (2 * 8)
+
+/*
+ * @brief Write literal entry: both bytes are always written, output advances by one or two
+ */
+static inline uint8_t* WriteLiterals(uint8_t* out, uint32_t entry) {
+  out[0] = (uint8_t)GetEntryValue(entry);
+  out[1] = (uint8_t)(GetEntryValue(entry) >> 8);
+  return out + 1 + (GetEntryKind(entry) == HUFFMAN_ENTRY_LITERAL_PAIR);
+}
+
+static inline bool IsLiteralEntry(uint32_t entry) {
+  return GetEntryKind(entry) <= HUFFMAN_ENTRY_LITERAL_PAIR;
+}
+
+/*
+ * @brief Decode symbols of Huffman block up to end of block
+ * @param[in,out] out Position in output
+ * @return false if data is invalid or doesn't fit output
+ */
+static bool InflateHuffmanBlock(struct BitReader* reader_ptr, const uint32_t* litlen_table, const uint32_t* dist_table,
+                                const uint8_t* out_begin, uint8_t** out_ptr, const uint8_t* out_end) {
+  /* Local copies stay in registers */
+  struct BitReader reader = *reader_ptr;
+  uint8_t* out = *out_ptr;
+  uint32_t entry = MakeHuffmanEntry(HUFFMAN_ENTRY_INVALID, 0, 0);
+  /* End of block, invalid symbol or match was met */
+  bool stopped = false;
+
+  /*
+   * Away from input and output ends: no bounds checks but distance. Refilled buffer holds three literal codes,
+   * or length and distance codes with their extra bits: 15 + 5 + 15 + 13 bits
+   */
+  while (!stopped && out_end - out >= PNG_INFLATE_FAST_OUTPUT_MARGIN &&
+         reader.end - reader.next >= PNG_INFLATE_FAST_INPUT_MARGIN) {
+    RefillBits(&reader);
+    entry = DecodeSymbol(&reader, litlen_table, PNG_INFLATE_LITLEN_TABLE_BITS);
+    if (IsLiteralEntry(entry)) {
+      out = WriteLiterals(out, entry);
+      entry = DecodeSymbol(&reader, litlen_table, PNG_INFLATE_LITLEN_TABLE_BITS);
+      if (IsLiteralEntry(entry)) {
+        out = WriteLiterals(out, entry);
+        entry = DecodeSymbol(&reader, litlen_table, PNG_INFLATE_LITLEN_TABLE_BITS);
+        if (IsLiteralEntry(entry)) {
+          out = WriteLiterals(out, entry);
+          continue;
+        }
+      }
+      RefillBits(&reader);
+    }
+    stopped = GetEntryKind(entry) != HUFFMAN_ENTRY_BASE;
+    if (stopped)
+      break;
+    const size_t length = GetEntryValue(entry) + ReadBits(&reader, GetEntryExtraBits(entry));
+    const uint32_t dist_entry = DecodeSymbol(&reader, dist_table, PNG_INFLATE_DIST_TABLE_BITS);
+    const size_t distance = GetEntryValue(dist_entry) + ReadBits(&reader, GetEntryExtraBits(dist_entry));
+    stopped = GetEntryKind(dist_entry) != HUFFMAN_ENTRY_BASE || distance > (size_t)(out - out_begin);
+    if (stopped)
+      break;
+    CopyMatchWide(out, distance, length);
+    out += length;
+  }
+
+  /* Near the ends every symbol is checked */
+  while (!stopped) {
+    RefillBits(&reader);
+    entry = DecodeSymbol(&reader, litlen_table, PNG_INFLATE_LITLEN_TABLE_BITS);
+    if (IsLiteralEntry(entry)) {
+      if (out_end - out < 1 + (GetEntryKind(entry) == HUFFMAN_ENTRY_LITERAL_PAIR))
+        break;
+      *out++ = (uint8_t)GetEntryValue(entry);
+      if (GetEntryKind(entry) == HUFFMAN_ENTRY_LITERAL_PAIR)
+        *out++ = (uint8_t)(GetEntryValue(entry) >> 8);
+      continue;
+    }
+    if (GetEntryKind(entry) != HUFFMAN_ENTRY_BASE)
+      break;
+    const size_t length = GetEntryValue(entry) + ReadBits(&reader, GetEntryExtraBits(entry));
+    const uint32_t dist_entry = DecodeSymbol(&reader, dist_table, PNG_INFLATE_DIST_TABLE_BITS);
+    const size_t distance = GetEntryValue(dist_entry) + ReadBits(&reader, GetEntryExtraBits(dist_entry));
+    if (GetEntryKind(dist_entry) != HUFFMAN_ENTRY_BASE || distance > (size_t)(out - out_begin) ||
+        length > (size_t)(out_end - out)) {
+      entry = dist_entry;
+      break;
+    }
+    CopyMatch(out, out_end, distance, length);
+    out += length;
+  }
+
+  *reader_ptr = reader;
+  *out_ptr = out;
+  return GetEntryKind(entry) == HUFFMAN_ENTRY_END_OF_BLOCK;
+}
+
+static bool InflateStoredBlock(struct BitReader* reader, uint8_t** out, const uint8_t* out_end) {
+  if (!AlignBitReader(reader) || reader->end - reader->next < 4)
+    return false;
+  const size_t length = reader->next[0] | reader->next[1] << 8;
+  const size_t inverted_length = reader->next[2] | reader->next[3] << 8;
+  reader->next += 4;
+  if ((length ^ 0xFFFF) != inverted_length || length > (size_t)(reader->end - reader->next) ||
+      length > (size_t)(out_end - *out))
+    return false;
+  memcpy(*out, reader->next, length);
+  *out += length;
+  reader->next += length;
+  return true;
+}
+
+/*
+ * @brief Read code lengths of dynamic block and build its tables
+ */
+static bool ReadDynamicHuffmanTables(struct BitReader* reader, struct DynamicHuffmanTables* tables) {
+  RefillBits(reader);
+  const int litlen_count = ReadBits(reader, 5) + 257;
+  const int dist_count = ReadBits(reader, 5) + 1;
+  const int code_length_count = ReadBits(reader, 4) + 4;
+  if (litlen_count > 286 || dist_count > 30)
+    return false;
+
+  uint8_t code_length_lengths[PNG_INFLATE_CODE_LENGTH_SYMBOLS_COUNT] = {0};
+  for (int i = 0; i < code_length_count; ++i) {
+    RefillBits(reader);
+    code_length_lengths[s_code_length_order[i]] = (uint8_t)ReadBits(reader, 3);
+  }
+  if (!BuildHuffmanTable(code_length_lengths, PNG_INFLATE_CODE_LENGTH_SYMBOLS_COUNT, HUFFMAN_ALPHABET_CODE_LENGTH,
+                         PNG_INFLATE_CODE_LENGTH_TABLE_BITS, tables->code_length,
+                         1 << PNG_INFLATE_CODE_LENGTH_TABLE_BITS))
+    return false;
+
+  /* Repeats may cross from literal/length lengths into distance ones */
+  const int lengths_count = litlen_count + dist_count;
+  for (int i = 0; i < lengths_count;) {
+    RefillBits(reader);
+    const uint32_t entry = DecodeSymbol(reader, tables->code_length, PNG_INFLATE_CODE_LENGTH_TABLE_BITS);
+    const uint32_t symbol = GetEntryValue(entry);
+    if (symbol < 16) {
+      tables->lengths[i++] = (uint8_t)symbol;
+      continue;
+    }
+    uint8_t value = 0;
+    int repeat_count;
+    if (symbol == 16) {
+      if (!i)
+        return false;
+      value = tables->lengths[i - 1];
+      repeat_count = 3 + ReadBits(reader, 2);
+    } else if (symbol == 17) {
+      repeat_count = 3 + ReadBits(reader, 3);
+    } else {
+      repeat_count = 11 + ReadBits(reader, 7);
+    }
+    if (repeat_count > lengths_count - i)
+      return false;
+    memset(tables->lengths + i, value, repeat_count);
+    i += repeat_count;
+  }
+
+  /* Block without end of block code never ends */
+  if (!tables->lengths[256])
+    return false;
+  return BuildHuffmanTable(tables->lengths, litlen_count, HUFFMAN_ALPHABET_LITLEN, PNG_INFLATE_LITLEN_TABLE_BITS,
+                           tables->litlen, PNG_INFLATE_LITLEN_TABLE_SIZE) &&
+         BuildHuffmanTable(tables->lengths + litlen_count, dist_count, HUFFMAN_ALPHABET_DIST,
+                           PNG_INFLATE_DIST_TABLE_BITS, tables->dist, PNG_INFLATE_DIST_TABLE_SIZE);
+}
+
+#ifdef PNG_INFLATE_SSE2
+static uint32_t SumEpi32(__m128i v) {
+  v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+  v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+  return (uint32_t)_mm_cvtsi128_si32(v);
+}
+
+/*
+ * @brief Add 16-byte blocks to sums. Byte i of a block is added to `b` 16 - i times, which are madd weights
+ * @param count Count of blocks, sums of PNG_ADLER32_BLOCK_SIZE bytes at most
+ */
+static void UpdateAdler32Blocks(const uint8_t* data, size_t count, uint32_t* a, uint32_t* b) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i weights_low = _mm_set_epi16(9, 10, 11, 12, 13, 14, 15, 16);
+  const __m128i weights_high = _mm_set_epi16(1, 2, 3, 4, 5, 6, 7, 8);
+  __m128i sum_a = zero;
+  /* Sum of `sum_a` before every block, each of them is added to `b` 16 times */
+  __m128i sum_previous_a = zero;
+  __m128i sum_b = zero;
+  for (size_t i = 0; i < count; ++i, data += 16) {
+    const __m128i bytes = _mm_loadu_si128((const __m128i*)data);
+    sum_previous_a = _mm_add_epi32(sum_previous_a, sum_a);
+    sum_a = _mm_add_epi32(sum_a, _mm_sad_epu8(bytes, zero));
+    sum_b = _mm_add_epi32(sum_b, _mm_madd_epi16(_mm_unpacklo_epi8(bytes, zero), weights_low));
+    sum_b = _mm_add_epi32(sum_b, _mm_madd_epi16(_mm_unpackhi_epi8(bytes, zero), weights_high));
+  }
+  const uint64_t b64 = *b + (uint64_t)*a * 16 * count + 16 * (uint64_t)SumEpi32(sum_previous_a) + SumEpi32(sum_b);
+  *a = (*a + SumEpi32(sum_a)) % PNG_ADLER32_MODULUS;
+  *b = (uint32_t)(b64 % PNG_ADLER32_MODULUS);
+}
+#endif
+
+static uint32_t ComputeAdler32(const uint8_t* data, size_t size) {
+  uint32_t a = 1;
+  uint32_t b = 0;
+  while (size) {
+    size_t block_size = size < PNG_ADLER32_BLOCK_SIZE ? size : PNG_ADLER32_BLOCK_SIZE;
+    size -= block_size;
+#ifdef PNG_INFLATE_SSE2
+    UpdateAdler32Blocks(data, block_size / 16, &a, &b);
+    data += block_size / 16 * 16;
+    block_size %= 16;
+#endif
+    for (; block_size >= 4; block_size -= 4, data += 4) {
+      a += data[0];
+      b += a;
+      a += data[1];
+      b += a;
+      a += data[2];
+      b += a;
+      a += data[3];
+      b += a;
+    }
+    for (; block_size; --block_size) {
+      a += *data++;
+      b += a;
+    }
+    a %= PNG_ADLER32_MODULUS;
+    b %= PNG_ADLER32_MODULUS;
+  }
+  return b << 16 | a;
+}
+
+static bool InflateBuiltin(const uint8_t* compressed, size_t compressed_size, uint8_t* out, size_t out_size,
+                           uint32_t max_ratio) {
+  /* zlib header: deflate method, window up to 32 KiB, check bits, no preset dictionary */
+  if (compressed_size < 2 || (compressed[0] & 0x0F) != 8 || compressed[0] >> 4 > 7 ||
+      (compressed[0] << 8 | compressed[1]) % 31 || compressed[1] & 0x20)
+    return false;
+  InitFixedHuffmanTables();
+
+  struct BitReader reader = {compressed, compressed + 2, compressed + compressed_size, 0, 0, 0};
+  struct DynamicHuffmanTables* tables = NULL;
+  uint8_t* const out_begin = out;
+  const uint8_t* const out_end = out + out_size;
+  bool ok = true;
+  bool final_block = false;
+  while (ok && !final_block) {
+    RefillBits(&reader);
+    final_block = ReadBits(&reader, 1);
+    switch (ReadBits(&reader, 2)) {
+      case 0: ok = InflateStoredBlock(&reader, &out, out_end); break;
+      case 1:
+        ok = InflateHuffmanBlock(&reader, s_fixed_litlen_table, s_fixed_dist_table, out_begin, &out, out_end);
+        break;
+      case 2:
+        if (!tables)
+          tables = ScratchMalloc(sizeof(struct DynamicHuffmanTables));
+        ok = tables && ReadDynamicHuffmanTables(&reader, tables) &&
+             InflateHuffmanBlock(&reader, tables->litlen, tables->dist, out_begin, &out, out_end);
+        break;
+      default: ok = false; break;
+    }
+    /* Ratio is checked between blocks, output can't outgrow its buffer anyway */
+    const uint64_t consumed_size = (uint64_t)(reader.next - reader.begin) + reader.overrun_count;
+    ok = ok && reader.overrun_count <= reader.bits_count >> 3 &&
+         (!max_ratio || (uint64_t)(out - out_begin) <= consumed_size * max_ratio);
+  }
+  ScratchFree(tables);
+
+  /* Adler-32 of output follows the last block from byte boundary */
+  if (!ok || out != out_end || !AlignBitReader(&reader) || reader.end - reader.next < 4)
+    return false;
+  const uint32_t adler = (uint32_t)reader.next[0] << 24 | (uint32_t)reader.next[1] << 16 |
+                         (uint32_t)reader.next[2] << 8 | reader.next[3];
+  return adler == ComputeAdler32(out_begin, out_size);
+}
+
+bool InflateZlibStream(const uint8_t* compressed, size_t compressed_size, uint8_t* out, size_t out_size,
+                       uint32_t max_ratio, enum PNGInflateEngine engine) {
+  switch (engine) {
+    case PNG_INFLATE_ENGINE_ZLIB: return InflateWithZlib(compressed, compressed_size, out, out_size, max_ratio);
+    case PNG_INFLATE_ENGINE_BUILTIN: return InflateBuiltin(compressed, compressed_size, out, out_size, max_ratio);
+  }
+  return false;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "png_core/compression.h"
+
+/*
+ * @brief Decompress whole zlib stream into buffer of known size.
+ * Decompressor state is allocated with ScratchMalloc, so it is counted by decode statistics
+ * @param max_ratio Limit of decompressed bytes per compressed byte consumed so far, 0 for none.
+ * zlib engine checks it every 64 KiB of input, built-in one after every deflate block
+ * @return false if data is corrupted, exceeds ratio, allocation failed or decompressed size differs from `out_size`
+ */
+bool InflateZlibStream(const uint8_t* compressed, size_t compressed_size, uint8_t* out, size_t out_size,
+                       uint32_t max_ratio, enum PNGInflateEngine engine);
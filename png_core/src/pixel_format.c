@@ -16,6 +16,31 @@ int PNGGetChannelCount(enum PNGImageType image_type) {
   return 0;
 }
 
+int PNGGetPixelFormatSizeBytes(enum PNGPixelFormat format) {
+  switch (format) {
+    case PNG_PIXEL_FORMAT_G8:
+    case PNG_PIXEL_FORMAT_INDEXED8: return 1;
+    case PNG_PIXEL_FORMAT_G16: return 2;
+    case PNG_PIXEL_FORMAT_RGB8: return 3;
+    case PNG_PIXEL_FORMAT_RGB16: return 6;
+    case PNG_PIXEL_FORMAT_RGBA8:
+    case PNG_PIXEL_FORMAT_BGRA8: return 4;
+    case PNG_PIXEL_FORMAT_RGBA16: return 8;
+    default: break;
+  }
+  return 0;
+}
+
+int PNGGetTensorTypeSizeBytes(enum PNGTensorType type) {
+  switch (type) {
+    case PNG_TENSOR_TYPE_FLOAT32: return 4;
+    case PNG_TENSOR_TYPE_FLOAT16:
+    case PNG_TENSOR_TYPE_BFLOAT16: return 2;
+    default: break;
+  }
+  return 0;
+}
+
 int PNGGetAllowedBitDepths(enum PNGImageType image_type, uint8_t* out_depths) {
   int amount = 0;
   int* depths = NULL;
@@ -53,3 +78,21 @@ int PNGGetAllowedBitDepths(enum PNGImageType image_type, uint8_t* out_depths) {
 
   return amount;
 }
+
+bool PNGIsValidImageFormat(enum PNGImageType image_type, int bit_depth) {
+  switch (image_type) {
+    case PNG_IMAGE_TYPE_GREYSCALE:
+    case PNG_IMAGE_TYPE_TRUECOLOR:
+    case PNG_IMAGE_TYPE_INDEXED:
+    case PNG_IMAGE_TYPE_GREYSCALEWITHAPLHA:
+    case PNG_IMAGE_TYPE_TRUECOLORWITHALPHA: break;
+    default: return false;
+  }
+
+  uint8_t depths[8];
+  const int amount = PNGGetAllowedBitDepths(image_type, depths);
+  for (int i = 0; i < amount; ++i)
+    if (depths[i] == bit_depth)
+      return true;
+  return false;
+}
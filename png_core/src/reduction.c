@@ -0,0 +1,533 @@
+#include "png_core/reduction.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "png_core/pixel_format.h"
+
+/*
+ * @return Ratio of maximal sample values of two bit depths, `to_depth` is not greater than `from_depth`
+ */
+static int GetSampleDivisor(int from_depth, int to_depth) {
+  return (int)((1u << from_depth) - 1) / (int)((1u << to_depth) - 1);
+}
+
+/*
+ * @brief Convert sample between bit depths. Downscaling is exact for samples counted in RaiseSampleDepth
+ */
+static uint16_t ScaleSample(uint16_t value, int from_depth, int to_depth) {
+  if (to_depth <= from_depth)
+    return (uint16_t)(value / GetSampleDivisor(from_depth, to_depth));
+  return (uint16_t)(value * GetSampleDivisor(to_depth, from_depth));
+}
+
+/*
+ * @brief Double `depth` until sample value of `bit_depth` is representable in it.
+ * Values representable in a depth are representable in every larger one, so the result is the smallest depth
+ * of all samples passed
+ */
+static int RaiseSampleDepth(int depth, uint16_t value, int bit_depth) {
+  while (depth < bit_depth && value % GetSampleDivisor(bit_depth, depth))
+    depth *= 2;
+  return depth;
+}
+
+static void UnpackSamples(const uint8_t* data, int samples_count, int bit_depth, uint16_t* out) {
+  if (bit_depth == 16) {
+    for (int i = 0; i < samples_count; ++i)
+      out[i] = (uint16_t)(data[2 * i] << 8 | data[2 * i + 1]);
+  } else if (bit_depth == 8) {
+    for (int i = 0; i < samples_count; ++i)
+      out[i] = data[i];
+  } else {
+    /* Sub-byte samples are packed from the most significant bit */
+    const uint8_t mask = (uint8_t)((1 << bit_depth) - 1);
+    for (int i = 0, bit = 0; i < samples_count; ++i, bit += bit_depth)
+      out[i] = (data[bit >> 3] >> (8 - bit_depth - (bit & 7))) & mask;
+  }
+}
+
+/*
+ * @param[out] out Scanline of ceil(samples_count * bit_depth / 8) bytes, padding bits are zeroed
+ */
+static void PackSamples(const uint16_t* samples, int samples_count, int bit_depth, uint8_t* out) {
+  if (bit_depth == 16) {
+    for (int i = 0; i < samples_count; ++i) {
+      out[2 * i] = (uint8_t)(samples[i] >> 8);
+      out[2 * i + 1] = (uint8_t)samples[i];
+    }
+  } else if (bit_depth == 8) {
+    for (int i = 0; i < samples_count; ++i)
+      out[i] = (uint8_t)samples[i];
+  } else {
+    memset(out, 0, (samples_count * bit_depth + 7) / 8);
+    for (int i = 0, bit = 0; i < samples_count; ++i, bit += bit_depth)
+      out[bit >> 3] |= (uint8_t)(samples[i] << (8 - bit_depth - (bit & 7)));
+  }
+}
+
+/*
+ * @brief Expand pixel of `channels_count` samples to R, G, B, A
+ */
+static void GetPixelRGBA(const uint16_t* samples, int channels_count, uint16_t max_sample, uint16_t out[4]) {
+  const bool color = channels_count >= 3;
+  out[0] = samples[0];
+  out[1] = samples[color ? 1 : 0];
+  out[2] = samples[color ? 2 : 0];
+  out[3] = channels_count == 2 || channels_count == 4 ? samples[channels_count - 1] : max_sample;
+}
+
+#define PNG_COLOR_TABLE_SLOTS 512
+
+/*
+ * Distinct RGBA8 colors of image in order of appearance, up to 256
+ */
+struct ColorTable {
+  uint32_t slot_colors[PNG_COLOR_TABLE_SLOTS];
+  /* Index in `colors` or -1 for empty slot */
+  int16_t slot_indices[PNG_COLOR_TABLE_SLOTS];
+  uint32_t colors[256];
+  /* Greater than maximal count passed to AddColor if image has more colors */
+  int colors_count;
+};
+
+static void InitColorTable(struct ColorTable* obj) {
+  memset(obj->slot_indices, -1, sizeof(obj->slot_indices));
+  obj->colors_count = 0;
+}
+
+/*
+ * @return Slot of color, either occupied by it or empty
+ */
+static int FindColorSlot(const struct ColorTable* obj, uint32_t color) {
+  int slot = (int)((color * 2654435761u) >> 23);
+  while (obj->slot_indices[slot] >= 0 && obj->slot_colors[slot] != color)
+    slot = (slot + 1) % PNG_COLOR_TABLE_SLOTS;
+  return slot;
+}
+
+/*
+ * @return false if color does not fit `max_colors_count`
+ */
+static bool AddColor(struct ColorTable* obj, uint32_t color, int max_colors_count) {
+  const int slot = FindColorSlot(obj, color);
+  if (obj->slot_indices[slot] >= 0)
+    return true;
+  if (obj->colors_count == max_colors_count) {
+    ++obj->colors_count;
+    return false;
+  }
+  obj->slot_colors[slot] = color;
+  obj->slot_indices[slot] = (int16_t)obj->colors_count;
+  obj->colors[obj->colors_count++] = color;
+  return true;
+}
+
+/*
+ * @return RGBA8 color of pixel. Exact if its samples fit 8 bits
+ */
+static uint32_t GetColor8(const uint16_t rgba[4], int bit_depth) {
+  uint32_t color = 0;
+  if (bit_depth == 16) {
+    for (int i = 0; i < 4; ++i)
+      color = color << 8 | rgba[i] >> 8;
+  } else if (bit_depth == 8) {
+    for (int i = 0; i < 4; ++i)
+      color = color << 8 | rgba[i];
+  } else {
+    const int multiplier = GetSampleDivisor(8, bit_depth);
+    for (int i = 0; i < 4; ++i)
+      color = color << 8 | (uint32_t)(rgba[i] * multiplier);
+  }
+  return color;
+}
+
+/*
+ * Properties of image samples found by AnalyzeImage
+ */
+struct ImageAnalysis {
+  /* Red, green and blue samples of every pixel are equal */
+  bool grey;
+  /* Every alpha sample is maximal */
+  bool opaque;
+  /* Alpha samples are 0 or maximal and fully transparent pixels have one color never used by opaque ones */
+  bool single_transparent_color;
+  uint16_t transparent_color[3];
+  /* Smallest bit depths representing every color and alpha sample */
+  int color_depth;
+  int alpha_depth;
+};
+
+/*
+ * @return Smallest depth allowed for image type that is not less than `min_depth`
+ */
+static int GetAllowedBitDepth(enum PNGImageType type, int min_depth) {
+  uint8_t depths[8];
+  const int depths_count = PNGGetAllowedBitDepths(type, depths);
+  for (int i = 0; i < depths_count; ++i)
+    if (depths[i] >= min_depth)
+      return depths[i];
+  return depths[depths_count - 1];
+}
+
+/*
+ * Colour type and bit depth to store image in
+ */
+struct ReductionTarget {
+  enum PNGImageType type;
+  int bit_depth;
+  /* Transparent color is written to tRNS */
+  bool transparent_color;
+  /* Image and palette bytes */
+  int64_t size_bytes;
+};
+
+static int64_t GetImageSizeBytes(enum PNGImageType type, int bit_depth, int width, int height) {
+  return (int64_t)height * (((int64_t)width * PNGGetChannelCount(type) * bit_depth + 7) / 8);
+}
+
+/*
+ * @return Greyscale or truecolor target
+ */
+static struct ReductionTarget GetDirectTarget(const struct ImageAnalysis* analysis, int width, int height) {
+  /* Chunk overhead is length, type and CRC */
+  const int chunk_overhead = 12;
+  const bool alpha = !analysis->opaque && !analysis->single_transparent_color;
+  struct ReductionTarget target;
+  if (analysis->grey)
+    target.type = alpha ? PNG_IMAGE_TYPE_GREYSCALEWITHAPLHA : PNG_IMAGE_TYPE_GREYSCALE;
+  else
+    target.type = alpha ? PNG_IMAGE_TYPE_TRUECOLORWITHALPHA : PNG_IMAGE_TYPE_TRUECOLOR;
+  const int min_depth = alpha && analysis->alpha_depth > analysis->color_depth ? analysis->alpha_depth
+                                                                                : analysis->color_depth;
+  target.bit_depth = GetAllowedBitDepth(target.type, min_depth);
+  target.transparent_color = !analysis->opaque && analysis->single_transparent_color;
+  target.size_bytes = GetImageSizeBytes(target.type, target.bit_depth, width, height);
+  if (target.transparent_color)
+    target.size_bytes += chunk_overhead + (analysis->grey ? 2 : 6);
+  return target;
+}
+
+static void AnalyzeImage(const struct PNGRawImage* image, int height, uint16_t* samples,
+                         struct ImageAnalysis* analysis) {
+  const int channels_count = PNGGetChannelCount(image->type);
+  const int bit_depth = image->channel_bit_depth;
+  const int width = image->scanline_pixel_count;
+  const int scanline_size_bytes = (width * channels_count * bit_depth + 7) / 8;
+  const uint16_t max_sample = (uint16_t)((1u << bit_depth) - 1);
+  const uint8_t* data = image->data;
+
+  analysis->grey = true;
+  analysis->opaque = true;
+  analysis->single_transparent_color = true;
+  analysis->color_depth = 1;
+  analysis->alpha_depth = 1;
+  bool has_transparent_color = false;
+  for (int y = 0; y < height; ++y) {
+    /* Findings are only lost on further pixels, so nothing is left to find once neither palette nor
+     * another direct format remains */
+    if (analysis->color_depth > 8 || analysis->alpha_depth > 8) {
+      const struct ReductionTarget target = GetDirectTarget(analysis, width, height);
+      if (target.type == image->type && target.bit_depth == bit_depth && !target.transparent_color)
+        return;
+    }
+    UnpackSamples(data + (int64_t)y * scanline_size_bytes, width * channels_count, bit_depth, samples);
+    for (int x = 0; x < width; ++x) {
+      uint16_t rgba[4];
+      GetPixelRGBA(samples + x * channels_count, channels_count, max_sample, rgba);
+      analysis->grey = analysis->grey && rgba[0] == rgba[1] && rgba[1] == rgba[2];
+      for (int i = 0; i < 3; ++i)
+        analysis->color_depth = RaiseSampleDepth(analysis->color_depth, rgba[i], bit_depth);
+      analysis->alpha_depth = RaiseSampleDepth(analysis->alpha_depth, rgba[3], bit_depth);
+
+      if (rgba[3] == max_sample)
+        continue;
+      analysis->opaque = false;
+      if (rgba[3] != 0) {
+        analysis->single_transparent_color = false;
+      } else if (!has_transparent_color) {
+        memcpy(analysis->transparent_color, rgba, sizeof(analysis->transparent_color));
+        has_transparent_color = true;
+      } else if (memcmp(analysis->transparent_color, rgba, sizeof(analysis->transparent_color))) {
+        analysis->single_transparent_color = false;
+      }
+    }
+  }
+  if (analysis->opaque || !analysis->single_transparent_color)
+    return;
+
+  /* Transparent color must not be used by opaque pixels */
+  for (int y = 0; y < height && analysis->single_transparent_color; ++y) {
+    UnpackSamples(data + (int64_t)y * scanline_size_bytes, width * channels_count, bit_depth, samples);
+    for (int x = 0; x < width; ++x) {
+      uint16_t rgba[4];
+      GetPixelRGBA(samples + x * channels_count, channels_count, max_sample, rgba);
+      if (rgba[3] == max_sample && !memcmp(analysis->transparent_color, rgba, sizeof(analysis->transparent_color))) {
+        analysis->single_transparent_color = false;
+        break;
+      }
+    }
+  }
+}
+
+/*
+ * @return Colors above which indexed image has no fewer bits per pixel than direct target, 0 if palette can not win
+ */
+static int GetMaxPaletteColorsCount(const struct ImageAnalysis* analysis, const struct ReductionTarget* target) {
+  if (analysis->color_depth > 8 || analysis->alpha_depth > 8)
+    return 0;
+  const int bits_per_pixel = PNGGetChannelCount(target->type) * target->bit_depth;
+  uint8_t depths[8];
+  const int depths_count = PNGGetAllowedBitDepths(PNG_IMAGE_TYPE_INDEXED, depths);
+  int max_colors_count = 0;
+  for (int i = 0; i < depths_count && depths[i] < bits_per_pixel; ++i)
+    max_colors_count = 1 << depths[i];
+  return max_colors_count;
+}
+
+/*
+ * @brief Collect image colors until there are more than `max_colors_count` of them
+ * @param[in, out] samples Buffer of a source scanline samples
+ */
+static void CollectColors(const struct PNGRawImage* image, int height, int max_colors_count, uint16_t* samples,
+                          struct ColorTable* colors) {
+  const int channels_count = PNGGetChannelCount(image->type);
+  const int bit_depth = image->channel_bit_depth;
+  const int width = image->scanline_pixel_count;
+  const int scanline_size_bytes = (width * channels_count * bit_depth + 7) / 8;
+  const uint16_t max_sample = (uint16_t)((1u << bit_depth) - 1);
+
+  InitColorTable(colors);
+  uint32_t last_color = 0;
+  for (int y = 0; y < height; ++y) {
+    UnpackSamples((const uint8_t*)image->data + (int64_t)y * scanline_size_bytes, width * channels_count, bit_depth,
+                  samples);
+    for (int x = 0; x < width; ++x) {
+      uint16_t rgba[4];
+      GetPixelRGBA(samples + x * channels_count, channels_count, max_sample, rgba);
+      const uint32_t color = GetColor8(rgba, bit_depth);
+      /* Neighbor pixels often share color */
+      if (colors->colors_count && color == last_color)
+        continue;
+      last_color = color;
+      if (!AddColor(colors, color, max_colors_count))
+        return;
+    }
+  }
+}
+
+/*
+ * @return Number of palette colors with alpha below 255
+ */
+static int GetTransparentColorsCount(const struct ColorTable* colors) {
+  int count = 0;
+  for (int i = 0; i < colors->colors_count; ++i)
+    count += (colors->colors[i] & 0xFF) != 0xFF;
+  return count;
+}
+
+/*
+ * @param[out] target Indexed target
+ * @return false if image colors do not fit palette
+ */
+static bool GetPaletteTarget(const struct ColorTable* colors, int max_colors_count, int width, int height,
+                             struct ReductionTarget* target) {
+  const int chunk_overhead = 12;
+  const int colors_count = colors->colors_count;
+  if (colors_count > max_colors_count)
+    return false;
+
+  target->type = PNG_IMAGE_TYPE_INDEXED;
+  target->bit_depth = 1;
+  while ((1 << target->bit_depth) < colors_count)
+    target->bit_depth *= 2;
+  target->bit_depth = GetAllowedBitDepth(PNG_IMAGE_TYPE_INDEXED, target->bit_depth);
+  target->transparent_color = false;
+  target->size_bytes = GetImageSizeBytes(PNG_IMAGE_TYPE_INDEXED, target->bit_depth, width, height) +
+                       chunk_overhead + 3 * colors_count;
+  const int transparent_colors_count = GetTransparentColorsCount(colors);
+  if (transparent_colors_count)
+    target->size_bytes += chunk_overhead + transparent_colors_count;
+  return true;
+}
+
+/*
+ * @brief Fill palette and tRNS of indexed target. Colors with alpha below 255 go first to keep tRNS short
+ * @param[out] indices Palette index of each color of table
+ * @return false if allocation failed
+ */
+static bool CreatePalette(const struct ColorTable* colors, struct PNGReducedImage* out, uint8_t* indices) {
+  out->palette.entries = malloc(sizeof(struct PaletteDataEntry) * colors->colors_count);
+  if (!out->palette.entries)
+    return false;
+  out->palette.entries_count = colors->colors_count;
+
+  int index = 0;
+  for (int pass = 0; pass < 2; ++pass)
+    for (int i = 0; i < colors->colors_count; ++i) {
+      const uint32_t color = colors->colors[i];
+      const bool opaque = (color & 0xFF) == 0xFF;
+      if (opaque != (pass == 1))
+        continue;
+      struct PaletteDataEntry* entry = &out->palette.entries[index];
+      entry->red = (uint8_t)(color >> 24);
+      entry->green = (uint8_t)(color >> 16);
+      entry->blue = (uint8_t)(color >> 8);
+      if (!opaque)
+        out->transparency.bytes[out->transparency.bytes_count++] = (uint8_t)color;
+      indices[i] = (uint8_t)index++;
+    }
+  return true;
+}
+
+static void SetTransparentColor(const struct ImageAnalysis* analysis, const struct ReductionTarget* target,
+                                int bit_depth, struct PNGChunkData_tRNS* out) {
+  const int samples_count = analysis->grey ? 1 : 3;
+  for (int i = 0; i < samples_count; ++i) {
+    const uint16_t sample = ScaleSample(analysis->transparent_color[i], bit_depth, target->bit_depth);
+    out->bytes[2 * i] = (uint8_t)(sample >> 8);
+    out->bytes[2 * i + 1] = (uint8_t)sample;
+  }
+  out->bytes_count = 2 * samples_count;
+}
+
+/*
+ * @brief Write image in target colour type and bit depth
+ * @param[in] colors Colors of indexed target, the first one is of the first pixel
+ * @param[in] indices Palette index of each color of table for indexed target
+ * @param[in, out] samples Buffer of a source scanline samples
+ * @return Plain image data or NULL if allocation failed
+ */
+static uint8_t* ConvertImage(const struct PNGRawImage* image, int height, const struct ReductionTarget* target,
+                             const struct ColorTable* colors, const uint8_t* indices, uint16_t* samples,
+                             int* out_size) {
+  const int channels_count = PNGGetChannelCount(image->type);
+  const int bit_depth = image->channel_bit_depth;
+  const int width = image->scanline_pixel_count;
+  const int scanline_size_bytes = (width * channels_count * bit_depth + 7) / 8;
+  const uint16_t max_sample = (uint16_t)((1u << bit_depth) - 1);
+  const int target_channels_count = PNGGetChannelCount(target->type);
+  const int target_scanline_size_bytes = (width * target_channels_count * target->bit_depth + 7) / 8;
+  const bool target_color = target->type == PNG_IMAGE_TYPE_TRUECOLOR ||
+                            target->type == PNG_IMAGE_TYPE_TRUECOLORWITHALPHA;
+  const bool target_alpha = target->type == PNG_IMAGE_TYPE_GREYSCALEWITHAPLHA ||
+                            target->type == PNG_IMAGE_TYPE_TRUECOLORWITHALPHA;
+
+  const int size = target_scanline_size_bytes * height;
+  uint8_t* out = malloc(size);
+  uint16_t* target_samples = malloc(sizeof(uint16_t) * width * target_channels_count);
+  if (!out || !target_samples) {
+    free(out);
+    free(target_samples);
+    return NULL;
+  }
+
+  const bool indexed = target->type == PNG_IMAGE_TYPE_INDEXED;
+  uint32_t last_color = indexed ? colors->colors[0] : 0;
+  uint8_t last_index = indexed ? indices[0] : 0;
+  for (int y = 0; y < height; ++y) {
+    UnpackSamples((const uint8_t*)image->data + (int64_t)y * scanline_size_bytes, width * channels_count, bit_depth,
+                  samples);
+    for (int x = 0; x < width; ++x) {
+      uint16_t rgba[4];
+      GetPixelRGBA(samples + x * channels_count, channels_count, max_sample, rgba);
+      uint16_t* pixel = target_samples + x * target_channels_count;
+      if (indexed) {
+        const uint32_t color = GetColor8(rgba, bit_depth);
+        if (color != last_color) {
+          last_color = color;
+          last_index = indices[colors->slot_indices[FindColorSlot(colors, color)]];
+        }
+        pixel[0] = last_index;
+        continue;
+      }
+      const int color_channels_count = target_color ? 3 : 1;
+      for (int i = 0; i < color_channels_count; ++i)
+        pixel[i] = ScaleSample(rgba[i], bit_depth, target->bit_depth);
+      if (target_alpha)
+        pixel[color_channels_count] = ScaleSample(rgba[3], bit_depth, target->bit_depth);
+    }
+    PackSamples(target_samples, width * target_channels_count, target->bit_depth,
+                out + (int64_t)y * target_scanline_size_bytes);
+  }
+  free(target_samples);
+  *out_size = size;
+  return out;
+}
+
+bool PNGReduceRawImage(const struct PNGRawImage* image, struct PNGReducedImage* out) {
+  memset(out, 0, sizeof(*out));
+  PNGInitData_PLTE(&out->palette);
+  PNGInitData_tRNS(&out->transparency);
+  if (!image->data || image->data_size <= 0 || image->scanline_pixel_count <= 0 ||
+      !PNGIsValidImageFormat(image->type, image->channel_bit_depth))
+    return false;
+  const int channels_count = PNGGetChannelCount(image->type);
+  const int64_t scanline_size_bytes =
+      ((int64_t)image->scanline_pixel_count * channels_count * image->channel_bit_depth + 7) / 8;
+  if (scanline_size_bytes > image->data_size || image->data_size % scanline_size_bytes)
+    return false;
+  const int height = (int)(image->data_size / scanline_size_bytes);
+
+  out->image = *image;
+  if (image->type == PNG_IMAGE_TYPE_INDEXED)
+    return true;
+
+  /* Scanline of 8-bit or wider samples holds at least as many bytes as samples */
+  uint16_t* samples = malloc(sizeof(uint16_t) * scanline_size_bytes * 8);
+  struct ColorTable* colors = malloc(sizeof(struct ColorTable));
+  if (!samples || !colors) {
+    free(samples);
+    free(colors);
+    return false;
+  }
+  struct ImageAnalysis analysis;
+  AnalyzeImage(image, height, samples, &analysis);
+
+  const int width = image->scanline_pixel_count;
+  struct ReductionTarget target = GetDirectTarget(&analysis, width, height);
+  const int max_colors_count = GetMaxPaletteColorsCount(&analysis, &target);
+  if (max_colors_count) {
+    CollectColors(image, height, max_colors_count, samples, colors);
+    struct ReductionTarget palette_target;
+    /* Equal sizes prefer direct target that needs no palette lookup on decode */
+    if (GetPaletteTarget(colors, max_colors_count, width, height, &palette_target) &&
+        palette_target.size_bytes < target.size_bytes)
+      target = palette_target;
+  }
+
+  bool success = true;
+  if (target.type != image->type || target.bit_depth != image->channel_bit_depth || target.transparent_color) {
+    uint8_t indices[256];
+    if (target.type == PNG_IMAGE_TYPE_INDEXED)
+      success = CreatePalette(colors, out, indices);
+    else if (target.transparent_color)
+      SetTransparentColor(&analysis, &target, image->channel_bit_depth, &out->transparency);
+    uint8_t* data =
+        success ? ConvertImage(image, height, &target, colors, indices, samples, &out->image.data_size) : NULL;
+    if (data) {
+      out->image.type = target.type;
+      out->image.channel_bit_depth = target.bit_depth;
+      out->image.data = data;
+      out->owns_data = true;
+    } else {
+      PNGFreeReducedImage(out);
+      success = false;
+    }
+  }
+  free(samples);
+  free(colors);
+  return success;
+}
+
+void PNGFreeReducedImage(struct PNGReducedImage* obj) {
+  if (!obj)
+    return;
+  if (obj->owns_data)
+    free(obj->image.data);
+  free(obj->palette.entries);
+  obj->owns_data = false;
+  obj->image.data = NULL;
+  PNGInitData_PLTE(&obj->palette);
+  PNGInitData_tRNS(&obj->transparency);
+}
@@ -0,0 +1,110 @@
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 199309L
+#endif
+
+#include "stats_recorder.h"
+
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+/*
+ * Scratch buffers start with a header, padded to keep the buffer maximally aligned
+ */
+struct ScratchHeader {
+  size_t size;
+  /* Recorder that counted the allocation, NULL if none was active */
+  struct StatsRecorder* recorder;
+};
+#define PNG_SCRATCH_HEADER_SIZE 16
+_Static_assert(PNG_SCRATCH_HEADER_SIZE >= sizeof(struct ScratchHeader) &&
+                   PNG_SCRATCH_HEADER_SIZE % _Alignof(max_align_t) == 0,
+               "Scratch header breaks alignment");
+
+static _Thread_local struct StatsRecorder* t_active_recorder = NULL;
+
+uint64_t GetMonotonicTimeNs(void) {
+#ifdef _WIN32
+  static LARGE_INTEGER frequency;
+  if (!frequency.QuadPart)
+    QueryPerformanceFrequency(&frequency);
+  LARGE_INTEGER counter;
+  QueryPerformanceCounter(&counter);
+  return (uint64_t)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (uint64_t)time.tv_sec * 1000000000u + (uint64_t)time.tv_nsec;
+#endif
+}
+
+void StartStatsRecorder(struct StatsRecorder* obj, struct PNGDecodeStats* stats) {
+  obj->stats = stats;
+  obj->previous = t_active_recorder;
+  obj->scratch_bytes = 0;
+  obj->live_bytes = 0;
+  if (stats)
+    t_active_recorder = obj;
+}
+
+void StopStatsRecorder(struct StatsRecorder* obj) {
+  if (!obj->stats)
+    return;
+  t_active_recorder = obj->previous;
+  obj->stats->live_bytes += obj->live_bytes;
+}
+
+/*
+ * @param scratch Buffer is freed before the call returns
+ */
+static void RecordAllocation(struct StatsRecorder* obj, size_t size, bool scratch) {
+  struct PNGDecodeStats* stats = obj->stats;
+  ++stats->allocations_count;
+  obj->live_bytes += size;
+  if (obj->live_bytes > stats->peak_bytes)
+    stats->peak_bytes = obj->live_bytes;
+  if (!scratch)
+    return;
+  obj->scratch_bytes += size;
+  if (obj->scratch_bytes > stats->peak_scratch_bytes)
+    stats->peak_scratch_bytes = obj->scratch_bytes;
+}
+
+void RecordOutputAllocation(struct StatsRecorder* obj, size_t size) {
+  if (obj->stats)
+    RecordAllocation(obj, size, false);
+}
+
+void* ScratchMalloc(size_t size) {
+  if (size > SIZE_MAX - PNG_SCRATCH_HEADER_SIZE)
+    return NULL;
+  uint8_t* block = malloc(size + PNG_SCRATCH_HEADER_SIZE);
+  if (!block)
+    return NULL;
+  struct ScratchHeader* header = (struct ScratchHeader*)block;
+  header->size = size;
+  header->recorder = t_active_recorder;
+  if (t_active_recorder)
+    RecordAllocation(t_active_recorder, size, true);
+  return block + PNG_SCRATCH_HEADER_SIZE;
+}
+
+void ScratchFree(void* ptr) {
+  if (!ptr)
+    return;
+  uint8_t* block = (uint8_t*)ptr - PNG_SCRATCH_HEADER_SIZE;
+  const struct ScratchHeader* header = (const struct ScratchHeader*)block;
+  /* Only the recorder that counted the buffer is credited, and only while it is still active in this thread */
+  for (struct StatsRecorder* recorder = t_active_recorder; recorder; recorder = recorder->previous) {
+    if (recorder == header->recorder) {
+      recorder->scratch_bytes -= header->size;
+      recorder->live_bytes -= header->size;
+      break;
+    }
+  }
+  free(block);
+}
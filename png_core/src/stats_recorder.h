@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "png_core/decode_stats.h"
+
+/*
+ * @return Nanoseconds of monotonic clock since unspecified point
+ */
+uint64_t GetMonotonicTimeNs(void);
+
+/*
+ * Fills caller stats during one call. Every function is a no-op if `stats` is NULL.
+ * Recorder with stats is active in calling thread between StartStatsRecorder and StopStatsRecorder,
+ * so scratch allocations of any module are counted without passing it around
+ */
+struct StatsRecorder {
+  struct PNGDecodeStats* stats;
+  /* Recorder that was active before this one */
+  struct StatsRecorder* previous;
+  /* Total size of scratch buffers alive now */
+  size_t scratch_bytes;
+  /* Total size of scratch and output buffers alive now */
+  size_t live_bytes;
+};
+
+void StartStatsRecorder(struct StatsRecorder* obj, struct PNGDecodeStats* stats);
+
+/*
+ * @brief Deactivate recorder and add bytes still alive to stats
+ */
+void StopStatsRecorder(struct StatsRecorder* obj);
+
+/*
+ * @return Start time of stage to pass to EndStage, 0 if disabled
+ */
+static inline uint64_t StartStage(const struct StatsRecorder* obj) {
+  return obj->stats ? GetMonotonicTimeNs() : 0;
+}
+
+/*
+ * @brief Add time since `start_ns` to stage
+ * @return Current time to start the next stage from, 0 if disabled
+ */
+static inline uint64_t AddStageTime(struct StatsRecorder* obj, enum PNGDecodeStage stage, uint64_t start_ns) {
+  if (!obj->stats)
+    return 0;
+  const uint64_t now = GetMonotonicTimeNs();
+  obj->stats->stages[stage].duration_ns += now - start_ns;
+  return now;
+}
+
+static inline void AddStageBytes(struct StatsRecorder* obj, enum PNGDecodeStage stage, uint64_t bytes_in,
+                                 uint64_t bytes_out) {
+  if (!obj->stats)
+    return;
+  obj->stats->stages[stage].bytes_in += bytes_in;
+  obj->stats->stages[stage].bytes_out += bytes_out;
+}
+
+static inline void EndStage(struct StatsRecorder* obj, enum PNGDecodeStage stage, uint64_t start_ns,
+                            uint64_t bytes_in, uint64_t bytes_out) {
+  AddStageTime(obj, stage, start_ns);
+  AddStageBytes(obj, stage, bytes_in, bytes_out);
+}
+
+/*
+ * @brief Count buffer returned to caller, which frees it with free()
+ */
+void RecordOutputAllocation(struct StatsRecorder* obj, size_t size);
+
+/*
+ * @brief Allocate buffer that never leaves the library. Counted by active recorder of calling thread
+ * @return Buffer to free with ScratchFree or NULL if allocation failed
+ */
+void* ScratchMalloc(size_t size);
+
+/*
+ * @brief Free buffer and uncount it from the recorder that counted it, if that one is still active
+ * @param[in] ptr Buffer from ScratchMalloc, nullable
+ */
+void ScratchFree(void* ptr);
@@ -0,0 +1,387 @@
+#include "png_core/stream_decoder.h"
+#include "png_core/filtering.h"
+
+#include <limits.h>
+#include <memory.h>
+#include <stdlib.h>
+#include <zlib.h>
+
+#include "decoding.h"
+#include "stats_recorder.h"
+#include "tools.h"
+
+enum StreamState {
+  STREAM_STATE_SIGNATURE,
+  /* Length and type */
+  STREAM_STATE_CHUNK_HEADER,
+  STREAM_STATE_CHUNK_DATA,
+  STREAM_STATE_CHUNK_CRC,
+  STREAM_STATE_END,
+  STREAM_STATE_ERROR,
+};
+
+struct PNGStreamDecoder {
+  struct PNGDecodeOptions options;
+  enum StreamState state;
+  /* Signature, chunk header or CRC gathered across pieces */
+  uint8_t field[8];
+  int field_size;
+  struct ChunkType chunk_type;
+  uint32_t chunk_remaining_size;
+  uLong crc;
+  uint32_t chunks_count;
+  int idat_chunks_count;
+
+  /* Signature and chunks before image data, loaded as chunk list when image data starts */
+  uint8_t* head;
+  size_t head_size;
+  size_t head_capacity;
+
+  /* Set up by the first IDAT chunk */
+  bool image_started;
+  struct PNGChunkData_IHDR header;
+  struct ImageConversion conversion;
+  struct PNGImage image;
+  z_stream stream;
+  bool stream_ended;
+  /* Current and previous filtered scanlines with filter type byte, defiltered in place. Both are in one buffer */
+  uint8_t* scanlines_buffer;
+  uint8_t* scanlines[2];
+  int scanline_size_bytes;
+  int pixel_size_bytes;
+  /* Bytes of current scanline inflated so far */
+  int scanline_filled;
+  int next_y;
+  uint64_t compressed_size;
+  uint64_t inflated_size;
+  uint8_t* row;
+};
+
+struct PNGStreamDecoder* PNGCreateStreamDecoder(const struct PNGDecodeOptions* options) {
+  struct PNGDecodeOptions default_options;
+  if (!options) {
+    PNGInitDecodeOptions(&default_options);
+    options = &default_options;
+  }
+  if (options->flip_vertically)
+    return NULL;
+
+  struct PNGStreamDecoder* obj = calloc(1, sizeof(struct PNGStreamDecoder));
+  if (!obj)
+    return NULL;
+  obj->options = *options;
+  obj->state = STREAM_STATE_SIGNATURE;
+  PNGInitImage(&obj->image);
+  return obj;
+}
+
+void PNGFreeStreamDecoder(struct PNGStreamDecoder* obj) {
+  if (!obj)
+    return;
+
+  free(obj->head);
+  if (obj->image_started) {
+    inflateEnd(&obj->stream);
+    FreeImageConversion(&obj->conversion);
+    free(obj->scanlines_buffer);
+    free(obj->row);
+  }
+  free(obj);
+}
+
+bool PNGGetStreamImageInfo(const struct PNGStreamDecoder* obj, struct PNGImage* out) {
+  if (!obj->image_started)
+    return false;
+  *out = obj->image;
+  return true;
+}
+
+/*
+ * @return false if chunks before image data exceed memory limit or allocation failed
+ */
+static bool ReserveHead(struct PNGStreamDecoder* obj, size_t size) {
+  const uint64_t max_size = obj->options.limits.max_chunk_memory_bytes;
+  if (size > INT_MAX || (max_size && size > max_size))
+    return false;
+  if (size <= obj->head_capacity)
+    return true;
+
+  size_t capacity = obj->head_capacity ? obj->head_capacity : 256;
+  while (capacity < size)
+    capacity *= 2;
+  if (capacity > INT_MAX)
+    capacity = INT_MAX;
+  uint8_t* head = realloc(obj->head, capacity);
+  if (!head)
+    return false;
+  obj->head = head;
+  obj->head_capacity = capacity;
+  return true;
+}
+
+static void AppendHead(struct PNGStreamDecoder* obj, const uint8_t* data, size_t size) {
+  memcpy(obj->head + obj->head_size, data, size);
+  obj->head_size += size;
+}
+
+/*
+ * @brief Load chunks before image data and set up conversion and inflation. Chunks buffer is freed
+ * @return false if image cannot be decoded, a limit is exceeded or allocation failed
+ */
+static bool StartImage(struct PNGStreamDecoder* obj, struct StatsRecorder* recorder) {
+  struct PNGChunkLoadOptions load_options;
+  PNGInitChunkLoadOptions(&load_options);
+  load_options.limits = obj->options.limits;
+  load_options.stats = obj->options.stats;
+  struct PNGRawChunk* chunk_list =
+      PNGLoadRawChunkListWithOptions(obj->head, (int)obj->head_size, true, &load_options);
+  free(obj->head);
+  obj->head = NULL;
+
+  const uint64_t setup_start = StartStage(recorder);
+
+  /* Inflate ratio is checked while image data arrives */
+  struct PNGDecodeOptions options = obj->options;
+  options.limits.max_inflate_ratio = 0;
+  const struct PNGChunkData_IHDR* header = chunk_list ? GetDecodableHeader(chunk_list) : NULL;
+  if (!header || !PrepareImageConversion(chunk_list, header, &options, &obj->conversion, &obj->image)) {
+    PNGFreeRawChunk(chunk_list);
+    return false;
+  }
+  obj->header = *header;
+  PNGFreeRawChunk(chunk_list);
+
+  obj->scanline_size_bytes = (int)PNGGetScanlineSizeBytes(&obj->header);
+  obj->pixel_size_bytes = GetFilterPixelSizeBytes(&obj->header);
+  obj->scanlines_buffer = malloc(2 * ((size_t)obj->scanline_size_bytes + 1));
+  obj->row = malloc(obj->image.row_stride);
+  if (!obj->scanlines_buffer || !obj->row || inflateInit(&obj->stream) != Z_OK) {
+    free(obj->scanlines_buffer);
+    free(obj->row);
+    FreeImageConversion(&obj->conversion);
+    return false;
+  }
+  /* Decoder buffers outlive the call, so they are counted as output */
+  RecordOutputAllocation(recorder, 2 * ((size_t)obj->scanline_size_bytes + 1));
+  RecordOutputAllocation(recorder, obj->image.row_stride);
+  obj->scanlines[0] = obj->scanlines_buffer;
+  obj->scanlines[1] = obj->scanlines_buffer + obj->scanline_size_bytes + 1;
+  obj->image_started = true;
+  AddStageTime(recorder, PNG_DECODE_STAGE_SETUP, setup_start);
+  return true;
+}
+
+enum InflateStep {
+  INFLATE_STEP_ERROR = -1,
+  /* Neither input is consumed nor output is produced */
+  INFLATE_STEP_NONE = 0,
+  INFLATE_STEP_PROGRESS = 1,
+  INFLATE_STEP_ROW = 2,
+};
+
+/*
+ * @brief Inflate IDAT data of current chunk from input into current scanline. Pending output of zlib is inflated
+ * with no input as well. When scanline is complete it is defiltered and converted into output row
+ */
+static enum InflateStep InflateScanline(struct PNGStreamDecoder* obj, struct StatsRecorder* recorder,
+                                        const uint8_t** data, size_t* size, struct PNGStreamRow* out) {
+  size_t input_size = *size < obj->chunk_remaining_size ? *size : obj->chunk_remaining_size;
+  if (input_size > UINT_MAX)
+    input_size = UINT_MAX;
+  const int scanline_total_size = obj->scanline_size_bytes + 1;
+  /* After the last row anything but the end of stream is excess data */
+  uint8_t excess;
+  const bool rows_left = obj->next_y < obj->header.height;
+  obj->stream.next_in = (Bytef*)*data;
+  obj->stream.avail_in = (uInt)input_size;
+  obj->stream.next_out = rows_left ? obj->scanlines[0] + obj->scanline_filled : &excess;
+  obj->stream.avail_out = rows_left ? (uInt)(scanline_total_size - obj->scanline_filled) : 1;
+  const uInt avail_out = obj->stream.avail_out;
+
+  uint64_t time = StartStage(recorder);
+  const int ret = inflate(&obj->stream, Z_NO_FLUSH);
+  const size_t consumed = input_size - obj->stream.avail_in;
+  const int produced = (int)(avail_out - obj->stream.avail_out);
+  time = AddStageTime(recorder, PNG_DECODE_STAGE_INFLATE, time);
+  AddStageBytes(recorder, PNG_DECODE_STAGE_INFLATE, consumed, produced);
+  if (consumed)
+    obj->crc = crc32(obj->crc, *data, (uInt)consumed);
+  *data += consumed;
+  *size -= consumed;
+  obj->chunk_remaining_size -= (uint32_t)consumed;
+  obj->compressed_size += consumed;
+  obj->inflated_size += produced;
+
+  if (ret == Z_STREAM_END)
+    obj->stream_ended = true;
+  else if (ret != Z_OK && ret != Z_BUF_ERROR)
+    return INFLATE_STEP_ERROR;
+  if (!rows_left && produced)
+    return INFLATE_STEP_ERROR;
+  const uint32_t max_ratio = obj->options.limits.max_inflate_ratio;
+  if (max_ratio && obj->inflated_size > obj->compressed_size * max_ratio)
+    return INFLATE_STEP_ERROR;
+
+  obj->scanline_filled += produced;
+  if (rows_left && obj->scanline_filled == scanline_total_size) {
+    uint8_t* scanline = obj->scanlines[0];
+    const uint8_t* previous = obj->next_y ? obj->scanlines[1] + 1 : NULL;
+    if (!PNGDefilterScanline0(scanline[0], scanline + 1, previous, scanline + 1, obj->scanline_size_bytes,
+                              obj->pixel_size_bytes))
+      return INFLATE_STEP_ERROR;
+    time = AddStageTime(recorder, PNG_DECODE_STAGE_DEFILTER, time);
+    AddStageBytes(recorder, PNG_DECODE_STAGE_DEFILTER, scanline_total_size, obj->scanline_size_bytes);
+    ConvertRow(&obj->conversion.converter, scanline + 1, obj->row);
+    EndStage(recorder, PNG_DECODE_STAGE_CONVERT, time, obj->scanline_size_bytes, obj->image.row_stride);
+    obj->scanlines[0] = obj->scanlines[1];
+    obj->scanlines[1] = scanline;
+    obj->scanline_filled = 0;
+    out->y = obj->next_y++;
+    out->data = obj->row;
+    out->size = obj->image.row_stride;
+    return INFLATE_STEP_ROW;
+  }
+  /* Stream ended before the last row */
+  if (obj->stream_ended && obj->next_y < obj->header.height)
+    return INFLATE_STEP_ERROR;
+  return consumed || produced ? INFLATE_STEP_PROGRESS : INFLATE_STEP_NONE;
+}
+
+/*
+ * @brief Gather field of `field_size` bytes across pieces
+ * @return true if field is complete
+ */
+static bool GatherField(struct PNGStreamDecoder* obj, int field_size, const uint8_t** data, size_t* size) {
+  size_t copy_size = (size_t)(field_size - obj->field_size);
+  if (copy_size > *size)
+    copy_size = *size;
+  memcpy(obj->field + obj->field_size, *data, copy_size);
+  obj->field_size += (int)copy_size;
+  *data += copy_size;
+  *size -= copy_size;
+  if (obj->field_size < field_size)
+    return false;
+  obj->field_size = 0;
+  return true;
+}
+
+/*
+ * @return Next state after chunk header
+ */
+static enum StreamState ReadChunkHeader(struct PNGStreamDecoder* obj, struct StatsRecorder* recorder) {
+  const uint8_t* field = obj->field;
+  const uint32_t length = ReadNetworkAndAdvanceUInt32(&field, true);
+  ReadNetworkAndAdvanceBytesInPlace(&field, obj->chunk_type.byte_array, sizeof(obj->chunk_type.byte_array));
+  const uint32_t max_chunks_count = obj->options.limits.max_chunks_count;
+  ++obj->chunks_count;
+  if (length > (uint32_t)s_png_max_chunk_data_size_bytes || (max_chunks_count && obj->chunks_count > max_chunks_count))
+    return STREAM_STATE_ERROR;
+
+  const bool idat = obj->chunk_type.bytes == CHUNK_IDAT.bytes;
+  obj->idat_chunks_count += idat;
+  if (recorder->stats) {
+    recorder->stats->chunks_count = (int)obj->chunks_count;
+    recorder->stats->idat_chunks_count = obj->idat_chunks_count;
+  }
+  if (!obj->image_started) {
+    if (idat) {
+      if (!StartImage(obj, recorder))
+        return STREAM_STATE_ERROR;
+    } else {
+      if (obj->chunk_type.bytes == CHUNK_IEND.bytes || !ReserveHead(obj, obj->head_size + 12 + length))
+        return STREAM_STATE_ERROR;
+      AppendHead(obj, obj->field, 8);
+    }
+  }
+  obj->chunk_remaining_size = length;
+  obj->crc = crc32(crc32(0L, Z_NULL, 0), obj->chunk_type.byte_array, sizeof(obj->chunk_type.byte_array));
+  return STREAM_STATE_CHUNK_DATA;
+}
+
+/*
+ * @return Next state after chunk CRC
+ */
+static enum StreamState ReadChunkCRC(struct PNGStreamDecoder* obj) {
+  const uint8_t* field = obj->field;
+  if (ReadNetworkAndAdvanceUInt32(&field, true) != (uint32_t)obj->crc)
+    return STREAM_STATE_ERROR;
+  if (!obj->image_started) {
+    AppendHead(obj, obj->field, 4);
+    return STREAM_STATE_CHUNK_HEADER;
+  }
+  if (obj->chunk_type.bytes == CHUNK_IEND.bytes)
+    return obj->stream_ended && obj->next_y == obj->header.height ? STREAM_STATE_END : STREAM_STATE_ERROR;
+  return STREAM_STATE_CHUNK_HEADER;
+}
+
+enum PNGStreamStatus PNGStreamDecode(struct PNGStreamDecoder* obj, const uint8_t* data, size_t size,
+                                     size_t* consumed, struct PNGStreamRow* out) {
+  const uint8_t* const data_begin = data;
+  struct StatsRecorder recorder;
+  StartStatsRecorder(&recorder, obj->options.stats);
+  enum PNGStreamStatus status = PNG_STREAM_NEED_INPUT;
+  while (status == PNG_STREAM_NEED_INPUT) {
+    if (obj->state == STREAM_STATE_END) {
+      status = PNG_STREAM_END;
+      break;
+    }
+    if (obj->state == STREAM_STATE_ERROR) {
+      status = PNG_STREAM_ERROR;
+      break;
+    }
+
+    if (obj->state == STREAM_STATE_CHUNK_DATA) {
+      if (obj->image_started && obj->chunk_type.bytes == CHUNK_IDAT.bytes && !obj->stream_ended) {
+        const enum InflateStep step = InflateScanline(obj, &recorder, &data, &size, out);
+        if (step == INFLATE_STEP_ERROR)
+          obj->state = STREAM_STATE_ERROR;
+        else if (step == INFLATE_STEP_ROW)
+          status = PNG_STREAM_ROW;
+        else if (step == INFLATE_STEP_NONE && obj->chunk_remaining_size)
+          break;
+        else if (step == INFLATE_STEP_NONE)
+          obj->state = STREAM_STATE_CHUNK_CRC;
+        continue;
+      }
+      /* Chunks before image data are buffered, the ones after it and IDAT data after end of stream are skipped */
+      if (obj->chunk_remaining_size && !size)
+        break;
+      const size_t part_size = size < obj->chunk_remaining_size ? size : obj->chunk_remaining_size;
+      if (part_size) {
+        obj->crc = crc32(obj->crc, data, (uInt)part_size);
+        if (!obj->image_started)
+          AppendHead(obj, data, part_size);
+        data += part_size;
+        size -= part_size;
+        obj->chunk_remaining_size -= (uint32_t)part_size;
+      }
+      if (obj->chunk_remaining_size)
+        break;
+      obj->state = STREAM_STATE_CHUNK_CRC;
+      continue;
+    }
+
+    if (!size)
+      break;
+    if (obj->state == STREAM_STATE_SIGNATURE) {
+      if (GatherField(obj, sizeof(s_png_signature), &data, &size)) {
+        if (memcmp(obj->field, s_png_signature, sizeof(s_png_signature)) != 0 ||
+            !ReserveHead(obj, sizeof(s_png_signature))) {
+          obj->state = STREAM_STATE_ERROR;
+        } else {
+          AppendHead(obj, obj->field, sizeof(s_png_signature));
+          obj->state = STREAM_STATE_CHUNK_HEADER;
+        }
+      }
+    } else if (obj->state == STREAM_STATE_CHUNK_HEADER) {
+      if (GatherField(obj, 8, &data, &size))
+        obj->state = ReadChunkHeader(obj, &recorder);
+    } else if (GatherField(obj, 4, &data, &size)) {
+      obj->state = ReadChunkCRC(obj);
+    }
+  }
+
+  StopStatsRecorder(&recorder);
+  *consumed = (size_t)(data - data_begin);
+  return status;
+}
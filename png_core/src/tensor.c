@@ -0,0 +1,319 @@
+#include "tensor.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#define PNG_TENSOR_SSE2 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#define PNG_TENSOR_NEON 1
+#include <arm_neon.h>
+#endif
+
+#include "stats_recorder.h"
+
+/*
+ * Scalar kernels. Also used for tails of SIMD kernels
+ */
+
+static void ToFloat8Scalar(const uint8_t* row, int stride, int channel, float multiplier, float offset, float* dst,
+                           int count) {
+  for (int i = 0; i < count; ++i)
+    dst[i] = (float)row[i * stride + channel] * multiplier + offset;
+}
+
+static void ToFloat16Scalar(const uint8_t* row, int stride, int channel, float multiplier, float offset, float* dst,
+                            int count) {
+  const uint16_t* samples = (const uint16_t*)row;
+  for (int i = 0; i < count; ++i)
+    dst[i] = (float)samples[i * stride + channel] * multiplier + offset;
+}
+
+static uint32_t FloatBits(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+/* Round to nearest even, overflow goes to infinity */
+static uint16_t FloatToHalf(float value) {
+  const uint32_t bits = FloatBits(value);
+  const uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+  const uint32_t magnitude = bits & 0x7FFFFFFF;
+  /* Infinity and NaN */
+  if (magnitude >= 0x7F800000)
+    return sign | 0x7C00 | (magnitude > 0x7F800000 ? 0x200 : 0);
+  /* 65520 and above round to infinity */
+  if (magnitude >= 0x477FF000)
+    return sign | 0x7C00;
+  /* Half of the smallest subnormal and below round to zero */
+  if (magnitude <= 0x33000000)
+    return sign;
+
+  uint32_t half;
+  uint32_t remainder;
+  uint32_t halfway;
+  if (magnitude < 0x38800000) {
+    /* Subnormal: mantissa * 2^-24 */
+    const uint32_t mantissa = (magnitude & 0x7FFFFF) | 0x800000;
+    const int shift = 126 - (int)(magnitude >> 23);
+    half = mantissa >> shift;
+    remainder = mantissa & ((1u << shift) - 1);
+    halfway = 1u << (shift - 1);
+  } else {
+    /* Rebias exponent from 127 to 15, carry of rounding goes into exponent */
+    half = (magnitude - 0x38000000) >> 13;
+    remainder = magnitude & 0x1FFF;
+    halfway = 0x1000;
+  }
+  if (remainder > halfway || (remainder == halfway && (half & 1)))
+    ++half;
+  return sign | (uint16_t)half;
+}
+
+static uint16_t FloatToBFloat16(float value) {
+  const uint32_t bits = FloatBits(value);
+  /* Keep NaN quiet instead of rounding it into infinity */
+  if ((bits & 0x7FFFFFFF) > 0x7F800000)
+    return (uint16_t)((bits >> 16) | 0x40);
+  return (uint16_t)((bits + 0x7FFF + ((bits >> 16) & 1)) >> 16);
+}
+
+static void StoreHalfScalar(const float* src, uint16_t* dst, int count) {
+  for (int i = 0; i < count; ++i)
+    dst[i] = FloatToHalf(src[i]);
+}
+
+static void StoreBFloat16Scalar(const float* src, uint16_t* dst, int count) {
+  for (int i = 0; i < count; ++i)
+    dst[i] = FloatToBFloat16(src[i]);
+}
+
+#ifdef PNG_TENSOR_SSE2
+
+static inline __m128 Normalize(__m128i samples, __m128 multiplier, __m128 offset) {
+  return _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(samples), multiplier), offset);
+}
+
+static void ToFloat8SSE2(const uint8_t* row, int stride, int channel, float multiplier, float offset, float* dst,
+                         int count) {
+  const __m128 multipliers = _mm_set1_ps(multiplier);
+  const __m128 offsets = _mm_set1_ps(offset);
+  const __m128i zero = _mm_setzero_si128();
+  int i = 0;
+  if (stride == 4) {
+    /* Channel of 4 RGBA pixels is one byte of each 32-bit lane */
+    const __m128i mask = _mm_set1_epi32(0xFF);
+    for (; i + 4 <= count; i += 4) {
+      const __m128i pixels = _mm_loadu_si128((const __m128i*)(row + 4 * i));
+      const __m128i samples = _mm_and_si128(_mm_srli_epi32(pixels, 8 * channel), mask);
+      _mm_storeu_ps(dst + i, Normalize(samples, multipliers, offsets));
+    }
+  } else {
+    for (; i + 16 <= count; i += 16) {
+      const __m128i bytes = _mm_loadu_si128((const __m128i*)(row + i));
+      const __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+      const __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+      _mm_storeu_ps(dst + i, Normalize(_mm_unpacklo_epi16(lo, zero), multipliers, offsets));
+      _mm_storeu_ps(dst + i + 4, Normalize(_mm_unpackhi_epi16(lo, zero), multipliers, offsets));
+      _mm_storeu_ps(dst + i + 8, Normalize(_mm_unpacklo_epi16(hi, zero), multipliers, offsets));
+      _mm_storeu_ps(dst + i + 12, Normalize(_mm_unpackhi_epi16(hi, zero), multipliers, offsets));
+    }
+  }
+  ToFloat8Scalar(row + (size_t)i * stride, stride, channel, multiplier, offset, dst + i, count - i);
+}
+
+static void ToFloat16SSE2(const uint8_t* row, int stride, int channel, float multiplier, float offset, float* dst,
+                          int count) {
+  const __m128 multipliers = _mm_set1_ps(multiplier);
+  const __m128 offsets = _mm_set1_ps(offset);
+  const __m128i zero = _mm_setzero_si128();
+  int i = 0;
+  if (stride == 4) {
+    /* Channel of 2 RGBA16 pixels is one 16-bit part of each 64-bit lane */
+    const __m128i mask = _mm_set1_epi64x(0xFFFF);
+    for (; i + 4 <= count; i += 4) {
+      const __m128i first = _mm_loadu_si128((const __m128i*)(row + 8 * i));
+      const __m128i second = _mm_loadu_si128((const __m128i*)(row + 8 * i + 16));
+      const __m128i first_samples = _mm_and_si128(_mm_srli_epi64(first, 16 * channel), mask);
+      const __m128i second_samples = _mm_and_si128(_mm_srli_epi64(second, 16 * channel), mask);
+      const __m128i samples = _mm_unpacklo_epi64(_mm_shuffle_epi32(first_samples, _MM_SHUFFLE(2, 0, 2, 0)),
+                                                 _mm_shuffle_epi32(second_samples, _MM_SHUFFLE(2, 0, 2, 0)));
+      _mm_storeu_ps(dst + i, Normalize(samples, multipliers, offsets));
+    }
+  } else {
+    for (; i + 8 <= count; i += 8) {
+      const __m128i samples = _mm_loadu_si128((const __m128i*)(row + 2 * i));
+      _mm_storeu_ps(dst + i, Normalize(_mm_unpacklo_epi16(samples, zero), multipliers, offsets));
+      _mm_storeu_ps(dst + i + 4, Normalize(_mm_unpackhi_epi16(samples, zero), multipliers, offsets));
+    }
+  }
+  ToFloat16Scalar(row + (size_t)i * stride * 2, stride, channel, multiplier, offset, dst + i, count - i);
+}
+
+/* Upper halves are sign-extended, so signed packing keeps their bits */
+static void StoreBFloat16SSE2(const float* src, uint16_t* dst, int count) {
+  const __m128i bias = _mm_set1_epi32(0x7FFF);
+  const __m128i one = _mm_set1_epi32(1);
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    /* Blocks with NaN go through scalar path */
+    const __m128 first = _mm_loadu_ps(src + i);
+    const __m128 second = _mm_loadu_ps(src + i + 4);
+    if (_mm_movemask_ps(_mm_or_ps(_mm_cmpunord_ps(first, first), _mm_cmpunord_ps(second, second))) != 0) {
+      StoreBFloat16Scalar(src + i, dst + i, 8);
+      continue;
+    }
+    const __m128 blocks[2] = {first, second};
+    __m128i halves[2];
+    for (int h = 0; h < 2; ++h) {
+      const __m128i bits = _mm_castps_si128(blocks[h]);
+      const __m128i odd = _mm_and_si128(_mm_srli_epi32(bits, 16), one);
+      halves[h] = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(bits, bias), odd), 16);
+    }
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_packs_epi32(halves[0], halves[1]));
+  }
+  StoreBFloat16Scalar(src + i, dst + i, count - i);
+}
+
+__attribute__((target("f16c"))) static void StoreHalfF16C(const float* src, uint16_t* dst, int count) {
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m128i lo = _mm_cvtps_ph(_mm_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+    const __m128i hi = _mm_cvtps_ph(_mm_loadu_ps(src + i + 4), _MM_FROUND_TO_NEAREST_INT);
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi64(lo, hi));
+  }
+  StoreHalfScalar(src + i, dst + i, count - i);
+}
+
+static bool HasF16C(void) {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("f16c");
+}
+
+#endif  // PNG_TENSOR_SSE2
+
+#ifdef PNG_TENSOR_NEON
+
+static void ToFloat8NEON(const uint8_t* row, int stride, int channel, float multiplier, float offset, float* dst,
+                         int count) {
+  const float32x4_t multipliers = vdupq_n_f32(multiplier);
+  const float32x4_t offsets = vdupq_n_f32(offset);
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const uint8x8_t bytes = stride == 4 ? vld4_u8(row + 4 * i).val[channel] : vld1_u8(row + i);
+    const uint16x8_t samples = vmovl_u8(bytes);
+    const float32x4_t lo = vcvtq_f32_u32(vmovl_u16(vget_low_u16(samples)));
+    const float32x4_t hi = vcvtq_f32_u32(vmovl_u16(vget_high_u16(samples)));
+    vst1q_f32(dst + i, vaddq_f32(vmulq_f32(lo, multipliers), offsets));
+    vst1q_f32(dst + i + 4, vaddq_f32(vmulq_f32(hi, multipliers), offsets));
+  }
+  ToFloat8Scalar(row + (size_t)i * stride, stride, channel, multiplier, offset, dst + i, count - i);
+}
+
+static void ToFloat16NEON(const uint8_t* row, int stride, int channel, float multiplier, float offset, float* dst,
+                          int count) {
+  const float32x4_t multipliers = vdupq_n_f32(multiplier);
+  const float32x4_t offsets = vdupq_n_f32(offset);
+  const uint16_t* samples = (const uint16_t*)row;
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const uint16x4_t values = stride == 4 ? vld4_u16(samples + 4 * i).val[channel] : vld1_u16(samples + i);
+    const float32x4_t floats = vcvtq_f32_u32(vmovl_u16(values));
+    vst1q_f32(dst + i, vaddq_f32(vmulq_f32(floats, multipliers), offsets));
+  }
+  ToFloat16Scalar(row + (size_t)i * stride * 2, stride, channel, multiplier, offset, dst + i, count - i);
+}
+
+#ifdef __aarch64__
+static void StoreHalfNEON(const float* src, uint16_t* dst, int count) {
+  int i = 0;
+  for (; i + 4 <= count; i += 4)
+    vst1_u16(dst + i, vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(src + i))));
+  StoreHalfScalar(src + i, dst + i, count - i);
+}
+#endif
+
+#endif  // PNG_TENSOR_NEON
+
+bool InitTensorWriter(struct TensorWriter* obj, enum PNGTensorType type, int width, int height, int channels,
+                      int bit_depth, const float* scale, const float* offset) {
+  assert(obj);
+  assert(scale && offset);
+
+  memset(obj, 0, sizeof(struct TensorWriter));
+  if (channels != 1 && channels != 3 && channels != 4)
+    return false;
+  if ((bit_depth != 8 && bit_depth != 16) || PNGGetTensorTypeSizeBytes(type) == 0)
+    return false;
+
+  obj->type = type;
+  obj->width = width;
+  obj->channels = channels;
+  obj->stride = channels == 1 ? 1 : 4;
+  obj->plane_size = (size_t)width * height;
+  /* Samples are normalized to [0, 1] by the same multiplication */
+  const float max = (float)((1 << bit_depth) - 1);
+  for (int c = 0; c < channels; ++c) {
+    obj->multipliers[c] = scale[c] / max;
+    obj->offsets[c] = offset[c];
+  }
+
+#if defined(PNG_TENSOR_SSE2)
+  obj->to_float = bit_depth == 16 ? ToFloat16SSE2 : ToFloat8SSE2;
+  if (type == PNG_TENSOR_TYPE_FLOAT16)
+    obj->store = HasF16C() ? StoreHalfF16C : StoreHalfScalar;
+  else if (type == PNG_TENSOR_TYPE_BFLOAT16)
+    obj->store = StoreBFloat16SSE2;
+#elif defined(PNG_TENSOR_NEON)
+  obj->to_float = bit_depth == 16 ? ToFloat16NEON : ToFloat8NEON;
+#ifdef __aarch64__
+  const TensorStoreKernel store_half = StoreHalfNEON;
+#else
+  const TensorStoreKernel store_half = StoreHalfScalar;
+#endif
+  if (type == PNG_TENSOR_TYPE_FLOAT16)
+    obj->store = store_half;
+  else if (type == PNG_TENSOR_TYPE_BFLOAT16)
+    obj->store = StoreBFloat16Scalar;
+#else
+  obj->to_float = bit_depth == 16 ? ToFloat16Scalar : ToFloat8Scalar;
+  if (type == PNG_TENSOR_TYPE_FLOAT16)
+    obj->store = StoreHalfScalar;
+  else if (type == PNG_TENSOR_TYPE_BFLOAT16)
+    obj->store = StoreBFloat16Scalar;
+#endif
+
+  if (obj->store) {
+    obj->scratch = ScratchMalloc((size_t)width * sizeof(float));
+    if (!obj->scratch)
+      return false;
+  }
+  return true;
+}
+
+void FreeTensorWriter(struct TensorWriter* obj) {
+  if (!obj)
+    return;
+
+  ScratchFree(obj->scratch);
+  obj->scratch = NULL;
+}
+
+void WriteTensorRow(const struct TensorWriter* obj, const uint8_t* row, int y, void* tensor) {
+  assert(obj);
+
+  const size_t row_offset = (size_t)y * obj->width;
+  for (int c = 0; c < obj->channels; ++c) {
+    const size_t plane_offset = c * obj->plane_size + row_offset;
+    if (!obj->store) {
+      obj->to_float(row, obj->stride, c, obj->multipliers[c], obj->offsets[c], (float*)tensor + plane_offset,
+                    obj->width);
+    } else {
+      obj->to_float(row, obj->stride, c, obj->multipliers[c], obj->offsets[c], obj->scratch, obj->width);
+      obj->store(obj->scratch, (uint16_t*)tensor + plane_offset, obj->width);
+    }
+  }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "png_core/pixel_format.h"
+
+/*
+ * One channel of interleaved row to normalized floats: sample * multiplier + offset
+ * @param stride Samples per pixel, 1 or 4
+ */
+typedef void (*TensorPlaneKernel)(const uint8_t* row, int stride, int channel, float multiplier, float offset,
+                                  float* dst, int count);
+
+/*
+ * Floats to 16-bit tensor elements
+ */
+typedef void (*TensorStoreKernel)(const float* src, uint16_t* dst, int count);
+
+/*
+ * Writes converted rows into planes of a tensor.
+ * Rows are G or RGBA pixels of 8-bit or native 16-bit samples, as produced by RowConverter
+ */
+struct TensorWriter {
+  enum PNGTensorType type;
+  int width;
+  int channels;
+  /* Samples per pixel of converted rows */
+  int stride;
+  /* Elements in one plane */
+  size_t plane_size;
+
+  float multipliers[4];
+  float offsets[4];
+
+  TensorPlaneKernel to_float;
+  /* NULL for PNG_TENSOR_TYPE_FLOAT32, whose planes are written directly */
+  TensorStoreKernel store;
+  /* Normalized channel of one row for 16-bit types */
+  float* scratch;
+};
+
+/*
+ * @brief Prepare writer for tensor rows
+ * @param channels 1, 3 or 4. Converted rows hold G samples for 1 channel and RGBA samples otherwise
+ * @param bit_depth Sample bit depth of converted rows, 8 or 16
+ * @param[in] scale, offset Per-channel normalization of samples in [0, 1] range
+ * @return false if parameters are not supported or allocation failed
+ */
+bool InitTensorWriter(struct TensorWriter* obj, enum PNGTensorType type, int width, int height, int channels,
+                      int bit_depth, const float* scale, const float* offset);
+
+void FreeTensorWriter(struct TensorWriter* obj);
+
+/*
+ * @brief Normalize converted row `y` into all planes of `tensor`
+ */
+void WriteTensorRow(const struct TensorWriter* obj, const uint8_t* row, int y, void* tensor);
@@ -0,0 +1,87 @@
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "thread_pool.h"
+
+#include <stdlib.h>
+
+/* pthreads instead of C11 threads: sanitizers do not intercept thrd_create of glibc */
+#ifdef _WIN32
+#include <windows.h>
+typedef HANDLE WorkerThread;
+#else
+#include <pthread.h>
+#include <unistd.h>
+typedef pthread_t WorkerThread;
+#endif
+
+int GetOnlineCPUCount(void) {
+#ifdef _WIN32
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  const long count = info.dwNumberOfProcessors;
+#else
+  const long count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  return count > 0 ? (int)count : 1;
+}
+
+struct WorkerStart {
+  ParallelTask task;
+  void* context;
+  int worker_index;
+};
+
+#ifdef _WIN32
+static DWORD WINAPI RunWorker(LPVOID arg) {
+#else
+static void* RunWorker(void* arg) {
+#endif
+  const struct WorkerStart* start = arg;
+  start->task(start->context, start->worker_index);
+  return 0;
+}
+
+static bool StartWorkerThread(WorkerThread* thread, struct WorkerStart* start) {
+#ifdef _WIN32
+  *thread = CreateThread(NULL, 0, RunWorker, start, 0, NULL);
+  return *thread != NULL;
+#else
+  return pthread_create(thread, NULL, RunWorker, start) == 0;
+#endif
+}
+
+static void JoinWorkerThread(WorkerThread thread) {
+#ifdef _WIN32
+  WaitForSingleObject(thread, INFINITE);
+  CloseHandle(thread);
+#else
+  pthread_join(thread, NULL);
+#endif
+}
+
+int RunParallel(ParallelTask task, void* context, int workers_count) {
+  if (workers_count <= 0)
+    workers_count = GetOnlineCPUCount();
+
+  /* Threads are started for workers 1.., worker 0 runs on calling thread */
+  WorkerThread* threads = workers_count > 1 ? malloc(sizeof(WorkerThread) * (workers_count - 1)) : NULL;
+  struct WorkerStart* starts = workers_count > 1 ? malloc(sizeof(struct WorkerStart) * (workers_count - 1)) : NULL;
+  int threads_count = 0;
+  if (threads && starts) {
+    for (int i = 0; i < workers_count - 1; ++i) {
+      starts[threads_count] = (struct WorkerStart){task, context, threads_count + 1};
+      if (!StartWorkerThread(&threads[threads_count], &starts[threads_count]))
+        break;
+      ++threads_count;
+    }
+  }
+
+  task(context, 0);
+  for (int i = 0; i < threads_count; ++i)
+    JoinWorkerThread(threads[i]);
+  free(threads);
+  free(starts);
+  return threads_count + 1;
+}
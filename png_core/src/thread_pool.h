@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdbool.h>
+
+/*
+ * @return Amount of online CPUs, at least 1
+ */
+int GetOnlineCPUCount(void);
+
+/*
+ * Function run by every worker. Workers share work through `context`, e.g. take items by atomic counter
+ * @param worker_index Index from 0 to workers count - 1. Worker 0 runs on calling thread
+ */
+typedef void (*ParallelTask)(void* context, int worker_index);
+
+/*
+ * @brief Run task on `workers_count` workers and wait until all of them return.
+ * Threads are started by every call and joined before it returns, no threads are kept between calls.
+ * Callers run it once per batch of work, so thread startup is paid once per batch and not per item.
+ * Workers which threads failed to start are not run, so task must not rely on every worker running
+ * @param workers_count Requested amount of workers, 0 for one per online CPU
+ * @return Amount of workers that ran the task, at least 1
+ */
+int RunParallel(ParallelTask task, void* context, int workers_count);
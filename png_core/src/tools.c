@@ -17,18 +17,53 @@ void FlipBytesInBuffer(void* buffer, int buffer_size) {
   }
 }
 
+/*
+ * Flip bytes of a single value. Constant sizes compile into a single byte swap instruction
+ */
+static inline void FlipValueBytes(void* value, int size) {
+#ifdef __GNUC__
+  switch (size) {
+    case 1: return;
+    case 2: {
+      uint16_t v;
+      memcpy(&v, value, sizeof(v));
+      v = __builtin_bswap16(v);
+      memcpy(value, &v, sizeof(v));
+      return;
+    }
+    case 4: {
+      uint32_t v;
+      memcpy(&v, value, sizeof(v));
+      v = __builtin_bswap32(v);
+      memcpy(value, &v, sizeof(v));
+      return;
+    }
+    case 8: {
+      uint64_t v;
+      memcpy(&v, value, sizeof(v));
+      v = __builtin_bswap64(v);
+      memcpy(value, &v, sizeof(v));
+      return;
+    }
+    default: break;
+  }
+#endif
+  FlipBytesInBuffer(value, size);
+}
+
 #define PNG_IMPLEMENT_READ_WRITE_NETWORK_AND_ADVANCE(type, name)                      \
   type ReadNetworkAndAdvance##name(const uint8_t** ptr_to_buffer_ptr, bool advance) { \
-    type res = *(const type*)(*ptr_to_buffer_ptr);                                    \
+    type res;                                                                         \
+    memcpy(&res, *ptr_to_buffer_ptr, sizeof(type));                                   \
     if (PNG_IS_LITTLE_ENDIAN)                                                         \
-      FlipBytesInBuffer(&res, sizeof(type));                                          \
+      FlipValueBytes(&res, sizeof(type));                                             \
     if (advance)                                                                      \
       *ptr_to_buffer_ptr += sizeof(type);                                             \
     return res;                                                                       \
   }                                                                                   \
   void WriteNetworkAndAdvance##name(uint8_t** buffer, type value) {                   \
     if (PNG_IS_LITTLE_ENDIAN)                                                         \
-      FlipBytesInBuffer(&value, sizeof(type));                                        \
+      FlipValueBytes(&value, sizeof(type));                                           \
     memcpy(*buffer, &value, sizeof(type));                                            \
     *buffer += sizeof(type);                                                          \
   }
@@ -21,6 +21,16 @@
 
 #endif  // PNG_IS_LITTLE_ENDIAN
 
+/**
+ * Product of non-negative sizes
+ * @return a * b or -1 if either is negative or product does not fit int64_t
+ */
+static inline int64_t MultiplySizes(int64_t a, int64_t b) {
+  if (a < 0 || b < 0 || (b && a > INT64_MAX / b))
+    return -1;
+  return a * b;
+}
+
 /**
  * Flip bytes in buffer
  */
@@ -0,0 +1,406 @@
+#include <array>
+
+#include <png_core/animation.h>
+#include <png_core/chunk_types.h>
+#include <png_core/decoder.h>
+
+#include "../test_utils.h"
+
+class AnimationTestSuite : public ::testing::Test {
+protected:
+  /// Frame of generated APNG, pixels are plain scanlines of the frame region
+  struct Frame {
+    uint32_t x_offset = 0;
+    uint32_t y_offset = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint8_t dispose_op = PNG_DISPOSE_OP_NONE;
+    uint8_t blend_op = PNG_BLEND_OP_SOURCE;
+    uint16_t delay_num = 0;
+    uint16_t delay_den = 0;
+    std::vector<uint8_t> pixels;
+    /// Zlib stream is split into this many data chunks
+    int chunks_count = 1;
+  };
+
+  static std::vector<uint8_t> CreateControl(uint32_t sequence_number, const Frame& frame) {
+    test_utils::VectorWrapper<uint8_t> data;
+    data.AppendBytes(sequence_number, true);
+    data.AppendBytes(frame.width, true).AppendBytes(frame.height, true);
+    data.AppendBytes(frame.x_offset, true).AppendBytes(frame.y_offset, true);
+    data.AppendBytes(frame.delay_num, true).AppendBytes(frame.delay_den, true);
+    data.push_back(frame.dispose_op);
+    data.push_back(frame.blend_op);
+    return data;
+  }
+
+  /**
+   * Build APNG datastream of 8-bit samples. The first frame is the default image if `default_image` is empty,
+   * otherwise the default image is not part of animation
+   */
+  static std::vector<uint8_t> CreateAPNG(int width, int height, int color_type, const std::vector<Frame>& frames,
+                                         const std::vector<uint8_t>& default_image = {},
+                                         const std::vector<std::pair<ChunkType, std::vector<uint8_t>>>& extra = {}) {
+    test_utils::VectorWrapper<uint8_t> stream;
+    stream.Append(std::vector<uint8_t>(std::begin(s_png_signature), std::end(s_png_signature)));
+    test_utils::VectorWrapper<uint8_t> header;
+    header.AppendBytes((uint32_t)width, true).AppendBytes((uint32_t)height, true);
+    header.Append(std::vector<uint8_t>{8, (uint8_t)color_type, 0, 0, 0});
+    test_utils::AppendChunk(stream, CHUNK_IHDR, header);
+    test_utils::VectorWrapper<uint8_t> animation;
+    animation.AppendBytes((uint32_t)frames.size(), true).AppendBytes((uint32_t)0, true);
+    test_utils::AppendChunk(stream, CHUNK_acTL, animation);
+    for (const auto& [type, data] : extra)
+      test_utils::AppendChunk(stream, type, data);
+
+    if (!default_image.empty()) {
+      const auto filtered = test_utils::AddFilterBytes(default_image, default_image.size() / height);
+      test_utils::AppendChunk(stream, CHUNK_IDAT, test_utils::ZlibStore(filtered));
+    }
+    uint32_t sequence_number = 0;
+    for (size_t i = 0; i < frames.size(); ++i) {
+      const Frame& frame = frames[i];
+      test_utils::AppendChunk(stream, CHUNK_fcTL, CreateControl(sequence_number++, frame));
+      const auto compressed =
+          test_utils::ZlibStore(test_utils::AddFilterBytes(frame.pixels, frame.pixels.size() / frame.height));
+      const size_t part_size = (compressed.size() + frame.chunks_count - 1) / frame.chunks_count;
+      for (size_t offset = 0; offset < compressed.size(); offset += part_size) {
+        const std::vector<uint8_t> part(compressed.begin() + offset,
+                                        compressed.begin() + std::min(offset + part_size, compressed.size()));
+        if (i == 0 && default_image.empty()) {
+          test_utils::AppendChunk(stream, CHUNK_IDAT, part);
+        } else {
+          test_utils::VectorWrapper<uint8_t> data;
+          data.AppendBytes(sequence_number++, true);
+          data.Append(part);
+          test_utils::AppendChunk(stream, CHUNK_fdAT, data);
+        }
+      }
+    }
+    test_utils::AppendChunk(stream, CHUNK_IEND, {});
+    return stream;
+  }
+
+  static PNGRawChunk* Load(const std::vector<uint8_t>& png) {
+    PNGRawChunk* chunk_list = PNGLoadRawChunkList(png.data(), png.size(), true);
+    EXPECT_NE(nullptr, chunk_list);
+    return chunk_list;
+  }
+
+  static PNGAnimationDecoder* CreateDecoder(const PNGRawChunk* chunk_list, int threads_count,
+                                            PNGPixelFormat format = PNG_PIXEL_FORMAT_RGBA8) {
+    PNGAnimationOptions options;
+    PNGInitAnimationOptions(&options);
+    options.threads_count = threads_count;
+    options.format = format;
+    return PNGCreateAnimationDecoder(chunk_list, &options);
+  }
+
+  /// Decode all frames, returning canvas after each of them
+  static std::vector<std::vector<uint8_t>> DecodeAll(PNGAnimationDecoder* decoder) {
+    std::vector<std::vector<uint8_t>> canvases;
+    PNGAnimationFrame frame;
+    int result = 0;
+    while ((result = PNGDecodeNextFrame(decoder, &frame)) == 1) {
+      EXPECT_EQ((int)canvases.size(), frame.index);
+      canvases.emplace_back(frame.canvas, frame.canvas + frame.canvas_size);
+    }
+    EXPECT_EQ(0, result);
+    return canvases;
+  }
+
+  static std::vector<uint8_t> Fill(int pixels_count, std::array<uint8_t, 4> rgba) {
+    std::vector<uint8_t> data;
+    for (int i = 0; i < pixels_count; ++i)
+      data.insert(data.end(), rgba.begin(), rgba.end());
+    return data;
+  }
+
+  static void SetPixel(std::vector<uint8_t>& canvas, int width, int x, int y, std::array<uint8_t, 4> rgba) {
+    std::copy(rgba.begin(), rgba.end(), canvas.begin() + (y * width + x) * 4);
+  }
+
+  static constexpr std::array<uint8_t, 4> red_ = {255, 0, 0, 255};
+  static constexpr std::array<uint8_t, 4> green_ = {0, 255, 0, 255};
+  static constexpr std::array<uint8_t, 4> clear_ = {0, 0, 0, 0};
+};
+
+TEST_F(AnimationTestSuite, LoadAnimationChunks) {
+  Frame frame;
+  frame.width = frame.height = 2;
+  frame.delay_num = 1;
+  frame.delay_den = 25;
+  frame.pixels = Fill(4, red_);
+  PNGRawChunk* chunk_list = Load(CreateAPNG(2, 2, PNG_IMAGE_TYPE_TRUECOLORWITHALPHA, {frame, frame}));
+  ASSERT_NE(nullptr, chunk_list);
+
+  int controls_count = 0, data_count = 0;
+  for (const PNGRawChunk* chunk = chunk_list; chunk; chunk = chunk->next) {
+    if (chunk->type.bytes == CHUNK_acTL.bytes) {
+      const auto* animation = static_cast<const PNGChunkData_acTL*>(chunk->parsed_data);
+      ASSERT_NE(nullptr, animation);
+      EXPECT_EQ(2u, animation->frames_count);
+    } else if (chunk->type.bytes == CHUNK_fcTL.bytes) {
+      const auto* control = static_cast<const PNGChunkData_fcTL*>(chunk->parsed_data);
+      ASSERT_NE(nullptr, control);
+      EXPECT_EQ(25, control->delay_den);
+      ++controls_count;
+    } else if (chunk->type.bytes == CHUNK_fdAT.bytes) {
+      const auto* data = static_cast<const PNGChunkData_fdAT*>(chunk->parsed_data);
+      ASSERT_NE(nullptr, data);
+      EXPECT_EQ(2u, data->sequence_number);
+      ++data_count;
+    }
+  }
+  EXPECT_EQ(2, controls_count);
+  EXPECT_EQ(1, data_count);
+  PNGFreeRawChunk(chunk_list);
+}
+
+TEST_F(AnimationTestSuite, StillImageIsSingleFrame) {
+  const std::vector<uint8_t> plain = {10, 20, 30, 40, 50, 60, 70, 80, 90, 100, 110, 120};
+  PNGRawChunk* chunk_list =
+      Load(test_utils::CreatePNG(2, 2, 8, PNG_IMAGE_TYPE_TRUECOLOR, test_utils::AddFilterBytes(plain, 6)));
+  ASSERT_NE(nullptr, chunk_list);
+
+  PNGAnimationDecoder* decoder = CreateDecoder(chunk_list, 0);
+  ASSERT_NE(nullptr, decoder);
+  PNGAnimationInfo info;
+  PNGGetAnimationInfo(decoder, &info);
+  EXPECT_EQ(2, info.width);
+  EXPECT_EQ(1, info.frames_count);
+  EXPECT_TRUE(info.default_image_is_frame);
+
+  PNGImage image;
+  ASSERT_TRUE(PNGDecodeImage(chunk_list, nullptr, &image));
+  const auto canvases = DecodeAll(decoder);
+  ASSERT_EQ(1u, canvases.size());
+  EXPECT_EQ(std::vector<uint8_t>(image.data, image.data + image.data_size), canvases[0]);
+
+  PNGFreeImage(&image);
+  PNGFreeAnimationDecoder(decoder);
+  PNGFreeRawChunk(chunk_list);
+}
+
+TEST_F(AnimationTestSuite, StillImageDataNotConsecutive) {
+  const std::vector<uint8_t> plain = {10, 20, 30, 40, 50, 60, 70, 80, 90, 100, 110, 120};
+  const auto compressed = test_utils::ZlibStore(test_utils::AddFilterBytes(plain, 6));
+  const size_t half = compressed.size() / 2;
+  ChunkType unknown;
+  std::copy_n("prVt", 4, unknown.byte_array);
+
+  test_utils::VectorWrapper<uint8_t> stream;
+  stream.Append(std::vector<uint8_t>(std::begin(s_png_signature), std::end(s_png_signature)));
+  test_utils::VectorWrapper<uint8_t> header;
+  header.AppendBytes((uint32_t)2, true).AppendBytes((uint32_t)2, true);
+  header.Append(std::vector<uint8_t>{8, PNG_IMAGE_TYPE_TRUECOLOR, 0, 0, 0});
+  test_utils::AppendChunk(stream, CHUNK_IHDR, header);
+  test_utils::AppendChunk(stream, CHUNK_IDAT, std::vector<uint8_t>(compressed.begin(), compressed.begin() + half));
+  /* Chunk between IDAT chunks is larger than the rest of image data */
+  test_utils::AppendChunk(stream, unknown, std::vector<uint8_t>(200, 0xAB));
+  test_utils::AppendChunk(stream, CHUNK_IDAT, std::vector<uint8_t>(compressed.begin() + half, compressed.end()));
+  test_utils::AppendChunk(stream, CHUNK_IEND, {});
+
+  PNGRawChunk* chunk_list = Load(stream);
+  ASSERT_NE(nullptr, chunk_list);
+  EXPECT_EQ(nullptr, CreateDecoder(chunk_list, 0));
+  PNGFreeRawChunk(chunk_list);
+}
+
+TEST_F(AnimationTestSuite, InvalidBitDepths) {
+  for (const auto& [bit_depth, color_type] : std::vector<std::pair<int, int>>{{0, 0}, {0, 3}, {0, 6}, {5, 0}, {4, 4}}) {
+    SCOPED_TRACE(testing::Message() << "bit depth " << bit_depth << ", color type " << color_type);
+    PNGRawChunk* chunk_list = Load(test_utils::CreatePNG(2, 1, bit_depth, color_type, std::vector<uint8_t>(9)));
+    ASSERT_NE(nullptr, chunk_list);
+    EXPECT_EQ(nullptr, CreateDecoder(chunk_list, 0));
+    PNGFreeRawChunk(chunk_list);
+  }
+}
+
+TEST_F(AnimationTestSuite, ComposeFrames) {
+  std::vector<Frame> frames(4);
+  frames[0].width = frames[0].height = 4;
+  frames[0].pixels = Fill(16, red_);
+  /* Translucent blue over red, then reverted */
+  frames[1] = {1, 1, 2, 2, PNG_DISPOSE_OP_PREVIOUS, PNG_BLEND_OP_OVER, 1, 0, Fill(4, {0, 0, 255, 128}), 2};
+  /* Cleared after it is shown */
+  frames[2] = {0, 0, 1, 1, PNG_DISPOSE_OP_BACKGROUND, PNG_BLEND_OP_SOURCE, 1, 10, Fill(1, green_), 1};
+  /* Transparent pixel replaces canvas one */
+  frames[3] = {3, 3, 1, 1, PNG_DISPOSE_OP_NONE, PNG_BLEND_OP_SOURCE, 0, 0, Fill(1, clear_), 3};
+  PNGRawChunk* chunk_list = Load(CreateAPNG(4, 4, PNG_IMAGE_TYPE_TRUECOLORWITHALPHA, frames));
+  ASSERT_NE(nullptr, chunk_list);
+
+  std::vector<std::vector<uint8_t>> expected(4, Fill(16, red_));
+  for (int y = 1; y < 3; ++y)
+    for (int x = 1; x < 3; ++x)
+      SetPixel(expected[1], 4, x, y, {127, 0, 128, 255});
+  SetPixel(expected[2], 4, 0, 0, green_);
+  SetPixel(expected[3], 4, 0, 0, clear_);
+  SetPixel(expected[3], 4, 3, 3, clear_);
+
+  /* Batches of one frame, of two frames with the last batch shorter, and of all frames */
+  for (int threads_count : {1, 3, 4}) {
+    PNGAnimationDecoder* decoder = CreateDecoder(chunk_list, threads_count);
+    ASSERT_NE(nullptr, decoder);
+    PNGAnimationInfo info;
+    PNGGetAnimationInfo(decoder, &info);
+    EXPECT_EQ(4, info.frames_count);
+    EXPECT_EQ(0u, info.plays_count);
+    EXPECT_TRUE(info.default_image_is_frame);
+
+    EXPECT_EQ(expected, DecodeAll(decoder));
+    PNGRewindAnimation(decoder);
+    EXPECT_EQ(expected, DecodeAll(decoder));
+    PNGFreeAnimationDecoder(decoder);
+  }
+
+  PNGAnimationDecoder* decoder = CreateDecoder(chunk_list, 2);
+  ASSERT_NE(nullptr, decoder);
+  PNGAnimationFrame frame;
+  ASSERT_EQ(1, PNGDecodeNextFrame(decoder, &frame));
+  ASSERT_EQ(1, PNGDecodeNextFrame(decoder, &frame));
+  EXPECT_EQ(1u, frame.control.x_offset);
+  EXPECT_EQ(PNG_BLEND_OP_OVER, frame.control.blend_op);
+  EXPECT_DOUBLE_EQ(0.01, frame.delay_seconds);
+  EXPECT_EQ(16, frame.row_stride);
+  ASSERT_EQ(1, PNGDecodeNextFrame(decoder, &frame));
+  EXPECT_DOUBLE_EQ(0.1, frame.delay_seconds);
+  PNGFreeAnimationDecoder(decoder);
+  PNGFreeRawChunk(chunk_list);
+}
+
+TEST_F(AnimationTestSuite, DefaultImageIsNotFrame) {
+  /* Indexed frames: 0 - opaque red, 1 - green, 2 - transparent */
+  const std::vector<std::pair<ChunkType, std::vector<uint8_t>>> palette = {
+      {CHUNK_PLTE, {255, 0, 0, 0, 255, 0, 0, 0, 0}},
+      {CHUNK_tRNS, {255, 255, 0}},
+  };
+  std::vector<Frame> frames(2);
+  /* Previous contents of the first frame are the cleared canvas */
+  frames[0] = {0, 0, 2, 2, PNG_DISPOSE_OP_PREVIOUS, PNG_BLEND_OP_SOURCE, 0, 0, {1, 1, 1, 1}, 1};
+  frames[1] = {1, 0, 1, 2, PNG_DISPOSE_OP_NONE, PNG_BLEND_OP_OVER, 0, 0, {0, 2}, 2};
+  PNGRawChunk* chunk_list = Load(CreateAPNG(2, 2, PNG_IMAGE_TYPE_INDEXED, frames, {0, 0, 0, 0}, palette));
+  ASSERT_NE(nullptr, chunk_list);
+
+  PNGAnimationDecoder* decoder = CreateDecoder(chunk_list, 0);
+  ASSERT_NE(nullptr, decoder);
+  PNGAnimationInfo info;
+  PNGGetAnimationInfo(decoder, &info);
+  EXPECT_EQ(2, info.frames_count);
+  EXPECT_FALSE(info.default_image_is_frame);
+
+  std::vector<uint8_t> second(16, 0);
+  SetPixel(second, 2, 1, 0, red_);
+  EXPECT_EQ((std::vector<std::vector<uint8_t>>{Fill(4, green_), second}), DecodeAll(decoder));
+  PNGFreeAnimationDecoder(decoder);
+  PNGFreeRawChunk(chunk_list);
+}
+
+TEST_F(AnimationTestSuite, ComposeFramesRGBA16) {
+  std::vector<Frame> frames(2);
+  frames[0].width = frames[0].height = 2;
+  frames[0].pixels = Fill(4, {0, 0, 255, 255});
+  frames[1] = {0, 1, 2, 1, PNG_DISPOSE_OP_NONE, PNG_BLEND_OP_OVER, 0, 0, Fill(2, {255, 255, 255, 0}), 1};
+  frames[1].pixels[3] = 255;
+  PNGRawChunk* chunk_list = Load(CreateAPNG(2, 2, PNG_IMAGE_TYPE_TRUECOLORWITHALPHA, frames));
+  ASSERT_NE(nullptr, chunk_list);
+
+  PNGAnimationDecoder* decoder = CreateDecoder(chunk_list, 2, PNG_PIXEL_FORMAT_RGBA16);
+  ASSERT_NE(nullptr, decoder);
+  const auto canvases = DecodeAll(decoder);
+  ASSERT_EQ(2u, canvases.size());
+  ASSERT_EQ(32u, canvases[1].size());
+  const auto* pixels = reinterpret_cast<const uint16_t*>(canvases[1].data());
+  const std::vector<uint16_t> expected = {0, 0, 0xFFFF, 0xFFFF, 0,      0,      0xFFFF, 0xFFFF,
+                                          0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0, 0, 0xFFFF, 0xFFFF};
+  EXPECT_EQ(expected, std::vector<uint16_t>(pixels, pixels + 16));
+  PNGFreeAnimationDecoder(decoder);
+  PNGFreeRawChunk(chunk_list);
+}
+
+TEST_F(AnimationTestSuite, InvalidAnimations) {
+  std::vector<Frame> frames(2);
+  frames[0].width = frames[0].height = 2;
+  frames[0].pixels = Fill(4, red_);
+  frames[1] = frames[0];
+  const auto valid = CreateAPNG(2, 2, PNG_IMAGE_TYPE_TRUECOLORWITHALPHA, frames);
+
+  auto expect_invalid = [](const std::vector<uint8_t>& png) {
+    PNGRawChunk* chunk_list = Load(png);
+    ASSERT_NE(nullptr, chunk_list);
+    EXPECT_EQ(nullptr, CreateDecoder(chunk_list, 0));
+    PNGFreeRawChunk(chunk_list);
+  };
+
+  /* Frame outside canvas */
+  auto outside = frames;
+  outside[1].x_offset = 1;
+  expect_invalid(CreateAPNG(2, 2, PNG_IMAGE_TYPE_TRUECOLORWITHALPHA, outside));
+  /* Default image frame not covering canvas */
+  auto partial = frames;
+  partial[0].width = 1;
+  partial[0].pixels = Fill(2, red_);
+  expect_invalid(CreateAPNG(2, 2, PNG_IMAGE_TYPE_TRUECOLORWITHALPHA, partial));
+  /* Unknown dispose op */
+  auto dispose = frames;
+  dispose[1].dispose_op = 3;
+  expect_invalid(CreateAPNG(2, 2, PNG_IMAGE_TYPE_TRUECOLORWITHALPHA, dispose));
+
+  /* acTL frames count differs from fcTL chunks count */
+  PNGRawChunk* chunk_list = Load(valid);
+  ASSERT_NE(nullptr, chunk_list);
+  for (PNGRawChunk* chunk = chunk_list; chunk; chunk = chunk->next)
+    if (chunk->type.bytes == CHUNK_acTL.bytes)
+      static_cast<PNGChunkData_acTL*>(chunk->parsed_data)->frames_count = 3;
+  EXPECT_EQ(nullptr, CreateDecoder(chunk_list, 0));
+  PNGFreeRawChunk(chunk_list);
+
+  /* Sequence numbers out of order */
+  chunk_list = Load(valid);
+  ASSERT_NE(nullptr, chunk_list);
+  for (PNGRawChunk* chunk = chunk_list; chunk; chunk = chunk->next)
+    if (chunk->type.bytes == CHUNK_fdAT.bytes)
+      static_cast<PNGChunkData_fdAT*>(chunk->parsed_data)->sequence_number = 5;
+  EXPECT_EQ(nullptr, CreateDecoder(chunk_list, 0));
+  PNGFreeRawChunk(chunk_list);
+
+  /* Canvas exceeds limits */
+  chunk_list = Load(valid);
+  ASSERT_NE(nullptr, chunk_list);
+  PNGAnimationOptions options;
+  PNGInitAnimationOptions(&options);
+  options.limits.max_output_bytes = 15;
+  EXPECT_EQ(nullptr, PNGCreateAnimationDecoder(chunk_list, &options));
+  options.limits.max_output_bytes = 0;
+  options.format = PNG_PIXEL_FORMAT_RGB8;
+  EXPECT_EQ(nullptr, PNGCreateAnimationDecoder(chunk_list, &options));
+  PNGFreeRawChunk(chunk_list);
+}
+
+TEST_F(AnimationTestSuite, CorruptedFrameData) {
+  std::vector<Frame> frames(3);
+  for (Frame& frame : frames) {
+    frame.width = frame.height = 2;
+    frame.pixels = Fill(4, green_);
+  }
+  PNGRawChunk* chunk_list = Load(CreateAPNG(2, 2, PNG_IMAGE_TYPE_TRUECOLORWITHALPHA, frames));
+  ASSERT_NE(nullptr, chunk_list);
+  /* Break zlib header of the second frame */
+  int data_index = 0;
+  for (PNGRawChunk* chunk = chunk_list; chunk; chunk = chunk->next)
+    if (chunk->type.bytes == CHUNK_fdAT.bytes && data_index++ == 0)
+      static_cast<PNGChunkData_fdAT*>(chunk->parsed_data)->data[0] = 0xFF;
+
+  for (int threads_count : {1, 3}) {
+    PNGAnimationDecoder* decoder = CreateDecoder(chunk_list, threads_count);
+    ASSERT_NE(nullptr, decoder);
+    PNGAnimationFrame frame;
+    EXPECT_EQ(1, PNGDecodeNextFrame(decoder, &frame));
+    EXPECT_EQ(-1, PNGDecodeNextFrame(decoder, &frame));
+    EXPECT_EQ(-1, PNGDecodeNextFrame(decoder, &frame));
+    PNGRewindAnimation(decoder);
+    EXPECT_EQ(1, PNGDecodeNextFrame(decoder, &frame));
+    PNGFreeAnimationDecoder(decoder);
+  }
+  PNGFreeRawChunk(chunk_list);
+}
@@ -0,0 +1,217 @@
+#include <png_core/async_decode.hpp>
+#include <png_core/decoder.h>
+#include <png_core/encoder.h>
+
+#include <deque>
+
+#include "../test_utils.h"
+
+class AsyncDecodeTestSuite : public ::testing::Test {
+protected:
+  /// Single-threaded executor: coroutines waiting for input are resumed in order of their reads
+  struct ManualQueue {
+    std::deque<std::coroutine_handle<>> ready;
+
+    void Run() {
+      while (!ready.empty()) {
+        std::coroutine_handle<> handle = ready.front();
+        ready.pop_front();
+        handle.resume();
+      }
+    }
+  };
+
+  /// Source handing out datastream in pieces, every read suspends until the queue resumes it
+  struct QueuedSource {
+    ManualQueue* queue;
+    const std::vector<uint8_t>* png;
+    size_t piece_size;
+    size_t position = 0;
+    int reads_count = 0;
+
+    auto read() {
+      struct read_awaiter {
+        QueuedSource* source;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> reader) const { source->queue->ready.push_back(reader); }
+        std::span<const std::byte> await_resume() const {
+          ++source->reads_count;
+          const size_t size = std::min(source->piece_size, source->png->size() - source->position);
+          const auto* data = reinterpret_cast<const std::byte*>(source->png->data()) + source->position;
+          source->position += size;
+          return {data, size};
+        }
+      };
+      return read_awaiter{this};
+    }
+  };
+
+  /// Coroutine started eagerly and destroyed when it finishes
+  struct DetachedTask {
+    struct promise_type {
+      DetachedTask get_return_object() const noexcept { return {}; }
+      std::suspend_never initial_suspend() const noexcept { return {}; }
+      std::suspend_never final_suspend() const noexcept { return {}; }
+      void return_void() const noexcept {}
+      void unhandled_exception() const { std::terminate(); }
+    };
+  };
+
+  /// Outcome of consuming decoded rows
+  struct Consumed {
+    bool finished = false;
+    std::string error;
+    int rows_count = 0;
+    PNGImage info;
+    std::vector<uint8_t> pixels;
+  };
+
+  static DetachedTask Consume(png_core::async_generator<std::span<const std::byte>> rows, Consumed* out) {
+    try {
+      while (std::optional<std::span<const std::byte>> row = co_await rows.next()) {
+        const auto* data = reinterpret_cast<const uint8_t*>(row->data());
+        out->pixels.insert(out->pixels.end(), data, data + row->size());
+        ++out->rows_count;
+      }
+    } catch (const png_core::decode_error& error) {
+      out->error = error.what();
+    }
+    out->finished = true;
+  }
+
+  /// Allocator counting its live allocations
+  template <class T>
+  struct CountingAllocator {
+    using value_type = T;
+
+    int* live_count;
+    int* total_count;
+
+    CountingAllocator(int* live_count, int* total_count) : live_count(live_count), total_count(total_count) {}
+    template <class U>
+    CountingAllocator(const CountingAllocator<U>& other)
+        : live_count(other.live_count), total_count(other.total_count) {}
+
+    T* allocate(size_t count) {
+      ++*live_count;
+      ++*total_count;
+      return std::allocator<T>().allocate(count);
+    }
+    void deallocate(T* ptr, size_t count) {
+      --*live_count;
+      std::allocator<T>().deallocate(ptr, count);
+    }
+  };
+
+  static std::vector<uint8_t> Encode(int width, int height, uint8_t seed) {
+    std::vector<uint8_t> data(width * height * 3);
+    for (size_t i = 0; i < data.size(); ++i)
+      data[i] = (uint8_t)(i * 7 + i / 13 * seed);
+    PNGRawImage image;
+    PNGInitRawImage(&image);
+    image.type = PNG_IMAGE_TYPE_TRUECOLOR;
+    image.channel_bit_depth = 8;
+    image.scanline_pixel_count = width;
+    image.data = data.data();
+    image.data_size = data.size();
+    PNGEncodeOptions options;
+    PNGInitEncodeOptions(&options);
+    options.idat_chunk_size = 100;
+    int size = 0;
+    uint8_t* encoded = PNGEncodeRawImage(&image, &options, &size);
+    EXPECT_NE(nullptr, encoded);
+    std::vector<uint8_t> png(encoded, encoded + size);
+    PNGFreeEncodedData(encoded);
+    return png;
+  }
+
+  static std::vector<uint8_t> DecodeImage(const std::vector<uint8_t>& png) {
+    PNGRawChunk* chunks = PNGLoadRawChunkList(png.data(), png.size(), true);
+    PNGImage image;
+    EXPECT_TRUE(PNGDecodeImage(chunks, nullptr, &image));
+    PNGFreeRawChunk(chunks);
+    std::vector<uint8_t> pixels(image.data, image.data + image.data_size);
+    PNGFreeImage(&image);
+    return pixels;
+  }
+};
+
+TEST_F(AsyncDecodeTestSuite, InterleavedDecodes) {
+  const int decodes_count = 1000;
+  std::vector<std::vector<uint8_t>> pngs;
+  for (int i = 0; i < 8; ++i)
+    pngs.push_back(Encode(17 + i, 11 + i, (uint8_t)i));
+
+  ManualQueue queue;
+  int live_count = 0;
+  int total_count = 0;
+  const CountingAllocator<std::byte> allocator(&live_count, &total_count);
+  std::vector<QueuedSource> sources;
+  for (int i = 0; i < decodes_count; ++i)
+    sources.push_back({&queue, &pngs[i % pngs.size()], (size_t)(1 + i % 97)});
+  std::vector<Consumed> consumed(decodes_count);
+  for (int i = 0; i < decodes_count; ++i)
+    Consume(png_core::async_decode(std::allocator_arg, allocator, sources[i], png_core::default_decode_options(),
+                                   &consumed[i].info),
+            &consumed[i]);
+  /* Every decode waits for its first piece, frames are allocated through allocator */
+  EXPECT_EQ(decodes_count, (int)queue.ready.size());
+  EXPECT_EQ(decodes_count, live_count);
+
+  queue.Run();
+  EXPECT_EQ(0, live_count);
+  EXPECT_EQ(decodes_count, total_count);
+  for (int i = 0; i < decodes_count; ++i) {
+    SCOPED_TRACE(testing::Message() << "decode " << i);
+    const std::vector<uint8_t>& png = pngs[i % pngs.size()];
+    ASSERT_TRUE(consumed[i].finished);
+    EXPECT_EQ("", consumed[i].error);
+    EXPECT_EQ(DecodeImage(png), consumed[i].pixels);
+    EXPECT_EQ(11 + i % (int)pngs.size(), consumed[i].rows_count);
+    EXPECT_EQ(17 + i % (int)pngs.size(), consumed[i].info.width);
+    EXPECT_EQ(PNG_PIXEL_FORMAT_RGBA8, consumed[i].info.format);
+    /* Pieces are read only while decoder needs input: the last read is the end of datastream at most */
+    EXPECT_LE(sources[i].reads_count, (int)((png.size() + sources[i].piece_size - 1) / sources[i].piece_size) + 1);
+  }
+}
+
+TEST_F(AsyncDecodeTestSuite, Errors) {
+  const std::vector<uint8_t> png = Encode(20, 10, 3);
+  ManualQueue queue;
+
+  /* Truncated datastream */
+  const std::vector<uint8_t> truncated(png.begin(), png.end() - 20);
+  QueuedSource truncated_source{&queue, &truncated, 16};
+  Consumed truncated_consumed;
+  Consume(png_core::async_decode(truncated_source), &truncated_consumed);
+
+  /* Corrupted image data */
+  std::vector<uint8_t> corrupted = png;
+  corrupted[png.size() / 2] ^= 0x40;
+  QueuedSource corrupted_source{&queue, &corrupted, 16};
+  Consumed corrupted_consumed;
+  Consume(png_core::async_decode(corrupted_source), &corrupted_consumed);
+
+  /* Unsupported options */
+  QueuedSource flipped_source{&queue, &png, 16};
+  PNGDecodeOptions options = png_core::default_decode_options();
+  options.flip_vertically = true;
+  Consumed flipped_consumed;
+  Consume(png_core::async_decode(flipped_source, options), &flipped_consumed);
+
+  queue.Run();
+  for (const Consumed* consumed : {&truncated_consumed, &corrupted_consumed, &flipped_consumed}) {
+    EXPECT_TRUE(consumed->finished);
+    EXPECT_NE("", consumed->error);
+  }
+  EXPECT_EQ(0, flipped_consumed.rows_count);
+  EXPECT_EQ(0, flipped_source.reads_count);
+
+  /* Generator destroyed before it is finished */
+  QueuedSource source{&queue, &png, 16};
+  {
+    png_core::async_generator<std::span<const std::byte>> rows = png_core::async_decode(source);
+  }
+  EXPECT_TRUE(queue.ready.empty());
+}
@@ -0,0 +1,263 @@
+#include <cerrno>
+#include <cstdlib>
+#include <mutex>
+
+#include <png_core/batch.h>
+
+#include "../test_utils.h"
+
+class BatchTestSuite : public ::testing::Test {
+protected:
+  /// Outcome of single file, recorded by callback
+  struct Record {
+    int calls_count = 0;
+    int error = 0;
+    bool loaded = false;
+    bool decoded = false;
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> pixels;
+    bool has_stats = false;
+    PNGDecodeStats stats;
+  };
+
+  struct Records {
+    std::mutex mutex;
+    std::vector<Record> records;
+  };
+
+  static void RecordItem(void* user_data, PNGBatchItem* item) {
+    Records* records = static_cast<Records*>(user_data);
+    std::lock_guard<std::mutex> lock(records->mutex);
+    Record& record = records->records[item->index];
+    ++record.calls_count;
+    record.error = item->error;
+    record.loaded = item->chunk_list != nullptr;
+    record.decoded = item->decoded;
+    record.has_stats = item->stats != nullptr;
+    if (item->stats)
+      record.stats = *item->stats;
+    EXPECT_EQ(item->error == 0, item->data != nullptr);
+    if (item->decoded) {
+      record.width = item->image.width;
+      record.height = item->image.height;
+      record.pixels.assign(item->image.data, item->image.data + item->image.data_size);
+    }
+  }
+
+  void SetUp() override {
+    for (int i = 0; i < 40; ++i) {
+      const int width = i % 7 * 5 + 1;
+      const int height = i + 1;
+      std::vector<uint8_t> grey;
+      for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+          grey.push_back((uint8_t)(x + y * 3 + i));
+      AddFile(test_utils::CreatePNG(width, height, 8, 0, test_utils::AddFilterBytes(grey, width), {}));
+      expected_.push_back(grey);
+    }
+    /* Files that are read but are not PNG datastreams */
+    AddFile({'n', 'o', 't', ' ', 'p', 'n', 'g'});
+    AddFile({});
+    missing_path_ = (std::filesystem::temp_directory_path() / "png_core_missing_batch_file.png").string();
+    for (const auto& path : files_)
+      paths_.push_back(path.c_str());
+    paths_.push_back(missing_path_.c_str());
+  }
+
+  void TearDown() override {
+    for (const auto& path : files_)
+      std::filesystem::remove(path);
+  }
+
+  void AddFile(const std::vector<uint8_t>& bytes) {
+    files_.push_back(test_utils::WriteTempFile(bytes).string());
+  }
+
+  /// Decode batch, checking that callback is called once per file
+  std::vector<Record> DecodeBatch(const PNGBatchOptions& options, PNGBatchResult* result) {
+    Records records;
+    records.records.resize(paths_.size());
+    EXPECT_TRUE(PNGDecodeBatch(paths_.data(), paths_.size(), &options, RecordItem, &records, result));
+    for (const Record& record : records.records)
+      EXPECT_EQ(1, record.calls_count);
+    return records.records;
+  }
+
+  void ExpectDecoded(const std::vector<Record>& records) {
+    ASSERT_EQ(paths_.size(), records.size());
+    for (size_t i = 0; i < expected_.size(); ++i) {
+      SCOPED_TRACE(testing::Message() << "file " << i);
+      EXPECT_EQ(0, records[i].error);
+      ASSERT_TRUE(records[i].decoded);
+      EXPECT_EQ((int)i + 1, records[i].height);
+      std::vector<uint8_t> rgba;
+      for (uint8_t grey : expected_[i])
+        rgba.insert(rgba.end(), {grey, grey, grey, 255});
+      EXPECT_EQ(rgba, records[i].pixels);
+    }
+    const size_t not_png = expected_.size();
+    EXPECT_EQ(0, records[not_png].error);
+    EXPECT_FALSE(records[not_png].loaded);
+    EXPECT_EQ(0, records[not_png + 1].error);
+    EXPECT_FALSE(records[not_png + 1].decoded);
+    EXPECT_EQ(ENOENT, records[not_png + 2].error);
+  }
+
+  std::vector<std::string> files_;
+  std::string missing_path_;
+  std::vector<const char*> paths_;
+  std::vector<std::vector<uint8_t>> expected_;
+};
+
+TEST_F(BatchTestSuite, DefaultOptions) {
+  PNGBatchOptions options;
+  PNGInitBatchOptions(&options);
+  EXPECT_EQ(PNG_BATCH_IO_ENGINE_AUTO, options.io_engine);
+  EXPECT_EQ(64, options.queue_depth);
+  EXPECT_EQ(0, options.threads_count);
+  EXPECT_EQ(PNG_PIXEL_FORMAT_RGBA8, options.decode.format);
+  EXPECT_FALSE(options.collect_stats);
+  EXPECT_EQ(256 << 20, options.max_file_size);
+}
+
+TEST_F(BatchTestSuite, DecodeWithPread) {
+  PNGBatchOptions options;
+  PNGInitBatchOptions(&options);
+  options.io_engine = PNG_BATCH_IO_ENGINE_PREAD;
+  for (int threads_count : {1, 3}) {
+    SCOPED_TRACE(testing::Message() << "threads " << threads_count);
+    options.threads_count = threads_count;
+    PNGBatchResult result;
+    ExpectDecoded(DecodeBatch(options, &result));
+    EXPECT_EQ(PNG_BATCH_IO_ENGINE_PREAD, result.io_engine);
+    EXPECT_EQ((int)expected_.size() + 2, result.read_files_count);
+    EXPECT_EQ((int)expected_.size(), result.decoded_files_count);
+  }
+}
+
+TEST_F(BatchTestSuite, CollectStats) {
+  PNGBatchOptions options;
+  PNGInitBatchOptions(&options);
+  options.io_engine = PNG_BATCH_IO_ENGINE_PREAD;
+  options.threads_count = 3;
+  for (const Record& record : DecodeBatch(options, nullptr))
+    EXPECT_FALSE(record.has_stats);
+
+  options.collect_stats = true;
+  const std::vector<Record> records = DecodeBatch(options, nullptr);
+  ExpectDecoded(records);
+  for (size_t i = 0; i < expected_.size(); ++i) {
+    SCOPED_TRACE(testing::Message() << "file " << i);
+    const Record& record = records[i];
+    ASSERT_TRUE(record.has_stats);
+    /* Every file has its own statistics of loading and decoding */
+    EXPECT_EQ(std::filesystem::file_size(files_[i]), record.stats.stages[PNG_DECODE_STAGE_PARSE].bytes_in);
+    EXPECT_EQ(3, record.stats.chunks_count);
+    EXPECT_EQ(1, record.stats.idat_chunks_count);
+    EXPECT_EQ(expected_[i].size(), record.stats.stages[PNG_DECODE_STAGE_DEFILTER].bytes_out);
+    EXPECT_EQ(record.pixels.size(), record.stats.stages[PNG_DECODE_STAGE_CONVERT].bytes_out);
+    EXPECT_EQ(record.pixels.size(), record.stats.live_bytes);
+  }
+  /* Read files have statistics even if they are not PNG datastreams, files that are not read have none */
+  EXPECT_TRUE(records[expected_.size()].has_stats);
+  EXPECT_FALSE(records[expected_.size() + 2].has_stats);
+}
+
+TEST_F(BatchTestSuite, DecodeWithIOUring) {
+  PNGBatchOptions options;
+  PNGInitBatchOptions(&options);
+  options.io_engine = PNG_BATCH_IO_ENGINE_IO_URING;
+  Records probe;
+  probe.records.resize(paths_.size());
+  if (!PNGDecodeBatch(paths_.data(), 0, &options, RecordItem, &probe, nullptr))
+    GTEST_SKIP() << "io_uring is not supported";
+
+  /* Queue shallower and deeper than files count, with decoding on reading thread only and on other threads */
+  for (int queue_depth : {1, 4, 64})
+    for (int threads_count : {1, 3}) {
+      SCOPED_TRACE(testing::Message() << "queue depth " << queue_depth << " threads " << threads_count);
+      options.queue_depth = queue_depth;
+      options.threads_count = threads_count;
+      PNGBatchResult result;
+      ExpectDecoded(DecodeBatch(options, &result));
+      EXPECT_EQ(PNG_BATCH_IO_ENGINE_IO_URING, result.io_engine);
+      EXPECT_EQ((int)expected_.size() + 2, result.read_files_count);
+      EXPECT_EQ((int)expected_.size(), result.decoded_files_count);
+    }
+
+  options.io_engine = PNG_BATCH_IO_ENGINE_AUTO;
+  PNGBatchResult result;
+  ExpectDecoded(DecodeBatch(options, &result));
+  EXPECT_EQ(PNG_BATCH_IO_ENGINE_IO_URING, result.io_engine);
+}
+
+TEST_F(BatchTestSuite, FileErrorsAndOwnership) {
+  for (PNGBatchIOEngine engine : {PNG_BATCH_IO_ENGINE_AUTO, PNG_BATCH_IO_ENGINE_PREAD}) {
+    SCOPED_TRACE(testing::Message() << "engine " << engine);
+    PNGBatchOptions options;
+    PNGInitBatchOptions(&options);
+    options.io_engine = engine;
+    /* Files larger than maximum are not read */
+    options.max_file_size = 100;
+    const std::vector<Record> records = DecodeBatch(options, nullptr);
+    for (size_t i = 0; i < expected_.size(); ++i) {
+      const bool small = std::filesystem::file_size(files_[i]) <= 100;
+      EXPECT_EQ(small ? 0 : EFBIG, records[i].error);
+      EXPECT_EQ(small, records[i].decoded);
+    }
+
+    /* Callback takes decoded pixels */
+    options.max_file_size = 1 << 20;
+    struct Taken {
+      std::mutex mutex;
+      std::vector<uint8_t*> data;
+    } taken;
+    auto take = [](void* user_data, PNGBatchItem* item) {
+      Taken* taken = static_cast<Taken*>(user_data);
+      if (!item->decoded)
+        return;
+      std::lock_guard<std::mutex> lock(taken->mutex);
+      taken->data.push_back(item->image.data);
+      item->image.data = nullptr;
+    };
+    PNGBatchResult result;
+    EXPECT_TRUE(PNGDecodeBatch(paths_.data(), paths_.size(), &options, take, &taken, &result));
+    EXPECT_EQ(expected_.size(), taken.data.size());
+    for (uint8_t* data : taken.data)
+      free(data);
+  }
+}
+
+TEST_F(BatchTestSuite, InvalidOptions) {
+  Records records;
+  records.records.resize(paths_.size());
+  PNGBatchOptions options;
+  PNGInitBatchOptions(&options);
+  auto expect_rejected = [&](const PNGBatchOptions& options) {
+    EXPECT_FALSE(PNGDecodeBatch(paths_.data(), paths_.size(), &options, RecordItem, &records, nullptr));
+  };
+
+  EXPECT_FALSE(PNGDecodeBatch(paths_.data(), paths_.size(), &options, nullptr, nullptr, nullptr));
+  EXPECT_FALSE(PNGDecodeBatch(nullptr, 1, &options, RecordItem, &records, nullptr));
+  EXPECT_FALSE(PNGDecodeBatch(paths_.data(), -1, &options, RecordItem, &records, nullptr));
+  PNGBatchOptions invalid = options;
+  invalid.queue_depth = 0;
+  expect_rejected(invalid);
+  invalid.queue_depth = 4097;
+  expect_rejected(invalid);
+  invalid = options;
+  invalid.threads_count = -1;
+  expect_rejected(invalid);
+  invalid = options;
+  invalid.max_file_size = -1;
+  expect_rejected(invalid);
+  invalid = options;
+  invalid.io_engine = (PNGBatchIOEngine)3;
+  expect_rejected(invalid);
+  for (const Record& record : records.records)
+    EXPECT_EQ(0, record.calls_count);
+
+  /* Empty batch */
+  EXPECT_TRUE(PNGDecodeBatch(nullptr, 0, nullptr, RecordItem, &records, nullptr));
+}
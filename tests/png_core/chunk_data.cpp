@@ -127,6 +127,7 @@ TEST_F(ChunkDataTestSuite, TestChunkData_PLTE) {
 
 TEST_F(ChunkDataTestSuite, TestChunkData_bKGD) {
   PNGChunkData_bKGD chunk;
+  PNGInitData_bKGD(&chunk);
   chunk.index_in_palette = 47;
 
   const auto expected_size = PNGWriteData_bKGD(&chunk, nullptr);
@@ -144,6 +145,23 @@ TEST_F(ChunkDataTestSuite, TestChunkData_bKGD) {
   ASSERT_TRUE(PNGEqualData_bKGD(&chunk, loaded_chunk));
 
   PNGFreeData_bKGD(loaded_chunk);
+
+  /* Truecolor background */
+  chunk.samples_count = 3;
+  chunk.samples[0] = 0x1234;
+  chunk.samples[1] = 0x0056;
+  chunk.samples[2] = 0xFFFF;
+  written_data.assign(PNGWriteData_bKGD(&chunk, nullptr), 0);
+  ASSERT_EQ(6, (int)written_data.size());
+  PNGWriteData_bKGD(&chunk, written_data.data());
+  EXPECT_EQ(std::vector<uint8_t>({0x12, 0x34, 0x00, 0x56, 0xFF, 0xFF}), written_data);
+
+  loaded_chunk = PNGLoadData_bKGD(written_data.data(), written_data.size());
+  ASSERT_TRUE(loaded_chunk);
+  ASSERT_TRUE(PNGEqualData_bKGD(&chunk, loaded_chunk));
+  PNGFreeData_bKGD(loaded_chunk);
+
+  EXPECT_EQ(nullptr, PNGLoadData_bKGD(written_data.data(), 4));
 }
 
 TEST_F(ChunkDataTestSuite, TestChunkData_gAMA) {
@@ -265,6 +283,131 @@ TEST_F(ChunkDataTestSuite, TestChunkData_sBIT) {
   PNGFreeData_sBIT(loaded_chunk);
 }
 
+TEST_F(ChunkDataTestSuite, TestChunkData_tRNS) {
+  test_utils::VectorWrapper<uint8_t> expected_data = {0x01, 0x02, 0x00, 0xFF, 0x80, 0x00};
+
+  struct PNGChunkData_tRNS* loaded_chunk = PNGLoadData_tRNS(expected_data.data(), expected_data.size());
+  ASSERT_TRUE(loaded_chunk);
+  EXPECT_EQ(6, loaded_chunk->bytes_count);
+  EXPECT_EQ(0x0102, PNGGetTransparentSample_tRNS(loaded_chunk, 0));
+  EXPECT_EQ(0x00FF, PNGGetTransparentSample_tRNS(loaded_chunk, 1));
+  EXPECT_EQ(0x8000, PNGGetTransparentSample_tRNS(loaded_chunk, 2));
+  EXPECT_EQ(-1, PNGGetTransparentSample_tRNS(loaded_chunk, 3));
+
+  const auto expected_size = PNGWriteData_tRNS(loaded_chunk, nullptr);
+  EXPECT_EQ(expected_size, 6);
+  std::vector<uint8_t> written_data(expected_size, 0);
+  EXPECT_EQ(expected_size, PNGWriteData_tRNS(loaded_chunk, written_data.data()));
+  EXPECT_EQ(written_data, expected_data);
+
+  PNGChunkData_tRNS chunk;
+  PNGInitData_tRNS(&chunk);
+  EXPECT_FALSE(PNGEqualData_tRNS(&chunk, loaded_chunk));
+  chunk.bytes_count = 6;
+  std::copy(expected_data.begin(), expected_data.end(), chunk.bytes);
+  EXPECT_TRUE(PNGEqualData_tRNS(&chunk, loaded_chunk));
+
+  /* Palette of more than 256 entries is not allowed */
+  EXPECT_EQ(nullptr, PNGLoadData_tRNS(std::vector<uint8_t>(257).data(), 257));
+
+  PNGFreeData_tRNS(loaded_chunk);
+}
+
+TEST_F(ChunkDataTestSuite, TestChunkData_acTL) {
+  PNGChunkData_acTL chunk;
+  chunk.frames_count = 12;
+  chunk.plays_count = 3;
+
+  const auto expected_size = PNGWriteData_acTL(&chunk, nullptr);
+  EXPECT_EQ(expected_size, 8);
+
+  std::vector<uint8_t> written_data(expected_size, 0);
+  const auto written_bytes = PNGWriteData_acTL(&chunk, written_data.data());
+  EXPECT_EQ(expected_size, written_bytes);
+
+  test_utils::VectorWrapper<uint8_t> expected_data;
+  expected_data.AppendBytes(chunk.frames_count, true);
+  expected_data.AppendBytes(chunk.plays_count, true);
+  EXPECT_EQ(written_data, expected_data);
+
+  struct PNGChunkData_acTL* loaded_chunk = PNGLoadData_acTL(expected_data.data(), expected_data.size());
+  ASSERT_TRUE(loaded_chunk);
+  ASSERT_TRUE(PNGEqualData_acTL(&chunk, loaded_chunk));
+  EXPECT_EQ(nullptr, PNGLoadData_acTL(expected_data.data(), 7));
+
+  PNGFreeData_acTL(loaded_chunk);
+}
+
+TEST_F(ChunkDataTestSuite, TestChunkData_fcTL) {
+  PNGChunkData_fcTL chunk;
+  chunk.sequence_number = 5;
+  chunk.width = 640;
+  chunk.height = 480;
+  chunk.x_offset = 16;
+  chunk.y_offset = 32;
+  chunk.delay_num = 1;
+  chunk.delay_den = 30;
+  chunk.dispose_op = PNG_DISPOSE_OP_PREVIOUS;
+  chunk.blend_op = PNG_BLEND_OP_OVER;
+
+  const auto expected_size = PNGWriteData_fcTL(&chunk, nullptr);
+  EXPECT_EQ(expected_size, 26);
+
+  std::vector<uint8_t> written_data(expected_size, 0);
+  const auto written_bytes = PNGWriteData_fcTL(&chunk, written_data.data());
+  EXPECT_EQ(expected_size, written_bytes);
+
+  test_utils::VectorWrapper<uint8_t> expected_data;
+  expected_data.AppendBytes(chunk.sequence_number, true);
+  expected_data.AppendBytes(chunk.width, true);
+  expected_data.AppendBytes(chunk.height, true);
+  expected_data.AppendBytes(chunk.x_offset, true);
+  expected_data.AppendBytes(chunk.y_offset, true);
+  expected_data.AppendBytes(chunk.delay_num, true);
+  expected_data.AppendBytes(chunk.delay_den, true);
+  expected_data.push_back(chunk.dispose_op);
+  expected_data.push_back(chunk.blend_op);
+  EXPECT_EQ(written_data, expected_data);
+
+  struct PNGChunkData_fcTL* loaded_chunk = PNGLoadData_fcTL(expected_data.data(), expected_data.size());
+  ASSERT_TRUE(loaded_chunk);
+  ASSERT_TRUE(PNGEqualData_fcTL(&chunk, loaded_chunk));
+  EXPECT_EQ(nullptr, PNGLoadData_fcTL(expected_data.data(), 25));
+
+  PNGFreeData_fcTL(loaded_chunk);
+}
+
+TEST_F(ChunkDataTestSuite, TestChunkData_fdAT) {
+  uint8_t data[543];
+  for (int i = 0; i < sizeof(data); ++i)
+    data[i] = i % 256;
+
+  PNGChunkData_fdAT chunk;
+  chunk.sequence_number = 7;
+  chunk.data_size = sizeof(data);
+  chunk.data = data;
+
+  const auto expected_size = PNGWriteData_fdAT(&chunk, nullptr);
+  EXPECT_EQ(expected_size, 4 + sizeof(data));
+
+  std::vector<uint8_t> written_data(expected_size, 0);
+  const auto written_bytes = PNGWriteData_fdAT(&chunk, written_data.data());
+  EXPECT_EQ(expected_size, written_bytes);
+
+  test_utils::VectorWrapper<uint8_t> expected_data;
+  expected_data.AppendBytes(chunk.sequence_number, true);
+  expected_data.insert(expected_data.end(), std::begin(data), std::end(data));
+  EXPECT_EQ(written_data, expected_data);
+
+  struct PNGChunkData_fdAT* loaded_chunk = PNGLoadData_fdAT(expected_data.data(), expected_data.size());
+  ASSERT_TRUE(loaded_chunk);
+  ASSERT_TRUE(PNGEqualData_fdAT(&chunk, loaded_chunk));
+  /* Sequence number is required */
+  EXPECT_EQ(nullptr, PNGLoadData_fdAT(expected_data.data(), 3));
+
+  PNGFreeData_fdAT(loaded_chunk);
+}
+
 TEST_F(ChunkDataTestSuite, TestChunkData_IEND) {
   PNGChunkData_IEND chunk;
 
@@ -327,3 +470,82 @@ TEST_F(ChunkDataTestSuite, LoadAndWritePNGFileTest) {
     ASSERT_EQ(original_data, written_data);
   }
 }
+
+/// Loads synthetic datastream with chunk types filtering
+TEST_F(ChunkDataTestSuite, LoadRawChunkListWithOptions) {
+  static const auto collect_types = [](const PNGRawChunk* chunk) {
+    std::vector<uint32_t> types;
+    for (; chunk; chunk = chunk->next)
+      types.push_back(chunk->type.bytes);
+    return types;
+  };
+
+  test_utils::VectorWrapper<uint8_t> stream;
+  stream.Append(std::vector<uint8_t>(std::begin(s_png_signature), std::end(s_png_signature)));
+  test_utils::AppendChunk(stream, CHUNK_IHDR, {0, 0, 0, 1, 0, 0, 0, 1, 8, 0, 0, 0, 0});
+  test_utils::AppendChunk(stream, CHUNK_tEXt, {'k', '\0', 'v'});
+  test_utils::AppendChunk(stream, CHUNK_IDAT, {1, 2, 3});
+  test_utils::AppendChunk(stream, CHUNK_IEND, {});
+
+  PNGChunkLoadOptions options;
+  PNGInitChunkLoadOptions(&options);
+  PNGRawChunk* all = PNGLoadRawChunkListWithOptions(stream.data(), stream.size(), true, &options);
+  EXPECT_EQ(collect_types(all),
+            (std::vector<uint32_t>{CHUNK_IHDR.bytes, CHUNK_tEXt.bytes, CHUNK_IDAT.bytes, CHUNK_IEND.bytes}));
+  PNGFreeRawChunk(all);
+
+  options.skip_ancillary = true;
+  PNGRawChunk* critical = PNGLoadRawChunkListWithOptions(stream.data(), stream.size(), true, &options);
+  EXPECT_EQ(collect_types(critical), (std::vector<uint32_t>{CHUNK_IHDR.bytes, CHUNK_IDAT.bytes, CHUNK_IEND.bytes}));
+  PNGFreeRawChunk(critical);
+
+  const ChunkType text_types[] = {CHUNK_tEXt};
+  options.skip_ancillary = false;
+  options.allowed_types = text_types;
+  options.allowed_types_count = 1;
+  PNGRawChunk* texts = PNGLoadRawChunkListWithOptions(stream.data(), stream.size(), true, &options);
+  ASSERT_EQ(collect_types(texts), (std::vector<uint32_t>{CHUNK_tEXt.bytes}));
+  EXPECT_STREQ(static_cast<PNGChunkData_tEXt*>(texts->parsed_data)->text, "v");
+  PNGFreeRawChunk(texts);
+}
+
+TEST_F(ChunkDataTestSuite, LoadRawChunkListLimits) {
+  test_utils::VectorWrapper<uint8_t> stream;
+  stream.Append(std::vector<uint8_t>(std::begin(s_png_signature), std::end(s_png_signature)));
+  test_utils::AppendChunk(stream, CHUNK_IHDR, {0, 0, 0x10, 0, 0, 0, 0x10, 0, 8, 0, 0, 0, 0});
+  test_utils::AppendChunk(stream, CHUNK_tEXt, {'k', '\0', 'v'});
+  test_utils::AppendChunk(stream, CHUNK_IDAT, std::vector<uint8_t>(100));
+  test_utils::AppendChunk(stream, CHUNK_IEND, {});
+
+  PNGChunkLoadOptions options;
+  PNGInitChunkLoadOptions(&options);
+  options.limits.max_chunks_count = 4;
+  options.limits.max_chunk_memory_bytes = 116;
+  options.limits.max_pixels = 4096 * 4096;
+  PNGRawChunk* chunks = PNGLoadRawChunkListWithOptions(stream.data(), stream.size(), true, &options);
+  EXPECT_NE(nullptr, chunks);
+  PNGFreeRawChunk(chunks);
+
+  /* Skipped chunks are counted, but take no memory */
+  options.allowed_types = &CHUNK_IDAT;
+  options.allowed_types_count = 1;
+  options.limits.max_chunk_memory_bytes = 100;
+  chunks = PNGLoadRawChunkListWithOptions(stream.data(), stream.size(), true, &options);
+  EXPECT_NE(nullptr, chunks);
+  PNGFreeRawChunk(chunks);
+  options.allowed_types = nullptr;
+
+  options.limits.max_chunks_count = 3;
+  EXPECT_EQ(nullptr, PNGLoadRawChunkListWithOptions(stream.data(), stream.size(), true, &options));
+  options.limits.max_chunks_count = 4;
+  options.limits.max_chunk_memory_bytes = 115;
+  EXPECT_EQ(nullptr, PNGLoadRawChunkListWithOptions(stream.data(), stream.size(), true, &options));
+  options.limits.max_chunk_memory_bytes = 0;
+  options.limits.max_pixels = 4096 * 4096 - 1;
+  EXPECT_EQ(nullptr, PNGLoadRawChunkListWithOptions(stream.data(), stream.size(), true, &options));
+
+  /* Default limits reject IHDR of 2^31-1 x 2^31-1 before anything else is loaded */
+  stream[16] = stream[20] = 0x7F;
+  stream[17] = stream[18] = stream[19] = stream[21] = stream[22] = stream[23] = 0xFF;
+  EXPECT_EQ(nullptr, PNGLoadRawChunkList(stream.data(), stream.size(), true));
+}
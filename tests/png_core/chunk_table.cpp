@@ -0,0 +1,160 @@
+#include <png_core/chunk_data.h>
+#include <png_core/chunk_table.h>
+
+#include "../test_utils.h"
+
+/// Test set for chunk index from `png_core/chunk_table.h`
+class ChunkTableTestSuite : public ::testing::Test {
+protected:
+  void SetUp() override {
+    PNGInitChunkTable(&table_);
+  }
+
+  void TearDown() override {
+    PNGFreeChunkTable(&table_);
+  }
+
+  /// Collect entry ids in file order
+  std::vector<int> FileOrder() const {
+    std::vector<int> entries;
+    for (int entry = table_.head; entry != PNG_CHUNK_TABLE_NO_ENTRY; entry = table_.next[entry])
+      entries.push_back(entry);
+    return entries;
+  }
+
+protected:
+  PNGChunkTable table_;
+};
+
+TEST_F(ChunkTableTestSuite, BuildFromDatastream) {
+  test_utils::VectorWrapper<uint8_t> stream;
+  stream.Append(std::vector<uint8_t>(std::begin(s_png_signature), std::end(s_png_signature)));
+  test_utils::AppendChunk(stream, CHUNK_IHDR, std::vector<uint8_t>(13, 0), 1);
+  test_utils::AppendChunk(stream, CHUNK_tEXt, std::vector<uint8_t>(5, 't'), 2);
+  test_utils::AppendChunk(stream, CHUNK_IDAT, std::vector<uint8_t>(100, 0xAA), 3);
+  test_utils::AppendChunk(stream, CHUNK_IDAT, std::vector<uint8_t>(7, 0xBB), 4);
+  test_utils::AppendChunk(stream, CHUNK_tEXt, std::vector<uint8_t>(3, 'u'), 5);
+  test_utils::AppendChunk(stream, CHUNK_IEND, {}, 6);
+
+  ASSERT_TRUE(PNGBuildChunkTable(stream.data(), stream.size(), true, &table_));
+  EXPECT_EQ(table_.count, 6);
+
+  const int ihdr = PNGChunkTableFindFirst(&table_, CHUNK_IHDR);
+  ASSERT_NE(ihdr, PNG_CHUNK_TABLE_NO_ENTRY);
+  EXPECT_EQ(table_.offsets[ihdr], 8 + 8);
+  EXPECT_EQ(table_.sizes[ihdr], 13);
+  EXPECT_EQ(table_.crcs[ihdr], 1);
+
+  EXPECT_EQ(PNGChunkTableCountOfType(&table_, CHUNK_tEXt), 2);
+  EXPECT_EQ(PNGChunkTableCountOfType(&table_, CHUNK_PLTE), 0);
+  EXPECT_EQ(PNGChunkTableFindFirst(&table_, CHUNK_PLTE), PNG_CHUNK_TABLE_NO_ENTRY);
+
+  std::vector<int> texts(PNGChunkTableFindAll(&table_, CHUNK_tEXt, nullptr));
+  PNGChunkTableFindAll(&table_, CHUNK_tEXt, texts.data());
+  ASSERT_EQ(texts.size(), 2);
+  EXPECT_EQ(stream[table_.offsets[texts[0]]], 't');
+  EXPECT_EQ(stream[table_.offsets[texts[1]]], 'u');
+
+  int spans_count = 0;
+  const PNGChunkSpan* spans = PNGChunkTableGetIDATSpans(&table_, &spans_count);
+  ASSERT_EQ(spans_count, 2);
+  EXPECT_EQ(spans[0].size, 100);
+  EXPECT_EQ(stream[spans[0].offset], 0xAA);
+  EXPECT_EQ(spans[1].size, 7);
+  EXPECT_EQ(stream[spans[1].offset], 0xBB);
+}
+
+TEST_F(ChunkTableTestSuite, BuildFromMalformedDatastream) {
+  test_utils::VectorWrapper<uint8_t> stream;
+  test_utils::AppendChunk(stream, CHUNK_IHDR, std::vector<uint8_t>(13, 0), 1);
+  // Data size exceeds buffer
+  stream.AppendBytes((uint32_t)100, true);
+  stream.Append(std::vector<uint8_t>(std::begin(CHUNK_IDAT.byte_array), std::end(CHUNK_IDAT.byte_array)));
+  stream.Append(std::vector<uint8_t>(10, 0));
+
+  EXPECT_FALSE(PNGBuildChunkTable(stream.data(), stream.size(), false, &table_));
+  // Missing signature
+  EXPECT_FALSE(PNGBuildChunkTable(stream.data(), stream.size(), true, &table_));
+}
+
+TEST_F(ChunkTableTestSuite, EditEntries) {
+  const int ihdr = PNGChunkTableAppend(&table_, CHUNK_IHDR, 0, 13, 0);
+  const int idat1 = PNGChunkTableAppend(&table_, CHUNK_IDAT, 100, 10, 0);
+  const int idat2 = PNGChunkTableAppend(&table_, CHUNK_IDAT, 200, 20, 0);
+  const int iend = PNGChunkTableAppend(&table_, CHUNK_IEND, 300, 0, 0);
+  EXPECT_EQ(FileOrder(), (std::vector<int>{ihdr, idat1, idat2, iend}));
+
+  // Insert IDAT between existing ones and check same type order
+  const int idat_mid = PNGChunkTableInsert(&table_, idat2, CHUNK_IDAT, 150, 15, 0);
+  ASSERT_NE(idat_mid, PNG_CHUNK_TABLE_NO_ENTRY);
+  EXPECT_EQ(FileOrder(), (std::vector<int>{ihdr, idat1, idat_mid, idat2, iend}));
+  std::vector<int> idats(PNGChunkTableCountOfType(&table_, CHUNK_IDAT));
+  PNGChunkTableFindAll(&table_, CHUNK_IDAT, idats.data());
+  EXPECT_EQ(idats, (std::vector<int>{idat1, idat_mid, idat2}));
+
+  int spans_count = 0;
+  const PNGChunkSpan* spans = PNGChunkTableGetIDATSpans(&table_, &spans_count);
+  ASSERT_EQ(spans_count, 3);
+  EXPECT_EQ(spans[1].offset, 150);
+
+  // Insert before the first chunk
+  const int text = PNGChunkTableInsert(&table_, ihdr, CHUNK_tEXt, 500, 1, 0);
+  EXPECT_EQ(table_.head, text);
+
+  ASSERT_TRUE(PNGChunkTableRemove(&table_, idat1));
+  EXPECT_FALSE(PNGChunkTableRemove(&table_, idat1));
+  EXPECT_EQ(PNGChunkTableFindFirst(&table_, CHUNK_IDAT), idat_mid);
+  spans = PNGChunkTableGetIDATSpans(&table_, &spans_count);
+  ASSERT_EQ(spans_count, 2);
+  EXPECT_EQ(spans[0].offset, 150);
+
+  ASSERT_TRUE(PNGChunkTableRemove(&table_, iend));
+  EXPECT_EQ(table_.tail, idat2);
+  EXPECT_EQ(PNGChunkTableCountOfType(&table_, CHUNK_IEND), 0);
+  EXPECT_EQ(PNGChunkTableFindFirst(&table_, CHUNK_IEND), PNG_CHUNK_TABLE_NO_ENTRY);
+
+  // Removed slot is reused
+  const int reused = PNGChunkTableAppend(&table_, CHUNK_IEND, 400, 0, 0);
+  EXPECT_EQ(reused, iend);
+  EXPECT_EQ(FileOrder(), (std::vector<int>{text, ihdr, idat_mid, idat2, reused}));
+  EXPECT_EQ(table_.count, 5);
+}
+
+TEST_F(ChunkTableTestSuite, NoIDATChunks) {
+  // Empty spans are not NULL, which means failed allocation
+  int spans_count = -1;
+  EXPECT_NE(PNGChunkTableGetIDATSpans(&table_, &spans_count), nullptr);
+  EXPECT_EQ(spans_count, 0);
+
+  ASSERT_NE(PNGChunkTableAppend(&table_, CHUNK_IHDR, 16, 13, 0), PNG_CHUNK_TABLE_NO_ENTRY);
+  const int idat = PNGChunkTableAppend(&table_, CHUNK_IDAT, 41, 10, 0);
+  spans_count = -1;
+  EXPECT_NE(PNGChunkTableGetIDATSpans(&table_, &spans_count), nullptr);
+  EXPECT_EQ(spans_count, 1);
+
+  ASSERT_TRUE(PNGChunkTableRemove(&table_, idat));
+  spans_count = -1;
+  EXPECT_NE(PNGChunkTableGetIDATSpans(&table_, &spans_count), nullptr);
+  EXPECT_EQ(spans_count, 0);
+}
+
+TEST_F(ChunkTableTestSuite, ManyChunkTypes) {
+  // Enough types and entries to grow all internal storages
+  for (int i = 0; i < 1000; ++i) {
+    ChunkType type;
+    type.byte1 = 'a' + i % 26;
+    type.byte2 = 'A' + i / 26 % 26;
+    type.byte3 = 'X';
+    type.byte4 = 't';
+    ASSERT_NE(PNGChunkTableAppend(&table_, type, i, i, i), PNG_CHUNK_TABLE_NO_ENTRY);
+  }
+  EXPECT_EQ(table_.count, 1000);
+
+  ChunkType type;
+  type.byte1 = 'a';
+  type.byte2 = 'A';
+  type.byte3 = 'X';
+  type.byte4 = 't';
+  EXPECT_EQ(PNGChunkTableCountOfType(&table_, type), 2);
+  EXPECT_EQ(table_.offsets[PNGChunkTableFindFirst(&table_, type)], 0);
+}
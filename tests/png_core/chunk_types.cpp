@@ -28,6 +28,7 @@ TEST_F(ChunkTypesTestSuite, TestChunkTypesValues) {
   type_to_expected[CHUNK_gAMA] = {103, 65, 77, 65};
   type_to_expected[CHUNK_IDAT] = {73, 68, 65, 84};
   type_to_expected[CHUNK_sBIT] = {115, 66, 73, 84};
+  type_to_expected[CHUNK_tRNS] = {116, 82, 78, 83};
 
   for (const auto& [type, expected] : type_to_expected) {
     const auto type_vec = to_vector(type);
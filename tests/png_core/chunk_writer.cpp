@@ -0,0 +1,130 @@
+#include <png_core/chunk_writer.h>
+
+#include <cstdio>
+
+#include "../test_utils.h"
+
+/// Test set for streaming chunk writers from `png_core/chunk_writer.h`
+class ChunkWriterTestSuite : public ::testing::Test {
+protected:
+  void SetUp() override {
+    test_utils::VectorWrapper<uint8_t> stream;
+    stream.Append(std::vector<uint8_t>(std::begin(s_png_signature), std::end(s_png_signature)));
+    test_utils::AppendChunk(stream, CHUNK_IHDR, {0, 0, 0, 1, 0, 0, 0, 1, 8, 0, 0, 0, 0}, 0x11223344);
+    test_utils::AppendChunk(stream, CHUNK_tEXt, {'k', 'e', 'y', '\0', 'v', 'a', 'l'}, 0x55667788);
+    test_utils::AppendChunk(stream, CHUNK_IDAT, std::vector<uint8_t>(1000, 0x42), 0x99AABBCC);
+    test_utils::AppendChunk(stream, CHUNK_IEND, {}, 0xAE426082);
+    stream_ = stream;
+
+    chunk_list_ = PNGLoadRawChunkList(stream_.data(), stream_.size(), true);
+    ASSERT_TRUE(chunk_list_);
+  }
+
+  void TearDown() override {
+    PNGFreeRawChunk(chunk_list_);
+  }
+
+  /// Sink collecting all pieces into vector
+  static bool VectorSink(const PNGIOVec* vecs, int vecs_count, void* user_data) {
+    auto* out = static_cast<std::vector<uint8_t>*>(user_data);
+    for (int i = 0; i < vecs_count; ++i) {
+      const auto* base = static_cast<const uint8_t*>(vecs[i].base);
+      out->insert(out->end(), base, base + vecs[i].length);
+    }
+    return true;
+  }
+
+protected:
+  std::vector<uint8_t> stream_;
+  PNGRawChunk* chunk_list_ = nullptr;
+};
+
+TEST_F(ChunkWriterTestSuite, WriteToSink) {
+  std::vector<uint8_t> written;
+  const auto size = PNGWriteRawChunkListToSink(chunk_list_, true, VectorSink, &written);
+  EXPECT_EQ(size, stream_.size());
+  EXPECT_EQ(written, stream_);
+}
+
+TEST_F(ChunkWriterTestSuite, WriteParsedDataToSink) {
+  // Drop raw data of tEXt chunk, so it is serialized from parsed data
+  PNGRawChunk* text = chunk_list_->next;
+  ASSERT_EQ(text->type.bytes, CHUNK_tEXt.bytes);
+  free(text->raw_data);
+  text->raw_data = nullptr;
+
+  std::vector<uint8_t> written;
+  const auto size = PNGWriteRawChunkListToSink(chunk_list_, false, VectorSink, &written);
+  EXPECT_EQ(size, stream_.size() - sizeof(s_png_signature));
+  EXPECT_EQ(written, std::vector<uint8_t>(stream_.begin() + sizeof(s_png_signature), stream_.end()));
+
+  // Buffer writer produces the same datastream
+  std::vector<uint8_t> buffer(PNGWriteRawChunkList(chunk_list_, nullptr, false));
+  PNGWriteRawChunkList(chunk_list_, buffer.data(), false);
+  EXPECT_EQ(buffer, written);
+}
+
+TEST_F(ChunkWriterTestSuite, ParsedChunkIsOnePiece) {
+  PNGRawChunk* text = chunk_list_->next;
+  free(text->raw_data);
+  text->raw_data = nullptr;
+  const size_t text_size = PNGWriteRawChunk(text, nullptr);
+
+  // Serialized chunk is passed as a single piece between IHDR CRC and IDAT header
+  static const auto pieces_sink = [](const PNGIOVec* vecs, int vecs_count, void* user_data) {
+    auto* lengths = static_cast<std::vector<size_t>*>(user_data);
+    for (int i = 0; i < vecs_count; ++i)
+      lengths->push_back(vecs[i].length);
+    return true;
+  };
+  std::vector<size_t> lengths;
+  ASSERT_EQ(PNGWriteRawChunkListToSink(chunk_list_, false, pieces_sink, &lengths), stream_.size() - 8);
+  EXPECT_EQ(lengths, std::vector<size_t>({8, 13, 4, text_size, 8, 1000, 4, 8, 4}));
+}
+
+TEST_F(ChunkWriterTestSuite, WriteParsedDataOnce) {
+  PNGRawChunk* text = chunk_list_->next;
+  free(text->raw_data);
+  text->raw_data = nullptr;
+
+  static int write_calls = 0;
+  write_calls = 0;
+  text->data_functions.write_func = [](const void* obj, uint8_t* out) {
+    ++write_calls;
+    return (uint32_t)PNGWriteData_tEXt(static_cast<const PNGChunkData_tEXt*>(obj), out);
+  };
+
+  std::vector<uint8_t> written;
+  ASSERT_EQ(PNGWriteRawChunkListToSink(chunk_list_, true, VectorSink, &written), stream_.size());
+  EXPECT_EQ(written, stream_);
+  EXPECT_EQ(write_calls, 1);
+
+  // Sizing pass of buffer writer does not serialize chunk data
+  write_calls = 0;
+  std::vector<uint8_t> buffer(PNGWriteRawChunkList(chunk_list_, nullptr, true));
+  EXPECT_EQ(write_calls, 0);
+  PNGWriteRawChunkList(chunk_list_, buffer.data(), true);
+  EXPECT_EQ(write_calls, 1);
+  EXPECT_EQ(buffer, stream_);
+}
+
+TEST_F(ChunkWriterTestSuite, AbortWriting) {
+  static const auto failing_sink = [](const PNGIOVec*, int, void*) {
+    return false;
+  };
+  EXPECT_EQ(PNGWriteRawChunkListToSink(chunk_list_, true, failing_sink, nullptr), -1);
+}
+
+TEST_F(ChunkWriterTestSuite, WriteToFd) {
+  std::FILE* file = std::tmpfile();
+  ASSERT_TRUE(file);
+
+  const auto size = PNGWriteRawChunkListToFd(chunk_list_, fileno(file), true);
+  EXPECT_EQ(size, stream_.size());
+
+  std::rewind(file);
+  std::vector<uint8_t> written(stream_.size() + 1);
+  written.resize(std::fread(written.data(), 1, written.size(), file));
+  EXPECT_EQ(written, stream_);
+  std::fclose(file);
+}
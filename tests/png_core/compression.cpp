@@ -1,11 +1,64 @@
 #include <png_core/compression.h>
 
+#include <random>
+
+#include <zlib.h>
+
 #include "../test_utils.h"
 
 /// Test set for compression functions
 class CompressionTestSuite : public ::testing::Test {
 protected:
-  static inline std::vector<PNGDataDecompressionFunction> decompression_functions_ = {PNGDataDecompress0};
+  static inline std::vector<PNGDataDecompressionFunction> decompression_functions_ = {PNGDataDecompress0,
+                                                                                      PNGDataDecompress0Builtin};
+
+  static std::vector<uint8_t> Compress(const std::vector<uint8_t>& data, int level, int strategy, int window_bits) {
+    z_stream stream = {};
+    EXPECT_EQ(Z_OK, deflateInit2(&stream, level, Z_DEFLATED, window_bits, 8, strategy));
+    std::vector<uint8_t> compressed(deflateBound(&stream, data.size()));
+    stream.next_in = const_cast<Bytef*>(data.data());
+    stream.avail_in = (uInt)data.size();
+    stream.next_out = compressed.data();
+    stream.avail_out = (uInt)compressed.size();
+    EXPECT_EQ(Z_STREAM_END, deflate(&stream, Z_FINISH));
+    compressed.resize(stream.total_out);
+    deflateEnd(&stream);
+    return compressed;
+  }
+
+  /// Data of PNG-like statistics: runs, repeats at pixel distances, noise and literal-heavy parts
+  static std::vector<uint8_t> GenerateData(size_t size, uint32_t seed) {
+    std::mt19937 generator(seed);
+    std::vector<uint8_t> data;
+    while (data.size() < size) {
+      const size_t part_size = generator() % 600 + 1;
+      switch (generator() % 4) {
+        case 0: data.insert(data.end(), part_size, (uint8_t)generator()); break;
+        case 1: {
+          const size_t distance = generator() % 20 + 1;
+          for (size_t i = 0; i < part_size; ++i)
+            data.push_back(data.size() >= distance ? data[data.size() - distance] : (uint8_t)generator());
+          break;
+        }
+        case 2:
+          for (size_t i = 0; i < part_size; ++i)
+            data.push_back((uint8_t)generator());
+          break;
+        default:
+          for (size_t i = 0; i < part_size; ++i)
+            data.push_back((uint8_t)(generator() % 8 + 'a'));
+          break;
+      }
+    }
+    data.resize(size);
+    return data;
+  }
+
+  /// zlib decompression into buffer of exact size, the contract of the built-in engine
+  static bool DecompressExactly(const std::vector<uint8_t>& compressed, std::vector<uint8_t>& out) {
+    uLongf out_size = out.size();
+    return uncompress(out.data(), &out_size, compressed.data(), compressed.size()) == Z_OK && out_size == out.size();
+  }
 };
 
 TEST_F(CompressionTestSuite, TestCompressionMethodEnum) {
@@ -14,6 +67,63 @@ TEST_F(CompressionTestSuite, TestCompressionMethodEnum) {
 
 TEST_F(CompressionTestSuite, TestCompressionMethodsGetters) {
   EXPECT_EQ(PNGDataDecompress0, PNGGetDataDecompressionFunction(PNGCompressionMethod::PNG_COMPRESSION_METHOD_0));
+  EXPECT_EQ(PNGDataDecompress0, PNGGetDataDecompressionFunctionWithEngine(PNG_COMPRESSION_METHOD_0,
+                                                                          PNG_INFLATE_ENGINE_ZLIB));
+  EXPECT_EQ(PNGDataDecompress0Builtin, PNGGetDataDecompressionFunctionWithEngine(PNG_COMPRESSION_METHOD_0,
+                                                                                 PNG_INFLATE_ENGINE_BUILTIN));
+  EXPECT_EQ(nullptr, PNGGetDataDecompressionFunctionWithEngine(1, PNG_INFLATE_ENGINE_BUILTIN));
+  EXPECT_EQ(PNGDataCompress0, PNGGetDataCompressionFunction(PNG_COMPRESSION_METHOD_0));
+  EXPECT_EQ(nullptr, PNGGetDataCompressionFunction(1));
+}
+
+TEST_F(CompressionTestSuite, TestCompressionFunctions) {
+  PNGCompressionParams params;
+  PNGInitCompressionParams(&params);
+  EXPECT_EQ(6, params.level);
+  EXPECT_EQ(PNG_COMPRESSION_STRATEGY_DEFAULT, params.strategy);
+  EXPECT_EQ(15, params.window_bits);
+  EXPECT_EQ(8, params.mem_level);
+
+  const auto data = GenerateData(300000, 7);
+  /* Streams are the same as of zlib deflate with the same parameters */
+  for (int strategy : {Z_DEFAULT_STRATEGY, Z_FILTERED, Z_HUFFMAN_ONLY, Z_RLE, Z_FIXED})
+    for (int level : {1, 9})
+      for (int window_bits : {9, 15}) {
+        SCOPED_TRACE(testing::Message() << "strategy " << strategy << " level " << level << " window " << window_bits);
+        params.level = level;
+        params.strategy = (PNGCompressionStrategy)strategy;
+        params.window_bits = window_bits;
+        int compressed_size = 0;
+        uint8_t* compressed = PNGDataCompress0WithParams(data.data(), data.size(), &params, &compressed_size);
+        ASSERT_NE(nullptr, compressed);
+        EXPECT_EQ(Compress(data, level, strategy, window_bits),
+                  std::vector<uint8_t>(compressed, compressed + compressed_size));
+        PNGFreeCompressionData(compressed);
+      }
+
+  int compressed_size = 0;
+  uint8_t* compressed = PNGDataCompress0(data.data(), data.size(), 9, &compressed_size);
+  ASSERT_NE(nullptr, compressed);
+  std::vector<uint8_t> decompressed(data.size());
+  EXPECT_TRUE(DecompressExactly(std::vector<uint8_t>(compressed, compressed + compressed_size), decompressed));
+  EXPECT_EQ(data, decompressed);
+  PNGFreeCompressionData(compressed);
+
+  auto expect_rejected = [&](const PNGCompressionParams& params) {
+    EXPECT_EQ(nullptr, PNGDataCompress0WithParams(data.data(), data.size(), &params, &compressed_size));
+  };
+  PNGInitCompressionParams(&params);
+  params.level = 10;
+  expect_rejected(params);
+  PNGInitCompressionParams(&params);
+  params.strategy = (PNGCompressionStrategy)5;
+  expect_rejected(params);
+  PNGInitCompressionParams(&params);
+  params.window_bits = 8;
+  expect_rejected(params);
+  PNGInitCompressionParams(&params);
+  params.mem_level = 10;
+  expect_rejected(params);
 }
 
 TEST_F(CompressionTestSuite, TestDecompressionFunctions) {
@@ -70,12 +180,60 @@ TEST_F(CompressionTestSuite, TestDecompressionFunctions) {
 
   for (const auto decompression_function : decompression_functions_) {
     uint8_t* decompressed_data =
-        PNGDataDecompress0(source_compressed_data.data(), source_compressed_data.size(), source_string.size());
+        decompression_function(source_compressed_data.data(), source_compressed_data.size(), source_string.size());
     ASSERT_TRUE(decompressed_data);
 
-    const auto decompressed_string = std::string((char*)decompressed_data);
+    const auto decompressed_string = std::string((char*)decompressed_data, source_string.size());
     EXPECT_EQ(source_string, decompressed_string);
 
     PNGFreeCompressionData(decompressed_data);
   }
 }
+
+TEST_F(CompressionTestSuite, BuiltinEngineMatchesZlib) {
+  const std::vector<std::tuple<int, int, int>> settings = {
+      {0, Z_DEFAULT_STRATEGY, 15}, {1, Z_DEFAULT_STRATEGY, 15}, {6, Z_DEFAULT_STRATEGY, 15},
+      {9, Z_DEFAULT_STRATEGY, 15}, {6, Z_FILTERED, 15},         {6, Z_HUFFMAN_ONLY, 15},
+      {6, Z_RLE, 15},              {6, Z_FIXED, 15},            {9, Z_DEFAULT_STRATEGY, 9}};
+  for (size_t size : {0, 1, 2, 3, 17, 258, 1000, 65535, 300000}) {
+    const auto data = GenerateData(size, (uint32_t)size);
+    for (const auto& [level, strategy, window_bits] : settings) {
+      const auto compressed = Compress(data, level, strategy, window_bits);
+      uint8_t* decompressed = PNGDataDecompress0Builtin(compressed.data(), compressed.size(), data.size());
+      ASSERT_NE(nullptr, decompressed) << size << " " << level << " " << strategy;
+      EXPECT_TRUE(std::equal(data.begin(), data.end(), decompressed)) << size << " " << level << " " << strategy;
+      PNGFreeCompressionData(decompressed);
+
+      /* Output size must be exact */
+      EXPECT_EQ(nullptr, PNGDataDecompress0Builtin(compressed.data(), compressed.size(), data.size() + 1));
+      if (size) {
+        EXPECT_EQ(nullptr, PNGDataDecompress0Builtin(compressed.data(), compressed.size(), data.size() - 1));
+      }
+    }
+  }
+}
+
+TEST_F(CompressionTestSuite, BuiltinEngineRejectsWhatZlibRejects) {
+  const auto data = GenerateData(5000, 1);
+  std::mt19937 generator(2);
+  for (const int strategy : {Z_DEFAULT_STRATEGY, Z_FIXED, Z_RLE}) {
+    const auto compressed = Compress(data, 6, strategy, 15);
+    for (size_t size = 0; size < compressed.size(); ++size)
+      EXPECT_EQ(nullptr, PNGDataDecompress0Builtin(compressed.data(), size, data.size())) << size;
+
+    /* Damaged streams are either rejected by both or decoded the same */
+    std::vector<uint8_t> expected(data.size());
+    for (int i = 0; i < 1000; ++i) {
+      auto damaged = compressed;
+      for (int flips = generator() % 3 + 1; flips; --flips)
+        damaged[generator() % damaged.size()] ^= (uint8_t)(1 << generator() % 8);
+      const bool zlib_ok = DecompressExactly(damaged, expected);
+      uint8_t* decompressed = PNGDataDecompress0Builtin(damaged.data(), damaged.size(), data.size());
+      ASSERT_EQ(zlib_ok, decompressed != nullptr) << strategy << " " << i;
+      if (decompressed) {
+        EXPECT_TRUE(std::equal(expected.begin(), expected.end(), decompressed));
+      }
+      PNGFreeCompressionData(decompressed);
+    }
+  }
+}
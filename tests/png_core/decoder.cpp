@@ -0,0 +1,898 @@
+#include <png_core/decoder.h>
+#include <png_core/filtering.h>
+
+#include <cmath>
+#include <cstring>
+#include <random>
+
+#include "../test_utils.h"
+
+class DecoderTestSuite : public ::testing::Test {
+protected:
+  /// Odd width to cover both SIMD blocks and scalar tails
+  static constexpr int width_ = 37;
+  static constexpr int height_ = 3;
+
+  static std::vector<uint8_t> RandomBytes(size_t size, uint32_t seed) {
+    std::mt19937 generator(seed);
+    std::vector<uint8_t> bytes(size);
+    for (auto& byte : bytes)
+      byte = (uint8_t)generator();
+    return bytes;
+  }
+
+  static int ScanlineSize(int width, int bit_depth, int color_type) {
+    return (width * PNGGetChannelCount((PNGImageType)color_type) * bit_depth + 7) / 8;
+  }
+
+  /// Sample `index` of plain scanline
+  static int Sample(const uint8_t* scanline, int index, int bit_depth) {
+    if (bit_depth == 16)
+      return (scanline[2 * index] << 8) | scanline[2 * index + 1];
+    if (bit_depth == 8)
+      return scanline[index];
+    const int per_byte = 8 / bit_depth;
+    const int shift = 8 - bit_depth * (index % per_byte + 1);
+    return (scanline[index / per_byte] >> shift) & ((1 << bit_depth) - 1);
+  }
+
+  /// Reference RGBA8 pixel of plain image
+  static std::array<uint8_t, 4> ReferenceRGBA8(const std::vector<uint8_t>& plain, int x, int y, int bit_depth,
+                                               int color_type, const std::vector<uint8_t>& palette = {}) {
+    const int channels = PNGGetChannelCount((PNGImageType)color_type);
+    const uint8_t* scanline = plain.data() + y * ScanlineSize(width_, bit_depth, color_type);
+    if (color_type == PNG_IMAGE_TYPE_INDEXED) {
+      const int index = Sample(scanline, x, bit_depth);
+      return {palette[3 * index], palette[3 * index + 1], palette[3 * index + 2], 0xFF};
+    }
+
+    std::array<int, 4> values;
+    for (int c = 0; c < channels; ++c) {
+      const int max = (1 << bit_depth) - 1;
+      const int v = Sample(scanline, x * channels + c, bit_depth);
+      values[c] = (v * 255 + max / 2) / max;
+    }
+    switch (color_type) {
+      case PNG_IMAGE_TYPE_GREYSCALE: return {(uint8_t)values[0], (uint8_t)values[0], (uint8_t)values[0], 0xFF};
+      case PNG_IMAGE_TYPE_GREYSCALEWITHAPLHA:
+        return {(uint8_t)values[0], (uint8_t)values[0], (uint8_t)values[0], (uint8_t)values[1]};
+      case PNG_IMAGE_TYPE_TRUECOLOR: return {(uint8_t)values[0], (uint8_t)values[1], (uint8_t)values[2], 0xFF};
+      default: return {(uint8_t)values[0], (uint8_t)values[1], (uint8_t)values[2], (uint8_t)values[3]};
+    }
+  }
+
+  /// zlib stream of `size` zeros: a literal and repeated 258-byte matches at distance 1 in one fixed Huffman block
+  static std::vector<uint8_t> ZlibZeros(size_t size) {
+    std::vector<uint8_t> stream = {0x78, 0x01};
+    uint32_t bits = 0;
+    int bits_count = 0;
+    /* Huffman codes are packed starting from their most significant bit */
+    const auto put_code = [&](uint32_t code, int length) {
+      for (int i = length - 1; i >= 0; --i) {
+        bits |= ((code >> i) & 1) << bits_count;
+        if (++bits_count == 8) {
+          stream.push_back((uint8_t)bits);
+          bits = 0;
+          bits_count = 0;
+        }
+      }
+    };
+    /* Final block with fixed codes: BFINAL=1, BTYPE=01 */
+    put_code(1, 1);
+    put_code(1, 1);
+    put_code(0, 1);
+    put_code(0x30, 8);
+    size_t remaining = size - 1;
+    for (; remaining >= 258; remaining -= 258) {
+      put_code(0xC5, 8);
+      put_code(0, 5);
+    }
+    for (; remaining > 0; --remaining)
+      put_code(0x30, 8);
+    put_code(0, 7);
+    if (bits_count)
+      stream.push_back((uint8_t)bits);
+    /* Adler-32 of zeros: a stays 1, b grows by 1 per byte */
+    const uint32_t adler = (uint32_t)(size % 65521) << 16 | 1;
+    for (int shift = 24; shift >= 0; shift -= 8)
+      stream.push_back((uint8_t)(adler >> shift));
+    return stream;
+  }
+
+  static PNGImage Decode(const std::vector<uint8_t>& png, PNGPixelFormat format, bool flip = false,
+                         PNGGammaCorrection gamma_correction = PNG_GAMMA_CORRECTION_NONE, bool premultiply = false) {
+    PNGDecodeOptions options;
+    PNGInitDecodeOptions(&options);
+    options.format = format;
+    options.flip_vertically = flip;
+    options.gamma_correction = gamma_correction;
+    options.premultiply_alpha = premultiply;
+    return Decode(png, options);
+  }
+
+  static PNGImage Decode(const std::vector<uint8_t>& png, const PNGDecodeOptions& options) {
+    PNGRawChunk* chunks = PNGLoadRawChunkList(png.data(), png.size(), true);
+    EXPECT_NE(nullptr, chunks);
+
+    PNGImage image;
+    const bool decoded = PNGDecodeImage(chunks, &options, &image);
+    EXPECT_TRUE(decoded);
+    PNGFreeRawChunk(chunks);
+    return image;
+  }
+};
+
+TEST_F(DecoderTestSuite, ImageSizes) {
+  PNGChunkData_IHDR header = {10, 3, 1, PNG_IMAGE_TYPE_GREYSCALE, 0, 0, 0};
+  EXPECT_EQ(2, PNGGetScanlineSizeBytes(&header));
+  EXPECT_EQ(9, PNGGetFilteredImageSizeBytes(&header));
+
+  header.bit_depth = 16;
+  header.color_type = PNG_IMAGE_TYPE_TRUECOLOR;
+  EXPECT_EQ(60, PNGGetScanlineSizeBytes(&header));
+  EXPECT_EQ(183, PNGGetFilteredImageSizeBytes(&header));
+
+  EXPECT_EQ(4, PNGGetPixelFormatSizeBytes(PNG_PIXEL_FORMAT_BGRA8));
+  EXPECT_EQ(8, PNGGetPixelFormatSizeBytes(PNG_PIXEL_FORMAT_RGBA16));
+}
+
+TEST_F(DecoderTestSuite, DefilterScanlineInPlace) {
+  const int size = 29;
+  const int bpp = 3;
+  const auto previous = RandomBytes(size, 1);
+  const auto filtered = RandomBytes(size, 2);
+
+  for (uint8_t filter_type = 0; filter_type < 5; ++filter_type) {
+    std::vector<uint8_t> expected(size);
+    for (int i = 0; i < size; ++i) {
+      const int a = i >= bpp ? expected[i - bpp] : 0;
+      const int b = previous[i];
+      const int c = i >= bpp ? previous[i - bpp] : 0;
+      int predictor = 0;
+      switch (filter_type) {
+        case 1: predictor = a; break;
+        case 2: predictor = b; break;
+        case 3: predictor = (a + b) / 2; break;
+        case 4: {
+          const int p = a + b - c;
+          const int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+          predictor = pa <= pb && pa <= pc ? a : (pb <= pc ? b : c);
+          break;
+        }
+      }
+      expected[i] = (uint8_t)(filtered[i] + predictor);
+    }
+
+    auto in_place = filtered;
+    ASSERT_TRUE(PNGDefilterScanline0(filter_type, in_place.data(), previous.data(), in_place.data(), size, bpp));
+    EXPECT_EQ(expected, in_place);
+  }
+
+  std::vector<uint8_t> out(size);
+  EXPECT_FALSE(PNGDefilterScanline0(5, filtered.data(), previous.data(), out.data(), size, bpp));
+}
+
+TEST_F(DecoderTestSuite, DecodeToRGBA8) {
+  struct Case {
+    int bit_depth;
+    int color_type;
+  };
+  const std::vector<Case> cases = {{1, 0}, {2, 0}, {4, 0}, {8, 0}, {16, 0}, {8, 2}, {16, 2},
+                                   {8, 4}, {16, 4}, {8, 6}, {16, 6}, {2, 3}, {8, 3}};
+  const auto palette = RandomBytes(256 * 3, 3);
+
+  for (const auto& [bit_depth, color_type] : cases) {
+    SCOPED_TRACE(testing::Message() << "bit depth " << bit_depth << ", color type " << color_type);
+    const int scanline_size = ScanlineSize(width_, bit_depth, color_type);
+    const auto plain = RandomBytes(scanline_size * height_, bit_depth * 10 + color_type);
+    const auto png = test_utils::CreatePNG(width_, height_, bit_depth, color_type,
+                                           test_utils::AddFilterBytes(plain, scanline_size), {{CHUNK_PLTE, palette}});
+
+    PNGImage image = Decode(png, PNG_PIXEL_FORMAT_RGBA8);
+    ASSERT_EQ(width_ * 4, image.row_stride);
+    for (int y = 0; y < height_; ++y)
+      for (int x = 0; x < width_; ++x) {
+        const auto expected = ReferenceRGBA8(plain, x, y, bit_depth, color_type, palette);
+        const uint8_t* pixel = image.data + y * image.row_stride + x * 4;
+        ASSERT_EQ(expected, (std::array<uint8_t, 4>{pixel[0], pixel[1], pixel[2], pixel[3]})) << x << "," << y;
+      }
+    PNGFreeImage(&image);
+  }
+}
+
+TEST_F(DecoderTestSuite, DecodeToOtherFormats) {
+  const std::vector<int> color_types = {0, 2, 4, 6};
+  for (int bit_depth : {8, 16}) {
+    for (int color_type : color_types) {
+      SCOPED_TRACE(testing::Message() << "bit depth " << bit_depth << ", color type " << color_type);
+      const int scanline_size = ScanlineSize(width_, bit_depth, color_type);
+      const auto plain = RandomBytes(scanline_size * height_, bit_depth * 10 + color_type);
+      const auto png = test_utils::CreatePNG(width_, height_, bit_depth, color_type,
+                                             test_utils::AddFilterBytes(plain, scanline_size));
+
+      PNGImage bgra = Decode(png, PNG_PIXEL_FORMAT_BGRA8);
+      PNGImage rgb = Decode(png, PNG_PIXEL_FORMAT_RGB8);
+      PNGImage grey = Decode(png, PNG_PIXEL_FORMAT_G8);
+      PNGImage rgba16 = Decode(png, PNG_PIXEL_FORMAT_RGBA16, true);
+      for (int y = 0; y < height_; ++y)
+        for (int x = 0; x < width_; ++x) {
+          const auto rgba = ReferenceRGBA8(plain, x, y, bit_depth, color_type);
+          const uint8_t* p = bgra.data + y * bgra.row_stride + x * 4;
+          ASSERT_EQ((std::array<uint8_t, 4>{rgba[2], rgba[1], rgba[0], rgba[3]}),
+                    (std::array<uint8_t, 4>{p[0], p[1], p[2], p[3]}));
+          p = rgb.data + y * rgb.row_stride + x * 3;
+          ASSERT_EQ((std::array<uint8_t, 3>{rgba[0], rgba[1], rgba[2]}), (std::array<uint8_t, 3>{p[0], p[1], p[2]}));
+
+          if (color_type == PNG_IMAGE_TYPE_GREYSCALE || color_type == PNG_IMAGE_TYPE_GREYSCALEWITHAPLHA)
+            ASSERT_EQ(rgba[0], grey.data[y * grey.row_stride + x]);
+          else
+            ASSERT_EQ((6969 * rgba[0] + 23434 * rgba[1] + 2365 * rgba[2] + 16384) >> 15,
+                      grey.data[y * grey.row_stride + x]);
+
+          /* 16-bit samples are kept as is, flipped image */
+          const int channels = PNGGetChannelCount((PNGImageType)color_type);
+          const uint8_t* scanline = plain.data() + y * scanline_size;
+          const uint16_t* p16 = (const uint16_t*)(rgba16.data + (height_ - 1 - y) * rgba16.row_stride) + x * 4;
+          const int first = Sample(scanline, x * channels, bit_depth) * (bit_depth == 8 ? 257 : 1);
+          ASSERT_EQ(first, p16[0]);
+          if (channels >= 3) {
+            ASSERT_EQ(Sample(scanline, x * channels + 2, bit_depth) * (bit_depth == 8 ? 257 : 1), p16[2]);
+          }
+          int alpha = 0xFFFF;
+          if (channels % 2 == 0)
+            alpha = Sample(scanline, x * channels + channels - 1, bit_depth) * (bit_depth == 8 ? 257 : 1);
+          ASSERT_EQ(alpha, p16[3]);
+        }
+      PNGFreeImage(&bgra);
+      PNGFreeImage(&rgb);
+      PNGFreeImage(&grey);
+      PNGFreeImage(&rgba16);
+    }
+  }
+}
+
+TEST_F(DecoderTestSuite, DecodeToNative16) {
+  for (int bit_depth : {8, 16}) {
+    for (int color_type : {0, 2, 4, 6}) {
+      SCOPED_TRACE(testing::Message() << "bit depth " << bit_depth << ", color type " << color_type);
+      const int channels = PNGGetChannelCount((PNGImageType)color_type);
+      const int scanline_size = ScanlineSize(width_, bit_depth, color_type);
+      const auto plain = RandomBytes(scanline_size * height_, bit_depth * 10 + color_type + 1);
+      const auto png = test_utils::CreatePNG(width_, height_, bit_depth, color_type,
+                                             test_utils::AddFilterBytes(plain, scanline_size));
+
+      PNGImage grey = Decode(png, PNG_PIXEL_FORMAT_G16);
+      PNGImage rgb = Decode(png, PNG_PIXEL_FORMAT_RGB16);
+      ASSERT_EQ(width_ * 2, grey.row_stride);
+      ASSERT_EQ(width_ * 6, rgb.row_stride);
+      const int scale = bit_depth == 8 ? 257 : 1;
+      for (int y = 0; y < height_; ++y)
+        for (int x = 0; x < width_; ++x) {
+          const uint8_t* scanline = plain.data() + y * scanline_size;
+          int color[3];
+          for (int c = 0; c < 3; ++c)
+            color[c] = Sample(scanline, x * channels + (channels >= 3 ? c : 0), bit_depth);
+
+          const uint16_t* p = (const uint16_t*)(rgb.data + y * rgb.row_stride) + x * 3;
+          ASSERT_EQ(color[0] * scale, p[0]);
+          ASSERT_EQ(color[1] * scale, p[1]);
+          ASSERT_EQ(color[2] * scale, p[2]);
+
+          int luminance = color[0];
+          if (channels >= 3)
+            luminance = (6969 * color[0] + 23434 * color[1] + 2365 * color[2] + 16384) >> 15;
+          ASSERT_EQ(luminance * scale, ((const uint16_t*)(grey.data + y * grey.row_stride))[x]);
+        }
+      PNGFreeImage(&grey);
+      PNGFreeImage(&rgb);
+    }
+  }
+}
+
+TEST_F(DecoderTestSuite, Rounding16To8) {
+  /* Every 16-bit value as greyscale samples */
+  const int width = 256;
+  const int height = 256;
+  std::vector<uint8_t> plain;
+  for (int v = 0; v < 65536; ++v) {
+    plain.push_back(v >> 8);
+    plain.push_back(v & 0xFF);
+  }
+  const auto png = test_utils::CreatePNG(width, height, 16, 0, test_utils::AddFilterBytes(plain, width * 2));
+
+  PNGImage image = Decode(png, PNG_PIXEL_FORMAT_G8);
+  for (int v = 0; v < 65536; ++v)
+    ASSERT_EQ((int)std::lround(v * 255.0 / 65535.0), image.data[v]) << v;
+  PNGFreeImage(&image);
+}
+
+TEST_F(DecoderTestSuite, DecodeToIndexed) {
+  const std::vector<uint8_t> palette = {10, 20, 30, 40, 50, 60, 70, 80, 90, 100, 110, 120};
+  const std::vector<uint8_t> plain = {0b00011011, 0b11100100};
+  const auto png = test_utils::CreatePNG(8, 1, 2, PNG_IMAGE_TYPE_INDEXED, test_utils::AddFilterBytes(plain, 2),
+                                         {{CHUNK_PLTE, palette}});
+
+  PNGImage image = Decode(png, PNG_PIXEL_FORMAT_INDEXED8);
+  EXPECT_EQ(std::vector<uint8_t>({0, 1, 2, 3, 3, 2, 1, 0}), std::vector<uint8_t>(image.data, image.data + 8));
+  ASSERT_EQ(4, image.palette_size);
+  EXPECT_EQ(70, image.palette[2][0]);
+  EXPECT_EQ(255, image.palette[2][3]);
+  PNGFreeImage(&image);
+
+  /* Greyscale image gets grey ramp palette */
+  const auto grey_png = test_utils::CreatePNG(8, 1, 2, PNG_IMAGE_TYPE_GREYSCALE, test_utils::AddFilterBytes(plain, 2));
+  image = Decode(grey_png, PNG_PIXEL_FORMAT_INDEXED8);
+  EXPECT_EQ(3, image.data[3]);
+  ASSERT_EQ(4, image.palette_size);
+  EXPECT_EQ(0x55, image.palette[1][0]);
+  PNGFreeImage(&image);
+}
+
+TEST_F(DecoderTestSuite, PaletteTransparency) {
+  for (int bit_depth : {4, 8}) {
+    SCOPED_TRACE(testing::Message() << "bit depth " << bit_depth);
+    const int entries = 1 << bit_depth;
+    const auto palette = RandomBytes(entries * 3, 4);
+    const auto alpha = RandomBytes(entries / 2, 5);
+    const int scanline_size = ScanlineSize(width_, bit_depth, PNG_IMAGE_TYPE_INDEXED);
+    const auto plain = RandomBytes(scanline_size * height_, 6);
+    const auto png = test_utils::CreatePNG(width_, height_, bit_depth, PNG_IMAGE_TYPE_INDEXED,
+                                           test_utils::AddFilterBytes(plain, scanline_size),
+                                           {{CHUNK_PLTE, palette}, {CHUNK_tRNS, alpha}});
+
+    for (auto format : {PNG_PIXEL_FORMAT_RGBA8, PNG_PIXEL_FORMAT_BGRA8}) {
+      PNGImage image = Decode(png, format);
+      for (int y = 0; y < height_; ++y)
+        for (int x = 0; x < width_; ++x) {
+          const int index = Sample(plain.data() + y * scanline_size, x, bit_depth);
+          const uint8_t* p = image.data + y * image.row_stride + x * 4;
+          const int r = format == PNG_PIXEL_FORMAT_RGBA8 ? p[0] : p[2];
+          ASSERT_EQ(palette[3 * index], r);
+          ASSERT_EQ(palette[3 * index + 1], p[1]);
+          ASSERT_EQ(index < (int)alpha.size() ? alpha[index] : 255, p[3]);
+        }
+      PNGFreeImage(&image);
+    }
+
+    PNGImage indexed = Decode(png, PNG_PIXEL_FORMAT_INDEXED8);
+    EXPECT_EQ(alpha[1], indexed.palette[1][3]);
+    EXPECT_EQ(255, indexed.palette[entries - 1][3]);
+    PNGFreeImage(&indexed);
+  }
+}
+
+TEST_F(DecoderTestSuite, ColorKeyTransparency) {
+  /* Greyscale 2-bit: sample 2 is transparent */
+  auto png = test_utils::CreatePNG(4, 1, 2, PNG_IMAGE_TYPE_GREYSCALE, {0, 0b00011011}, {{CHUNK_tRNS, {0, 2}}});
+  PNGImage image = Decode(png, PNG_PIXEL_FORMAT_RGBA8);
+  EXPECT_EQ(std::vector<uint8_t>({0, 0, 0, 255, 85, 85, 85, 255, 170, 170, 170, 0, 255, 255, 255, 255}),
+            std::vector<uint8_t>(image.data, image.data + 16));
+  PNGFreeImage(&image);
+
+  /* Truecolor 8-bit */
+  png = test_utils::CreatePNG(2, 1, 8, PNG_IMAGE_TYPE_TRUECOLOR, {0, 1, 2, 3, 4, 5, 6},
+                              {{CHUNK_tRNS, {0, 4, 0, 5, 0, 6}}});
+  image = Decode(png, PNG_PIXEL_FORMAT_BGRA8);
+  EXPECT_EQ(std::vector<uint8_t>({3, 2, 1, 255, 6, 5, 4, 0}), std::vector<uint8_t>(image.data, image.data + 8));
+  PNGFreeImage(&image);
+  /* Format without alpha ignores transparency */
+  image = Decode(png, PNG_PIXEL_FORMAT_RGB8);
+  EXPECT_EQ(std::vector<uint8_t>({1, 2, 3, 4, 5, 6}), std::vector<uint8_t>(image.data, image.data + 6));
+  PNGFreeImage(&image);
+  /* Samples of the key are 16-bit, a non-zero high byte never matches */
+  png = test_utils::CreatePNG(2, 1, 8, PNG_IMAGE_TYPE_TRUECOLOR, {0, 1, 2, 3, 4, 5, 6},
+                              {{CHUNK_tRNS, {1, 4, 0, 5, 0, 6}}});
+  image = Decode(png, PNG_PIXEL_FORMAT_RGBA8);
+  EXPECT_EQ(std::vector<uint8_t>({1, 2, 3, 255, 4, 5, 6, 255}), std::vector<uint8_t>(image.data, image.data + 8));
+  PNGFreeImage(&image);
+
+  /* Greyscale 16-bit */
+  png = test_utils::CreatePNG(2, 1, 16, PNG_IMAGE_TYPE_GREYSCALE, {0, 0x12, 0x34, 0x56, 0x78},
+                              {{CHUNK_tRNS, {0x56, 0x78}}});
+  image = Decode(png, PNG_PIXEL_FORMAT_RGBA16);
+  const uint16_t* samples = (const uint16_t*)image.data;
+  EXPECT_EQ(0x1234, samples[0]);
+  EXPECT_EQ(0xFFFF, samples[3]);
+  EXPECT_EQ(0x5678, samples[4]);
+  EXPECT_EQ(0, samples[7]);
+  PNGFreeImage(&image);
+}
+
+TEST_F(DecoderTestSuite, GammaCorrection) {
+  const auto srgb_to_linear = [](double v) { return v <= 0.04045 ? v / 12.92 : std::pow((v + 0.055) / 1.055, 2.4); };
+  const auto linear_to_srgb = [](double v) {
+    return v <= 0.0031308 ? v * 12.92 : 1.055 * std::pow(v, 1.0 / 2.4) - 0.055;
+  };
+  const int scanline_size = ScanlineSize(width_, 8, PNG_IMAGE_TYPE_TRUECOLORWITHALPHA);
+  const auto plain = RandomBytes(scanline_size * height_, 7);
+  const auto filtered = test_utils::AddFilterBytes(plain, scanline_size);
+
+  /* Linear image is kept as is */
+  auto png = test_utils::CreatePNG(width_, height_, 8, PNG_IMAGE_TYPE_TRUECOLORWITHALPHA, filtered,
+                                   {{CHUNK_gAMA, {0, 0x01, 0x86, 0xA0}}});
+  PNGImage image = Decode(png, PNG_PIXEL_FORMAT_RGBA8, false, PNG_GAMMA_CORRECTION_LINEAR);
+  EXPECT_EQ(plain, std::vector<uint8_t>(image.data, image.data + image.data_size));
+  PNGFreeImage(&image);
+
+  /* sRGB chunk takes precedence over gAMA */
+  png = test_utils::CreatePNG(width_, height_, 8, PNG_IMAGE_TYPE_TRUECOLORWITHALPHA, filtered,
+                              {{CHUNK_sRGB, {0}}, {CHUNK_gAMA, {0, 0x01, 0x86, 0xA0}}});
+  image = Decode(png, PNG_PIXEL_FORMAT_RGBA8, false, PNG_GAMMA_CORRECTION_LINEAR);
+  for (size_t i = 0; i < plain.size(); ++i) {
+    const int expected = i % 4 == 3 ? plain[i] : (int)std::lround(srgb_to_linear(plain[i] / 255.0) * 255);
+    ASSERT_NEAR(expected, image.data[i], 1) << i;
+  }
+  PNGFreeImage(&image);
+  image = Decode(png, PNG_PIXEL_FORMAT_RGBA8, false, PNG_GAMMA_CORRECTION_SRGB);
+  EXPECT_EQ(plain, std::vector<uint8_t>(image.data, image.data + image.data_size));
+  PNGFreeImage(&image);
+
+  /* Gamma 1/2.2 to sRGB, corrected with 16-bit table */
+  png = test_utils::CreatePNG(width_, height_, 8, PNG_IMAGE_TYPE_TRUECOLORWITHALPHA, filtered,
+                              {{CHUNK_gAMA, {0, 0, 0xB1, 0x8F}}});
+  image = Decode(png, PNG_PIXEL_FORMAT_RGBA16, false, PNG_GAMMA_CORRECTION_SRGB);
+  const uint16_t* samples = (const uint16_t*)image.data;
+  for (size_t i = 0; i < plain.size(); ++i) {
+    const double linear = std::pow(plain[i] / 255.0, 100000.0 / 45455);
+    const int expected = i % 4 == 3 ? plain[i] * 257 : (int)std::lround(linear_to_srgb(linear) * 65535);
+    ASSERT_NEAR(expected, samples[i], 1) << i;
+  }
+  PNGFreeImage(&image);
+
+  /* Palette is corrected instead of pixels */
+  const std::vector<uint8_t> palette = {0, 64, 128, 192, 255, 10};
+  png = test_utils::CreatePNG(2, 1, 8, PNG_IMAGE_TYPE_INDEXED, {0, 1, 0}, {{CHUNK_PLTE, palette}});
+  image = Decode(png, PNG_PIXEL_FORMAT_INDEXED8, false, PNG_GAMMA_CORRECTION_LINEAR);
+  EXPECT_EQ(std::vector<uint8_t>({1, 0}), std::vector<uint8_t>(image.data, image.data + 2));
+  for (int i = 0; i < 6; ++i)
+    EXPECT_NEAR(std::lround(srgb_to_linear(palette[i] / 255.0) * 255), image.palette[i / 3][i % 3], 1);
+  const uint8_t corrected_red = image.palette[1][0];
+  PNGFreeImage(&image);
+  image = Decode(png, PNG_PIXEL_FORMAT_RGBA8, false, PNG_GAMMA_CORRECTION_LINEAR);
+  EXPECT_EQ(corrected_red, image.data[0]);
+  EXPECT_EQ(255, image.data[3]);
+  PNGFreeImage(&image);
+}
+
+TEST_F(DecoderTestSuite, PremultiplyAlpha) {
+  for (int bit_depth : {8, 16}) {
+    SCOPED_TRACE(testing::Message() << "bit depth " << bit_depth);
+    const int sample_size = bit_depth / 8;
+    const int scanline_size = ScanlineSize(width_, bit_depth, PNG_IMAGE_TYPE_TRUECOLORWITHALPHA);
+    auto plain = RandomBytes(scanline_size * height_, 8);
+    /* First row starts with a run of opaque pixels, the last one is fully transparent */
+    for (int x = 0; x < 20; ++x)
+      std::fill_n(plain.begin() + (4 * x + 3) * sample_size, sample_size, 0xFF);
+    for (int x = 0; x < width_; ++x)
+      std::fill_n(plain.begin() + (size_t)(height_ - 1) * scanline_size + (4 * x + 3) * sample_size, sample_size, 0);
+    const auto png = test_utils::CreatePNG(width_, height_, bit_depth, PNG_IMAGE_TYPE_TRUECOLORWITHALPHA,
+                                           test_utils::AddFilterBytes(plain, scanline_size));
+
+    PNGImage image = Decode(png, PNG_PIXEL_FORMAT_RGBA8, false, PNG_GAMMA_CORRECTION_NONE, true);
+    PNGImage wide = Decode(png, PNG_PIXEL_FORMAT_RGBA16, false, PNG_GAMMA_CORRECTION_NONE, true);
+    const uint16_t* wide_samples = (const uint16_t*)wide.data;
+    for (int i = 0; i < width_ * height_; ++i) {
+      const int a = Sample(plain.data(), 4 * i + 3, bit_depth);
+      for (int c = 0; c < 4; ++c) {
+        const int v = Sample(plain.data(), 4 * i + c, bit_depth);
+        const int max = (1 << bit_depth) - 1;
+        const int v8 = (v * 255 + max / 2) / max;
+        const int a8 = (a * 255 + max / 2) / max;
+        const int v16 = bit_depth == 16 ? v : v * 257;
+        const int a16 = bit_depth == 16 ? a : a * 257;
+        ASSERT_EQ(c == 3 ? a8 : (v8 * a8 + 127) / 255, image.data[4 * i + c]) << i;
+        ASSERT_EQ(c == 3 ? a16 : (int)(((int64_t)v16 * a16 + 32767) / 65535), wide_samples[4 * i + c]) << i;
+      }
+    }
+    PNGFreeImage(&image);
+    PNGFreeImage(&wide);
+  }
+
+  /* Palette is premultiplied once, formats without alpha are not affected */
+  const std::vector<uint8_t> palette = {200, 100, 50, 10, 20, 30};
+  const auto png = test_utils::CreatePNG(2, 1, 8, PNG_IMAGE_TYPE_INDEXED, {0, 0, 1},
+                                         {{CHUNK_PLTE, palette}, {CHUNK_tRNS, {128}}});
+  PNGImage image = Decode(png, PNG_PIXEL_FORMAT_BGRA8, false, PNG_GAMMA_CORRECTION_NONE, true);
+  EXPECT_EQ(std::vector<uint8_t>({25, 50, 100, 128, 30, 20, 10, 255}),
+            std::vector<uint8_t>(image.data, image.data + 8));
+  PNGFreeImage(&image);
+  image = Decode(png, PNG_PIXEL_FORMAT_INDEXED8, false, PNG_GAMMA_CORRECTION_NONE, true);
+  EXPECT_EQ(100, image.palette[0][0]);
+  EXPECT_EQ(10, image.palette[1][0]);
+  PNGFreeImage(&image);
+  image = Decode(png, PNG_PIXEL_FORMAT_RGB8, false, PNG_GAMMA_CORRECTION_NONE, true);
+  EXPECT_EQ(std::vector<uint8_t>({200, 100, 50, 10, 20, 30}), std::vector<uint8_t>(image.data, image.data + 6));
+  PNGFreeImage(&image);
+}
+
+TEST_F(DecoderTestSuite, AlphaFlattening) {
+  const auto blend = [](int c, int background, int a, int max) {
+    return (int)((((int64_t)c * a + (int64_t)background * (max - a)) * 2 + max) / (2 * max));
+  };
+  PNGDecodeOptions options;
+  PNGInitDecodeOptions(&options);
+  options.alpha_flattening = PNG_ALPHA_FLATTENING_CUSTOM_BACKGROUND;
+  options.background_rgb16[0] = 0x1010;
+  options.background_rgb16[1] = 0x8080;
+  options.background_rgb16[2] = 0xFFFF;
+
+  for (int bit_depth : {8, 16}) {
+    SCOPED_TRACE(testing::Message() << "bit depth " << bit_depth);
+    const int sample_size = bit_depth / 8;
+    const int scanline_size = ScanlineSize(width_, bit_depth, PNG_IMAGE_TYPE_TRUECOLORWITHALPHA);
+    auto plain = RandomBytes(scanline_size * height_, 9);
+    for (int x = 0; x < 12; ++x)
+      std::fill_n(plain.begin() + (4 * x + 3) * sample_size, sample_size, 0xFF);
+    const auto png = test_utils::CreatePNG(width_, height_, bit_depth, PNG_IMAGE_TYPE_TRUECOLORWITHALPHA,
+                                           test_utils::AddFilterBytes(plain, scanline_size));
+
+    options.format = PNG_PIXEL_FORMAT_RGB8;
+    PNGImage rgb = Decode(png, options);
+    options.format = PNG_PIXEL_FORMAT_G8;
+    PNGImage grey = Decode(png, options);
+    options.format = PNG_PIXEL_FORMAT_RGB16;
+    PNGImage rgb16 = Decode(png, options);
+    options.format = PNG_PIXEL_FORMAT_G16;
+    PNGImage grey16 = Decode(png, options);
+    const auto* rgb16_samples = (const uint16_t*)rgb16.data;
+    const auto* grey16_samples = (const uint16_t*)grey16.data;
+
+    for (int i = 0; i < width_ * height_; ++i) {
+      const auto pixel = ReferenceRGBA8(plain, i % width_, i / width_, bit_depth, PNG_IMAGE_TYPE_TRUECOLORWITHALPHA);
+      std::array<int, 3> blended;
+      std::array<int, 3> blended16;
+      for (int c = 0; c < 3; ++c) {
+        blended[c] = blend(pixel[c], options.background_rgb16[c] / 257, pixel[3], 255);
+        const int v16 = Sample(plain.data(), 4 * i + c, bit_depth) * (bit_depth == 8 ? 257 : 1);
+        const int a16 = Sample(plain.data(), 4 * i + 3, bit_depth) * (bit_depth == 8 ? 257 : 1);
+        blended16[c] = blend(v16, options.background_rgb16[c], a16, 65535);
+        ASSERT_EQ(blended[c], rgb.data[3 * i + c]) << i;
+        ASSERT_EQ(blended16[c], rgb16_samples[3 * i + c]) << i;
+      }
+      ASSERT_EQ((6969 * blended[0] + 23434 * blended[1] + 2365 * blended[2] + 16384) >> 15, grey.data[i]) << i;
+      ASSERT_EQ((6969u * blended16[0] + 23434u * blended16[1] + 2365u * blended16[2] + 16384u) >> 15,
+                grey16_samples[i])
+          << i;
+    }
+    PNGFreeImage(&rgb);
+    PNGFreeImage(&grey);
+    PNGFreeImage(&rgb16);
+    PNGFreeImage(&grey16);
+  }
+
+  /* Background from bKGD of greyscale image */
+  options.alpha_flattening = PNG_ALPHA_FLATTENING_FILE_BACKGROUND;
+  options.format = PNG_PIXEL_FORMAT_RGB8;
+  auto png = test_utils::CreatePNG(2, 1, 8, PNG_IMAGE_TYPE_GREYSCALEWITHAPLHA, {0, 200, 0, 200, 255},
+                                   {{CHUNK_bKGD, {0, 100}}});
+  PNGImage image = Decode(png, options);
+  EXPECT_EQ(std::vector<uint8_t>({100, 100, 100, 200, 200, 200}), std::vector<uint8_t>(image.data, image.data + 6));
+  PNGFreeImage(&image);
+
+  /* bKGD sample of bit depth 0 is never scaled, the header is rejected first */
+  const auto invalid = test_utils::CreatePNG(2, 1, 0, PNG_IMAGE_TYPE_GREYSCALEWITHAPLHA, {0},
+                                             {{CHUNK_bKGD, {0, 100}}});
+  PNGRawChunk* chunks = PNGLoadRawChunkList(invalid.data(), invalid.size(), true);
+  ASSERT_NE(nullptr, chunks);
+  EXPECT_FALSE(PNGDecodeImage(chunks, &options, &image));
+  PNGFreeRawChunk(chunks);
+
+  /* Palette entry background and transparent palette entries */
+  png = test_utils::CreatePNG(2, 1, 8, PNG_IMAGE_TYPE_INDEXED, {0, 0, 1},
+                              {{CHUNK_PLTE, {255, 255, 255, 0, 0, 0, 10, 20, 30}}, {CHUNK_tRNS, {0, 255}},
+                               {CHUNK_bKGD, {2}}});
+  image = Decode(png, options);
+  EXPECT_EQ(std::vector<uint8_t>({10, 20, 30, 0, 0, 0}), std::vector<uint8_t>(image.data, image.data + 6));
+  PNGFreeImage(&image);
+
+  /* Image without bKGD uses caller background, transparent color key is replaced by it */
+  png = test_utils::CreatePNG(2, 1, 8, PNG_IMAGE_TYPE_TRUECOLOR, {0, 1, 2, 3, 4, 5, 6},
+                              {{CHUNK_tRNS, {0, 4, 0, 5, 0, 6}}});
+  image = Decode(png, options);
+  EXPECT_EQ(std::vector<uint8_t>({1, 2, 3, 0x10, 0x80, 0xFF}), std::vector<uint8_t>(image.data, image.data + 6));
+  PNGFreeImage(&image);
+
+  /* Formats with alpha are not flattened */
+  options.format = PNG_PIXEL_FORMAT_RGBA8;
+  image = Decode(png, options);
+  EXPECT_EQ(std::vector<uint8_t>({1, 2, 3, 255, 4, 5, 6, 0}), std::vector<uint8_t>(image.data, image.data + 8));
+  PNGFreeImage(&image);
+}
+
+TEST_F(DecoderTestSuite, DecodeToTensor) {
+  const auto half_to_float = [](uint16_t half) {
+    const int exponent = (half >> 10) & 0x1F;
+    const double mantissa = half & 0x3FF;
+    const double magnitude = exponent == 0 ? mantissa * std::pow(2.0, -24)
+                                           : (1.0 + mantissa / 1024) * std::pow(2.0, exponent - 15);
+    return (half & 0x8000) ? -magnitude : magnitude;
+  };
+  const auto bfloat16_to_float = [](uint16_t value) {
+    const uint32_t bits = (uint32_t)value << 16;
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return (double)result;
+  };
+  const float mean[4] = {0.485f, 0.456f, 0.406f, 0.5f};
+  const float std[4] = {0.229f, 0.224f, 0.225f, 0.5f};
+  PNGTensorOptions options;
+  PNGInitTensorOptions(&options);
+  for (int c = 0; c < 4; ++c) {
+    options.scale[c] = 1 / std[c];
+    options.offset[c] = -mean[c] / std[c];
+  }
+
+  struct Case {
+    int bit_depth;
+    int color_type;
+    int channels;
+    PNGTensorType type;
+  };
+  const std::vector<Case> cases = {{8, 6, 3, PNG_TENSOR_TYPE_FLOAT32},  {8, 6, 4, PNG_TENSOR_TYPE_FLOAT16},
+                                   {16, 6, 4, PNG_TENSOR_TYPE_FLOAT32}, {16, 2, 3, PNG_TENSOR_TYPE_BFLOAT16},
+                                   {8, 2, 1, PNG_TENSOR_TYPE_FLOAT32},  {16, 0, 1, PNG_TENSOR_TYPE_FLOAT16},
+                                   {2, 0, 3, PNG_TENSOR_TYPE_FLOAT32}};
+  for (const auto& [bit_depth, color_type, channels, type] : cases) {
+    SCOPED_TRACE(testing::Message() << "bit depth " << bit_depth << ", color type " << color_type << ", channels "
+                                    << channels << ", type " << type);
+    const int scanline_size = ScanlineSize(width_, bit_depth, color_type);
+    const auto plain = RandomBytes(scanline_size * height_, 10);
+    const auto png = test_utils::CreatePNG(width_, height_, bit_depth, color_type,
+                                           test_utils::AddFilterBytes(plain, scanline_size));
+    PNGRawChunk* chunks = PNGLoadRawChunkList(png.data(), png.size(), true);
+    ASSERT_NE(nullptr, chunks);
+
+    options.channels = channels;
+    options.type = type;
+    PNGTensor tensor;
+    ASSERT_TRUE(PNGDecodeTensor(chunks, &options, &tensor));
+    EXPECT_EQ(channels, tensor.channels);
+    EXPECT_EQ((size_t)width_ * height_ * channels * PNGGetTensorTypeSizeBytes(type), tensor.data_size);
+
+    /* Samples come from 16-bit decoding of the same image */
+    PNGImage image = Decode(png, channels == 1 ? PNG_PIXEL_FORMAT_G16 : PNG_PIXEL_FORMAT_RGBA16);
+    const auto* samples = (const uint16_t*)image.data;
+    const int sample_stride = channels == 1 ? 1 : 4;
+    const double tolerance = type == PNG_TENSOR_TYPE_FLOAT32 ? 1e-5 : (type == PNG_TENSOR_TYPE_FLOAT16 ? 4e-3 : 2e-2);
+    for (int c = 0; c < channels; ++c)
+      for (int i = 0; i < width_ * height_; ++i) {
+        const uint16_t sample = samples[i * sample_stride + c];
+        /* 8-bit output widened to 16 bits keeps the exact ratio */
+        const double expected = sample / 65535.0 * options.scale[c] + options.offset[c];
+        const size_t index = (size_t)c * width_ * height_ + i;
+        double actual = 0;
+        switch (type) {
+          case PNG_TENSOR_TYPE_FLOAT32: actual = ((const float*)tensor.data)[index]; break;
+          case PNG_TENSOR_TYPE_FLOAT16: actual = half_to_float(((const uint16_t*)tensor.data)[index]); break;
+          case PNG_TENSOR_TYPE_BFLOAT16: actual = bfloat16_to_float(((const uint16_t*)tensor.data)[index]); break;
+        }
+        ASSERT_NEAR(expected, actual, tolerance * std::max(1.0, std::abs(expected))) << c << " " << i;
+      }
+    PNGFreeImage(&image);
+    PNGFreeTensor(&tensor);
+    PNGFreeRawChunk(chunks);
+  }
+
+  const auto png = test_utils::CreatePNG(1, 1, 8, PNG_IMAGE_TYPE_GREYSCALE, {0, 0});
+  PNGRawChunk* chunks = PNGLoadRawChunkList(png.data(), png.size(), true);
+  options.channels = 2;
+  PNGTensor tensor;
+  EXPECT_FALSE(PNGDecodeTensor(chunks, &options, &tensor));
+  EXPECT_EQ(nullptr, tensor.data);
+  PNGFreeRawChunk(chunks);
+
+  /* Invalid bit depths of header */
+  options.channels = 3;
+  for (const auto& [bit_depth, color_type] : std::vector<std::pair<int, int>>{{0, 0}, {0, 6}, {3, 0}, {4, 4}}) {
+    const auto invalid = test_utils::CreatePNG(2, 1, bit_depth, color_type, std::vector<uint8_t>(9));
+    chunks = PNGLoadRawChunkList(invalid.data(), invalid.size(), true);
+    ASSERT_NE(nullptr, chunks);
+    EXPECT_FALSE(PNGDecodeTensor(chunks, &options, &tensor)) << bit_depth << " " << color_type;
+    EXPECT_EQ(nullptr, tensor.data);
+    PNGFreeRawChunk(chunks);
+  }
+}
+
+TEST_F(DecoderTestSuite, DecodeStats) {
+  const int scanline_size = ScanlineSize(width_, 8, PNG_IMAGE_TYPE_TRUECOLOR);
+  const auto plain = RandomBytes(scanline_size * height_, 11);
+  const auto filtered = test_utils::AddFilterBytes(plain, scanline_size);
+  const auto png = test_utils::CreatePNG(width_, height_, 8, PNG_IMAGE_TYPE_TRUECOLOR, filtered);
+  const uint64_t idat_size = test_utils::ZlibStore(filtered).size();
+
+  PNGDecodeStats stats;
+  PNGInitDecodeStats(&stats);
+  PNGChunkLoadOptions load_options;
+  PNGInitChunkLoadOptions(&load_options);
+  load_options.stats = &stats;
+  PNGRawChunk* chunks = PNGLoadRawChunkListWithOptions(png.data(), png.size(), true, &load_options);
+  ASSERT_NE(nullptr, chunks);
+  EXPECT_EQ(png.size(), stats.stages[PNG_DECODE_STAGE_PARSE].bytes_in);
+  EXPECT_EQ(13 + idat_size, stats.stages[PNG_DECODE_STAGE_PARSE].bytes_out);
+
+  PNGDecodeOptions options;
+  PNGInitDecodeOptions(&options);
+  options.stats = &stats;
+  PNGImage image;
+  ASSERT_TRUE(PNGDecodeImage(chunks, &options, &image));
+  EXPECT_EQ(3, stats.chunks_count);
+  EXPECT_EQ(1, stats.idat_chunks_count);
+  EXPECT_EQ(idat_size, stats.stages[PNG_DECODE_STAGE_CONCAT].bytes_out);
+  EXPECT_EQ(idat_size, stats.stages[PNG_DECODE_STAGE_INFLATE].bytes_in);
+  EXPECT_EQ(filtered.size(), stats.stages[PNG_DECODE_STAGE_INFLATE].bytes_out);
+  EXPECT_EQ(filtered.size(), stats.stages[PNG_DECODE_STAGE_DEFILTER].bytes_in);
+  EXPECT_EQ(plain.size(), stats.stages[PNG_DECODE_STAGE_DEFILTER].bytes_out);
+  EXPECT_EQ(plain.size(), stats.stages[PNG_DECODE_STAGE_CONVERT].bytes_in);
+  EXPECT_EQ(image.data_size, stats.stages[PNG_DECODE_STAGE_CONVERT].bytes_out);
+  /* Output, IDAT data and inflated data. Built-in inflater needs no state for stored blocks */
+  const int image_allocations = stats.allocations_count;
+  EXPECT_EQ(3, image_allocations);
+  EXPECT_EQ(idat_size + filtered.size(), stats.peak_scratch_bytes);
+  EXPECT_EQ(image.data_size + stats.peak_scratch_bytes, stats.peak_bytes);
+  EXPECT_EQ(image.data_size, stats.live_bytes);
+  const uint64_t image_size = image.data_size;
+  PNGFreeImage(&image);
+
+  /* Stats are added to */
+  PNGRawImage raw;
+  ASSERT_TRUE(PNGGetRawImageWithStats(chunks, &raw, &stats));
+  EXPECT_EQ(2 * idat_size, stats.stages[PNG_DECODE_STAGE_INFLATE].bytes_in);
+  EXPECT_EQ(2 * plain.size(), stats.stages[PNG_DECODE_STAGE_DEFILTER].bytes_out);
+  EXPECT_EQ(image_size, stats.stages[PNG_DECODE_STAGE_CONVERT].bytes_out);
+  EXPECT_EQ(2 * image_allocations, stats.allocations_count);
+  EXPECT_EQ(image_size + plain.size(), stats.live_bytes);
+  free(raw.data);
+
+  PNGTensorOptions tensor_options;
+  PNGInitTensorOptions(&tensor_options);
+  PNGInitDecodeStats(&stats);
+  tensor_options.stats = &stats;
+  PNGTensor tensor;
+  ASSERT_TRUE(PNGDecodeTensor(chunks, &tensor_options, &tensor));
+  EXPECT_EQ(tensor.data_size, stats.stages[PNG_DECODE_STAGE_CONVERT].bytes_out);
+  /* Tensor row and converter scratch rows too */
+  EXPECT_LT(image_allocations, stats.allocations_count);
+  EXPECT_EQ(tensor.data_size, stats.live_bytes);
+  PNGFreeTensor(&tensor);
+
+  /* zlib engine allocates its state, which is alive with IDAT data and inflated data */
+  PNGInitDecodeStats(&stats);
+  options.inflate_engine = PNG_INFLATE_ENGINE_ZLIB;
+  ASSERT_TRUE(PNGDecodeImage(chunks, &options, &image));
+  EXPECT_LT(image_allocations, stats.allocations_count);
+  EXPECT_LT(idat_size + filtered.size(), stats.peak_scratch_bytes);
+  PNGFreeImage(&image);
+  PNGFreeRawChunk(chunks);
+
+  EXPECT_STREQ("inflate", PNGGetDecodeStageName(PNG_DECODE_STAGE_INFLATE));
+  EXPECT_EQ(nullptr, PNGGetDecodeStageName(PNG_DECODE_STAGE_COUNT));
+}
+
+TEST_F(DecoderTestSuite, DecodeLimits) {
+  PNGChunkData_IHDR header = {100000, 100000, 16, PNG_IMAGE_TYPE_TRUECOLORWITHALPHA, 0, 0, 0};
+  EXPECT_EQ(640000000000, PNGGetPlainImageSizeBits(&header));
+  EXPECT_EQ(800000, PNGGetScanlineSizeBytes(&header));
+  EXPECT_EQ(80000100000, PNGGetFilteredImageSizeBytes(&header));
+  header.width = header.height = INT32_MAX;
+  EXPECT_EQ(-1, PNGGetPlainImageSizeBits(&header));
+  EXPECT_EQ(-1, PNGGetFilteredImageSizeBytes(&header));
+
+  /* All-zero 256x257 greyscale image compresses more than 100 times: its filtered data is a literal and 256 matches */
+  const int width = 256;
+  const int height = 257;
+  const size_t filtered_size = (size_t)(width + 1) * height;
+  const auto idat = ZlibZeros(filtered_size);
+  ASSERT_GT(filtered_size, idat.size() * 100);
+  test_utils::VectorWrapper<uint8_t> png;
+  png.Append(std::vector<uint8_t>(std::begin(s_png_signature), std::end(s_png_signature)));
+  test_utils::AppendChunk(png, CHUNK_IHDR, {0, 0, 1, 0, 0, 0, 1, 1, 8, 0, 0, 0, 0});
+  test_utils::AppendChunk(png, CHUNK_IDAT, idat);
+  test_utils::AppendChunk(png, CHUNK_IEND, {});
+  PNGRawChunk* chunks = PNGLoadRawChunkList(png.data(), png.size(), true);
+  ASSERT_NE(nullptr, chunks);
+
+  PNGDecodeStats stats;
+  PNGInitDecodeStats(&stats);
+  PNGDecodeOptions options;
+  PNGInitDecodeOptions(&options);
+  options.format = PNG_PIXEL_FORMAT_G8;
+  options.stats = &stats;
+  PNGImage image;
+  ASSERT_TRUE(PNGDecodeImage(chunks, &options, &image));
+  EXPECT_EQ(std::vector<uint8_t>((size_t)width * height, 0),
+            std::vector<uint8_t>(image.data, image.data + image.data_size));
+  PNGFreeImage(&image);
+
+  /* Limits are checked before anything is allocated */
+  const auto expect_rejected = [&](const PNGDecodeOptions& options) {
+    PNGInitDecodeStats(&stats);
+    EXPECT_FALSE(PNGDecodeImage(chunks, &options, &image));
+    EXPECT_EQ(0, stats.allocations_count);
+  };
+  options.limits.max_pixels = width * height - 1;
+  expect_rejected(options);
+  options.limits.max_pixels = width * height;
+  options.limits.max_output_bytes = (uint64_t)width * height - 1;
+  expect_rejected(options);
+  options.limits.max_output_bytes = 0;
+  options.limits.max_inflate_ratio = 100;
+  expect_rejected(options);
+  options.limits.max_inflate_ratio = 200;
+  EXPECT_TRUE(PNGDecodeImage(chunks, &options, &image));
+  PNGFreeImage(&image);
+
+  PNGRawImageOptions raw_options;
+  PNGInitRawImageOptions(&raw_options);
+  raw_options.limits.max_inflate_ratio = 100;
+  PNGRawImage raw;
+  EXPECT_FALSE(PNGGetRawImageWithOptions(chunks, &raw_options, &raw));
+  PNGFreeRawChunk(chunks);
+
+  /* 30000x30000 image of a few bytes is rejected by default limits */
+  const auto bomb = test_utils::CreatePNG(30000, 30000, 8, PNG_IMAGE_TYPE_TRUECOLORWITHALPHA, {0});
+  PNGChunkLoadOptions load_options;
+  PNGInitChunkLoadOptions(&load_options);
+  load_options.limits.max_pixels = 0;
+  chunks = PNGLoadRawChunkListWithOptions(bomb.data(), bomb.size(), true, &load_options);
+  ASSERT_NE(nullptr, chunks);
+  PNGInitDecodeOptions(&options);
+  options.stats = &stats;
+  options.limits.max_pixels = 0;
+  expect_rejected(options);
+  EXPECT_FALSE(PNGGetRawImage(chunks, &raw));
+  PNGFreeRawChunk(chunks);
+}
+
+TEST_F(DecoderTestSuite, UnsupportedImages) {
+  PNGDecodeOptions options;
+  PNGInitDecodeOptions(&options);
+  options.format = PNG_PIXEL_FORMAT_INDEXED8;
+
+  const std::vector<uint8_t> plain(6);
+  auto png = test_utils::CreatePNG(2, 1, 8, PNG_IMAGE_TYPE_TRUECOLOR, test_utils::AddFilterBytes(plain, 6));
+  PNGRawChunk* chunks = PNGLoadRawChunkList(png.data(), png.size(), true);
+  PNGImage image;
+  EXPECT_FALSE(PNGDecodeImage(chunks, &options, &image));
+  EXPECT_EQ(nullptr, image.data);
+  PNGFreeRawChunk(chunks);
+
+  /* Image data is shorter than scanlines */
+  const auto truncated = test_utils::CreatePNG(2, 2, 8, PNG_IMAGE_TYPE_TRUECOLOR, test_utils::AddFilterBytes(plain, 6));
+  chunks = PNGLoadRawChunkList(truncated.data(), truncated.size(), true);
+  EXPECT_FALSE(PNGDecodeImage(chunks, nullptr, &image));
+  PNGFreeRawChunk(chunks);
+
+  /* Interlaced */
+  png[8 + 8 + 12] = 1;
+  const uint32_t crc = PNGComputeChunkCRC(CHUNK_IHDR, png.data() + 16, 13);
+  for (int i = 0; i < 4; ++i)
+    png[29 + i] = (uint8_t)(crc >> (24 - 8 * i));
+  chunks = PNGLoadRawChunkList(png.data(), png.size(), true);
+  ASSERT_NE(nullptr, chunks);
+  EXPECT_FALSE(PNGDecodeImage(chunks, nullptr, &image));
+  PNGFreeRawChunk(chunks);
+}
+
+TEST_F(DecoderTestSuite, InvalidBitDepths) {
+  struct Case {
+    int bit_depth;
+    int color_type;
+  };
+  /* Depth 0 would divide by zero in palette filling and sub-byte unpacking */
+  const std::vector<Case> cases = {{0, 0}, {0, 2}, {0, 3}, {0, 4}, {0, 6}, {3, 0}, {5, 0}, {4, 4}, {16, 3}, {8, 1}};
+  for (const auto& [bit_depth, color_type] : cases) {
+    SCOPED_TRACE(testing::Message() << "bit depth " << bit_depth << ", color type " << color_type);
+    const auto png = test_utils::CreatePNG(2, 1, bit_depth, color_type, std::vector<uint8_t>(9));
+    PNGRawChunk* chunks = PNGLoadRawChunkList(png.data(), png.size(), true);
+    ASSERT_NE(nullptr, chunks);
+    PNGImage image;
+    EXPECT_FALSE(PNGDecodeImage(chunks, nullptr, &image));
+    EXPECT_EQ(nullptr, image.data);
+    PNGRawImage raw;
+    EXPECT_FALSE(PNGGetRawImage(chunks, &raw));
+    PNGRawImageOptions raw_options;
+    PNGInitRawImageOptions(&raw_options);
+    EXPECT_FALSE(PNGGetRawImageWithOptions(chunks, &raw_options, &raw));
+    PNGFreeRawChunk(chunks);
+  }
+}
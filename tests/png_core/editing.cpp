@@ -0,0 +1,178 @@
+#include <png_core/chunk_table.h>
+#include <png_core/editing.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../test_utils.h"
+
+/// Test set for chunk-level file editing from `png_core/editing.h`
+class EditingTestSuite : public ::testing::Test {
+protected:
+  void SetUp() override {
+    test_utils::VectorWrapper<uint8_t> stream;
+    stream.Append(std::vector<uint8_t>(std::begin(s_png_signature), std::end(s_png_signature)));
+    test_utils::AppendChunk(stream, CHUNK_IHDR, {0, 0, 0, 1, 0, 0, 0, 1, 8, 0, 0, 0, 0});
+    test_utils::AppendChunk(stream, CHUNK_gAMA, {0, 0, 0xB1, 0x8F});
+    test_utils::AppendChunk(stream, CHUNK_tEXt, {'k', '\0', 'v'});
+    test_utils::AppendChunk(stream, CHUNK_IDAT, std::vector<uint8_t>(5000, 0x42));
+    test_utils::AppendChunk(stream, CHUNK_IDAT, std::vector<uint8_t>(300, 0x43));
+    test_utils::AppendChunk(stream, CHUNK_IEND, {});
+    source_ = stream;
+
+    source_path_ = test_utils::WriteTempFile(source_);
+    out_path_ = test_utils::WriteTempFile({});
+    in_fd_ = open(source_path_.c_str(), O_RDONLY);
+    out_fd_ = open(out_path_.c_str(), O_WRONLY | O_TRUNC);
+    ASSERT_GE(in_fd_, 0);
+    ASSERT_GE(out_fd_, 0);
+    PNGInitEditPlan(&plan_);
+  }
+
+  void TearDown() override {
+    PNGFreeEditPlan(&plan_);
+    close(in_fd_);
+    close(out_fd_);
+    std::filesystem::remove(source_path_);
+    std::filesystem::remove(out_path_);
+  }
+
+  /// Write plan and read resulting file
+  std::vector<uint8_t> WritePlan() {
+    const auto written = PNGWriteEditPlanToFd(&plan_, in_fd_, out_fd_);
+    EXPECT_GT(written, 0);
+    const auto bytes = test_utils::ReadBinaryFile(out_path_.string());
+    EXPECT_EQ(written, bytes.size());
+    return bytes;
+  }
+
+  /// Chunk types of datastream in file order
+  static std::vector<uint32_t> ChunkTypes(const std::vector<uint8_t>& stream) {
+    PNGChunkTable table;
+    PNGInitChunkTable(&table);
+    EXPECT_TRUE(PNGBuildChunkTable(stream.data(), stream.size(), true, &table));
+    std::vector<uint32_t> types;
+    for (int entry = table.head; entry != PNG_CHUNK_TABLE_NO_ENTRY; entry = table.next[entry]) {
+      EXPECT_EQ(table.crcs[entry],
+                PNGComputeChunkCRC(PNGChunkTableGetType(&table, entry), &stream[table.offsets[entry]],
+                                   table.sizes[entry]));
+      types.push_back(table.types[entry]);
+    }
+    PNGFreeChunkTable(&table);
+    return types;
+  }
+
+protected:
+  std::vector<uint8_t> source_;
+  std::filesystem::path source_path_;
+  std::filesystem::path out_path_;
+  int in_fd_ = -1;
+  int out_fd_ = -1;
+  PNGEditPlan plan_;
+};
+
+TEST_F(EditingTestSuite, KeepAllChunks) {
+  ASSERT_TRUE(PNGCreateEditPlanFromFd(in_fd_, &plan_));
+  EXPECT_EQ(plan_.table.count, 6);
+  EXPECT_EQ(WritePlan(), source_);
+}
+
+TEST_F(EditingTestSuite, StripAncillaryChunks) {
+  ASSERT_TRUE(PNGCreateEditPlanFromFd(in_fd_, &plan_));
+  const ChunkType keep[] = {CHUNK_gAMA};
+  EXPECT_EQ(PNGEditPlanRemoveAncillary(&plan_, keep, 1), 1);
+
+  const auto written = WritePlan();
+  EXPECT_EQ(ChunkTypes(written), (std::vector<uint32_t>{CHUNK_IHDR.bytes, CHUNK_gAMA.bytes, CHUNK_IDAT.bytes,
+                                                        CHUNK_IDAT.bytes, CHUNK_IEND.bytes}));
+  EXPECT_EQ(written.size(), source_.size() - (12 + 3));
+}
+
+TEST_F(EditingTestSuite, ReplaceAndInsertChunks) {
+  ASSERT_TRUE(PNGCreateEditPlanFromFd(in_fd_, &plan_));
+  EXPECT_EQ(PNGEditPlanRemoveType(&plan_, CHUNK_gAMA), 1);
+
+  const int text = PNGChunkTableFindFirst(&plan_.table, CHUNK_tEXt);
+  const uint8_t replacement[] = {'k', 'e', 'y', '\0', 'v', 'a', 'l', 'u', 'e'};
+  ASSERT_NE(PNGEditPlanReplaceChunk(&plan_, text, replacement, sizeof(replacement)), PNG_CHUNK_TABLE_NO_ENTRY);
+  ASSERT_NE(PNGEditPlanInsertText(&plan_, "Author", "Somebody"), PNG_CHUNK_TABLE_NO_ENTRY);
+
+  const auto written = WritePlan();
+  EXPECT_EQ(ChunkTypes(written), (std::vector<uint32_t>{CHUNK_IHDR.bytes, CHUNK_tEXt.bytes, CHUNK_tEXt.bytes,
+                                                        CHUNK_IDAT.bytes, CHUNK_IDAT.bytes, CHUNK_IEND.bytes}));
+
+  PNGRawChunk* chunks = PNGLoadRawChunkList(written.data(), written.size(), true);
+  ASSERT_TRUE(chunks);
+  const auto* replaced = static_cast<PNGChunkData_tEXt*>(chunks->next->parsed_data);
+  EXPECT_STREQ(replaced->keyword, "key");
+  EXPECT_STREQ(replaced->text, "value");
+  const auto* inserted = static_cast<PNGChunkData_tEXt*>(chunks->next->next->parsed_data);
+  EXPECT_STREQ(inserted->keyword, "Author");
+  EXPECT_STREQ(inserted->text, "Somebody");
+  PNGFreeRawChunk(chunks);
+}
+
+TEST_F(EditingTestSuite, RemovedChunks) {
+  ASSERT_TRUE(PNGCreateEditPlanFromFd(in_fd_, &plan_));
+  const int text = PNGChunkTableFindFirst(&plan_.table, CHUNK_tEXt);
+  const int gama = PNGChunkTableFindFirst(&plan_.table, CHUNK_gAMA);
+  ASSERT_TRUE(PNGEditPlanRemoveChunk(&plan_, text));
+  EXPECT_EQ(PNGEditPlanRemoveType(&plan_, CHUNK_gAMA), 1);
+
+  // Ids of removed chunks are not reused by insertions
+  const uint8_t data[] = {'k', '\0', 'v'};
+  const int inserted = PNGEditPlanInsertChunk(&plan_, PNG_CHUNK_TABLE_NO_ENTRY, CHUNK_tEXt, data, sizeof(data));
+  ASSERT_NE(inserted, PNG_CHUNK_TABLE_NO_ENTRY);
+  EXPECT_NE(inserted, text);
+  EXPECT_NE(inserted, gama);
+
+  EXPECT_FALSE(PNGEditPlanRemoveChunk(&plan_, text));
+  EXPECT_EQ(PNGEditPlanReplaceChunk(&plan_, text, data, sizeof(data)), PNG_CHUNK_TABLE_NO_ENTRY);
+  EXPECT_EQ(PNGEditPlanReplaceChunk(&plan_, gama, data, sizeof(data)), PNG_CHUNK_TABLE_NO_ENTRY);
+  EXPECT_EQ(PNGEditPlanInsertChunk(&plan_, gama, CHUNK_tEXt, data, sizeof(data)), PNG_CHUNK_TABLE_NO_ENTRY);
+
+  // Replaced chunk is removed as well
+  const int replaced = PNGEditPlanReplaceChunk(&plan_, inserted, data, sizeof(data));
+  ASSERT_NE(replaced, PNG_CHUNK_TABLE_NO_ENTRY);
+  EXPECT_EQ(PNGEditPlanReplaceChunk(&plan_, inserted, data, sizeof(data)), PNG_CHUNK_TABLE_NO_ENTRY);
+  EXPECT_EQ(plan_.inserted_count, 2);
+
+  const auto written = WritePlan();
+  EXPECT_EQ(ChunkTypes(written), (std::vector<uint32_t>{CHUNK_IHDR.bytes, CHUNK_IDAT.bytes, CHUNK_IDAT.bytes,
+                                                        CHUNK_IEND.bytes, CHUNK_tEXt.bytes}));
+}
+
+TEST_F(EditingTestSuite, InvalidSourceFile) {
+  const auto path = test_utils::WriteTempFile({1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20});
+  const int fd = open(path.c_str(), O_RDONLY);
+  EXPECT_FALSE(PNGCreateEditPlanFromFd(fd, &plan_));
+  close(fd);
+  std::filesystem::remove(path);
+}
+
+TEST_F(EditingTestSuite, RechunkIDAT) {
+  ASSERT_TRUE(PNGCreateEditPlanFromFd(in_fd_, &plan_));
+  ASSERT_TRUE(PNGEditPlanSetIDATChunkSize(&plan_, 1024));
+
+  const auto written = WritePlan();
+  const auto types = ChunkTypes(written);
+  ASSERT_EQ(types.size(), 4 + 6);
+  EXPECT_EQ(std::count(types.begin(), types.end(), CHUNK_IDAT.bytes), 6);
+
+  // Compressed data is the same, only boundaries changed
+  PNGChunkTable table;
+  PNGInitChunkTable(&table);
+  ASSERT_TRUE(PNGBuildChunkTable(written.data(), written.size(), true, &table));
+  int spans_count = 0;
+  const PNGChunkSpan* spans = PNGChunkTableGetIDATSpans(&table, &spans_count);
+  std::vector<uint8_t> idat_data;
+  for (int i = 0; i < spans_count; ++i) {
+    EXPECT_EQ(spans[i].size, i + 1 < spans_count ? 1024 : 5300 - 5 * 1024);
+    idat_data.insert(idat_data.end(), &written[spans[i].offset], &written[spans[i].offset] + spans[i].size);
+  }
+  PNGFreeChunkTable(&table);
+
+  std::vector<uint8_t> expected(5000, 0x42);
+  expected.resize(5300, 0x43);
+  EXPECT_EQ(idat_data, expected);
+}
@@ -0,0 +1,807 @@
+#include <array>
+
+#include <png_core/animation.h>
+#include <png_core/chunk_types.h>
+#include <png_core/compression.h>
+#include <png_core/decoder.h>
+#include <png_core/encoder.h>
+#include <png_core/pixel_format.h>
+
+#include "../test_utils.h"
+
+class EncoderTestSuite : public ::testing::Test {
+protected:
+  static PNGRawImage CreateRawImage(PNGImageType type, int bit_depth, int width, std::vector<uint8_t>& data) {
+    PNGRawImage image;
+    PNGInitRawImage(&image);
+    image.type = type;
+    image.channel_bit_depth = bit_depth;
+    image.scanline_pixel_count = width;
+    image.data = data.data();
+    image.data_size = data.size();
+    return image;
+  }
+
+  static std::vector<uint8_t> Encode(const PNGRawImage& image, const PNGEncodeOptions* options) {
+    int size = 0;
+    uint8_t* encoded = PNGEncodeRawImage(&image, options, &size);
+    EXPECT_NE(nullptr, encoded);
+    if (!encoded)
+      return {};
+    std::vector<uint8_t> png(encoded, encoded + size);
+    PNGFreeEncodedData(encoded);
+    return png;
+  }
+
+  /// Split datastream into chunk types and data, checking lengths and CRCs
+  static std::vector<std::pair<ChunkType, std::vector<uint8_t>>> SplitChunks(const std::vector<uint8_t>& png) {
+    std::vector<std::pair<ChunkType, std::vector<uint8_t>>> chunks;
+    const uint8_t signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    EXPECT_TRUE(png.size() >= 8 && std::equal(signature, signature + 8, png.begin()));
+    auto read_uint32 = [&](size_t offset) {
+      return (uint32_t)png[offset] << 24 | (uint32_t)png[offset + 1] << 16 | (uint32_t)png[offset + 2] << 8 |
+             (uint32_t)png[offset + 3];
+    };
+    size_t offset = 8;
+    while (offset + 12 <= png.size()) {
+      const uint32_t length = read_uint32(offset);
+      EXPECT_LE(offset + 12 + length, png.size());
+      ChunkType type;
+      std::copy(png.begin() + offset + 4, png.begin() + offset + 8, type.byte_array);
+      std::vector<uint8_t> data(png.begin() + offset + 8, png.begin() + offset + 8 + length);
+      EXPECT_EQ(PNGComputeChunkCRC(type, data.data(), length), read_uint32(offset + 8 + length));
+      chunks.emplace_back(type, std::move(data));
+      offset += 12 + length;
+    }
+    EXPECT_EQ(png.size(), offset);
+    return chunks;
+  }
+
+  /// Filter type bytes of scanlines of encoded single-IDAT image
+  static std::vector<uint8_t> GetFilterTypes(const std::vector<uint8_t>& png, int scanline_size_bytes, int height) {
+    const auto chunks = SplitChunks(png);
+    const std::vector<uint8_t>& idat = chunks[1].second;
+    const int filtered_size = (1 + scanline_size_bytes) * height;
+    uint8_t* filtered = PNGDataDecompress0(idat.data(), idat.size(), filtered_size);
+    EXPECT_NE(nullptr, filtered);
+    std::vector<uint8_t> types;
+    for (int i = 0; filtered && i < height; ++i)
+      types.push_back(filtered[i * (1 + scanline_size_bytes)]);
+    PNGFreeCompressionData(filtered);
+    return types;
+  }
+
+  static std::vector<uint8_t> GenerateData(int size, uint32_t seed) {
+    std::vector<uint8_t> data(size);
+    for (int i = 0; i < size; ++i) {
+      seed = seed * 1103515245 + 12345;
+      /* Noise over gradient, so that each filter type wins somewhere */
+      data[i] = (uint8_t)(i / 3 + (seed >> 16) % 7);
+    }
+    return data;
+  }
+
+  /// Pack `width * height` pixels of R, G, B, A samples returned by `get_pixel(x, y)`.
+  /// Greyscale images take R sample as grey
+  template <typename Function>
+  static std::vector<uint8_t> PackImage(int channels_count, int bit_depth, int width, int height,
+                                        Function get_pixel) {
+    const int scanline_size = (width * channels_count * bit_depth + 7) / 8;
+    std::vector<uint8_t> data(scanline_size * height);
+    for (int y = 0; y < height; ++y)
+      for (int x = 0; x < width; ++x) {
+        const std::array<uint16_t, 4> pixel = get_pixel(x, y);
+        for (int c = 0; c < channels_count; ++c) {
+          const uint16_t sample = pixel[channels_count == 2 && c == 1 ? 3 : c];
+          const int bit = (x * channels_count + c) * bit_depth;
+          uint8_t* out = &data[y * scanline_size + bit / 8];
+          if (bit_depth == 16) {
+            out[0] = sample >> 8;
+            out[1] = (uint8_t)sample;
+          } else {
+            out[0] |= sample << (8 - bit % 8 - bit_depth);
+          }
+        }
+      }
+    return data;
+  }
+
+  /// Decode datastream into RGBA16 samples, checking its IHDR colour type and bit depth
+  static std::vector<uint16_t> DecodeRGBA16(const std::vector<uint8_t>& png, PNGImageType type, int bit_depth) {
+    PNGRawChunk* chunks = PNGLoadRawChunkList(png.data(), png.size(), true);
+    EXPECT_NE(nullptr, chunks);
+    if (!chunks)
+      return {};
+    const PNGChunkData_IHDR* header = (const PNGChunkData_IHDR*)chunks->parsed_data;
+    EXPECT_EQ(type, header->color_type);
+    EXPECT_EQ(bit_depth, header->bit_depth);
+
+    PNGDecodeOptions options;
+    PNGInitDecodeOptions(&options);
+    options.format = PNG_PIXEL_FORMAT_RGBA16;
+    PNGImage image;
+    PNGInitImage(&image);
+    EXPECT_TRUE(PNGDecodeImage(chunks, &options, &image));
+    std::vector<uint16_t> samples((uint16_t*)image.data, (uint16_t*)(image.data + image.data_size));
+    PNGFreeImage(&image);
+    PNGFreeRawChunk(chunks);
+    return samples;
+  }
+
+  /// Encode animation of frames sharing type, bit depth and width, each shown for 1/10 s
+  static std::vector<uint8_t> EncodeAnimation(PNGImageType type, int bit_depth, int width,
+                                              std::vector<std::vector<uint8_t>>& frames_data,
+                                              const PNGEncodeAnimationOptions* options) {
+    std::vector<PNGEncodeAnimationFrame> frames(frames_data.size());
+    for (size_t i = 0; i < frames.size(); ++i) {
+      frames[i].image = CreateRawImage(type, bit_depth, width, frames_data[i]);
+      frames[i].delay_num = 1;
+      frames[i].delay_den = 10;
+    }
+    int size = 0;
+    uint8_t* encoded = PNGEncodeAnimation(frames.data(), frames.size(), options, &size);
+    EXPECT_NE(nullptr, encoded);
+    if (!encoded)
+      return {};
+    std::vector<uint8_t> png(encoded, encoded + size);
+    PNGFreeEncodedData(encoded);
+    return png;
+  }
+
+  /// Decode animation into RGBA16 canvas and control of each frame
+  static std::vector<std::pair<std::vector<uint16_t>, PNGChunkData_fcTL>> DecodeAnimation(
+      const std::vector<uint8_t>& png) {
+    std::vector<std::pair<std::vector<uint16_t>, PNGChunkData_fcTL>> frames;
+    PNGRawChunk* chunks = PNGLoadRawChunkList(png.data(), png.size(), true);
+    EXPECT_NE(nullptr, chunks);
+    PNGAnimationOptions options;
+    PNGInitAnimationOptions(&options);
+    options.format = PNG_PIXEL_FORMAT_RGBA16;
+    PNGAnimationDecoder* decoder = chunks ? PNGCreateAnimationDecoder(chunks, &options) : nullptr;
+    EXPECT_NE(nullptr, decoder);
+    PNGAnimationFrame frame;
+    int result = 0;
+    while (decoder && (result = PNGDecodeNextFrame(decoder, &frame)) == 1) {
+      const uint16_t* canvas = (const uint16_t*)frame.canvas;
+      frames.emplace_back(std::vector<uint16_t>(canvas, canvas + frame.canvas_size / 2), frame.control);
+    }
+    EXPECT_EQ(0, result);
+    PNGFreeAnimationDecoder(decoder);
+    PNGFreeRawChunk(chunks);
+    return frames;
+  }
+};
+
+TEST_F(EncoderTestSuite, DefaultOptions) {
+  PNGEncodeOptions options;
+  PNGInitEncodeOptions(&options);
+  EXPECT_EQ(PNG_FILTER_SELECTION_ADAPTIVE, options.filter_selection);
+  EXPECT_EQ(6, options.compression.level);
+  EXPECT_EQ(15, options.compression.window_bits);
+  EXPECT_EQ(65536, options.idat_chunk_size);
+  EXPECT_EQ(nullptr, options.palette);
+  EXPECT_EQ(nullptr, options.transparency);
+  EXPECT_FALSE(options.reduce);
+}
+
+TEST_F(EncoderTestSuite, RoundTrip) {
+  const PNGImageType types[] = {PNG_IMAGE_TYPE_GREYSCALE, PNG_IMAGE_TYPE_TRUECOLOR, PNG_IMAGE_TYPE_INDEXED,
+                                PNG_IMAGE_TYPE_GREYSCALEWITHAPLHA, PNG_IMAGE_TYPE_TRUECOLORWITHALPHA};
+  const PNGFilterSelection selections[] = {PNG_FILTER_SELECTION_NONE,  PNG_FILTER_SELECTION_SUB,
+                                           PNG_FILTER_SELECTION_UP,    PNG_FILTER_SELECTION_AVERAGE,
+                                           PNG_FILTER_SELECTION_PAETH, PNG_FILTER_SELECTION_ADAPTIVE};
+  const int width = 13;
+  const int height = 7;
+  for (PNGImageType type : types) {
+    uint8_t depths[8];
+    const int depths_count = PNGGetAllowedBitDepths(type, depths);
+    for (int d = 0; d < depths_count; ++d) {
+      const int depth = depths[d];
+      const PNGChunkData_IHDR header = {width, height, (int8_t)depth, (int8_t)type, 0, 0, 0};
+      const int scanline_size = PNGGetScanlineSizeBytes(&header);
+      std::vector<uint8_t> data = GenerateData(scanline_size * height, depth * 16 + type);
+
+      std::vector<PaletteDataEntry> entries(1 << std::min(depth, 8));
+      for (size_t i = 0; i < entries.size(); ++i)
+        entries[i] = {(uint8_t)i, (uint8_t)(255 - i), (uint8_t)(i * 7)};
+      const PNGChunkData_PLTE palette = {entries.data(), (int)entries.size()};
+
+      for (PNGFilterSelection selection : selections) {
+        SCOPED_TRACE(testing::Message() << "type " << type << " depth " << depth << " selection " << selection);
+        PNGEncodeOptions options;
+        PNGInitEncodeOptions(&options);
+        options.filter_selection = selection;
+        if (type == PNG_IMAGE_TYPE_INDEXED)
+          options.palette = &palette;
+        const PNGRawImage image = CreateRawImage(type, depth, width, data);
+        const std::vector<uint8_t> png = Encode(image, &options);
+
+        PNGRawChunk* chunks = PNGLoadRawChunkList(png.data(), png.size(), true);
+        ASSERT_NE(nullptr, chunks);
+        EXPECT_TRUE(PNGEqualData_IHDR(&header, (PNGChunkData_IHDR*)chunks->parsed_data));
+        if (type == PNG_IMAGE_TYPE_INDEXED) {
+          EXPECT_TRUE(PNGEqualData_PLTE(&palette, (PNGChunkData_PLTE*)chunks->next->parsed_data));
+        }
+
+        PNGRawImage decoded;
+        ASSERT_TRUE(PNGGetRawImage(chunks, &decoded));
+        EXPECT_EQ(type, decoded.type);
+        EXPECT_EQ(depth, decoded.channel_bit_depth);
+        EXPECT_EQ(width, decoded.scanline_pixel_count);
+        EXPECT_EQ(data, std::vector<uint8_t>((uint8_t*)decoded.data, (uint8_t*)decoded.data + decoded.data_size));
+        free(decoded.data);
+        PNGFreeRawChunk(chunks);
+      }
+    }
+  }
+}
+
+TEST_F(EncoderTestSuite, ChunkList) {
+  const int width = 64;
+  const int height = 64;
+  std::vector<uint8_t> data = GenerateData(width * height * 3, 1);
+  const PNGRawImage image = CreateRawImage(PNG_IMAGE_TYPE_TRUECOLOR, 8, width, data);
+  PNGEncodeOptions options;
+  PNGInitEncodeOptions(&options);
+  options.idat_chunk_size = 1000;
+
+  const std::vector<uint8_t> png = Encode(image, &options);
+  const auto chunks = SplitChunks(png);
+  ASSERT_GE(chunks.size(), 4);
+  EXPECT_EQ(CHUNK_IHDR.bytes, chunks.front().first.bytes);
+  EXPECT_EQ(CHUNK_IEND.bytes, chunks.back().first.bytes);
+  EXPECT_TRUE(chunks.back().second.empty());
+  std::vector<uint8_t> idat;
+  for (size_t i = 1; i + 1 < chunks.size(); ++i) {
+    EXPECT_EQ(CHUNK_IDAT.bytes, chunks[i].first.bytes);
+    /* Only the last IDAT chunk may be shorter */
+    if (i + 2 < chunks.size())
+      EXPECT_EQ(1000, chunks[i].second.size());
+    else
+      EXPECT_LE(chunks[i].second.size(), 1000);
+    idat = idat + chunks[i].second;
+  }
+
+  /* Chunk list has the same chunks with stored CRCs */
+  PNGRawChunk* list = PNGEncodeRawImageToChunkList(&image, &options);
+  ASSERT_NE(nullptr, list);
+  int list_size = 0;
+  for (PNGRawChunk* chunk = list; chunk; chunk = chunk->next, ++list_size) {
+    const auto& [type, chunk_data] = chunks[list_size];
+    EXPECT_EQ(type.bytes, chunk->type.bytes);
+    EXPECT_EQ(PNGComputeChunkCRC(type, chunk_data.data(), chunk_data.size()), chunk->crc);
+  }
+  EXPECT_EQ(chunks.size(), list_size);
+  std::vector<uint8_t> written(PNGWriteRawChunkList(list, nullptr, true));
+  PNGWriteRawChunkList(list, written.data(), true);
+  EXPECT_EQ(png, written);
+  PNGFreeRawChunk(list);
+
+  /* Single IDAT chunk has the whole zlib stream */
+  options.idat_chunk_size = 1 << 20;
+  const auto single_chunks = SplitChunks(Encode(image, &options));
+  ASSERT_EQ(3, single_chunks.size());
+  EXPECT_EQ(idat, single_chunks[1].second);
+}
+
+TEST_F(EncoderTestSuite, AdaptiveFilterSelection) {
+  /* Horizontal gradient: Sub wins on the first scanline, Up on the others */
+  const int width = 32;
+  const int height = 4;
+  std::vector<uint8_t> data(width * height);
+  for (int y = 0; y < height; ++y)
+    for (int x = 0; x < width; ++x)
+      data[y * width + x] = (uint8_t)(x * 5);
+  const PNGRawImage image = CreateRawImage(PNG_IMAGE_TYPE_GREYSCALE, 8, width, data);
+  const std::vector<uint8_t> png = Encode(image, nullptr);
+  EXPECT_EQ(std::vector<uint8_t>({1, 2, 2, 2}), GetFilterTypes(png, width, height));
+
+  PNGEncodeOptions options;
+  PNGInitEncodeOptions(&options);
+  options.filter_selection = PNG_FILTER_SELECTION_PAETH;
+  EXPECT_EQ(std::vector<uint8_t>({4, 4, 4, 4}), GetFilterTypes(Encode(image, &options), width, height));
+
+  /* Sub-byte depths are not filtered by adaptive selection */
+  std::vector<uint8_t> packed(width / 2 * height, 0x12);
+  const PNGRawImage packed_image = CreateRawImage(PNG_IMAGE_TYPE_GREYSCALE, 4, width, packed);
+  EXPECT_EQ(std::vector<uint8_t>({0, 0, 0, 0}), GetFilterTypes(Encode(packed_image, nullptr), width / 2, height));
+}
+
+TEST_F(EncoderTestSuite, InvalidImages) {
+  std::vector<uint8_t> data(12 * 2);
+  PNGEncodeOptions options;
+  PNGInitEncodeOptions(&options);
+  int size = 0;
+  auto expect_rejected = [&](const PNGRawImage& image, const PNGEncodeOptions* options) {
+    EXPECT_EQ(nullptr, PNGEncodeRawImage(&image, options, &size));
+    EXPECT_EQ(nullptr, PNGEncodeRawImageToChunkList(&image, options));
+  };
+
+  /* Data is not a whole amount of scanlines */
+  expect_rejected(CreateRawImage(PNG_IMAGE_TYPE_TRUECOLOR, 8, 5, data), nullptr);
+  expect_rejected(CreateRawImage(PNG_IMAGE_TYPE_TRUECOLOR, 8, 9, data), nullptr);
+  /* Not allowed bit depths */
+  expect_rejected(CreateRawImage(PNG_IMAGE_TYPE_TRUECOLOR, 4, 8, data), nullptr);
+  expect_rejected(CreateRawImage(PNG_IMAGE_TYPE_GREYSCALE, 3, 8, data), nullptr);
+  expect_rejected(CreateRawImage((PNGImageType)1, 8, 8, data), nullptr);
+  /* Empty image */
+  std::vector<uint8_t> empty;
+  expect_rejected(CreateRawImage(PNG_IMAGE_TYPE_GREYSCALE, 8, 8, empty), nullptr);
+
+  /* Palette is required for indexed images, must fit bit depth and must not be present for greyscale */
+  const PNGRawImage indexed = CreateRawImage(PNG_IMAGE_TYPE_INDEXED, 2, 8, data);
+  expect_rejected(indexed, nullptr);
+  std::vector<PaletteDataEntry> entries(5);
+  const PNGChunkData_PLTE palette = {entries.data(), (int)entries.size()};
+  options.palette = &palette;
+  expect_rejected(indexed, &options);
+  expect_rejected(CreateRawImage(PNG_IMAGE_TYPE_GREYSCALE, 8, 8, data), &options);
+  const PNGRawImage indexed8 = CreateRawImage(PNG_IMAGE_TYPE_INDEXED, 8, 8, data);
+  std::vector<uint8_t> png = Encode(indexed8, &options);
+  EXPECT_EQ(CHUNK_PLTE.bytes, SplitChunks(png)[1].first.bytes);
+
+  /* Suggested palette of truecolor images is written */
+  png = Encode(CreateRawImage(PNG_IMAGE_TYPE_TRUECOLOR, 8, 4, data), &options);
+  EXPECT_EQ(CHUNK_PLTE.bytes, SplitChunks(png)[1].first.bytes);
+
+  PNGInitEncodeOptions(&options);
+  const PNGRawImage grey = CreateRawImage(PNG_IMAGE_TYPE_GREYSCALE, 8, 8, data);
+  options.compression.level = 10;
+  expect_rejected(grey, &options);
+  options.compression.level = 0;
+  Encode(grey, &options);
+  options.idat_chunk_size = 0;
+  expect_rejected(grey, &options);
+  PNGInitEncodeOptions(&options);
+  options.filter_selection = (PNGFilterSelection)6;
+  expect_rejected(grey, &options);
+
+  /* tRNS holds a sample of image bit depth per color channel and is written after PLTE */
+  PNGInitEncodeOptions(&options);
+  PNGChunkData_tRNS transparency;
+  PNGInitData_tRNS(&transparency);
+  transparency.bytes_count = 2;
+  transparency.bytes[1] = 0x80;
+  options.transparency = &transparency;
+  png = Encode(grey, &options);
+  EXPECT_EQ(CHUNK_tRNS.bytes, SplitChunks(png)[1].first.bytes);
+  expect_rejected(CreateRawImage(PNG_IMAGE_TYPE_GREYSCALE, 4, 16, data), &options);
+  expect_rejected(CreateRawImage(PNG_IMAGE_TYPE_TRUECOLOR, 8, 4, data), &options);
+  expect_rejected(CreateRawImage(PNG_IMAGE_TYPE_GREYSCALEWITHAPLHA, 8, 4, data), &options);
+  options.palette = &palette;
+  transparency.bytes_count = 5;
+  png = Encode(indexed8, &options);
+  EXPECT_EQ(CHUNK_PLTE.bytes, SplitChunks(png)[1].first.bytes);
+  EXPECT_EQ(CHUNK_tRNS.bytes, SplitChunks(png)[2].first.bytes);
+  transparency.bytes_count = 6;
+  expect_rejected(indexed8, &options);
+}
+
+TEST_F(EncoderTestSuite, ReduceRawImage) {
+  const int width = 32;
+  const int height = 16;
+  uint32_t seed = 7;
+  auto random = [&seed](int modulo) {
+    seed = seed * 1103515245 + 12345;
+    return (uint16_t)((seed >> 16) % modulo);
+  };
+  PNGEncodeOptions plain_options;
+  PNGInitEncodeOptions(&plain_options);
+  PNGEncodeOptions reduce_options = plain_options;
+  reduce_options.reduce = true;
+
+  /* Reduced datastream decodes to the same samples in colour type and bit depth expected for the image */
+  auto expect_reduced = [&](PNGImageType source_type, int source_depth, PNGImageType type, int depth,
+                            const std::vector<std::array<uint16_t, 4>>& pixels) {
+    SCOPED_TRACE(testing::Message() << "source type " << source_type << " depth " << source_depth);
+    std::vector<uint8_t> data = PackImage(PNGGetChannelCount(source_type), source_depth, width, height,
+                                          [&](int x, int y) { return pixels[y * width + x]; });
+    const PNGRawImage image = CreateRawImage(source_type, source_depth, width, data);
+    const std::vector<uint8_t> png = Encode(image, &reduce_options);
+    EXPECT_EQ(DecodeRGBA16(Encode(image, &plain_options), source_type, source_depth), DecodeRGBA16(png, type, depth));
+    return png;
+  };
+  std::vector<std::array<uint16_t, 4>> pixels(width * height);
+
+  /* Opaque alpha is dropped */
+  for (auto& pixel : pixels)
+    pixel = {random(256), random(256), random(256), 255};
+  expect_reduced(PNG_IMAGE_TYPE_TRUECOLORWITHALPHA, 8, PNG_IMAGE_TYPE_TRUECOLOR, 8, pixels);
+
+  /* Pixels with equal R, G, B are greyscale */
+  for (auto& pixel : pixels) {
+    const uint16_t grey = random(256);
+    pixel = {grey, grey, grey, random(256)};
+  }
+  expect_reduced(PNG_IMAGE_TYPE_TRUECOLORWITHALPHA, 8, PNG_IMAGE_TYPE_GREYSCALEWITHAPLHA, 8, pixels);
+  expect_reduced(PNG_IMAGE_TYPE_TRUECOLOR, 8, PNG_IMAGE_TYPE_GREYSCALE, 8, pixels);
+
+  /* 16-bit samples with equal bytes fit 8 bits, unless any of them differ */
+  for (auto& pixel : pixels)
+    pixel = {(uint16_t)(random(256) * 257), (uint16_t)(random(256) * 257), (uint16_t)(random(256) * 257), 65535};
+  expect_reduced(PNG_IMAGE_TYPE_TRUECOLOR, 16, PNG_IMAGE_TYPE_TRUECOLOR, 8, pixels);
+  pixels[100][1] += 1;
+  expect_reduced(PNG_IMAGE_TYPE_TRUECOLORWITHALPHA, 16, PNG_IMAGE_TYPE_TRUECOLOR, 16, pixels);
+
+  /* Greyscale samples that are multiples of 0x1111 fit 4 bits, black and white fit 1 bit */
+  for (auto& pixel : pixels) {
+    const uint16_t grey = random(16) * 0x1111;
+    pixel = {grey, grey, grey, 65535};
+  }
+  expect_reduced(PNG_IMAGE_TYPE_GREYSCALEWITHAPLHA, 16, PNG_IMAGE_TYPE_GREYSCALE, 4, pixels);
+  for (auto& pixel : pixels) {
+    const uint16_t grey = random(2) * 255;
+    pixel = {grey, grey, grey, 255};
+  }
+  expect_reduced(PNG_IMAGE_TYPE_GREYSCALE, 8, PNG_IMAGE_TYPE_GREYSCALE, 1, pixels);
+
+  /* Fully transparent pixels of one color become tRNS color, unless that color is also opaque */
+  for (auto& pixel : pixels)
+    pixel = random(4) ? std::array<uint16_t, 4>{random(256), random(256), random(256), 255}
+                      : std::array<uint16_t, 4>{1, 2, 3, 0};
+  std::vector<uint8_t> png =
+      expect_reduced(PNG_IMAGE_TYPE_TRUECOLORWITHALPHA, 8, PNG_IMAGE_TYPE_TRUECOLOR, 8, pixels);
+  EXPECT_EQ(std::vector<uint8_t>({0, 1, 0, 2, 0, 3}), SplitChunks(png)[1].second);
+  pixels[0] = {1, 2, 3, 255};
+  expect_reduced(PNG_IMAGE_TYPE_TRUECOLORWITHALPHA, 8, PNG_IMAGE_TYPE_TRUECOLORWITHALPHA, 8, pixels);
+
+  /* Few colors are indexed with translucent ones first in palette */
+  const std::array<uint16_t, 4> colors[] = {{10, 20, 30, 255}, {40, 50, 60, 128}, {0, 0, 0, 0}, {70, 80, 90, 255}};
+  for (auto& pixel : pixels)
+    pixel = colors[random(4)];
+  png = expect_reduced(PNG_IMAGE_TYPE_TRUECOLORWITHALPHA, 8, PNG_IMAGE_TYPE_INDEXED, 2, pixels);
+  const auto chunks = SplitChunks(png);
+  EXPECT_EQ(CHUNK_PLTE.bytes, chunks[1].first.bytes);
+  EXPECT_EQ(12u, chunks[1].second.size());
+  EXPECT_EQ(CHUNK_tRNS.bytes, chunks[2].first.bytes);
+  EXPECT_EQ(2u, chunks[2].second.size());
+  /* 16 greyscale values are cheaper as 4-bit indices than 8-bit samples */
+  for (auto& pixel : pixels) {
+    const uint16_t grey = random(16) * 3 * 257;
+    pixel = {grey, grey, grey, 65535};
+  }
+  expect_reduced(PNG_IMAGE_TYPE_GREYSCALE, 16, PNG_IMAGE_TYPE_INDEXED, 4, pixels);
+
+  /* Images already in the smallest format and indexed ones are not copied */
+  std::vector<uint8_t> data = GenerateData(width * height * 3, 11);
+  PNGRawImage image = CreateRawImage(PNG_IMAGE_TYPE_TRUECOLOR, 8, width, data);
+  PNGReducedImage reduced;
+  ASSERT_TRUE(PNGReduceRawImage(&image, &reduced));
+  EXPECT_FALSE(reduced.owns_data);
+  EXPECT_EQ(image.data, reduced.image.data);
+  EXPECT_EQ(0, reduced.palette.entries_count);
+  EXPECT_EQ(0, reduced.transparency.bytes_count);
+  PNGFreeReducedImage(&reduced);
+  image = CreateRawImage(PNG_IMAGE_TYPE_INDEXED, 8, width, data);
+  ASSERT_TRUE(PNGReduceRawImage(&image, &reduced));
+  EXPECT_FALSE(reduced.owns_data);
+  EXPECT_EQ(PNG_IMAGE_TYPE_INDEXED, reduced.image.type);
+  PNGFreeReducedImage(&reduced);
+  image = CreateRawImage(PNG_IMAGE_TYPE_TRUECOLOR, 4, width, data);
+  EXPECT_FALSE(PNGReduceRawImage(&image, &reduced));
+}
+
+TEST_F(EncoderTestSuite, OptimizeRawImage) {
+  const int width = 96;
+  const int height = 48;
+  std::vector<uint8_t> data = GenerateData(width * height * 3, 5);
+  const PNGRawImage image = CreateRawImage(PNG_IMAGE_TYPE_TRUECOLOR, 8, width, data);
+
+  PNGOptimizeOptions options;
+  PNGInitOptimizeOptions(&options);
+  EXPECT_EQ(2, options.effort);
+  EXPECT_EQ(0, options.time_budget_ms);
+  EXPECT_EQ(0, options.threads_count);
+  EXPECT_TRUE(options.reduce);
+  options.threads_count = 4;
+
+  auto optimize = [&](const PNGRawImage& image, const PNGOptimizeOptions& options, PNGOptimizeResult& result) {
+    int size = 0;
+    uint8_t* optimized = PNGOptimizeRawImage(&image, &options, &size, &result);
+    EXPECT_NE(nullptr, optimized);
+    if (!optimized)
+      return std::vector<uint8_t>();
+    std::vector<uint8_t> png(optimized, optimized + size);
+    PNGFreeEncodedData(optimized);
+    return png;
+  };
+
+  PNGOptimizeResult result;
+  const std::vector<uint8_t> png = optimize(image, options, result);
+  /* Every filter selection, three strategies and two memLevels */
+  EXPECT_EQ(36, result.trials_count);
+  EXPECT_EQ(36, result.finished_trials_count + result.stopped_trials_count);
+  EXPECT_EQ(0, result.skipped_trials_count);
+
+  PNGRawChunk* chunks = PNGLoadRawChunkList(png.data(), png.size(), true);
+  ASSERT_NE(nullptr, chunks);
+  PNGRawImage decoded;
+  ASSERT_TRUE(PNGGetRawImage(chunks, &decoded));
+  EXPECT_EQ(data, std::vector<uint8_t>((uint8_t*)decoded.data, (uint8_t*)decoded.data + decoded.data_size));
+  free(decoded.data);
+  PNGFreeRawChunk(chunks);
+
+  /* Result reproduces the datastream and is not larger than any trial */
+  EXPECT_EQ(png, Encode(image, &result.encode_options));
+  PNGEncodeOptions encode_options;
+  PNGInitEncodeOptions(&encode_options);
+  EXPECT_LT(png.size(), Encode(image, &encode_options).size());
+  encode_options.compression.level = 9;
+  encode_options.compression.mem_level = 9;
+  for (int selection = PNG_FILTER_SELECTION_NONE; selection <= PNG_FILTER_SELECTION_ADAPTIVE; ++selection) {
+    encode_options.filter_selection = (PNGFilterSelection)selection;
+    EXPECT_LE(png.size(), Encode(image, &encode_options).size());
+  }
+
+  /* Result does not depend on threads */
+  options.threads_count = 1;
+  PNGOptimizeResult single_thread_result;
+  EXPECT_EQ(png, optimize(image, options, single_thread_result));
+  EXPECT_EQ(result.encode_options.filter_selection, single_thread_result.encode_options.filter_selection);
+  EXPECT_EQ(result.encode_options.compression.strategy, single_thread_result.encode_options.compression.strategy);
+  EXPECT_EQ(result.encode_options.compression.mem_level, single_thread_result.encode_options.compression.mem_level);
+
+  /* Adaptive selection of sub-byte images is None, so it is not tried twice */
+  std::vector<uint8_t> packed = GenerateData(width / 4 * height, 9);
+  const PNGRawImage packed_image = CreateRawImage(PNG_IMAGE_TYPE_GREYSCALE, 2, width, packed);
+  options.effort = 1;
+  optimize(packed_image, options, result);
+  EXPECT_EQ(2, result.trials_count);
+  optimize(image, options, result);
+  EXPECT_EQ(4, result.trials_count);
+
+  /* Windows larger than data give the same streams, Huffman-only and RLE ignore level and window */
+  std::vector<uint8_t> small = GenerateData(8 * 8, 3);
+  options.effort = 3;
+  options.threads_count = 0;
+  optimize(CreateRawImage(PNG_IMAGE_TYPE_GREYSCALE, 8, 8, small), options, result);
+  EXPECT_EQ(4 * (9 * 3 + 2) * 6, result.trials_count);
+  EXPECT_EQ(result.trials_count, result.finished_trials_count + result.stopped_trials_count);
+
+  /* Time budget stops the search once there is a result */
+  options.time_budget_ms = 1;
+  const std::vector<uint8_t> budget_png = optimize(image, options, result);
+  EXPECT_EQ(4 * (9 * 3 * 3 + 2) * 6, result.trials_count);
+  EXPECT_GE(result.finished_trials_count, 1);
+  EXPECT_LT(result.finished_trials_count, result.trials_count);
+  EXPECT_EQ(budget_png, Encode(image, &result.encode_options));
+
+  int size = 0;
+  options.effort = 4;
+  EXPECT_EQ(nullptr, PNGOptimizeRawImage(&image, &options, &size, nullptr));
+  options.effort = 1;
+  options.threads_count = -1;
+  EXPECT_EQ(nullptr, PNGOptimizeRawImage(&image, &options, &size, nullptr));
+  options.threads_count = 1;
+  uint8_t* optimized = PNGOptimizeRawImage(&image, &options, &size, nullptr);
+  EXPECT_NE(nullptr, optimized);
+  PNGFreeEncodedData(optimized);
+}
+
+TEST_F(EncoderTestSuite, EncodeAnimation) {
+  const int width = 64;
+  const int height = 48;
+  PNGEncodeAnimationOptions options;
+  PNGInitEncodeAnimationOptions(&options);
+  EXPECT_EQ(0u, options.plays_count);
+  EXPECT_EQ(0, options.threads_count);
+  EXPECT_TRUE(options.optimize_frames);
+  EXPECT_EQ(65536, options.encode.idat_chunk_size);
+
+  /* Translucent square moves over gradient with transparent corner */
+  auto create_frame = [&](int square_x, int square_y) {
+    return PackImage(4, 8, width, height, [&](int x, int y) -> std::array<uint16_t, 4> {
+      if (x >= square_x && x < square_x + 8 && y >= square_y && y < square_y + 8)
+        return {200, 40, 40, 160};
+      if (x < 16 && y < 16)
+        return {0, 0, 0, 0};
+      const uint16_t noise = (uint16_t)((x * 7919 + y * 104729) % 31);
+      return {(uint16_t)(x * 3 + noise), (uint16_t)(y * 4 + noise), (uint16_t)((x + y) * 2), 255};
+    });
+  };
+  std::vector<std::vector<uint8_t>> frames_data;
+  for (int i = 0; i < 6; ++i)
+    frames_data.push_back(create_frame(20 + i * 3, 10 + i * 2));
+  /* Square leaves canvas, then moves into transparent corner */
+  frames_data.push_back(create_frame(width, height));
+  frames_data.push_back(create_frame(4, 4));
+
+  options.threads_count = 3;
+  const std::vector<uint8_t> png = EncodeAnimation(PNG_IMAGE_TYPE_TRUECOLORWITHALPHA, 8, width, frames_data, &options);
+  const auto frames = DecodeAnimation(png);
+  ASSERT_EQ(frames_data.size(), frames.size());
+  for (size_t i = 0; i < frames.size(); ++i) {
+    SCOPED_TRACE(testing::Message() << "frame " << i);
+    const PNGRawImage image = CreateRawImage(PNG_IMAGE_TYPE_TRUECOLORWITHALPHA, 8, width, frames_data[i]);
+    EXPECT_EQ(DecodeRGBA16(Encode(image, nullptr), PNG_IMAGE_TYPE_TRUECOLORWITHALPHA, 8), frames[i].first);
+    EXPECT_EQ(1, frames[i].second.delay_num);
+    EXPECT_EQ(10, frames[i].second.delay_den);
+    /* Moving square changes two overlapping squares at most */
+    if (i > 0 && i < 6) {
+      EXPECT_LE(frames[i].second.width, 11u);
+      EXPECT_LE(frames[i].second.height, 10u);
+    }
+  }
+  EXPECT_EQ(width, (int)frames[0].second.width);
+  EXPECT_EQ(height, (int)frames[0].second.height);
+
+  /* Full frames decode to the same canvases, split into many data chunks */
+  options.optimize_frames = false;
+  options.encode.idat_chunk_size = 256;
+  options.plays_count = 2;
+  const std::vector<uint8_t> full_png =
+      EncodeAnimation(PNG_IMAGE_TYPE_TRUECOLORWITHALPHA, 8, width, frames_data, &options);
+  const auto full_frames = DecodeAnimation(full_png);
+  ASSERT_EQ(frames.size(), full_frames.size());
+  for (size_t i = 0; i < frames.size(); ++i) {
+    EXPECT_EQ(frames[i].first, full_frames[i].first);
+    EXPECT_EQ(width, (int)full_frames[i].second.width);
+    EXPECT_EQ(PNG_DISPOSE_OP_NONE, full_frames[i].second.dispose_op);
+    EXPECT_EQ(PNG_BLEND_OP_SOURCE, full_frames[i].second.blend_op);
+  }
+  EXPECT_LT(png.size() * 2, full_png.size());
+
+  const auto chunks = SplitChunks(full_png);
+  EXPECT_EQ(CHUNK_IHDR.bytes, chunks[0].first.bytes);
+  EXPECT_EQ(CHUNK_acTL.bytes, chunks[1].first.bytes);
+  EXPECT_EQ((std::vector<uint8_t>{0, 0, 0, 8, 0, 0, 0, 2}), chunks[1].second);
+  EXPECT_EQ(CHUNK_fcTL.bytes, chunks[2].first.bytes);
+  EXPECT_EQ(CHUNK_IEND.bytes, chunks.back().first.bytes);
+  uint32_t sequence_number = 0;
+  for (const auto& [type, data] : chunks) {
+    if (type.bytes != CHUNK_fcTL.bytes && type.bytes != CHUNK_fdAT.bytes)
+      continue;
+    EXPECT_EQ(sequence_number++, (uint32_t)data[0] << 24 | data[1] << 16 | data[2] << 8 | data[3]);
+    EXPECT_LE(data.size(), type.bytes == CHUNK_fdAT.bytes ? 260u : 26u);
+  }
+  EXPECT_GT(sequence_number, 8u * 2);
+}
+
+TEST_F(EncoderTestSuite, AnimationFrameOps) {
+  const int width = 32;
+  const int height = 32;
+  auto create_frame = [&](int square_x, std::array<uint16_t, 4> color) {
+    return PackImage(3, 8, width, height, [&](int x, int y) -> std::array<uint16_t, 4> {
+      if (x >= square_x && x < square_x + 6 && y >= 8 && y < 14)
+        return color;
+      return {(uint16_t)(x * 8), (uint16_t)(y * 8), 100, 255};
+    });
+  };
+  const std::vector<uint8_t> background = create_frame(width, {});
+  const std::vector<uint8_t> square = create_frame(10, {255, 255, 255, 255});
+  PNGEncodeAnimationOptions options;
+  PNGInitEncodeAnimationOptions(&options);
+  options.threads_count = 1;
+
+  /* Flickering square: canvas before it is restored, then the next background needs a single pixel */
+  std::vector<std::vector<uint8_t>> frames_data = {background, square, background, square};
+  auto frames = DecodeAnimation(EncodeAnimation(PNG_IMAGE_TYPE_TRUECOLOR, 8, width, frames_data, &options));
+  ASSERT_EQ(4u, frames.size());
+  EXPECT_EQ(frames[0].first, frames[2].first);
+  EXPECT_EQ(frames[1].first, frames[3].first);
+  EXPECT_EQ(PNG_DISPOSE_OP_PREVIOUS, frames[1].second.dispose_op);
+  EXPECT_EQ(1u, frames[2].second.width);
+  EXPECT_EQ(1u, frames[2].second.height);
+  EXPECT_EQ(6u, frames[3].second.width);
+  EXPECT_EQ(6u, frames[3].second.height);
+  EXPECT_EQ(10u, frames[3].second.x_offset);
+  EXPECT_EQ(8u, frames[3].second.y_offset);
+
+  /* Equal consecutive frames are merged while their delays can be summed */
+  frames_data = {background, square, square, square, background};
+  frames = DecodeAnimation(EncodeAnimation(PNG_IMAGE_TYPE_TRUECOLOR, 8, width, frames_data, &options));
+  ASSERT_EQ(3u, frames.size());
+  EXPECT_EQ(3, frames[1].second.delay_num);
+  EXPECT_EQ(10, frames[1].second.delay_den);
+  EXPECT_EQ(frames[0].first, frames[2].first);
+
+  std::vector<PNGEncodeAnimationFrame> frames_list(2);
+  frames_list[0].image = CreateRawImage(PNG_IMAGE_TYPE_TRUECOLOR, 8, width, frames_data[0]);
+  frames_list[0].delay_num = 1;
+  frames_list[0].delay_den = 100;
+  frames_list[1] = frames_list[0];
+  frames_list[1].delay_den = 0;
+  int size = 0;
+  uint8_t* encoded = PNGEncodeAnimation(frames_list.data(), 2, &options, &size);
+  ASSERT_NE(nullptr, encoded);
+  frames = DecodeAnimation(std::vector<uint8_t>(encoded, encoded + size));
+  PNGFreeEncodedData(encoded);
+  ASSERT_EQ(1u, frames.size());
+  EXPECT_EQ(2, frames[0].second.delay_num);
+  frames_list[1].delay_den = 10;
+  encoded = PNGEncodeAnimation(frames_list.data(), 2, &options, &size);
+  ASSERT_NE(nullptr, encoded);
+  frames = DecodeAnimation(std::vector<uint8_t>(encoded, encoded + size));
+  PNGFreeEncodedData(encoded);
+  ASSERT_EQ(2u, frames.size());
+  EXPECT_EQ(1u, frames[1].second.width);
+
+  /* Opaque pixels over changed ones are blended */
+  auto create_alpha_frame = [&](int square_x) {
+    return PackImage(4, 16, width, height, [&](int x, int y) -> std::array<uint16_t, 4> {
+      if (x >= square_x && x < square_x + 6 && y >= 8 && y < 14)
+        return {65535, 0, 0, 65535};
+      if (x == square_x + 2)
+        return {0, 0, 0, 0};
+      return {(uint16_t)(x * 2000), (uint16_t)(y * 2000), 100, (uint16_t)(x * 2000 + 1)};
+    });
+  };
+  frames_data = {create_alpha_frame(4), create_alpha_frame(5)};
+  frames = DecodeAnimation(EncodeAnimation(PNG_IMAGE_TYPE_TRUECOLORWITHALPHA, 16, width, frames_data, &options));
+  ASSERT_EQ(2u, frames.size());
+  for (size_t i = 0; i < frames.size(); ++i) {
+    const PNGRawImage image = CreateRawImage(PNG_IMAGE_TYPE_TRUECOLORWITHALPHA, 16, width, frames_data[i]);
+    EXPECT_EQ(DecodeRGBA16(Encode(image, nullptr), PNG_IMAGE_TYPE_TRUECOLORWITHALPHA, 16), frames[i].first);
+  }
+}
+
+TEST_F(EncoderTestSuite, EncodeIndexedAnimation) {
+  const int width = 19;
+  const int height = 7;
+  std::vector<PaletteDataEntry> entries;
+  for (int i = 0; i < 4; ++i)
+    entries.push_back({(uint8_t)(i * 80), (uint8_t)(255 - i * 80), 7});
+  const PNGChunkData_PLTE palette = {entries.data(), (int)entries.size()};
+  PNGEncodeAnimationOptions options;
+  PNGInitEncodeAnimationOptions(&options);
+  options.encode.palette = &palette;
+
+  std::vector<std::vector<uint8_t>> frames_data;
+  for (int i = 0; i < 5; ++i)
+    frames_data.push_back(PackImage(1, 2, width, height, [&](int x, int y) -> std::array<uint16_t, 4> {
+      return {(uint16_t)(x == 3 + i * 3 && y == 2 ? 3 : (x + y) % 3), 0, 0, 0};
+    }));
+  const auto frames = DecodeAnimation(EncodeAnimation(PNG_IMAGE_TYPE_INDEXED, 2, width, frames_data, &options));
+  ASSERT_EQ(frames_data.size(), frames.size());
+  for (size_t i = 0; i < frames.size(); ++i) {
+    SCOPED_TRACE(testing::Message() << "frame " << i);
+    PNGEncodeOptions encode_options;
+    PNGInitEncodeOptions(&encode_options);
+    encode_options.palette = &palette;
+    const PNGRawImage image = CreateRawImage(PNG_IMAGE_TYPE_INDEXED, 2, width, frames_data[i]);
+    EXPECT_EQ(DecodeRGBA16(Encode(image, &encode_options), PNG_IMAGE_TYPE_INDEXED, 2), frames[i].first);
+    /* Region is widened to whole bytes of 4 pixels */
+    if (i > 0) {
+      EXPECT_EQ(0u, frames[i].second.x_offset % 4);
+      EXPECT_LE(frames[i].second.width, 8u);
+      EXPECT_EQ(1u, frames[i].second.height);
+    }
+  }
+}
+
+TEST_F(EncoderTestSuite, InvalidAnimations) {
+  const int width = 8;
+  std::vector<uint8_t> rgb(width * 8 * 3);
+  std::vector<uint8_t> rgba(width * 8 * 4);
+  std::vector<uint8_t> short_rgb(width * 7 * 3);
+  std::vector<PNGEncodeAnimationFrame> frames(2);
+  frames[0].image = CreateRawImage(PNG_IMAGE_TYPE_TRUECOLOR, 8, width, rgb);
+  frames[1] = frames[0];
+  PNGEncodeAnimationOptions options;
+  PNGInitEncodeAnimationOptions(&options);
+  int size = 0;
+  auto expect_rejected = [&](int frames_count) {
+    EXPECT_EQ(nullptr, PNGEncodeAnimation(frames.data(), frames_count, &options, &size));
+  };
+
+  uint8_t* encoded = PNGEncodeAnimation(frames.data(), 2, nullptr, &size);
+  EXPECT_NE(nullptr, encoded);
+  PNGFreeEncodedData(encoded);
+  EXPECT_EQ(nullptr, PNGEncodeAnimation(nullptr, 1, &options, &size));
+  expect_rejected(0);
+  frames[1].image = CreateRawImage(PNG_IMAGE_TYPE_TRUECOLORWITHALPHA, 8, width, rgba);
+  expect_rejected(2);
+  frames[1].image = CreateRawImage(PNG_IMAGE_TYPE_TRUECOLOR, 8, width, short_rgb);
+  expect_rejected(2);
+  frames[1].image = CreateRawImage(PNG_IMAGE_TYPE_TRUECOLOR, 8, width, rgb);
+  frames[1].image.data = nullptr;
+  expect_rejected(2);
+  frames[1] = frames[0];
+  options.threads_count = -1;
+  expect_rejected(2);
+  /* Frames are checked as images */
+  options.threads_count = 0;
+  frames[0].image.channel_bit_depth = 4;
+  frames[1].image.channel_bit_depth = 4;
+  expect_rejected(2);
+}
@@ -38,3 +38,61 @@ TEST_F(FilteringTestSuite, TestDefilteringMethod0) {
     EXPECT_EQ(expected, std::vector<uint8_t>(std::begin(defiltered), std::end(defiltered)));
   }
 }
+
+TEST_F(FilteringTestSuite, TestFilteringMethod0) {
+  const std::vector<uint8_t> scanline = {10, 20, 30, 25, 200, 5};
+  const std::vector<uint8_t> previous = {12, 40, 33, 5, 190, 180};
+  std::array<std::vector<uint8_t>, 5> expected;
+  expected[0] = {10, 20, 30, 25, 200, 5};
+  expected[1] = {10, 10, 10, 251, 175, 61};
+  expected[2] = {254, 236, 253, 20, 10, 81};
+  expected[3] = {4, 251, 4, 8, 93, 71};
+  /* Paeth predictors are up, up, left, up, up, upper left */
+  expected[4] = {254, 236, 10, 20, 10, 71};
+
+  for (uint8_t type = 0; type < 5; ++type) {
+    std::vector<uint8_t> filtered(scanline.size());
+    EXPECT_TRUE(PNGFilterScanline0(type, scanline.data(), previous.data(), filtered.data(), 6, 1));
+    EXPECT_EQ(expected[type], filtered);
+
+    std::vector<uint8_t> restored(scanline.size());
+    EXPECT_TRUE(PNGDefilterScanline0(type, filtered.data(), previous.data(), restored.data(), 6, 1));
+    EXPECT_EQ(scanline, restored);
+  }
+  std::vector<uint8_t> filtered(scanline.size());
+  EXPECT_FALSE(PNGFilterScanline0(5, scanline.data(), previous.data(), filtered.data(), 6, 1));
+}
+
+TEST_F(FilteringTestSuite, TestFilteringScanlinesMethod0) {
+  /* Three RGB pixels per scanline */
+  const int scanline_size = 9;
+  const int height = 6;
+  std::vector<uint8_t> plain(scanline_size * height);
+  for (size_t i = 0; i < plain.size(); ++i)
+    plain[i] = (uint8_t)(i * i * 31 + i / 5);
+
+  const PNGFilterSelection selections[] = {PNG_FILTER_SELECTION_NONE,  PNG_FILTER_SELECTION_SUB,
+                                           PNG_FILTER_SELECTION_UP,    PNG_FILTER_SELECTION_AVERAGE,
+                                           PNG_FILTER_SELECTION_PAETH, PNG_FILTER_SELECTION_ADAPTIVE};
+  for (PNGFilterSelection selection : selections) {
+    std::vector<uint8_t> filtered(plain.size() + height);
+    ASSERT_TRUE(PNGFilterScanlines0(plain.data(), plain.size(), scanline_size, 3, selection, filtered.data()));
+    for (int y = 0; y < height; ++y) {
+      const uint8_t type = filtered[y * (scanline_size + 1)];
+      if (selection == PNG_FILTER_SELECTION_ADAPTIVE)
+        EXPECT_LE(type, 4);
+      else
+        EXPECT_EQ(selection, type);
+    }
+
+    std::vector<uint8_t> defiltered(plain.size());
+    EXPECT_TRUE(PNGDefilterScanlines0(filtered.data(), filtered.size(), 3, 3, defiltered.data()));
+    EXPECT_EQ(plain, defiltered);
+  }
+
+  std::vector<uint8_t> filtered(plain.size() + height);
+  EXPECT_FALSE(PNGFilterScanlines0(plain.data(), plain.size() - 1, scanline_size, 3, PNG_FILTER_SELECTION_NONE,
+                                   filtered.data()));
+  EXPECT_FALSE(PNGFilterScanlines0(plain.data(), plain.size(), scanline_size, 3, (PNGFilterSelection)6,
+                                   filtered.data()));
+}
@@ -0,0 +1,128 @@
+#include <png_core/raii.hpp>
+
+#include "../test_utils.h"
+
+namespace {
+constexpr int width_ = 5;
+constexpr int height_ = 4;
+
+std::vector<uint8_t> FilteredGrey() {
+  std::vector<uint8_t> grey;
+  for (int i = 0; i < width_ * height_; ++i)
+    grey.push_back((uint8_t)(i * 11));
+  return test_utils::AddFilterBytes(grey, width_);
+}
+
+std::vector<uint8_t> CreateGreyPNG() {
+  return test_utils::CreatePNG(width_, height_, 8, 0, FilteredGrey(), {{CHUNK_gAMA, {0, 0, 0xB1, 0x8F}}});
+}
+}  // namespace
+
+static_assert(!std::is_copy_constructible_v<png_core::chunk_list> &&
+              std::is_move_constructible_v<png_core::chunk_list>);
+static_assert(!std::is_copy_constructible_v<png_core::image> && std::is_move_constructible_v<png_core::image>);
+static_assert(std::ranges::forward_range<png_core::chunk_list> && std::ranges::borrowed_range<png_core::chunk_range>);
+static_assert(std::ranges::view<png_core::chunk_range>);
+static_assert(std::is_convertible_v<png_core::image_view, png_core::const_image_view> &&
+              !std::is_convertible_v<png_core::const_image_view, png_core::image_view>);
+
+TEST(RAIITestSuite, ChunkList) {
+  const std::vector<uint8_t> png = CreateGreyPNG();
+  png_core::chunk_list chunks = png_core::chunk_list::load(png);
+  ASSERT_TRUE(chunks);
+
+  std::vector<std::string_view> names;
+  for (png_core::chunk_view chunk : chunks)
+    names.push_back(chunk.type_name());
+  EXPECT_EQ((std::vector<std::string_view>{"IHDR", "gAMA", "IDAT", "IEND"}), names);
+
+  /* Views point into chunks */
+  const png_core::chunk_view header = chunks.find(CHUNK_IHDR);
+  ASSERT_TRUE(header);
+  EXPECT_EQ(chunks.get(), header.get());
+  EXPECT_EQ(width_, header.parsed<PNGChunkData_IHDR>()->width);
+  EXPECT_EQ(header.get()->raw_data, header.payload().data());
+  EXPECT_EQ(13, header.payload().size());
+  EXPECT_EQ(PNGComputeChunkCRC(CHUNK_IHDR, header.payload().data(), 13), header.crc());
+  EXPECT_FALSE(chunks.find(CHUNK_PLTE));
+
+  /* Adaptors */
+  int idat_count = 0;
+  for (std::span<const uint8_t> payload : chunks | png_core::of_type(CHUNK_IDAT) | png_core::payloads()) {
+    ++idat_count;
+    EXPECT_EQ(test_utils::ZlibStore(FilteredGrey()), std::vector<uint8_t>(payload.begin(), payload.end()));
+  }
+  EXPECT_EQ(1, idat_count);
+  EXPECT_EQ(3, std::ranges::distance(chunks.chunks() | std::views::drop(1)));
+
+  /* Ownership */
+  PNGRawChunk* const first = chunks.get();
+  png_core::chunk_list moved = std::move(chunks);
+  EXPECT_FALSE(chunks);
+  EXPECT_EQ(first, moved.get());
+  EXPECT_EQ(chunks.begin(), chunks.end());
+  PNGRawChunk* released = moved.release();
+  EXPECT_FALSE(moved);
+  png_core::chunk_list adopted(released);
+  EXPECT_EQ(first, adopted.get());
+
+  EXPECT_FALSE(png_core::chunk_list::load(std::span<const uint8_t>(png).first(10)));
+}
+
+TEST(RAIITestSuite, Image) {
+  const std::vector<uint8_t> png = CreateGreyPNG();
+  const png_core::chunk_list chunks = png_core::chunk_list::load(png);
+  PNGDecodeOptions options;
+  PNGInitDecodeOptions(&options);
+  options.format = PNG_PIXEL_FORMAT_RGB8;
+  png_core::image image = png_core::image::decode(chunks, &options);
+  ASSERT_TRUE(image);
+  EXPECT_EQ(width_, image.width());
+  EXPECT_EQ(height_, image.height());
+  EXPECT_EQ(PNG_PIXEL_FORMAT_RGB8, image.format());
+  EXPECT_TRUE(image.palette().empty());
+
+  /* Views point into image data */
+  const png_core::const_image_view view = std::as_const(image).view();
+  EXPECT_EQ(height_, view.extent(0));
+  EXPECT_EQ(width_, view.extent(1));
+  EXPECT_EQ(3, view.pixel_size());
+  EXPECT_EQ(image.data().data(), view.data());
+  int y = 0;
+  for (std::span<const uint8_t> row : view.rows()) {
+    EXPECT_EQ(view.data() + y * view.row_stride(), row.data());
+    ASSERT_EQ(width_ * 3, row.size());
+    for (int x = 0; x < width_; ++x) {
+      const uint8_t grey = (uint8_t)((y * width_ + x) * 11);
+      EXPECT_EQ((std::vector<uint8_t>{grey, grey, grey}), std::vector<uint8_t>(view(y, x).begin(), view(y, x).end()));
+    }
+    ++y;
+  }
+  EXPECT_EQ(height_, y);
+
+  /* Writable view */
+  image.view()[1][0] = 7;
+  EXPECT_EQ(7, view.row(1)[0]);
+
+  /* Ownership */
+  png_core::image moved = std::move(image);
+  EXPECT_FALSE(image);
+  EXPECT_EQ(view.data(), moved.data().data());
+  PNGImage released = moved.release();
+  EXPECT_FALSE(moved);
+  png_core::image adopted(released);
+  EXPECT_EQ(view.data(), adopted.data().data());
+
+  /* Failures give empty images */
+  options.limits.max_pixels = 1;
+  EXPECT_FALSE(png_core::image::decode(chunks, &options));
+  EXPECT_FALSE(png_core::image::decode(png_core::chunk_list()));
+
+  /* Palette of indexed output */
+  options.limits.max_pixels = 0;
+  options.format = PNG_PIXEL_FORMAT_INDEXED8;
+  const png_core::image indexed = png_core::image::decode(chunks, &options);
+  ASSERT_TRUE(indexed);
+  ASSERT_EQ(256, indexed.palette().size());
+  EXPECT_EQ(255, indexed.palette()[255][0]);
+}
@@ -0,0 +1,357 @@
+#include <png_core/decoder.h>
+#include <png_core/encoder.h>
+#include <png_core/stream_decoder.h>
+
+#include <random>
+
+#include "../test_utils.h"
+
+class StreamDecoderTestSuite : public ::testing::Test {
+protected:
+  /// Outcome of feeding whole datastream in pieces
+  struct Decoded {
+    PNGStreamStatus status = PNG_STREAM_NEED_INPUT;
+    size_t consumed = 0;
+    int rows_count = 0;
+    bool has_info = false;
+    PNGImage info;
+    std::vector<uint8_t> pixels;
+  };
+
+  static std::vector<uint8_t> Encode(PNGImageType type, int bit_depth, int width, const std::vector<uint8_t>& data,
+                                     const PNGChunkData_PLTE* palette = nullptr,
+                                     const PNGChunkData_tRNS* transparency = nullptr) {
+    PNGRawImage image;
+    PNGInitRawImage(&image);
+    image.type = type;
+    image.channel_bit_depth = bit_depth;
+    image.scanline_pixel_count = width;
+    image.data = const_cast<uint8_t*>(data.data());
+    image.data_size = data.size();
+    PNGEncodeOptions options;
+    PNGInitEncodeOptions(&options);
+    /* Image data spans many IDAT chunks */
+    options.idat_chunk_size = 50;
+    options.palette = palette;
+    options.transparency = transparency;
+    int size = 0;
+    uint8_t* encoded = PNGEncodeRawImage(&image, &options, &size);
+    EXPECT_NE(nullptr, encoded);
+    if (!encoded)
+      return {};
+    std::vector<uint8_t> png(encoded, encoded + size);
+    PNGFreeEncodedData(encoded);
+    return png;
+  }
+
+  static std::vector<uint8_t> RandomBytes(size_t size, uint32_t seed) {
+    std::mt19937 generator(seed);
+    std::vector<uint8_t> bytes(size);
+    for (auto& byte : bytes)
+      byte = (uint8_t)(generator() % 7 * 40);
+    return bytes;
+  }
+
+  /// Feed datastream in pieces of `piece_size` until decoder ends or fails, checking row order
+  static Decoded StreamDecode(const std::vector<uint8_t>& png, const PNGDecodeOptions* options, size_t piece_size) {
+    Decoded decoded;
+    PNGStreamDecoder* decoder = PNGCreateStreamDecoder(options);
+    EXPECT_NE(nullptr, decoder);
+    if (!decoder)
+      return decoded;
+
+    size_t position = 0;
+    while (true) {
+      const size_t size = std::min(piece_size, png.size() - position);
+      size_t consumed = 0;
+      PNGStreamRow row;
+      decoded.status = PNGStreamDecode(decoder, png.data() + position, size, &consumed, &row);
+      EXPECT_LE(consumed, size);
+      position += consumed;
+      if (decoded.status == PNG_STREAM_ROW) {
+        if (decoded.rows_count == 0)
+          decoded.has_info = PNGGetStreamImageInfo(decoder, &decoded.info);
+        EXPECT_EQ(decoded.rows_count++, row.y);
+        decoded.pixels.insert(decoded.pixels.end(), row.data, row.data + row.size);
+        continue;
+      }
+      if (decoded.status != PNG_STREAM_NEED_INPUT)
+        break;
+      EXPECT_EQ(size, consumed);
+      if (position == png.size())
+        break;
+    }
+    decoded.consumed = position;
+    PNGFreeStreamDecoder(decoder);
+    return decoded;
+  }
+
+  /// Stream decoding with every piece size matches PNGDecodeImage
+  static void ExpectSameAsDecodeImage(const std::vector<uint8_t>& png, const PNGDecodeOptions& options) {
+    PNGRawChunk* chunks = PNGLoadRawChunkList(png.data(), png.size(), true);
+    ASSERT_NE(nullptr, chunks);
+    PNGImage image;
+    ASSERT_TRUE(PNGDecodeImage(chunks, &options, &image));
+    PNGFreeRawChunk(chunks);
+    const std::vector<uint8_t> expected(image.data, image.data + image.data_size);
+
+    for (size_t piece_size : {(size_t)1, (size_t)7, (size_t)4096, png.size()}) {
+      SCOPED_TRACE(testing::Message() << "piece size " << piece_size);
+      const Decoded decoded = StreamDecode(png, &options, piece_size);
+      EXPECT_EQ(PNG_STREAM_END, decoded.status);
+      EXPECT_EQ(png.size(), decoded.consumed);
+      EXPECT_EQ(image.height, decoded.rows_count);
+      EXPECT_EQ(expected, decoded.pixels);
+      ASSERT_TRUE(decoded.has_info);
+      EXPECT_EQ(image.format, decoded.info.format);
+      EXPECT_EQ(image.width, decoded.info.width);
+      EXPECT_EQ(image.row_stride, decoded.info.row_stride);
+      EXPECT_EQ(image.data_size, decoded.info.data_size);
+      EXPECT_EQ(nullptr, decoded.info.data);
+      EXPECT_EQ(image.palette_size, decoded.info.palette_size);
+    }
+    PNGFreeImage(&image);
+  }
+};
+
+TEST_F(StreamDecoderTestSuite, MatchesDecodeImage) {
+  const int width = 23;
+  const int height = 9;
+  const std::vector<uint8_t> palette_entries = {10, 20, 30, 200, 100, 0, 0, 255, 0, 90, 90, 90};
+  std::vector<PaletteDataEntry> entries;
+  for (size_t i = 0; i < palette_entries.size(); i += 3)
+    entries.push_back({palette_entries[i], palette_entries[i + 1], palette_entries[i + 2]});
+  const PNGChunkData_PLTE palette = {entries.data(), (int)entries.size()};
+  PNGChunkData_tRNS transparency = {{255, 128, 0}, 3};
+
+  std::vector<uint8_t> indices;
+  /* 4-bit indices, two per byte, half a byte of padding at the end of scanline */
+  for (int y = 0; y < height; ++y)
+    for (int x = 0; x < (width + 1) / 2; ++x)
+      indices.push_back((uint8_t)(((x + y) % 4) << 4 | (x * 3 + y) % 4));
+
+  const std::vector<std::vector<uint8_t>> images = {
+      Encode(PNG_IMAGE_TYPE_TRUECOLOR, 8, width, RandomBytes(width * height * 3, 1)),
+      Encode(PNG_IMAGE_TYPE_TRUECOLORWITHALPHA, 16, width, RandomBytes(width * height * 8, 2)),
+      Encode(PNG_IMAGE_TYPE_GREYSCALE, 2, width, RandomBytes((width * 2 + 7) / 8 * height, 3)),
+      Encode(PNG_IMAGE_TYPE_INDEXED, 4, width, indices, &palette, &transparency),
+  };
+  for (size_t i = 0; i < images.size(); ++i)
+    for (PNGPixelFormat format : {PNG_PIXEL_FORMAT_RGBA8, PNG_PIXEL_FORMAT_RGB16, PNG_PIXEL_FORMAT_G8})
+      for (bool premultiply : {false, true}) {
+        SCOPED_TRACE(testing::Message() << "image " << i << " format " << format << " premultiply " << premultiply);
+        PNGDecodeOptions options;
+        PNGInitDecodeOptions(&options);
+        options.format = format;
+        options.premultiply_alpha = premultiply;
+        options.gamma_correction = premultiply ? PNG_GAMMA_CORRECTION_SRGB : PNG_GAMMA_CORRECTION_NONE;
+        options.alpha_flattening = PNG_ALPHA_FLATTENING_CUSTOM_BACKGROUND;
+        ExpectSameAsDecodeImage(images[i], options);
+      }
+
+  PNGDecodeOptions options;
+  PNGInitDecodeOptions(&options);
+  options.format = PNG_PIXEL_FORMAT_INDEXED8;
+  ExpectSameAsDecodeImage(images[3], options);
+
+  /* Ancillary chunks before image data, image data in one chunk of stored blocks */
+  const std::vector<uint8_t> grey = RandomBytes(width * height, 4);
+  const std::vector<uint8_t> png = test_utils::CreatePNG(width, height, 8, 0, test_utils::AddFilterBytes(grey, width),
+                                                         {{CHUNK_gAMA, {0, 0, 0xB1, 0x8F}}});
+  ExpectSameAsDecodeImage(png, options);
+}
+
+TEST_F(StreamDecoderTestSuite, StatusesAndInput) {
+  const int width = 16;
+  const std::vector<uint8_t> png = Encode(PNG_IMAGE_TYPE_GREYSCALE, 8, width, RandomBytes(width * 4, 5));
+  PNGStreamDecoder* decoder = PNGCreateStreamDecoder(nullptr);
+  ASSERT_NE(nullptr, decoder);
+  PNGImage info;
+  PNGStreamRow row;
+  size_t consumed = 0;
+
+  /* Empty pieces before and inside signature */
+  EXPECT_EQ(PNG_STREAM_NEED_INPUT, PNGStreamDecode(decoder, nullptr, 0, &consumed, &row));
+  EXPECT_EQ(0, consumed);
+  EXPECT_EQ(PNG_STREAM_NEED_INPUT, PNGStreamDecode(decoder, png.data(), 3, &consumed, &row));
+  EXPECT_EQ(3, consumed);
+  EXPECT_FALSE(PNGGetStreamImageInfo(decoder, &info));
+
+  /* Whole rest with trailing bytes: rows one by one, then end without consuming trailing bytes */
+  std::vector<uint8_t> rest(png.begin() + 3, png.end());
+  rest.insert(rest.end(), {1, 2, 3});
+  size_t position = 0;
+  int rows_count = 0;
+  PNGStreamStatus status;
+  while ((status = PNGStreamDecode(decoder, rest.data() + position, rest.size() - position, &consumed, &row)) ==
+         PNG_STREAM_ROW) {
+    position += consumed;
+    EXPECT_EQ(rows_count++, row.y);
+    EXPECT_EQ(width * 4, row.size);
+  }
+  position += consumed;
+  EXPECT_EQ(PNG_STREAM_END, status);
+  EXPECT_EQ(4, rows_count);
+  EXPECT_EQ(rest.size() - 3, position);
+  ASSERT_TRUE(PNGGetStreamImageInfo(decoder, &info));
+  EXPECT_EQ(width, info.width);
+  EXPECT_EQ(4, info.height);
+
+  /* End is sticky */
+  EXPECT_EQ(PNG_STREAM_END, PNGStreamDecode(decoder, rest.data() + position, 3, &consumed, &row));
+  EXPECT_EQ(0, consumed);
+  PNGFreeStreamDecoder(decoder);
+  PNGFreeStreamDecoder(nullptr);
+
+  /* Flipping is not supported */
+  PNGDecodeOptions options;
+  PNGInitDecodeOptions(&options);
+  options.flip_vertically = true;
+  EXPECT_EQ(nullptr, PNGCreateStreamDecoder(&options));
+}
+
+TEST_F(StreamDecoderTestSuite, InvalidDatastreams) {
+  const int width = 30;
+  const int height = 20;
+  const std::vector<uint8_t> png = Encode(PNG_IMAGE_TYPE_TRUECOLOR, 8, width, RandomBytes(width * height * 3, 6));
+  const auto decode = [](const std::vector<uint8_t>& png, size_t piece_size = 5) {
+    return StreamDecode(png, nullptr, piece_size);
+  };
+
+  /* Truncated datastream needs more input */
+  for (size_t size : {(size_t)5, (size_t)40, png.size() / 2, png.size() - 1}) {
+    const Decoded decoded = decode(std::vector<uint8_t>(png.begin(), png.begin() + size));
+    EXPECT_EQ(PNG_STREAM_NEED_INPUT, decoded.status);
+    EXPECT_EQ(size, decoded.consumed);
+  }
+
+  /* Corrupted signature, CRC of chunk before and after image start, image data */
+  for (size_t offset : {(size_t)1, (size_t)20, (size_t)40, png.size() / 2, png.size() - 5}) {
+    SCOPED_TRACE(testing::Message() << "offset " << offset);
+    std::vector<uint8_t> corrupted = png;
+    corrupted[offset] ^= 0x10;
+    EXPECT_EQ(PNG_STREAM_ERROR, decode(corrupted).status);
+  }
+
+  /* Image data ends before the last row */
+  const std::vector<uint8_t> rows = test_utils::AddFilterBytes(RandomBytes(width * 3 * height, 7), width * 3);
+  std::vector<uint8_t> short_png = test_utils::CreatePNG(width, height + 1, 8, 2, rows);
+  EXPECT_EQ(PNG_STREAM_ERROR, decode(short_png).status);
+  /* Excess image data after the last row */
+  std::vector<uint8_t> long_png = test_utils::CreatePNG(width, height - 1, 8, 2, rows);
+  const Decoded long_decoded = decode(long_png);
+  EXPECT_EQ(PNG_STREAM_ERROR, long_decoded.status);
+  EXPECT_EQ(height - 1, long_decoded.rows_count);
+  /* Interlaced images are not supported */
+  std::vector<uint8_t> interlaced = test_utils::CreatePNG(width, height, 8, 2, rows);
+  interlaced[28] = 1;
+  test_utils::VectorWrapper<uint8_t> header;
+  test_utils::AppendChunk(header, CHUNK_IHDR, std::vector<uint8_t>(interlaced.begin() + 16, interlaced.begin() + 29));
+  std::copy(header.begin(), header.end(), interlaced.begin() + 8);
+  EXPECT_EQ(PNG_STREAM_ERROR, decode(interlaced).status);
+  /* Invalid bit depth and color type pairs, bit depth 0 would divide by zero */
+  for (const auto& [bit_depth, color_type] : std::vector<std::pair<int, int>>{{0, 0}, {0, 2}, {3, 0}, {5, 0}, {4, 4}}) {
+    SCOPED_TRACE(testing::Message() << "bit depth " << bit_depth << ", color type " << color_type);
+    const Decoded decoded = decode(test_utils::CreatePNG(width, height, bit_depth, color_type, rows));
+    EXPECT_EQ(PNG_STREAM_ERROR, decoded.status);
+    EXPECT_EQ(0, decoded.rows_count);
+  }
+  /* IEND before image data */
+  test_utils::VectorWrapper<uint8_t> no_image(png.begin(), png.begin() + 33);
+  test_utils::AppendChunk(no_image, CHUNK_IEND, {});
+  EXPECT_EQ(PNG_STREAM_ERROR, decode(no_image).status);
+
+  /* Error is sticky */
+  PNGStreamDecoder* decoder = PNGCreateStreamDecoder(nullptr);
+  size_t consumed = 0;
+  PNGStreamRow row;
+  EXPECT_EQ(PNG_STREAM_ERROR, PNGStreamDecode(decoder, interlaced.data() + 1, 8, &consumed, &row));
+  EXPECT_EQ(PNG_STREAM_ERROR, PNGStreamDecode(decoder, png.data(), png.size(), &consumed, &row));
+  EXPECT_EQ(0, consumed);
+  PNGFreeStreamDecoder(decoder);
+}
+
+TEST_F(StreamDecoderTestSuite, DecodeLimits) {
+  const int width = 200;
+  const int height = 50;
+  /* Highly compressible image */
+  const std::vector<uint8_t> png = Encode(PNG_IMAGE_TYPE_GREYSCALE, 8, width, std::vector<uint8_t>(width * height));
+  PNGDecodeOptions options;
+  PNGInitDecodeOptions(&options);
+  EXPECT_EQ(PNG_STREAM_END, StreamDecode(png, &options, 64).status);
+
+  PNGDecodeOptions limited = options;
+  limited.limits.max_inflate_ratio = 10;
+  Decoded decoded = StreamDecode(png, &limited, 64);
+  EXPECT_EQ(PNG_STREAM_ERROR, decoded.status);
+  EXPECT_LT(decoded.rows_count, height);
+
+  limited = options;
+  limited.limits.max_chunks_count = 2;
+  EXPECT_EQ(PNG_STREAM_ERROR, StreamDecode(png, &limited, 64).status);
+
+  limited = options;
+  limited.limits.max_pixels = width * height - 1;
+  decoded = StreamDecode(png, &limited, 64);
+  EXPECT_EQ(PNG_STREAM_ERROR, decoded.status);
+  EXPECT_EQ(0, decoded.rows_count);
+
+  /* Chunks before image data are buffered within chunk memory limit */
+  std::vector<uint8_t> text = {'C', 'o', 'm', 'm', 'e', 'n', 't', 0};
+  text.resize(1000, 'a');
+  const std::vector<uint8_t> grey(width * 2);
+  const std::vector<uint8_t> with_text =
+      test_utils::CreatePNG(width, 2, 8, 0, test_utils::AddFilterBytes(grey, width), {{CHUNK_tEXt, text}});
+  limited = options;
+  limited.limits.max_chunk_memory_bytes = 500;
+  EXPECT_EQ(PNG_STREAM_ERROR, StreamDecode(with_text, &limited, 64).status);
+  limited.limits.max_chunk_memory_bytes = 2000;
+  EXPECT_EQ(PNG_STREAM_END, StreamDecode(with_text, &limited, 64).status);
+}
+
+TEST_F(StreamDecoderTestSuite, DecodeStats) {
+  const int width = 31;
+  const int height = 12;
+  const std::vector<uint8_t> png = Encode(PNG_IMAGE_TYPE_TRUECOLOR, 8, width, RandomBytes(width * height * 3, 3));
+  PNGRawChunk* chunks = PNGLoadRawChunkList(png.data(), png.size(), true);
+  ASSERT_NE(nullptr, chunks);
+  int chunks_count = 0;
+  int idat_chunks_count = 0;
+  uint64_t idat_size = 0;
+  for (const PNGRawChunk* chunk = chunks; chunk; chunk = chunk->next) {
+    ++chunks_count;
+    if (chunk->type.bytes == CHUNK_IDAT.bytes) {
+      ++idat_chunks_count;
+      idat_size += chunk->raw_data_size_bytes;
+    }
+  }
+  PNGFreeRawChunk(chunks);
+  ASSERT_LT(1, idat_chunks_count);
+
+  for (size_t piece_size : {(size_t)7, png.size()}) {
+    SCOPED_TRACE(testing::Message() << "piece size " << piece_size);
+    PNGDecodeStats stats;
+    PNGInitDecodeStats(&stats);
+    PNGDecodeOptions options;
+    PNGInitDecodeOptions(&options);
+    options.stats = &stats;
+    const Decoded decoded = StreamDecode(png, &options, piece_size);
+    ASSERT_EQ(PNG_STREAM_END, decoded.status);
+
+    const uint64_t plain_size = (uint64_t)width * 3 * height;
+    EXPECT_EQ(chunks_count, stats.chunks_count);
+    EXPECT_EQ(idat_chunks_count, stats.idat_chunks_count);
+    /* Only IHDR is loaded as chunk list, image data is inflated as it arrives */
+    EXPECT_EQ(8 + 25, stats.stages[PNG_DECODE_STAGE_PARSE].bytes_in);
+    EXPECT_EQ(idat_size, stats.stages[PNG_DECODE_STAGE_INFLATE].bytes_in);
+    EXPECT_EQ(plain_size + height, stats.stages[PNG_DECODE_STAGE_INFLATE].bytes_out);
+    EXPECT_EQ(plain_size + height, stats.stages[PNG_DECODE_STAGE_DEFILTER].bytes_in);
+    EXPECT_EQ(plain_size, stats.stages[PNG_DECODE_STAGE_DEFILTER].bytes_out);
+    EXPECT_EQ(plain_size, stats.stages[PNG_DECODE_STAGE_CONVERT].bytes_in);
+    EXPECT_EQ(decoded.pixels.size(), stats.stages[PNG_DECODE_STAGE_CONVERT].bytes_out);
+    EXPECT_LT(0, stats.stages[PNG_DECODE_STAGE_INFLATE].duration_ns);
+    /* Scanlines and output row of decoder are alive until it is freed */
+    EXPECT_LE(2 * (width * 3 + 1) + width * 4, stats.live_bytes);
+    EXPECT_LE(2, stats.allocations_count);
+  }
+}
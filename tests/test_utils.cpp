@@ -8,6 +8,8 @@ std::pair<std::ofstream, std::filesystem::path> CreateUniqueFile(const std::file
     ++i;
     try {
       const auto path = dir / (std::string("tmp_") + std::to_string(i));
+      if (std::filesystem::exists(path))
+        continue;
       std::ofstream out(path, mode);
       return std::make_pair(std::move(out), path);
     } catch (std::exception& e) {
@@ -25,4 +27,70 @@ void WriteBinaryFile(std::string_view filename, std::vector<uint8_t> const& byte
   std::ofstream out(filename.data(), std::ios::binary);
   std::copy(bytes.begin(), bytes.end(), std::ostreambuf_iterator<char>(out));
 }
+
+void AppendChunk(VectorWrapper<uint8_t>& stream, ChunkType type, const std::vector<uint8_t>& data) {
+  AppendChunk(stream, type, data, PNGComputeChunkCRC(type, data.data(), data.size()));
+}
+
+void AppendChunk(VectorWrapper<uint8_t>& stream, ChunkType type, const std::vector<uint8_t>& data, uint32_t crc) {
+  stream.AppendBytes((uint32_t)data.size(), true);
+  stream.Append(std::vector<uint8_t>(std::begin(type.byte_array), std::end(type.byte_array)));
+  stream.Append(data);
+  stream.AppendBytes(crc, true);
+}
+
+std::filesystem::path WriteTempFile(std::vector<uint8_t> const& bytes) {
+  auto [out, path] = CreateUniqueFile(std::filesystem::temp_directory_path());
+  std::copy(bytes.begin(), bytes.end(), std::ostreambuf_iterator<char>(out));
+  return path;
+}
+
+std::vector<uint8_t> ZlibStore(const std::vector<uint8_t>& data) {
+  VectorWrapper<uint8_t> stream = {0x78, 0x01};
+  size_t offset = 0;
+  do {
+    const uint16_t block_size = (uint16_t)std::min<size_t>(data.size() - offset, 0xFFFF);
+    const bool last = offset + block_size == data.size();
+    stream.push_back(last ? 1 : 0);
+    stream.AppendBytes(block_size, false);
+    stream.AppendBytes((uint16_t)~block_size, false);
+    stream.insert(stream.end(), data.begin() + offset, data.begin() + offset + block_size);
+    offset += block_size;
+  } while (offset < data.size());
+
+  uint32_t a = 1, b = 0;
+  for (uint8_t byte : data) {
+    a = (a + byte) % 65521;
+    b = (b + a) % 65521;
+  }
+  stream.AppendBytes((b << 16) | a, true);
+  return stream;
+}
+
+std::vector<uint8_t> CreatePNG(int width, int height, int bit_depth, int color_type,
+                               const std::vector<uint8_t>& filtered_scanlines,
+                               const std::vector<std::pair<ChunkType, std::vector<uint8_t>>>& extra_chunks) {
+  VectorWrapper<uint8_t> stream;
+  stream.Append(std::vector<uint8_t>(std::begin(s_png_signature), std::end(s_png_signature)));
+
+  VectorWrapper<uint8_t> header;
+  header.AppendBytes((uint32_t)width, true).AppendBytes((uint32_t)height, true);
+  header.Append(std::vector<uint8_t>{(uint8_t)bit_depth, (uint8_t)color_type, 0, 0, 0});
+  AppendChunk(stream, CHUNK_IHDR, header);
+
+  for (const auto& [type, data] : extra_chunks)
+    AppendChunk(stream, type, data);
+  AppendChunk(stream, CHUNK_IDAT, ZlibStore(filtered_scanlines));
+  AppendChunk(stream, CHUNK_IEND, {});
+  return stream;
+}
+
+std::vector<uint8_t> AddFilterBytes(const std::vector<uint8_t>& plain, int scanline_size_bytes) {
+  std::vector<uint8_t> filtered;
+  for (size_t i = 0; i < plain.size(); i += scanline_size_bytes) {
+    filtered.push_back(0);
+    filtered.insert(filtered.end(), plain.begin() + i, plain.begin() + i + scanline_size_bytes);
+  }
+  return filtered;
+}
 }  // namespace test_utils
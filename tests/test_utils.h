@@ -17,6 +17,8 @@
 #include <utility>
 #include <vector>
 
+#include <png_core/chunk_data.h>
+
 #include "../png_core/src/tools.h"
 
 namespace test_utils {
@@ -59,6 +61,26 @@ public:
     return *this;
   }
 };
+
+/// Append chunk with calculated CRC to network-ordered datastream
+void AppendChunk(VectorWrapper<uint8_t>& stream, ChunkType type, const std::vector<uint8_t>& data);
+
+/// Append chunk with given CRC to network-ordered datastream
+void AppendChunk(VectorWrapper<uint8_t>& stream, ChunkType type, const std::vector<uint8_t>& data, uint32_t crc);
+
+/// Write binary data to unique temp file
+std::filesystem::path WriteTempFile(std::vector<uint8_t> const& bytes);
+
+/// Wrap data into zlib stream of stored (not compressed) deflate blocks
+std::vector<uint8_t> ZlibStore(const std::vector<uint8_t>& data);
+
+/// Build PNG datastream with IHDR, extra chunks, single IDAT of filtered scanlines and IEND
+std::vector<uint8_t> CreatePNG(int width, int height, int bit_depth, int color_type,
+                               const std::vector<uint8_t>& filtered_scanlines,
+                               const std::vector<std::pair<ChunkType, std::vector<uint8_t>>>& extra_chunks = {});
+
+/// Prepend filter type 0 (None) to each scanline of plain image
+std::vector<uint8_t> AddFilterBytes(const std::vector<uint8_t>& plain, int scanline_size_bytes);
 }  // namespace test_utils
 
 template <typename T>
@@ -0,0 +1,233 @@
+/**
+ * @file png_edit.c
+ *
+ * @brief Batch chunk-level editing of PNG files. Reports throughput in files per second.
+ * Example: `png_edit --strip-ancillary --keep iCCP --text Author=me -o out/ a.png b.png`
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <png_core/editing.h>
+
+/* Upper bounds of repeated options */
+#define PNG_EDIT_MAX_TYPES 64
+#define PNG_EDIT_MAX_TEXTS 64
+
+struct EditOptions {
+  bool strip_ancillary;
+  struct ChunkType keep_types[PNG_EDIT_MAX_TYPES];
+  int keep_types_count;
+  struct ChunkType strip_types[PNG_EDIT_MAX_TYPES];
+  int strip_types_count;
+  /* "keyword=text" arguments */
+  const char* texts[PNG_EDIT_MAX_TEXTS];
+  int texts_count;
+  uint32_t idat_chunk_size;
+  const char* out_dir;
+  int repeat;
+};
+
+static void PrintUsage(const char* program) {
+  fprintf(stderr,
+          "Usage: %s [options] -o <out_dir> <file>...\n"
+          "  --strip-ancillary      Remove all ancillary chunks\n"
+          "  --keep <TYPE>          Keep ancillary chunks of type when stripping\n"
+          "  --strip <TYPE>         Remove all chunks of type\n"
+          "  --text <KEY>=<VALUE>   Insert tEXt chunk before image data\n"
+          "  --idat-chunk-size <N>  Rewrite image data as IDAT chunks of N bytes\n"
+          "  --repeat <N>           Process the file list N times\n"
+          "  -o <out_dir>           Directory for edited files\n",
+          program);
+}
+
+static bool ParseChunkType(const char* str, struct ChunkType* out) {
+  if (strlen(str) != 4)
+    return false;
+  memcpy(out->byte_array, str, 4);
+  return IsValidChunkType(*out);
+}
+
+static double GetMonotonicSeconds() {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+/*
+ * @return File name part of path
+ */
+static const char* GetFileName(const char* path) {
+  const char* separator = strrchr(path, '/');
+  return separator ? separator + 1 : path;
+}
+
+static int CompareFileNames(const void* lhs, const void* rhs) {
+  return strcmp(GetFileName(*(const char* const*)lhs), GetFileName(*(const char* const*)rhs));
+}
+
+/*
+ * @return First of two paths with the same file name, they would be written to the same output. NULL if there is none
+ */
+static const char* FindDuplicateFileName(char** paths, int paths_count) {
+  char** sorted = malloc(sizeof(char*) * paths_count);
+  if (!sorted)
+    return NULL;
+  memcpy(sorted, paths, sizeof(char*) * paths_count);
+  qsort(sorted, paths_count, sizeof(char*), CompareFileNames);
+
+  const char* duplicate = NULL;
+  for (int i = 1; i < paths_count && !duplicate; ++i)
+    if (CompareFileNames(&sorted[i - 1], &sorted[i]) == 0)
+      duplicate = sorted[i - 1];
+  free(sorted);
+  return duplicate;
+}
+
+/*
+ * @brief Write plan to temporary file next to out_path and rename it over out_path on success.
+ * So out_path may be the source file itself, and failed writing leaves no truncated output
+ * @return Amount of bytes written or -1 if error occurred
+ */
+static int64_t WritePlanToPath(const struct PNGEditPlan* plan, int in_fd, const char* out_path) {
+  char temp_path[4096];
+  if (snprintf(temp_path, sizeof(temp_path), "%s.XXXXXX", out_path) >= (int)sizeof(temp_path))
+    return -1;
+  const int out_fd = mkstemp(temp_path);
+  if (out_fd < 0)
+    return -1;
+
+  int64_t written = fchmod(out_fd, 0644) == 0 ? PNGWriteEditPlanToFd(plan, in_fd, out_fd) : -1;
+  if (close(out_fd) != 0)
+    written = -1;
+  if (written < 0 || rename(temp_path, out_path) != 0) {
+    unlink(temp_path);
+    return -1;
+  }
+  return written;
+}
+
+/*
+ * @return Amount of bytes written or -1 if error occurred
+ */
+static int64_t EditFile(const struct EditOptions* options, const char* in_path, const char* out_path) {
+  const int in_fd = open(in_path, O_RDONLY);
+  if (in_fd < 0)
+    return -1;
+
+  struct PNGEditPlan plan;
+  PNGInitEditPlan(&plan);
+  bool ok = PNGCreateEditPlanFromFd(in_fd, &plan);
+
+  if (ok && options->strip_ancillary)
+    PNGEditPlanRemoveAncillary(&plan, options->keep_types, options->keep_types_count);
+  for (int i = 0; ok && i < options->strip_types_count; ++i)
+    PNGEditPlanRemoveType(&plan, options->strip_types[i]);
+  if (ok && options->idat_chunk_size > 0)
+    ok = PNGEditPlanSetIDATChunkSize(&plan, options->idat_chunk_size);
+  for (int i = 0; ok && i < options->texts_count; ++i) {
+    char keyword[80];
+    const char* separator = strchr(options->texts[i], '=');
+    const size_t keyword_length = separator - options->texts[i];
+    memcpy(keyword, options->texts[i], keyword_length);
+    keyword[keyword_length] = '\0';
+    ok = PNGEditPlanInsertText(&plan, keyword, separator + 1) != PNG_CHUNK_TABLE_NO_ENTRY;
+  }
+
+  const int64_t written = ok ? WritePlanToPath(&plan, in_fd, out_path) : -1;
+
+  PNGFreeEditPlan(&plan);
+  close(in_fd);
+  return written;
+}
+
+int main(int argc, char** argv) {
+  struct EditOptions options;
+  memset(&options, 0, sizeof(options));
+  options.repeat = 1;
+
+  int first_file = argc;
+  for (int i = 1; i < argc; ++i) {
+    const char* arg = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (strcmp(arg, "--strip-ancillary") == 0) {
+      options.strip_ancillary = true;
+    } else if (strcmp(arg, "--keep") == 0 && has_value && options.keep_types_count < PNG_EDIT_MAX_TYPES) {
+      if (!ParseChunkType(argv[++i], &options.keep_types[options.keep_types_count++])) {
+        fprintf(stderr, "Invalid chunk type: %s\n", argv[i]);
+        return 1;
+      }
+    } else if (strcmp(arg, "--strip") == 0 && has_value && options.strip_types_count < PNG_EDIT_MAX_TYPES) {
+      if (!ParseChunkType(argv[++i], &options.strip_types[options.strip_types_count++])) {
+        fprintf(stderr, "Invalid chunk type: %s\n", argv[i]);
+        return 1;
+      }
+    } else if (strcmp(arg, "--text") == 0 && has_value && options.texts_count < PNG_EDIT_MAX_TEXTS) {
+      const char* text = argv[++i];
+      const char* separator = strchr(text, '=');
+      if (!separator || separator == text || separator - text > 79) {
+        fprintf(stderr, "Invalid text, expected <KEY>=<VALUE>: %s\n", text);
+        return 1;
+      }
+      options.texts[options.texts_count++] = text;
+    } else if (strcmp(arg, "--idat-chunk-size") == 0 && has_value) {
+      options.idat_chunk_size = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--repeat") == 0 && has_value) {
+      options.repeat = atoi(argv[++i]);
+    } else if (strcmp(arg, "-o") == 0 && has_value) {
+      options.out_dir = argv[++i];
+    } else if (arg[0] == '-') {
+      PrintUsage(argv[0]);
+      return 1;
+    } else {
+      first_file = i;
+      break;
+    }
+  }
+  if (!options.out_dir || first_file == argc || options.repeat < 1) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+  const char* duplicate = FindDuplicateFileName(argv + first_file, argc - first_file);
+  if (duplicate) {
+    fprintf(stderr, "Several input files are named %s, their outputs would overwrite each other\n",
+            GetFileName(duplicate));
+    return 1;
+  }
+
+  int processed = 0;
+  int failed = 0;
+  int64_t bytes_written = 0;
+  const double start = GetMonotonicSeconds();
+  for (int r = 0; r < options.repeat; ++r) {
+    for (int i = first_file; i < argc; ++i) {
+      char out_path[4096];
+      snprintf(out_path, sizeof(out_path), "%s/%s", options.out_dir, GetFileName(argv[i]));
+
+      const int64_t written = EditFile(&options, argv[i], out_path);
+      if (written < 0) {
+        if (r == 0)
+          fprintf(stderr, "Failed: %s\n", argv[i]);
+        ++failed;
+        continue;
+      }
+      bytes_written += written;
+      ++processed;
+    }
+  }
+  const double elapsed = GetMonotonicSeconds() - start;
+
+  printf("Processed %d files (%d failed), %.2f MiB written in %.3f s: %.1f files/s, %.1f MiB/s\n", processed, failed,
+         bytes_written / (1024.0 * 1024.0), elapsed, elapsed > 0 ? processed / elapsed : 0.0,
+         elapsed > 0 ? bytes_written / (1024.0 * 1024.0) / elapsed : 0.0);
+  return failed == 0 ? 0 : 2;
+}